@@ -22,6 +22,12 @@
 
 #include <stdint.h>
 
+typedef enum {
+    EI_CLASSIFIER_SMOOTH_VOTE = 0,          // consensus over the last n readings
+    EI_CLASSIFIER_SMOOTH_EMA = 1,           // exponential moving average of the scores
+    EI_CLASSIFIER_SMOOTH_HYSTERESIS = 2     // moving average, separate enter and release thresholds
+} ei_classifier_smooth_mode_t;
+
 typedef struct ei_classifier_smooth {
     int *last_readings;
     size_t last_readings_size;
@@ -30,6 +36,15 @@ typedef struct ei_classifier_smooth {
     float anomaly_confidence;
     uint8_t count[EI_CLASSIFIER_LABEL_COUNT + 2] = { 0 };
     size_t count_size = EI_CLASSIFIER_LABEL_COUNT + 2;
+    // circular history, the oldest reading is overwritten next
+    size_t last_readings_head = 0;
+    ei_classifier_smooth_mode_t mode = EI_CLASSIFIER_SMOOTH_VOTE;
+    // moving average modes
+    float alpha = 1.0f;
+    float release_confidence = 0.0f;
+    float scores[EI_CLASSIFIER_LABEL_COUNT + 1] = { 0 };
+    bool scores_valid = false;
+    int current_reading = -1;
 } ei_classifier_smooth_t;
 
 /**
@@ -51,10 +66,97 @@ void ei_classifier_smooth_init(ei_classifier_smooth_t *smooth, size_t n_readings
         smooth->last_readings[ix] = -1; // -1 == uncertain
     }
     smooth->last_readings_size = n_readings;
+    smooth->last_readings_head = 0;
     smooth->min_readings_same = min_readings_same;
     smooth->classifier_confidence = classifier_confidence;
     smooth->anomaly_confidence = anomaly_confidence;
     smooth->count_size = EI_CLASSIFIER_LABEL_COUNT + 2;
+    smooth->mode = EI_CLASSIFIER_SMOOTH_VOTE;
+
+    // the history starts out all uncertain
+    memset(smooth->count, 0, sizeof(smooth->count));
+    smooth->count[EI_CLASSIFIER_LABEL_COUNT] = (uint8_t)n_readings;
+}
+
+/**
+ * Initialize a smooth structure that follows an exponential moving average
+ * of the scores instead of voting. No history is kept (no heap allocation).
+ * With hysteresis, a class is entered once its average reaches
+ * classifier_confidence and kept until it drops below release_confidence.
+ * @param smooth Pointer to an uninitialized ei_classifier_smooth_t struct
+ * @param alpha Weight of a new reading, in (0, 1]. Lower is smoother
+ * @param classifier_confidence Minimum averaged confidence to enter a class (default 0.8)
+ * @param anomaly_confidence Maximum averaged error for anomalies (default 0.3)
+ * @param release_confidence Averaged confidence under which the current class is left,
+ *                           values >= classifier_confidence disable the hysteresis
+ */
+void ei_classifier_smooth_init_ema(ei_classifier_smooth_t *smooth, float alpha,
+                                   float classifier_confidence = 0.8,
+                                   float anomaly_confidence = 0.3,
+                                   float release_confidence = 1.0f) {
+    smooth->last_readings = NULL;
+    smooth->last_readings_size = 0;
+    smooth->last_readings_head = 0;
+    smooth->min_readings_same = 0;
+    smooth->classifier_confidence = classifier_confidence;
+    smooth->anomaly_confidence = anomaly_confidence;
+    smooth->count_size = EI_CLASSIFIER_LABEL_COUNT + 2;
+    smooth->alpha = alpha;
+    smooth->release_confidence = release_confidence;
+    smooth->mode = release_confidence < classifier_confidence ?
+        EI_CLASSIFIER_SMOOTH_HYSTERESIS : EI_CLASSIFIER_SMOOTH_EMA;
+    smooth->scores_valid = false;
+    smooth->current_reading = -1;
+}
+
+/**
+ * Map a reading (-1 uncertain, -2 anomaly, otherwise the label index) onto its label
+ */
+static const char* ei_classifier_smooth_label(ei_impulse_result_t *result, int reading) {
+    if (reading == -1) {
+        return "uncertain";
+    }
+    else if (reading == -2) {
+        return "anomaly";
+    }
+    return result->classification[reading].label;
+}
+
+/**
+ * Moving average modes, the scores are blended into the running averages
+ * and the reading is picked from those.
+ */
+static const char* ei_classifier_smooth_update_ema(ei_classifier_smooth_t *smooth, ei_impulse_result_t *result) {
+    // the first reading seeds the averages
+    const float alpha = smooth->scores_valid ? smooth->alpha : 1.0f;
+    smooth->scores_valid = true;
+
+    int top_result = -1;
+    float top_score = 0.0f;
+    for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
+        smooth->scores[ix] += alpha * (result->classification[ix].value - smooth->scores[ix]);
+        if (smooth->scores[ix] >= smooth->classifier_confidence && smooth->scores[ix] > top_score) {
+            top_result = (int)ix;
+            top_score = smooth->scores[ix];
+        }
+    }
+
+    int reading = top_result;
+    if (smooth->mode == EI_CLASSIFIER_SMOOTH_HYSTERESIS && smooth->current_reading >= 0 && reading == -1 &&
+        smooth->scores[smooth->current_reading] >= smooth->release_confidence) {
+        // nothing new above the enter threshold, stay on the current class until released
+        reading = smooth->current_reading;
+    }
+
+#if EI_CLASSIFIER_HAS_ANOMALY
+    smooth->scores[EI_CLASSIFIER_LABEL_COUNT] += alpha * (result->anomaly - smooth->scores[EI_CLASSIFIER_LABEL_COUNT]);
+    if (smooth->scores[EI_CLASSIFIER_LABEL_COUNT] >= smooth->anomaly_confidence) {
+        reading = -2; // anomaly
+    }
+#endif
+
+    smooth->current_reading = reading;
+    return ei_classifier_smooth_label(result, reading);
 }
 
 /**
@@ -64,16 +166,12 @@ void ei_classifier_smooth_init(ei_classifier_smooth_t *smooth, size_t n_readings
  * @returns Label, either 'uncertain', 'anomaly', or a label from the result struct
  */
 const char* ei_classifier_smooth_update(ei_classifier_smooth_t *smooth, ei_impulse_result_t *result) {
-    // clear out the count array
-    memset(smooth->count, 0, EI_CLASSIFIER_LABEL_COUNT + 2);
-
-    // roll through the last_readings buffer
-    numpy::roll(smooth->last_readings, smooth->last_readings_size, -1);
+    if (smooth->mode != EI_CLASSIFIER_SMOOTH_VOTE) {
+        return ei_classifier_smooth_update_ema(smooth, result);
+    }
 
     int reading = -1; // uncertain
 
-    // print the predictions
-    // printf("[");
     for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
         if (result->classification[ix].value >= smooth->classifier_confidence) {
             reading = (int)ix;
@@ -85,46 +183,30 @@ const char* ei_classifier_smooth_update(ei_classifier_smooth_t *smooth, ei_impul
     }
 #endif
 
-    smooth->last_readings[smooth->last_readings_size - 1] = reading;
-
-    // now count last 10 readings and see what we actually see...
-    for (size_t ix = 0; ix < smooth->last_readings_size; ix++) {
-        if (smooth->last_readings[ix] >= 0) {
-            smooth->count[smooth->last_readings[ix]]++;
-        }
-        else if (smooth->last_readings[ix] == -1) { // uncertain
-            smooth->count[EI_CLASSIFIER_LABEL_COUNT]++;
-        }
-        else if (smooth->last_readings[ix] == -2) { // anomaly
-            smooth->count[EI_CLASSIFIER_LABEL_COUNT + 1]++;
-        }
+    // the new reading replaces the oldest one, only their counts change
+    // (-1 uncertain and -2 anomaly count at the end of the count array)
+    int *oldest = &smooth->last_readings[smooth->last_readings_head];
+    smooth->count[*oldest >= 0 ? *oldest : EI_CLASSIFIER_LABEL_COUNT - 1 - *oldest]--;
+    smooth->count[reading >= 0 ? reading : EI_CLASSIFIER_LABEL_COUNT - 1 - reading]++;
+    *oldest = reading;
+    if (++smooth->last_readings_head == smooth->last_readings_size) {
+        smooth->last_readings_head = 0;
     }
 
     // then loop over the count and see which is highest
     uint8_t top_result = 0;
     uint8_t top_count = 0;
-    bool met_confidence_threshold = false;
-    uint8_t confidence_threshold = smooth->min_readings_same; // XX% of windows should be the same
     for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT + 2; ix++) {
         if (smooth->count[ix] > top_count) {
             top_result = ix;
             top_count = smooth->count[ix];
         }
-        if (smooth->count[ix] >= confidence_threshold) {
-            met_confidence_threshold = true;
-        }
     }
 
-    if (met_confidence_threshold) {
-        if (top_result == EI_CLASSIFIER_LABEL_COUNT) {
-            return "uncertain";
-        }
-        else if (top_result == EI_CLASSIFIER_LABEL_COUNT + 1) {
-            return "anomaly";
-        }
-        else {
-            return result->classification[top_result].label;
-        }
+    // XX% of windows should be the same
+    if (top_count >= smooth->min_readings_same) {
+        return ei_classifier_smooth_label(result,
+            top_result < EI_CLASSIFIER_LABEL_COUNT ? top_result : EI_CLASSIFIER_LABEL_COUNT - 1 - top_result);
     }
     return "uncertain";
 }
@@ -133,7 +215,10 @@ const char* ei_classifier_smooth_update(ei_classifier_smooth_t *smooth, ei_impul
  * Clear up a smooth structure
  */
 void ei_classifier_smooth_free(ei_classifier_smooth_t *smooth) {
-    ei_free(smooth->last_readings);
+    if (smooth->last_readings) {
+        ei_free(smooth->last_readings);
+        smooth->last_readings = NULL;
+    }
 }
 
 #endif // #if EI_CLASSIFIER_OBJECT_DETECTION != 1
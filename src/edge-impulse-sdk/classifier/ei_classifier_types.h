@@ -21,6 +21,7 @@
 #include <stdint.h>
 // needed for standalone C example
 #include "model-parameters/model_metadata.h"
+#include "edge-impulse-sdk/classifier/ei_model_profiler.h"
 
 #ifndef EI_CLASSIFIER_MAX_OBJECT_DETECTION_COUNT
 #define EI_CLASSIFIER_MAX_OBJECT_DETECTION_COUNT 10
@@ -199,6 +200,14 @@ typedef struct {
      * `EI_CLASSIFIER_HAS_ANOMALY == 1`.
      */
     int64_t anomaly_us;
+
+#if EI_CLASSIFIER_PROFILE_OPS == 1
+    /**
+     * Per operator timing of the neural network, see ei_model_profiler.h.
+     * Points to a table that is overwritten by the next inference.
+     */
+    const ei_model_profile_t *ops;
+#endif
 } ei_impulse_result_timing_t;
 
 /**
@@ -28,6 +28,7 @@ using namespace ei;
 #include "edge-impulse-sdk/classifier/ei_classifier_types.h"
 #include "edge-impulse-sdk/classifier/ei_nms.h"
 #include "edge-impulse-sdk/dsp/ei_vector.h"
+#include <limits>
 
 #ifndef EI_HAS_OBJECT_DETECTION
     #if (EI_CLASSIFIER_OBJECT_DETECTION_LAST_LAYER == EI_CLASSIFIER_LAST_LAYER_SSD)
@@ -66,6 +67,126 @@ __attribute__((unused)) inline float sigmoid(float a) {
     return 1.0f / (1.0f + exp(-a));
 }
 
+// number of boxes kept (highest score first) after NMS for TAO models
+#ifndef EI_CLASSIFIER_OBJECT_DETECTION_KEEP_TOPK
+#define EI_CLASSIFIER_OBJECT_DETECTION_KEEP_TOPK 200
+#endif
+
+// number of anchors (highest score first) that are fully decoded and sent to NMS
+#ifndef EI_CLASSIFIER_OBJECT_DETECTION_MAX_CANDIDATES
+#define EI_CLASSIFIER_OBJECT_DETECTION_MAX_CANDIDATES 400
+#endif
+
+typedef struct {
+    float score;
+    uint32_t ix;
+} ei_object_detection_candidate_t;
+
+/**
+ * Bounded top-k selection over the anchors of a detection output.
+ * Decoders push a cheap per-anchor score, only the anchors that survive
+ * are decoded into boxes, so post-processing scales with the number of
+ * detections rather than the number of anchors.
+ */
+class ei_object_detection_topk {
+public:
+    ei_object_detection_topk(size_t anchor_count)
+        : _size(0)
+    {
+        _capacity = anchor_count < EI_CLASSIFIER_OBJECT_DETECTION_MAX_CANDIDATES ?
+            anchor_count : EI_CLASSIFIER_OBJECT_DETECTION_MAX_CANDIDATES;
+        _heap = (ei_object_detection_candidate_t*)ei_malloc(
+            (_capacity > 0 ? _capacity : 1) * sizeof(ei_object_detection_candidate_t));
+    }
+
+    ~ei_object_detection_topk() {
+        ei_free(_heap);
+    }
+
+    bool is_allocated() {
+        return _heap != nullptr;
+    }
+
+    /**
+     * Offer an anchor. When full, it replaces the lowest score kept,
+     * on equal scores the earlier anchor stays.
+     */
+    void push(float score, uint32_t ix) {
+        if (_size < _capacity) {
+            _heap[_size].score = score;
+            _heap[_size].ix = ix;
+            _size++;
+            std::push_heap(_heap, _heap + _size, min_score_first);
+        }
+        else if (_capacity > 0 && score > _heap[0].score) {
+            std::pop_heap(_heap, _heap + _size, min_score_first);
+            _heap[_size - 1].score = score;
+            _heap[_size - 1].ix = ix;
+            std::push_heap(_heap, _heap + _size, min_score_first);
+        }
+    }
+
+    /**
+     * Order the survivors by anchor index, so boxes are produced in the
+     * same order as a full scan would produce them
+     * @returns number of survivors
+     */
+    size_t sort_by_anchor() {
+        std::sort(_heap, _heap + _size, [](const ei_object_detection_candidate_t &a, const ei_object_detection_candidate_t &b) {
+            return a.ix < b.ix;
+        });
+        return _size;
+    }
+
+    uint32_t anchor(size_t ix) {
+        return _heap[ix].ix;
+    }
+
+private:
+    static bool min_score_first(const ei_object_detection_candidate_t &a, const ei_object_detection_candidate_t &b) {
+        return a.score > b.score;
+    }
+
+    ei_object_detection_candidate_t *_heap;
+    size_t _capacity;
+    size_t _size;
+};
+
+/**
+ * Find the range of raw quantized values whose dequantized value lies in
+ * [min_value, max_value], so scores can be filtered without dequantizing.
+ * Evaluates the same expression as the decoders, so the filter is exact.
+ * @returns false if no quantized value is in range
+ */
+template<typename T>
+__attribute__((unused)) static bool ei_quantized_score_range(float zero_point, float scale, float min_value, float max_value,
+                                                             T *q_min, T *q_max) {
+    static_assert(sizeof(T) <= 2, "only 8 and 16 bit outputs can be scanned");
+
+    bool found = false;
+    for (int32_t q = std::numeric_limits<T>::min(); q <= std::numeric_limits<T>::max(); q++) {
+        float v = (static_cast<T>(q) - zero_point) * scale;
+        if (v >= min_value && v <= max_value) {
+            if (!found) {
+                *q_min = static_cast<T>(q);
+                found = true;
+            }
+            *q_max = static_cast<T>(q);
+        }
+    }
+    return found;
+}
+
+/**
+ * Unquantized outputs (zero point 0, scale 1) compare against the range directly
+ */
+__attribute__((unused)) static bool ei_quantized_score_range(float zero_point, float scale, float min_value, float max_value,
+                                                             float *q_min, float *q_max) {
+    *q_min = min_value / scale + zero_point;
+    *q_max = max_value / scale + zero_point;
+    return min_value <= max_value;
+}
+
 #ifdef EI_HAS_FOMO
 typedef struct cube {
     size_t x;
@@ -453,6 +574,32 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_visual_ad_struct_f32
     return EI_IMPULSE_OK;
 }
 
+#ifdef EI_HAS_YOLOV5
+/**
+ * Turn a YOLOv5 box (center, size) into its top left corner and clip it to
+ * the input
+ * @returns false if nothing is left of the box
+ */
+__attribute__((unused)) static bool ei_yolov5_clip_box(const ei_impulse_t *impulse, float xc, float yc,
+                                                       float *x, float *y, float *w, float *h) {
+    *x = xc - (*w / 2.0f);
+    *y = yc - (*h / 2.0f);
+    if (*x < 0) {
+        *x = 0;
+    }
+    if (*y < 0) {
+        *y = 0;
+    }
+    if (*x + *w > impulse->input_width) {
+        *w = impulse->input_width - *x;
+    }
+    if (*y + *h > impulse->input_height) {
+        *h = impulse->input_height - *y;
+    }
+    return !(*w < 0 || *h < 0);
+}
+#endif // EI_HAS_YOLOV5
+
 /**
   * Fill the result structure from an unquantized output tensor
   */
@@ -470,30 +617,32 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_f32_yolov5(co
     size_t col_size = 5 + impulse->label_count;
     size_t row_count = output_features_count / col_size;
 
+    // objectness is the box score, keep the best anchors before decoding.
+    // Boxes clipped away are dropped here, so they don't take the place of
+    // a box that would have been kept
+    ei_object_detection_topk topk(row_count);
+    if (!topk.is_allocated()) {
+        return EI_IMPULSE_OUT_OF_MEMORY;
+    }
     for (size_t ix = 0; ix < row_count; ix++) {
-        size_t base_ix = ix * col_size;
-        float xc = data[base_ix + 0];
-        float yc = data[base_ix + 1];
-        float w = data[base_ix + 2];
-        float h = data[base_ix + 3];
-        float x = xc - (w / 2.0f);
-        float y = yc - (h / 2.0f);
-        if (x < 0) {
-            x = 0;
-        }
-        if (y < 0) {
-            y = 0;
-        }
-        if (x + w > impulse->input_width) {
-            w = impulse->input_width - x;
+        const float *row = data + (ix * col_size);
+        float score = row[4];
+        if (score < block_config->threshold || score > 1.0f) {
+            continue;
         }
-        if (y + h > impulse->input_height) {
-            h = impulse->input_height - y;
+        float x, y, w = row[2], h = row[3];
+        if (ei_yolov5_clip_box(impulse, row[0], row[1], &x, &y, &w, &h)) {
+            topk.push(score, ix);
         }
+    }
 
-        if (w < 0 || h < 0) {
-            continue;
-        }
+    size_t candidate_count = topk.sort_by_anchor();
+    for (size_t cand_ix = 0; cand_ix < candidate_count; cand_ix++) {
+        size_t base_ix = topk.anchor(cand_ix) * col_size;
+        float x, y;
+        float w = data[base_ix + 2];
+        float h = data[base_ix + 3];
+        ei_yolov5_clip_box(impulse, data[base_ix + 0], data[base_ix + 1], &x, &y, &w, &h);
 
         float score = data[base_ix + 4];
 
@@ -506,24 +655,22 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_f32_yolov5(co
             }
         }
 
-        if (score >= block_config->threshold && score <= 1.0f) {
-            ei_impulse_result_bounding_box_t r;
-            r.label = impulse->categories[label];
-
-            if (version != 5) {
-                x *= static_cast<float>(impulse->input_width);
-                y *= static_cast<float>(impulse->input_height);
-                w *= static_cast<float>(impulse->input_width);
-                h *= static_cast<float>(impulse->input_height);
-            }
+        ei_impulse_result_bounding_box_t r;
+        r.label = impulse->categories[label];
 
-            r.x = static_cast<uint32_t>(x);
-            r.y = static_cast<uint32_t>(y);
-            r.width = static_cast<uint32_t>(w);
-            r.height = static_cast<uint32_t>(h);
-            r.value = score;
-            results.push_back(r);
+        if (version != 5) {
+            x *= static_cast<float>(impulse->input_width);
+            y *= static_cast<float>(impulse->input_height);
+            w *= static_cast<float>(impulse->input_width);
+            h *= static_cast<float>(impulse->input_height);
         }
+
+        r.x = static_cast<uint32_t>(x);
+        r.y = static_cast<uint32_t>(y);
+        r.width = static_cast<uint32_t>(w);
+        r.height = static_cast<uint32_t>(h);
+        r.value = score;
+        results.push_back(r);
     }
 
     EI_IMPULSE_ERROR nms_res = ei_run_nms(impulse, &results, debug);
@@ -570,30 +717,39 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_quantized_yol
     size_t col_size = 5 + impulse->label_count;
     size_t row_count = output_features_count / col_size;
 
-    for (size_t ix = 0; ix < row_count; ix++) {
-        size_t base_ix = ix * col_size;
-        float xc = (data[base_ix + 0] - zero_point) * scale;
-        float yc = (data[base_ix + 1] - zero_point) * scale;
-        float w = (data[base_ix + 2] - zero_point) * scale;
-        float h = (data[base_ix + 3] - zero_point) * scale;
-        float x = xc - (w / 2.0f);
-        float y = yc - (h / 2.0f);
-        if (x < 0) {
-            x = 0;
-        }
-        if (y < 0) {
-            y = 0;
-        }
-        if (x + w > impulse->input_width) {
-            w = impulse->input_width - x;
-        }
-        if (y + h > impulse->input_height) {
-            h = impulse->input_height - y;
+    // objectness is the box score, compare it in the quantized domain and
+    // keep the best anchors before decoding
+    ei_object_detection_topk topk(row_count);
+    if (!topk.is_allocated()) {
+        return EI_IMPULSE_OUT_OF_MEMORY;
+    }
+    T q_min, q_max;
+    if (ei_quantized_score_range(zero_point, scale, block_config->threshold, 1.0f, &q_min, &q_max)) {
+        for (size_t ix = 0; ix < row_count; ix++) {
+            const T *row = data + (ix * col_size);
+            T q = row[4];
+            if (q < q_min || q > q_max) {
+                continue;
+            }
+            // boxes clipped away don't take the place of a box that would be kept
+            float x, y;
+            float w = (row[2] - zero_point) * scale;
+            float h = (row[3] - zero_point) * scale;
+            if (ei_yolov5_clip_box(impulse, (row[0] - zero_point) * scale, (row[1] - zero_point) * scale,
+                                   &x, &y, &w, &h)) {
+                topk.push((q - zero_point) * scale, ix);
+            }
         }
+    }
 
-        if (w < 0 || h < 0) {
-            continue;
-        }
+    size_t candidate_count = topk.sort_by_anchor();
+    for (size_t cand_ix = 0; cand_ix < candidate_count; cand_ix++) {
+        size_t base_ix = topk.anchor(cand_ix) * col_size;
+        float x, y;
+        float w = (data[base_ix + 2] - zero_point) * scale;
+        float h = (data[base_ix + 3] - zero_point) * scale;
+        ei_yolov5_clip_box(impulse, (data[base_ix + 0] - zero_point) * scale, (data[base_ix + 1] - zero_point) * scale,
+                           &x, &y, &w, &h);
 
         float score = (data[base_ix + 4] - zero_point) * scale;
 
@@ -606,24 +762,22 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_quantized_yol
             }
         }
 
-        if (score >= block_config->threshold && score <= 1.0f) {
-            ei_impulse_result_bounding_box_t r;
-            r.label = ei_classifier_inferencing_categories[label];
-
-            if (version != 5) {
-                x *= static_cast<float>(impulse->input_width);
-                y *= static_cast<float>(impulse->input_height);
-                w *= static_cast<float>(impulse->input_width);
-                h *= static_cast<float>(impulse->input_height);
-            }
+        ei_impulse_result_bounding_box_t r;
+        r.label = ei_classifier_inferencing_categories[label];
 
-            r.x = static_cast<uint32_t>(x);
-            r.y = static_cast<uint32_t>(y);
-            r.width = static_cast<uint32_t>(w);
-            r.height = static_cast<uint32_t>(h);
-            r.value = score;
-            results.push_back(r);
+        if (version != 5) {
+            x *= static_cast<float>(impulse->input_width);
+            y *= static_cast<float>(impulse->input_height);
+            w *= static_cast<float>(impulse->input_width);
+            h *= static_cast<float>(impulse->input_height);
         }
+
+        r.x = static_cast<uint32_t>(x);
+        r.y = static_cast<uint32_t>(y);
+        r.width = static_cast<uint32_t>(w);
+        r.height = static_cast<uint32_t>(h);
+        r.value = score;
+        results.push_back(r);
     }
 
     EI_IMPULSE_ERROR nms_res = ei_run_nms(impulse, &results, debug);
@@ -670,141 +824,83 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_f32_yolox(con
     //     strides = [8, 16, 32]
     // else:
     //     strides = [8, 16, 32, 64]
-    const std::vector<int> strides { 8, 16, 32 };
+    const int strides[] = { 8, 16, 32 };
+    const int stride_count = sizeof(strides) / sizeof(strides[0]);
 
     // hsizes = [img_size[0] // stride for stride in strides]
     // wsizes = [img_size[1] // stride for stride in strides]
-    std::vector<int> hsizes(strides.size());
-    std::vector<int> wsizes(strides.size());
-    for (int ix = 0; ix < (int)strides.size(); ix++) {
-        hsizes[ix] = (int)floor((float)impulse->input_width / (float)strides[ix]);
+    // the grid of every stride is laid out row by row (xv, yv = np.meshgrid(...)),
+    // the grids of all strides are concatenated, so the grid cell and stride
+    // of an output row follow from its index
+    int wsizes[stride_count];
+    int grid_rows[stride_count];
+    size_t total_grid_rows = 0;
+    for (int ix = 0; ix < stride_count; ix++) {
+        int hsize = (int)floor((float)impulse->input_width / (float)strides[ix]);
         wsizes[ix] = (int)floor((float)impulse->input_height / (float)strides[ix]);
+        grid_rows[ix] = hsize * wsizes[ix];
+        total_grid_rows += grid_rows[ix];
     }
 
-    // for hsize, wsize, stride in zip(hsizes, wsizes, strides):
-    //      grid = np.stack((xv, yv), 2).reshape(1, -1, 2)
-    //      grids.append(grid)
-    //      shape = grid.shape[:2]
-    //      expanded_strides.append(np.full((*shape, 1), stride))
-    std::vector<matrix_i32_t*> grids;
-    std::vector<matrix_i32_t*> expanded_strides;
-
-    for (int ix = 0; ix < (int)strides.size(); ix++) {
-        int hsize = hsizes.at(ix);
-        int wsize = wsizes.at(ix);
-        int stride = strides.at(ix);
-
-        // xv, yv = np.meshgrid(np.arange(wsize), np.arange(hsize))
-        // grid = np.stack((xv, yv), 2).reshape(1, -1, 2)
-        matrix_i32_t *grid = new matrix_i32_t(hsize * wsize, 2);
-        int grid_ix = 0;
-        for (int h = 0; h < hsize; h++) {
-            for (int w = 0; w < wsize; w++) {
-                grid->buffer[grid_ix + 0] = w;
-                grid->buffer[grid_ix + 1] = h;
-                grid_ix += 2;
-            }
-        }
-        grids.push_back(grid);
-
-        // shape = grid.shape[:2]
-        // expanded_strides.append(np.full((*shape, 1), stride))
-        matrix_i32_t *expanded_stride = new matrix_i32_t(hsize * wsize, 1);
-        for (int ix = 0; ix < hsize * wsize; ix++) {
-            expanded_stride->buffer[ix] = stride;
-        }
-        expanded_strides.push_back(expanded_stride);
+    const size_t col_size = 5 + impulse->label_count;
+    size_t output_rows = output_features_count / col_size;
+    if (output_rows > total_grid_rows) {
+        output_rows = total_grid_rows;
     }
 
-    // grids = np.concatenate(grids, 1)
-    int total_grid_rows = 0;
-    for (auto g : grids) {
-        total_grid_rows += g->rows;
+    // scores = predictions[:, 4:5] * predictions[:, 5:]
+    // keep the anchors with the best valid score before decoding
+    ei_object_detection_topk topk(output_rows);
+    if (!topk.is_allocated()) {
+        return EI_IMPULSE_OUT_OF_MEMORY;
     }
-    matrix_i32_t c_grid(total_grid_rows, 2);
-    int c_grid_ix = 0;
-    for (auto g : grids) {
-        for (int row = 0; row < (int)g->rows; row++) {
-            c_grid.buffer[c_grid_ix + 0] = g->buffer[(row * 2) + 0];
-            c_grid.buffer[c_grid_ix + 1] = g->buffer[(row * 2) + 1];
-            c_grid_ix += 2;
+    for (size_t row = 0; row < output_rows; row++) {
+        const float *outputs = data + (row * col_size);
+        float best = 0.0f;
+        bool has_box = false;
+        for (int cc = 0; cc < impulse->label_count; cc++) {
+            float confidence = outputs[4] * outputs[5 + cc];
+            if (confidence >= block_config->threshold && confidence <= 1.0f &&
+                    (!has_box || confidence > best)) {
+                best = confidence;
+                has_box = true;
+            }
         }
-        delete g;
-    }
-
-    // expanded_strides = np.concatenate(expanded_strides, 1)
-    int total_stride_rows = 0;
-    for (auto g : expanded_strides) {
-        total_stride_rows += g->rows;
-    }
-    matrix_i32_t c_expanded_strides(total_stride_rows, 1);
-    int c_expanded_strides_ix = 0;
-    for (auto g : expanded_strides) {
-        for (int row = 0; row < (int)g->rows; row++) {
-            c_expanded_strides.buffer[c_expanded_strides_ix + 0] = g->buffer[(row * 1) + 0];
-            c_expanded_strides_ix += 1;
+        if (has_box) {
+            topk.push(best, row);
         }
-        delete g;
     }
 
-    const int output_rows = output_features_count / (5 + impulse->label_count);
-    matrix_t outputs(output_rows, 5 + impulse->label_count, data);
-    for (int row = 0; row < (int)outputs.rows; row++) {
-        float v0 = outputs.buffer[(row * outputs.cols) + 0];
-        float v1 = outputs.buffer[(row * outputs.cols) + 1];
-        float v2 = outputs.buffer[(row * outputs.cols) + 2];
-        float v3 = outputs.buffer[(row * outputs.cols) + 3];
-
-        float cgrid0 = (float)c_grid.buffer[(row * c_grid.cols) + 0];
-        float cgrid1 = (float)c_grid.buffer[(row * c_grid.cols) + 1];
+    size_t candidate_count = topk.sort_by_anchor();
+    for (size_t cand_ix = 0; cand_ix < candidate_count; cand_ix++) {
+        size_t row = topk.anchor(cand_ix);
+        const float *outputs = data + (row * col_size);
 
-        float stride = (float)c_expanded_strides.buffer[row];
+        int level = 0;
+        int grid_ix = (int)row;
+        while (grid_ix >= grid_rows[level]) {
+            grid_ix -= grid_rows[level];
+            level++;
+        }
+        float cgrid0 = (float)(grid_ix % wsizes[level]);
+        float cgrid1 = (float)(grid_ix / wsizes[level]);
+        float stride = (float)strides[level];
 
         // outputs[..., :2] = (outputs[..., :2] + grids) * expanded_strides
-        outputs.buffer[(row * outputs.cols) + 0] = (v0 + cgrid0) * stride;
-        outputs.buffer[(row * outputs.cols) + 1] = (v1 + cgrid1) * stride;
-
         // outputs[..., 2:4] = np.exp(outputs[..., 2:4]) * expanded_strides
-        outputs.buffer[(row * outputs.cols) + 2] = exp(v2) * stride;
-        outputs.buffer[(row * outputs.cols) + 3] = exp(v3) * stride;
-    }
+        float xcenter = (outputs[0] + cgrid0) * stride;
+        float ycenter = (outputs[1] + cgrid1) * stride;
+        float width = exp(outputs[2]) * stride;
+        float height = exp(outputs[3]) * stride;
 
-    // END: def yolox_postprocess()
-
-    // boxes = predictions[:, :4]
-    matrix_t boxes(outputs.rows, 4);
-    for (int row = 0; row < (int)outputs.rows; row++) {
-        boxes.buffer[(row * boxes.cols) + 0] = outputs.buffer[(row * outputs.cols) + 0];
-        boxes.buffer[(row * boxes.cols) + 1] = outputs.buffer[(row * outputs.cols) + 1];
-        boxes.buffer[(row * boxes.cols) + 2] = outputs.buffer[(row * outputs.cols) + 2];
-        boxes.buffer[(row * boxes.cols) + 3] = outputs.buffer[(row * outputs.cols) + 3];
-    }
-
-    // scores = predictions[:, 4:5] * predictions[:, 5:]
-    matrix_t scores(outputs.rows, impulse->label_count);
-    for (int row = 0; row < (int)outputs.rows; row++) {
-        float confidence = outputs.buffer[(row * outputs.cols) + 4];
-        for (int cc = 0; cc < impulse->label_count; cc++) {
-            scores.buffer[(row * scores.cols) + cc] = confidence * outputs.buffer[(row * outputs.cols) + (5 + cc)];
-        }
-    }
-
-    // iterate through scores to see if we have anything with confidence
-    for (int row = 0; row < (int)scores.rows; row++) {
-        for (int col = 0; col < (int)scores.cols; col++) {
-            float confidence = scores.buffer[(row * scores.cols) + col];
+        for (int col = 0; col < impulse->label_count; col++) {
+            float confidence = outputs[4] * outputs[5 + col];
 
             if (confidence >= block_config->threshold && confidence <= 1.0f) {
                 ei_impulse_result_bounding_box_t r;
                 r.label = impulse->categories[col];
                 r.value = confidence;
 
-                // now find the box...
-                float xcenter = boxes.buffer[(row * boxes.cols) + 0];
-                float ycenter = boxes.buffer[(row * boxes.cols) + 1];
-                float width = boxes.buffer[(row * boxes.cols) + 2];
-                float height = boxes.buffer[(row * boxes.cols) + 3];
-
                 int x = (int)(xcenter - (width / 2.0f));
                 int y = (int)(ycenter - (height / 2.0f));
 
@@ -831,6 +927,8 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_f32_yolox(con
         }
     }
 
+    // END: def yolox_postprocess()
+
     EI_IMPULSE_ERROR nms_res = ei_run_nms(impulse, &results, debug);
     if (nms_res != EI_IMPULSE_OK) {
         return nms_res;
@@ -941,10 +1039,22 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_f32_yolov7(co
     size_t col_size = 7;
     size_t row_count = output_features_count / col_size;
 
+    ei_object_detection_topk topk(row_count);
+    if (!topk.is_allocated()) {
+        return EI_IMPULSE_OUT_OF_MEMORY;
+    }
+    for (size_t ix = 0; ix < row_count; ix++) {
+        float score = data[ix * col_size + 6];
+        if (score >= block_config->threshold && score <= 1.0f) {
+            topk.push(score, ix);
+        }
+    }
+
     // output is:
     // batch_id, xmin, ymin, xmax, ymax, cls_id, score
-    for (size_t ix = 0; ix < row_count; ix++) {
-        size_t base_ix = ix * col_size;
+    size_t candidate_count = topk.sort_by_anchor();
+    for (size_t cand_ix = 0; cand_ix < candidate_count; cand_ix++) {
+        size_t base_ix = topk.anchor(cand_ix) * col_size;
         float xmin = data[base_ix + 1];
         float ymin = data[base_ix + 2];
         float xmax = data[base_ix + 3];
@@ -952,17 +1062,15 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_f32_yolov7(co
         uint32_t label = (uint32_t)data[base_ix + 5];
         float score = data[base_ix + 6];
 
-        if (score >= block_config->threshold && score <= 1.0f) {
-            ei_impulse_result_bounding_box_t r;
-            r.label = ei_classifier_inferencing_categories[label];
+        ei_impulse_result_bounding_box_t r;
+        r.label = ei_classifier_inferencing_categories[label];
 
-            r.x = static_cast<uint32_t>(xmin);
-            r.y = static_cast<uint32_t>(ymin);
-            r.width = static_cast<uint32_t>(xmax - xmin);
-            r.height = static_cast<uint32_t>(ymax - ymin);
-            r.value = score;
-            results.push_back(r);
-        }
+        r.x = static_cast<uint32_t>(xmin);
+        r.y = static_cast<uint32_t>(ymin);
+        r.width = static_cast<uint32_t>(xmax - xmin);
+        r.height = static_cast<uint32_t>(ymax - ymin);
+        r.value = score;
+        results.push_back(r);
     }
 
     // if we didn't detect min required objects, fill the rest with fixed value
@@ -989,8 +1097,6 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_f32_yolov7(co
 __attribute__((unused)) static void prepare_tao_results_common(const ei_impulse_t *impulse,
                                                                ei_impulse_result_t *result,
                                                                std::vector<ei_impulse_result_bounding_box_t> *results) {
-    #define EI_CLASSIFIER_OBJECT_DETECTION_KEEP_TOPK 200
-
     // if we didn't detect min required objects, fill the rest with fixed value
     size_t added_boxes_count = results->size();
     size_t object_detection_count = impulse->object_detection_count;
@@ -1038,17 +1144,39 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_tao_decode_de
     size_t row_count = output_features_count / col_size;
 
     static std::vector<ei_impulse_result_bounding_box_t> results;
-    static std::vector<ei_impulse_result_bounding_box_t> class_results;
+    std::vector<float> boxes;
+    std::vector<float> scores;
+    std::vector<int> classes;
     results.clear();
 
-    for (size_t cls_idx = 1; cls_idx < (size_t)(impulse->label_count + 1); cls_idx++)  {
-
-        std::vector<float> boxes;
-        std::vector<float> scores;
-        std::vector<int> classes;
-        class_results.clear();
-
+    // keep the anchors with the best class score (compared on the raw
+    // output values) before decoding
+    ei_object_detection_topk topk(row_count);
+    if (!topk.is_allocated()) {
+        return EI_IMPULSE_OUT_OF_MEMORY;
+    }
+    T q_min, q_max;
+    if (ei_quantized_score_range(zero_point, scale, threshold, 1.0f, &q_min, &q_max)) {
         for (size_t ix = 0; ix < row_count; ix++) {
+            bool has_box = false;
+            T best = q_min;
+            for (size_t cls_idx = 1; cls_idx < (size_t)(impulse->label_count + 1); cls_idx++) {
+                T q = data[ix * col_size + cls_idx];
+                if (q >= q_min && q <= q_max && (!has_box || q > best)) {
+                    best = q;
+                    has_box = true;
+                }
+            }
+            if (has_box) {
+                topk.push((static_cast<float>(best) - zero_point) * scale, ix);
+            }
+        }
+    }
+    size_t candidate_count = topk.sort_by_anchor();
+
+    for (size_t cls_idx = 1; cls_idx < (size_t)(impulse->label_count + 1); cls_idx++)  {
+        for (size_t cand_ix = 0; cand_ix < candidate_count; cand_ix++) {
+            size_t ix = topk.anchor(cand_ix);
 
             float score = (static_cast<float>(data[ix * col_size + cls_idx]) - zero_point) * scale;
 
@@ -1129,21 +1257,17 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_tao_decode_de
             scores.push_back(score);
             classes.push_back((int)(cls_idx-1));
         }
+    }
 
-        size_t nr_boxes = scores.size();
-        EI_IMPULSE_ERROR nms_res = ei_run_nms(impulse, &class_results,
-                                              boxes.data(), scores.data(), classes.data(),
-                                              nr_boxes,
-                                              true /*clip_boxes*/,
-                                              debug);
-
-        if (nms_res != EI_IMPULSE_OK) {
-            return nms_res;
-        }
-
-        for (auto bb: class_results) {
-            results.push_back(bb);
-        }
+    // suppress within each class, all classes in one pass
+    EI_IMPULSE_ERROR nms_res = ei_run_nms(impulse, &results,
+                                          boxes.data(), scores.data(), classes.data(),
+                                          scores.size(),
+                                          true /*clip_boxes*/,
+                                          debug,
+                                          true /*class_aware*/);
+    if (nms_res != EI_IMPULSE_OK) {
+        return nms_res;
     }
 
     prepare_tao_results_common(impulse, result, &results);
@@ -1207,17 +1331,38 @@ __attribute__((unused)) static EI_IMPULSE_ERROR  fill_result_struct_tao_yolov3_c
     size_t row_count = output_features_count / col_size;
 
     static std::vector<ei_impulse_result_bounding_box_t> results;
-    static std::vector<ei_impulse_result_bounding_box_t> class_results;
+    std::vector<float> boxes;
+    std::vector<float> scores;
+    std::vector<int> classes;
 
     results.clear();
-    for (size_t cls_idx = 0; cls_idx < (size_t)impulse->label_count; cls_idx++)  {
-
-        std::vector<float> boxes;
-        std::vector<float> scores;
-        std::vector<int> classes;
-        class_results.clear();
+    // the score is sigmoid(cls) * sigmoid(object), which grows with the raw
+    // class value, so the best class of every anchor is found on the raw
+    // output values and only the best anchors are decoded
+    ei_object_detection_topk topk(row_count);
+    if (!topk.is_allocated()) {
+        return EI_IMPULSE_OUT_OF_MEMORY;
+    }
+    for (size_t ix = 0; ix < row_count; ix++) {
+        const T *row = data + (ix * col_size);
+        T best = row[11];
+        for (size_t cls_idx = 1; cls_idx < (size_t)impulse->label_count; cls_idx++) {
+            if (row[11 + cls_idx] > best) {
+                best = row[11 + cls_idx];
+            }
+        }
+        float object = (static_cast<float>(row[10]) - zero_point) * scale;
+        float cls = (static_cast<float>(best) - zero_point) * scale;
+        float score = sigmoid(cls) * sigmoid(object);
+        if (score >= threshold && score <= 1.0f) {
+            topk.push(score, ix);
+        }
+    }
+    size_t candidate_count = topk.sort_by_anchor();
 
-        for (size_t ix = 0; ix < row_count; ix++) {
+    for (size_t cls_idx = 0; cls_idx < (size_t)impulse->label_count; cls_idx++)  {
+        for (size_t cand_ix = 0; cand_ix < candidate_count; cand_ix++) {
+            size_t ix = topk.anchor(cand_ix);
             size_t data_ix = ix * col_size;
             float r_0  = (static_cast<float>(data[data_ix +  0]) - zero_point) * scale;
             float r_1  = (static_cast<float>(data[data_ix +  1]) - zero_point) * scale;
@@ -1261,20 +1406,17 @@ __attribute__((unused)) static EI_IMPULSE_ERROR  fill_result_struct_tao_yolov3_c
             scores.push_back(score);
             classes.push_back((int)cls_idx);
         }
+    }
 
-        size_t nr_boxes = scores.size();
-        EI_IMPULSE_ERROR nms_res = ei_run_nms(impulse, &class_results,
-                                              boxes.data(), scores.data(), classes.data(),
-                                              nr_boxes,
-                                              true /*clip_boxes*/,
-                                              debug);
-        if (nms_res != EI_IMPULSE_OK) {
-            return nms_res;
-        }
-
-        for (auto bb: class_results) {
-            results.push_back(bb);
-        }
+    // suppress within each class, all classes in one pass
+    EI_IMPULSE_ERROR nms_res = ei_run_nms(impulse, &results,
+                                          boxes.data(), scores.data(), classes.data(),
+                                          scores.size(),
+                                          true /*clip_boxes*/,
+                                          debug,
+                                          true /*class_aware*/);
+    if (nms_res != EI_IMPULSE_OK) {
+        return nms_res;
     }
 
     prepare_tao_results_common(impulse, result, &results);
@@ -1301,19 +1443,40 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_tao_yolov4_co
     size_t row_count = output_features_count / col_size;
 
     static std::vector<ei_impulse_result_bounding_box_t> results;
-    static std::vector<ei_impulse_result_bounding_box_t> class_results;
+    std::vector<float> boxes;
+    std::vector<float> scores;
+    std::vector<int> classes;
     results.clear();
 
     const float grid_scale_xy = 1.0f;
 
-    for (size_t cls_idx = 0; cls_idx < (size_t)impulse->label_count; cls_idx++)  {
-
-        std::vector<float> boxes;
-        std::vector<float> scores;
-        std::vector<int> classes;
-        class_results.clear();
+    // the score is sigmoid(cls) * sigmoid(object), which grows with the raw
+    // class value, so the best class of every anchor is found on the raw
+    // output values and only the best anchors are decoded
+    ei_object_detection_topk topk(row_count);
+    if (!topk.is_allocated()) {
+        return EI_IMPULSE_OUT_OF_MEMORY;
+    }
+    for (size_t ix = 0; ix < row_count; ix++) {
+        const T *row = data + (ix * col_size);
+        T best = row[11];
+        for (size_t cls_idx = 1; cls_idx < (size_t)impulse->label_count; cls_idx++) {
+            if (row[11 + cls_idx] > best) {
+                best = row[11 + cls_idx];
+            }
+        }
+        float object = (static_cast<float>(row[10]) - zero_point) * scale;
+        float cls = (static_cast<float>(best) - zero_point) * scale;
+        float score = sigmoid(cls) * sigmoid(object);
+        if (score >= threshold && score <= 1.0f) {
+            topk.push(score, ix);
+        }
+    }
+    size_t candidate_count = topk.sort_by_anchor();
 
-        for (size_t ix = 0; ix < row_count; ix++) {
+    for (size_t cls_idx = 0; cls_idx < (size_t)impulse->label_count; cls_idx++)  {
+        for (size_t cand_ix = 0; cand_ix < candidate_count; cand_ix++) {
+            size_t ix = topk.anchor(cand_ix);
 
             float r_0  = (static_cast<float>(data[ix * col_size +  0]) - zero_point) * scale;
             float r_1  = (static_cast<float>(data[ix * col_size +  1]) - zero_point) * scale;
@@ -1367,20 +1530,17 @@ __attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_tao_yolov4_co
             scores.push_back(score);
             classes.push_back((int)cls_idx);
         }
+    }
 
-        size_t nr_boxes = scores.size();
-        EI_IMPULSE_ERROR nms_res = ei_run_nms(impulse, &class_results,
-                                              boxes.data(), scores.data(), classes.data(),
-                                              nr_boxes,
-                                              true /*clip_boxes*/,
-                                              debug);
-        if (nms_res != EI_IMPULSE_OK) {
-            return nms_res;
-        }
-
-        for (auto bb: class_results) {
-            results.push_back(bb);
-        }
+    // suppress within each class, all classes in one pass
+    EI_IMPULSE_ERROR nms_res = ei_run_nms(impulse, &results,
+                                          boxes.data(), scores.data(), classes.data(),
+                                          scores.size(),
+                                          true /*clip_boxes*/,
+                                          debug,
+                                          true /*class_aware*/);
+    if (nms_res != EI_IMPULSE_OK) {
+        return nms_res;
     }
 
     prepare_tao_results_common(impulse, result, &results);
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2022 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS
+ * IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language
+ * governing permissions and limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ei_model_profiler.h"
+
+#if EI_CLASSIFIER_PROFILE_OPS == 1
+
+#include <new>
+#include <utility>
+#include "edge-impulse-sdk/porting/ei_classifier_porting.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/all_ops_resolver.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/memory_helpers.h"
+#include "edge-impulse-sdk/tensorflow/lite/schema/schema_generated.h"
+
+// handle returned for ops that did not fit, ignored by ei_profiler_op_end
+#define EI_PROFILER_NO_HANDLE 0xffffffff
+// kernel of ops that were not recorded by a wrapped kernel
+#define EI_PROFILER_NO_KERNEL 0xff
+
+static ei_model_profile_t profile;
+static uint64_t op_start_us[EI_CLASSIFIER_PROFILE_MAX_OPS];
+static uint8_t op_kernel[EI_CLASSIFIER_PROFILE_MAX_OPS];
+
+typedef struct {
+    ei_profiler_invoke_fn_t prepare;
+    ei_profiler_invoke_fn_t invoke;
+    const char *name;
+} ei_profiler_kernel_t;
+
+static ei_profiler_kernel_t kernels[EI_CLASSIFIER_PROFILE_MAX_KERNELS];
+static size_t kernel_count = 0;
+// off while the name lookup registers every kernel
+static bool kernel_wrapping = true;
+static bool kernel_names_resolved = false;
+
+void ei_profiler_reset(void)
+{
+    profile.count = 0;
+    profile.dropped = 0;
+}
+
+uint32_t ei_profiler_op_begin(const char *op)
+{
+    if (profile.count >= EI_CLASSIFIER_PROFILE_MAX_OPS) {
+        profile.dropped++;
+        return EI_PROFILER_NO_HANDLE;
+    }
+
+    uint32_t handle = profile.count++;
+    ei_op_profile_t *entry = &profile.ops[handle];
+    entry->op = op;
+    op_kernel[handle] = EI_PROFILER_NO_KERNEL;
+    entry->time_us = 0;
+    entry->input_bytes = 0;
+    entry->output_bytes = 0;
+    op_start_us[handle] = ei_read_timer_us();
+
+    return handle;
+}
+
+void ei_profiler_op_end(uint32_t handle, size_t input_bytes, size_t output_bytes)
+{
+    uint64_t end_us = ei_read_timer_us();
+
+    if (handle >= profile.count) {
+        return;
+    }
+
+    profile.ops[handle].time_us = (uint32_t)(end_us - op_start_us[handle]);
+    ei_profiler_op_set_bytes(handle, input_bytes, output_bytes);
+}
+
+void ei_profiler_op_set_bytes(uint32_t handle, size_t input_bytes, size_t output_bytes)
+{
+    if (handle >= profile.count) {
+        return;
+    }
+
+    profile.ops[handle].input_bytes = (uint32_t)input_bytes;
+    profile.ops[handle].output_bytes = (uint32_t)output_bytes;
+}
+
+/**
+ * Name the wrapped kernels after the builtin op that registers the same
+ * invoke function, or else the same prepare function (kernel variants)
+ */
+static void resolve_kernel_names(void)
+{
+    // too large for the stack, only allocated once
+    void *resolver_buf = ei_malloc(sizeof(tflite::AllOpsResolver));
+    if (!resolver_buf) {
+        return;
+    }
+
+    kernel_wrapping = false;
+    tflite::AllOpsResolver *resolver = new (resolver_buf) tflite::AllOpsResolver();
+    kernel_wrapping = true;
+
+    for (size_t k = 0; k < kernel_count; k++) {
+        if (kernels[k].name) {
+            continue;
+        }
+        const char *prepare_match = nullptr;
+        for (int code = tflite::BuiltinOperator_MIN; code <= tflite::BuiltinOperator_MAX; code++) {
+            const TfLiteRegistration *registration = resolver->FindOp((tflite::BuiltinOperator)code);
+            if (!registration) {
+                continue;
+            }
+            if (registration->invoke == kernels[k].invoke) {
+                kernels[k].name = tflite::EnumNameBuiltinOperator((tflite::BuiltinOperator)code);
+                break;
+            }
+            if (!prepare_match && kernels[k].prepare && registration->prepare == kernels[k].prepare) {
+                prepare_match = tflite::EnumNameBuiltinOperator((tflite::BuiltinOperator)code);
+            }
+        }
+        if (!kernels[k].name) {
+            kernels[k].name = prepare_match;
+        }
+    }
+
+    resolver->~AllOpsResolver();
+    ei_free(resolver_buf);
+    kernel_names_resolved = true;
+}
+
+const ei_model_profile_t *ei_profiler_get(void)
+{
+    bool named = true;
+    for (uint16_t ix = 0; ix < profile.count; ix++) {
+        named = named && (profile.ops[ix].op || op_kernel[ix] == EI_PROFILER_NO_KERNEL);
+    }
+    if (named) {
+        return &profile;
+    }
+
+    if (!kernel_names_resolved) {
+        resolve_kernel_names();
+    }
+    for (uint16_t ix = 0; ix < profile.count; ix++) {
+        if (!profile.ops[ix].op && op_kernel[ix] != EI_PROFILER_NO_KERNEL) {
+            profile.ops[ix].op = kernels[op_kernel[ix]].name;
+        }
+    }
+
+    return &profile;
+}
+
+/**
+ * Bytes of the tensors in a node's input or output list, optional tensors
+ * that are not set (-1) count as 0
+ */
+static size_t tensor_list_bytes(TfLiteContext *context, const TfLiteIntArray *tensors)
+{
+    size_t total = 0;
+
+    for (int ix = 0; ix < tensors->size; ix++) {
+        if (tensors->data[ix] < 0) {
+            continue;
+        }
+        const TfLiteEvalTensor *tensor = context->GetEvalTensor(context, tensors->data[ix]);
+        size_t bytes = 0;
+        if (tensor && tflite::TfLiteEvalTensorByteLength(tensor, &bytes) == kTfLiteOk) {
+            total += bytes;
+        }
+    }
+
+    return total;
+}
+
+static TfLiteStatus profiled_invoke(size_t kernel, TfLiteContext *context, TfLiteNode *node)
+{
+    uint32_t handle = ei_profiler_op_begin(nullptr);
+    if (handle != EI_PROFILER_NO_HANDLE) {
+        op_kernel[handle] = (uint8_t)kernel;
+    }
+
+    TfLiteStatus status = kernels[kernel].invoke(context, node);
+
+    // time first, the tensor lookups are not part of the op
+    ei_profiler_op_end(handle, 0, 0);
+    if (handle != EI_PROFILER_NO_HANDLE) {
+        ei_profiler_op_set_bytes(handle,
+            tensor_list_bytes(context, node->inputs),
+            tensor_list_bytes(context, node->outputs));
+    }
+
+    return status;
+}
+
+/**
+ * One entry point per kernel slot, the slot tells which invoke to run
+ */
+template<size_t KERNEL>
+static TfLiteStatus kernel_thunk(TfLiteContext *context, TfLiteNode *node)
+{
+    return profiled_invoke(KERNEL, context, node);
+}
+
+template<size_t... KERNEL>
+static ei_profiler_invoke_fn_t kernel_thunk_at(size_t kernel, std::index_sequence<KERNEL...>)
+{
+    static const ei_profiler_invoke_fn_t thunks[] = { &kernel_thunk<KERNEL>... };
+    return thunks[kernel];
+}
+
+ei_profiler_invoke_fn_t ei_profiler_wrap_kernel(ei_profiler_invoke_fn_t prepare, ei_profiler_invoke_fn_t invoke)
+{
+    static_assert(EI_CLASSIFIER_PROFILE_MAX_KERNELS < EI_PROFILER_NO_KERNEL,
+        "EI_CLASSIFIER_PROFILE_MAX_KERNELS needs to fit in op_kernel");
+
+    if (!kernel_wrapping || !invoke) {
+        return invoke;
+    }
+
+    // the same kernel is registered by every resolver (and model) using it
+    size_t kernel = 0;
+    while (kernel < kernel_count && kernels[kernel].invoke != invoke) {
+        kernel++;
+    }
+    if (kernel == kernel_count) {
+        if (kernel_count >= EI_CLASSIFIER_PROFILE_MAX_KERNELS) {
+            return invoke;
+        }
+        kernels[kernel].prepare = prepare;
+        kernels[kernel].invoke = invoke;
+        kernels[kernel].name = nullptr;
+        kernel_count++;
+        kernel_names_resolved = false;
+    }
+
+    return kernel_thunk_at(kernel, std::make_index_sequence<EI_CLASSIFIER_PROFILE_MAX_KERNELS>());
+}
+
+void ei_profiler_print(const ei_model_profile_t *p)
+{
+    uint32_t total_us = 0;
+    for (uint16_t ix = 0; ix < p->count; ix++) {
+        total_us += p->ops[ix].time_us;
+    }
+
+    ei_printf("Ops: %u, total: %lu us\n", (unsigned)p->count, (unsigned long)total_us);
+    ei_printf("#,op,time_us,input_bytes,output_bytes\n");
+    for (uint16_t ix = 0; ix < p->count; ix++) {
+        const ei_op_profile_t *op = &p->ops[ix];
+        ei_printf("%u,%s,%lu,%lu,%lu\n",
+            (unsigned)ix,
+            op->op ? op->op : "?",
+            (unsigned long)op->time_us,
+            (unsigned long)op->input_bytes,
+            (unsigned long)op->output_bytes);
+    }
+    if (p->dropped > 0) {
+        ei_printf("%u ops not recorded (EI_CLASSIFIER_PROFILE_MAX_OPS is %d)\n",
+            (unsigned)p->dropped, EI_CLASSIFIER_PROFILE_MAX_OPS);
+    }
+}
+
+#endif // EI_CLASSIFIER_PROFILE_OPS == 1
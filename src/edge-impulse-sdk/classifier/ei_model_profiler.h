@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2022 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS
+ * IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language
+ * governing permissions and limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _EI_CLASSIFIER_MODEL_PROFILER_H_
+#define _EI_CLASSIFIER_MODEL_PROFILER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Per operator timing of the neural network, for both EON compiled models
+ * and the TFLite Micro interpreter. Every op of the last inference is
+ * recorded (op name, time and the bytes of its input / output tensors) in a
+ * preallocated table, see ei_impulse_result_timing_t::ops.
+ * Ops are timed by wrapping the invoke function of every kernel registered
+ * through tflite::micro::RegisterOp, so the compiled model needs no changes.
+ * Names are looked up in an AllOpsResolver the first time the table is read,
+ * which links every kernel: only meant for profiling builds.
+ * Must be set for every translation unit, including the TFLite kernels.
+ */
+#ifndef EI_CLASSIFIER_PROFILE_OPS
+#define EI_CLASSIFIER_PROFILE_OPS 0
+#endif
+
+/** Number of ops the table holds, later ops are counted in `dropped` */
+#ifndef EI_CLASSIFIER_PROFILE_MAX_OPS
+#define EI_CLASSIFIER_PROFILE_MAX_OPS 64
+#endif
+
+/**
+ * Number of different kernels (invoke functions) that can be wrapped, the
+ * ops of kernels registered after that are not recorded
+ */
+#ifndef EI_CLASSIFIER_PROFILE_MAX_KERNELS
+#define EI_CLASSIFIER_PROFILE_MAX_KERNELS 32
+#endif
+
+typedef struct {
+    /**
+     * Op name, e.g. "CONV_2D"
+     */
+    const char *op;
+
+    /**
+     * Time (in microseconds) spent in the op
+     */
+    uint32_t time_us;
+
+    /**
+     * Bytes of all input tensors (weights and biases included)
+     */
+    uint32_t input_bytes;
+
+    /**
+     * Bytes of all output tensors
+     */
+    uint32_t output_bytes;
+} ei_op_profile_t;
+
+typedef struct {
+    ei_op_profile_t ops[EI_CLASSIFIER_PROFILE_MAX_OPS];
+
+    /**
+     * Number of ops in `ops`
+     */
+    uint16_t count;
+
+    /**
+     * Number of ops that ran after the table was full
+     */
+    uint16_t dropped;
+} ei_model_profile_t;
+
+#if EI_CLASSIFIER_PROFILE_OPS == 1
+
+/**
+ * Clear the table, called before the model is invoked
+ */
+void ei_profiler_reset(void);
+
+/**
+ * Mark the start of an op
+ * @param op Op name, must outlive the table
+ * @returns Handle for ei_profiler_op_end
+ */
+uint32_t ei_profiler_op_begin(const char *op);
+
+/**
+ * Mark the end of an op
+ * @param handle Handle from ei_profiler_op_begin
+ * @param input_bytes Bytes of the op's input tensors (0 if not known)
+ * @param output_bytes Bytes of the op's output tensors (0 if not known)
+ */
+void ei_profiler_op_end(uint32_t handle, size_t input_bytes, size_t output_bytes);
+
+/**
+ * Set the tensor sizes of an op after the fact
+ */
+void ei_profiler_op_set_bytes(uint32_t handle, size_t input_bytes, size_t output_bytes);
+
+/**
+ * Table of the last inference
+ */
+const ei_model_profile_t *ei_profiler_get(void);
+
+/**
+ * Print a table, one line per op
+ */
+void ei_profiler_print(const ei_model_profile_t *profile);
+
+#ifdef __cplusplus
+#include "edge-impulse-sdk/tensorflow/lite/c/common.h"
+
+typedef TfLiteStatus (*ei_profiler_invoke_fn_t)(TfLiteContext *context, TfLiteNode *node);
+
+/**
+ * Wrap the invoke function of a kernel, called by tflite::micro::RegisterOp.
+ * The wrapper records every op it runs, with the bytes of the tensors the
+ * node reads and writes.
+ * @param prepare Prepare function of the kernel, used to name kernel variants
+ * (e.g. an int8 only invoke) that share it with the default registration
+ * @param invoke Invoke function of the kernel
+ * @returns Function to register instead of invoke, or invoke itself if
+ * EI_CLASSIFIER_PROFILE_MAX_KERNELS kernels are wrapped already
+ */
+ei_profiler_invoke_fn_t ei_profiler_wrap_kernel(ei_profiler_invoke_fn_t prepare, ei_profiler_invoke_fn_t invoke);
+#endif // __cplusplus
+
+#endif // EI_CLASSIFIER_PROFILE_OPS == 1
+
+#endif // _EI_CLASSIFIER_MODEL_PROFILER_H_
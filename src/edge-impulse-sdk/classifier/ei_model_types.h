@@ -89,6 +89,8 @@ struct ei_impulse;
 typedef struct {
     ei::matrix_t* matrix;
     uint32_t blockId;
+    // EI_CLASSIFIER_IMAGE_SCALING_* already applied to matrix (NONE: 0..1 as the DSP block returns it)
+    int image_scaling;
 } ei_feature_t;
 
 typedef struct {
@@ -0,0 +1,432 @@
+/*
+ * Copyright (c) 2022 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS
+ * IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language
+ * governing permissions and limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _EI_CLASSIFIER_MULTI_IMPULSE_H_
+#define _EI_CLASSIFIER_MULTI_IMPULSE_H_
+
+#include "ei_run_classifier.h"
+
+#if EIDSP_SIGNAL_C_FN_POINTER == 0
+
+/**
+ * An impulse run by run_classifier_multi(). All impulses classify the same
+ * window; DSP blocks that are identical across impulses (same extract
+ * function, axes, output size and config) are computed once and the feature
+ * matrix is handed to every learning block that needs it.
+ */
+typedef struct {
+    /**
+     * Handle of the impulse, see ei_impulse_handle_t
+     */
+    ei_impulse_handle_t *handle;
+
+    /**
+     * Where to write the results of this impulse
+     */
+    ei_impulse_result_t *result;
+
+    /**
+     * Classify every nth window (0 or 1: every window)
+     */
+    uint16_t decision_interval;
+
+    /**
+     * Set if `result` was written by the last run_classifier_multi() call
+     */
+    bool has_result;
+
+    /**
+     * Windows seen, set to 0 to restart the decision_interval count
+     */
+    uint32_t window_count;
+} ei_scheduled_impulse_t;
+
+/**
+ * DSP block computed by run_classifier_multi(), possibly used by several impulses
+ */
+typedef struct {
+    ei_impulse_handle_t *handle;
+    size_t block_ix;
+    uint32_t hash;
+    uint64_t dsp_us;
+    // EI_CLASSIFIER_IMAGE_SCALING_* the features are computed in
+    int image_scaling;
+    // whether other impulses may use the features, see ei_multi_private_features
+    bool shared;
+} ei_multi_dsp_job_t;
+
+/**
+ * FNV-1a over a buffer
+ */
+static uint32_t ei_multi_hash(uint32_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t ix = 0; ix < size; ix++) {
+        hash ^= bytes[ix];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Hash of everything that decides the output of a DSP block. block_id (the
+ * first field of every config) differs between projects and is left out.
+ * Configs of unknown size (custom blocks) are hashed by address.
+ */
+static uint32_t ei_multi_dsp_block_hash(const ei_impulse_t *impulse, const ei_model_dsp_t *block)
+{
+    uint32_t hash = 2166136261u;
+    hash = ei_multi_hash(hash, &block->extract_fn, sizeof(block->extract_fn));
+    hash = ei_multi_hash(hash, &impulse->frequency, sizeof(impulse->frequency));
+    hash = ei_multi_hash(hash, &block->n_output_features, sizeof(block->n_output_features));
+    hash = ei_multi_hash(hash, block->axes, block->axes_size * sizeof(block->axes[0]));
+
+    size_t config_size = ei_dsp_config_size(block->extract_fn);
+    if (config_size > sizeof(uint32_t)) {
+        hash = ei_multi_hash(hash, (const uint8_t *)block->config + sizeof(uint32_t), config_size - sizeof(uint32_t));
+    }
+    else {
+        hash = ei_multi_hash(hash, &block->config, sizeof(block->config));
+    }
+    return hash;
+}
+
+/**
+ * Whether two DSP blocks produce the same features from the same window
+ */
+static bool ei_multi_dsp_blocks_equal(const ei_impulse_t *impulse_a, const ei_model_dsp_t *a,
+                                      const ei_impulse_t *impulse_b, const ei_model_dsp_t *b)
+{
+    if (a->extract_fn != b->extract_fn ||
+        impulse_a->frequency != impulse_b->frequency ||
+        a->n_output_features != b->n_output_features ||
+        a->axes_size != b->axes_size ||
+        memcmp(a->axes, b->axes, a->axes_size * sizeof(a->axes[0])) != 0) {
+        return false;
+    }
+
+    if (a->config == b->config) {
+        return true;
+    }
+
+    size_t config_size = ei_dsp_config_size(a->extract_fn);
+    if (config_size <= sizeof(uint32_t)) {
+        return false;
+    }
+    return memcmp((const uint8_t *)a->config + sizeof(uint32_t),
+                  (const uint8_t *)b->config + sizeof(uint32_t),
+                  config_size - sizeof(uint32_t)) == 0;
+}
+
+/**
+ * Scaling the image features of an impulse are unpacked in, as process_impulse
+ * does: the scaling of its learning blocks if they all agree, else none
+ */
+static int ei_multi_image_scaling(const ei_impulse_t *impulse, const ei_model_dsp_t *block, size_t block_ix)
+{
+#if EI_CLASSIFIER_LOAD_IMAGE_SCALING
+    if (block_ix != 0 || block->factory || block->extract_fn != extract_image_features ||
+        impulse->learning_blocks_size == 0) {
+        return EI_CLASSIFIER_IMAGE_SCALING_NONE;
+    }
+
+    int image_scaling = impulse->learning_blocks[0].image_scaling;
+    for (size_t ix = 1; ix < impulse->learning_blocks_size; ix++) {
+        if (impulse->learning_blocks[ix].image_scaling != image_scaling) {
+            return EI_CLASSIFIER_IMAGE_SCALING_NONE;
+        }
+    }
+    return image_scaling;
+#else
+    (void)impulse;
+    (void)block;
+    (void)block_ix;
+    return EI_CLASSIFIER_IMAGE_SCALING_NONE;
+#endif
+}
+
+/**
+ * Whether the features of a DSP block have to be computed for this impulse
+ * alone: blocks with state, and the first block when run_inference would
+ * rescale it in place for a learning block (the round trip is not exact, and
+ * is not undone if inference fails)
+ */
+static bool ei_multi_private_features(const ei_impulse_t *impulse, const ei_model_dsp_t *block, size_t block_ix,
+                                      int image_scaling)
+{
+    if (block->factory) {
+        return true;
+    }
+#if EI_CLASSIFIER_LOAD_IMAGE_SCALING
+    if (block_ix == 0) {
+        for (size_t ix = 0; ix < impulse->learning_blocks_size; ix++) {
+            if (impulse->learning_blocks[ix].image_scaling != image_scaling) {
+                return true;
+            }
+        }
+    }
+#else
+    (void)impulse;
+    (void)block_ix;
+    (void)image_scaling;
+#endif
+    return false;
+}
+
+/**
+ * @defgroup ei_functions Functions
+ *
+ * @{
+ */
+
+/**
+ * @brief Run several impulses over one window, sharing DSP results.
+ *
+ * Every impulse whose decision_interval is due for this window is classified.
+ * Each distinct DSP block of those impulses runs once, the feature matrix is
+ * fed to the learning blocks of all impulses that use it. Blocks that keep
+ * state (e.g. performance calibration) always run per impulse. Image
+ * features are unpacked in the scaling of the impulse's learning blocks, so
+ * impulses share them only if they want the same scaling; an impulse whose
+ * learning blocks want different scalings gets its own copy, which
+ * run_inference rescales in place.
+ * `result->timing.dsp_us` includes the time of shared blocks for every
+ * impulse that uses them.
+ *
+ * **Blocking**: yes
+ *
+ * @param[in,out] impulses Impulses to run. `has_result` and `window_count` are updated.
+ * @param[in] impulses_count Number of entries in `impulses`
+ * @param[in] signal Window of raw features. All impulses must use the same
+ *  frequency and axes per frame, and the length must match the
+ *  dsp_input_frame_size of every impulse.
+ * @param[in] debug Print internal preprocessing and inference debugging information via `ei_printf()`.
+ *
+ * @return Error code as defined by `EI_IMPULSE_ERROR` enum. Will be `EI_IMPULSE_OK` if all due
+ *  impulses completed successfully.
+ */
+__attribute__((unused)) EI_IMPULSE_ERROR run_classifier_multi(
+    ei_scheduled_impulse_t *impulses,
+    size_t impulses_count,
+    signal_t *signal,
+    bool debug = false)
+{
+    if (!impulses || impulses_count == 0) {
+        return EI_IMPULSE_INFERENCE_ERROR;
+    }
+
+    for (size_t ix = 0; ix < impulses_count; ix++) {
+        if (!impulses[ix].handle || !impulses[ix].result) {
+            return EI_IMPULSE_INFERENCE_ERROR;
+        }
+
+        const ei_impulse_t *impulse = impulses[ix].handle->impulse;
+        if (impulse->raw_samples_per_frame != impulses[0].handle->impulse->raw_samples_per_frame ||
+            impulse->frequency != impulses[0].handle->impulse->frequency) {
+            ei_printf("ERR: All impulses need the same frequency and axes to share a window\n");
+            return EI_IMPULSE_INVALID_SIZE;
+        }
+        if (signal->total_length != impulse->dsp_input_frame_size) {
+            ei_printf("ERR: Signal length (%d) does not match the input frame size of impulse %d (%d)\n",
+                (int)signal->total_length, (int)ix, (int)impulse->dsp_input_frame_size);
+            return EI_IMPULSE_INVALID_SIZE;
+        }
+    }
+
+    // features, DSP scratch and tensor arena share one region if EIDSP_SHARED_SCRATCH_SIZE is set
+    EI_DSP_SCRATCH_SESSION();
+
+    std::unique_ptr<bool[]> due(new bool[impulses_count]);
+    size_t max_jobs = 0;
+    for (size_t ix = 0; ix < impulses_count; ix++) {
+        ei_scheduled_impulse_t *s = &impulses[ix];
+        due[ix] = s->decision_interval <= 1 || (s->window_count % s->decision_interval) == 0;
+        s->window_count++;
+        s->has_result = false;
+        if (due[ix]) {
+            max_jobs += s->handle->impulse->dsp_blocks_size;
+        }
+    }
+
+    // one entry per DSP block of every due impulse, pointing into jobs
+    std::unique_ptr<ei_multi_dsp_job_t[]> jobs(new ei_multi_dsp_job_t[max_jobs]);
+    std::unique_ptr<size_t[]> block_jobs(new size_t[max_jobs]);
+    size_t jobs_count = 0;
+    size_t block_jobs_index = 0;
+
+    for (size_t ix = 0; ix < impulses_count; ix++) {
+        if (!due[ix]) {
+            continue;
+        }
+
+        ei_impulse_handle_t *handle = impulses[ix].handle;
+        size_t out_features_index = 0;
+
+        for (size_t bx = 0; bx < handle->impulse->dsp_blocks_size; bx++) {
+            const ei_model_dsp_t *block = &handle->impulse->dsp_blocks[bx];
+
+            if (out_features_index + block->n_output_features > handle->impulse->nn_input_frame_size) {
+                ei_printf("ERR: Would write outside feature buffer\n");
+                return EI_IMPULSE_DSP_ERROR;
+            }
+            out_features_index += block->n_output_features;
+
+            int image_scaling = ei_multi_image_scaling(handle->impulse, block, bx);
+            bool shared = !ei_multi_private_features(handle->impulse, block, bx, image_scaling);
+            uint32_t hash = ei_multi_dsp_block_hash(handle->impulse, block);
+            hash = ei_multi_hash(hash, &image_scaling, sizeof(image_scaling));
+
+            size_t jx = jobs_count;
+            if (shared) {
+                for (size_t kx = 0; kx < jobs_count; kx++) {
+                    const ei_model_dsp_t *other = &jobs[kx].handle->impulse->dsp_blocks[jobs[kx].block_ix];
+                    if (jobs[kx].shared && jobs[kx].hash == hash && jobs[kx].image_scaling == image_scaling &&
+                        ei_multi_dsp_blocks_equal(handle->impulse, block, jobs[kx].handle->impulse, other)) {
+                        jx = kx;
+                        break;
+                    }
+                }
+            }
+
+            if (jx == jobs_count) {
+                jobs[jobs_count].handle = handle;
+                jobs[jobs_count].block_ix = bx;
+                jobs[jobs_count].hash = hash;
+                jobs[jobs_count].dsp_us = 0;
+                jobs[jobs_count].image_scaling = image_scaling;
+                jobs[jobs_count].shared = shared;
+                jobs_count++;
+            }
+            block_jobs[block_jobs_index++] = jx;
+        }
+    }
+
+    if (debug) {
+        ei_printf("Running %d DSP blocks for %d blocks in due impulses\n", (int)jobs_count, (int)max_jobs);
+    }
+
+    // have it outside of the loop to avoid going out of scope
+    std::unique_ptr<std::unique_ptr<ei::matrix_t>[]> job_matrices(new std::unique_ptr<ei::matrix_t>[jobs_count]);
+
+    for (size_t jx = 0; jx < jobs_count; jx++) {
+        ei_impulse_handle_t *handle = jobs[jx].handle;
+        const ei_model_dsp_t *block = &handle->impulse->dsp_blocks[jobs[jx].block_ix];
+
+        uint64_t dsp_start_us = ei_read_timer_us();
+
+        job_matrices[jx] = std::unique_ptr<ei::matrix_t>(new ei::matrix_t(1, block->n_output_features));
+        if (!job_matrices[jx]->buffer) {
+            return EI_IMPULSE_OUT_OF_MEMORY;
+        }
+
+        SignalWithAxes swa(signal, block->axes, block->axes_size, handle->impulse);
+        auto internal_signal = swa.get_signal();
+
+        int ret;
+        if (block->factory) {
+            // getter has a lazy init, so we can just call it
+            auto dsp_handle = handle->state.get_dsp_handle(jobs[jx].block_ix);
+            if (!dsp_handle) {
+                return EI_IMPULSE_OUT_OF_MEMORY;
+            }
+            ret = dsp_handle->extract(internal_signal, job_matrices[jx].get(), block->config, handle->impulse->frequency);
+        }
+#if EI_CLASSIFIER_LOAD_IMAGE_SCALING
+        else if (jobs[jx].image_scaling != EI_CLASSIFIER_IMAGE_SCALING_NONE) {
+            ret = extract_image_features_scaled(internal_signal, job_matrices[jx].get(), block->config,
+                handle->impulse->frequency, jobs[jx].image_scaling);
+        }
+#endif
+        else {
+            ret = block->extract_fn(internal_signal, job_matrices[jx].get(), block->config, handle->impulse->frequency);
+        }
+
+        if (ret != EIDSP_OK) {
+            ei_printf("ERR: Failed to run DSP process (%d)\n", ret);
+            return EI_IMPULSE_DSP_ERROR;
+        }
+
+        jobs[jx].dsp_us = ei_read_timer_us() - dsp_start_us;
+
+        if (ei_run_impulse_check_canceled() == EI_IMPULSE_CANCELED) {
+            return EI_IMPULSE_CANCELED;
+        }
+    }
+
+    block_jobs_index = 0;
+
+    for (size_t ix = 0; ix < impulses_count; ix++) {
+        if (!due[ix]) {
+            continue;
+        }
+
+        ei_impulse_handle_t *handle = impulses[ix].handle;
+        ei_impulse_result_t *result = impulses[ix].result;
+        uint32_t block_num = handle->impulse->dsp_blocks_size + handle->impulse->learning_blocks_size;
+
+        memset(result, 0, sizeof(ei_impulse_result_t));
+
+        std::unique_ptr<ei_feature_t[]> features_ptr(new ei_feature_t[block_num]());
+        ei_feature_t* features = features_ptr.get();
+        memset(features, 0, sizeof(ei_feature_t) * block_num);
+
+        std::unique_ptr<std::unique_ptr<ei::matrix_t>[]> output_matrices(new std::unique_ptr<ei::matrix_t>[block_num]);
+
+        for (size_t bx = 0; bx < handle->impulse->dsp_blocks_size; bx++) {
+            size_t jx = block_jobs[block_jobs_index++];
+            // shared matrices are already in the scaling of every learning
+            // block, run_inference only rescales private ones
+            features[bx].matrix = job_matrices[jx].get();
+            features[bx].blockId = handle->impulse->dsp_blocks[bx].blockId;
+            features[bx].image_scaling = jobs[jx].image_scaling;
+            result->timing.dsp_us += jobs[jx].dsp_us;
+        }
+
+#if EI_CLASSIFIER_SINGLE_FEATURE_INPUT == 0
+        for (size_t bx = 0; bx < handle->impulse->learning_blocks_size; bx++) {
+            ei_learning_block_t block = handle->impulse->learning_blocks[bx];
+
+            if (block.keep_output) {
+                output_matrices[bx] = std::unique_ptr<ei::matrix_t>(new ei::matrix_t(1, block.output_features_count));
+                features[handle->impulse->dsp_blocks_size + bx].matrix = output_matrices[bx].get();
+                features[handle->impulse->dsp_blocks_size + bx].blockId = block.blockId;
+            }
+        }
+#endif // EI_CLASSIFIER_SINGLE_FEATURE_INPUT
+
+        result->timing.dsp = (int)(result->timing.dsp_us / 1000);
+
+        if (debug) {
+            ei_printf("Running impulse %d...\n", (int)ix);
+        }
+
+        EI_IMPULSE_ERROR res = run_inference(handle, features, result, debug);
+        if (res != EI_IMPULSE_OK) {
+            return res;
+        }
+
+        impulses[ix].has_result = true;
+    }
+
+    return EI_IMPULSE_OK;
+}
+
+/** @} */ // end of ei_functions Doxygen group
+
+#endif // EIDSP_SIGNAL_C_FN_POINTER == 0
+
+#endif // _EI_CLASSIFIER_MULTI_IMPULSE_H_
@@ -28,13 +28,11 @@
 
 #if (EI_CLASSIFIER_OBJECT_DETECTION_LAST_LAYER == EI_CLASSIFIER_LAST_LAYER_YOLOV5) || (EI_CLASSIFIER_OBJECT_DETECTION_LAST_LAYER == EI_CLASSIFIER_LAST_LAYER_YOLOV5_V5_DRPAI) || (EI_CLASSIFIER_OBJECT_DETECTION_LAST_LAYER == EI_CLASSIFIER_LAST_LAYER_YOLOX) || (EI_CLASSIFIER_OBJECT_DETECTION_LAST_LAYER == EI_CLASSIFIER_LAST_LAYER_TAO_RETINANET) || (EI_CLASSIFIER_OBJECT_DETECTION_LAST_LAYER == EI_CLASSIFIER_LAST_LAYER_TAO_SSD) || (EI_CLASSIFIER_OBJECT_DETECTION_LAST_LAYER == EI_CLASSIFIER_LAST_LAYER_TAO_YOLOV3) || (EI_CLASSIFIER_OBJECT_DETECTION_LAST_LAYER == EI_CLASSIFIER_LAST_LAYER_TAO_YOLOV4) || (EI_CLASSIFIER_OBJECT_DETECTION_LAST_LAYER == EI_CLASSIFIER_LAST_LAYER_YOLOV2)
 
-// The code below comes from tensorflow/lite/kernels/internal/reference/non_max_suppression.h
+// The code below is based on tensorflow/lite/kernels/internal/reference/non_max_suppression.h
 // Copyright 2019 The TensorFlow Authors.  All rights reserved.
 // Licensed under the Apache License, Version 2.0
 #include <algorithm>
 #include <cmath>
-#include <deque>
-#include <queue>
 
 // A pair of diagonal corners of the box.
 struct BoxCornerEncoding {
@@ -44,164 +42,204 @@ struct BoxCornerEncoding {
   float x2;
 };
 
-static inline float ComputeIntersectionOverUnion(const float* boxes, const int i,
-                                          const int j) {
-  auto& box_i = reinterpret_cast<const BoxCornerEncoding*>(boxes)[i];
-  auto& box_j = reinterpret_cast<const BoxCornerEncoding*>(boxes)[j];
-  const float box_i_y_min = std::min<float>(box_i.y1, box_i.y2);
-  const float box_i_y_max = std::max<float>(box_i.y1, box_i.y2);
-  const float box_i_x_min = std::min<float>(box_i.x1, box_i.x2);
-  const float box_i_x_max = std::max<float>(box_i.x1, box_i.x2);
-  const float box_j_y_min = std::min<float>(box_j.y1, box_j.y2);
-  const float box_j_y_max = std::max<float>(box_j.y1, box_j.y2);
-  const float box_j_x_min = std::min<float>(box_j.x1, box_j.x2);
-  const float box_j_x_max = std::max<float>(box_j.x1, box_j.x2);
-
-  const float area_i =
-      (box_i_y_max - box_i_y_min) * (box_i_x_max - box_i_x_min);
-  const float area_j =
-      (box_j_y_max - box_j_y_min) * (box_j_x_max - box_j_x_min);
-  if (area_i <= 0 || area_j <= 0) return 0.0;
-  const float intersection_ymax = std::min<float>(box_i_y_max, box_j_y_max);
-  const float intersection_xmax = std::min<float>(box_i_x_max, box_j_x_max);
-  const float intersection_ymin = std::max<float>(box_i_y_min, box_j_y_min);
-  const float intersection_xmin = std::max<float>(box_i_x_min, box_j_x_min);
-  const float intersection_area =
-      std::max<float>(intersection_ymax - intersection_ymin, 0.0) *
-      std::max<float>(intersection_xmax - intersection_xmin, 0.0);
-  return intersection_area / (area_i + area_j - intersection_area);
+// A box with ordered corners and its area, computed once per candidate.
+struct NmsCandidateBox {
+  float y_min;
+  float x_min;
+  float y_max;
+  float x_max;
+  float area;
+};
+
+static inline float ComputeIntersectionOverUnion(const NmsCandidateBox& box_i,
+                                                 const NmsCandidateBox& box_j) {
+  if (box_i.area <= 0 || box_j.area <= 0) return 0.0;
+  const float intersection_ymax = std::min<float>(box_i.y_max, box_j.y_max);
+  const float intersection_ymin = std::max<float>(box_i.y_min, box_j.y_min);
+  if (intersection_ymax <= intersection_ymin) return 0.0;
+  const float intersection_xmax = std::min<float>(box_i.x_max, box_j.x_max);
+  const float intersection_xmin = std::max<float>(box_i.x_min, box_j.x_min);
+  if (intersection_xmax <= intersection_xmin) return 0.0;
+  const float intersection_area = (intersection_ymax - intersection_ymin) *
+                                  (intersection_xmax - intersection_xmin);
+  return intersection_area / (box_i.area + box_j.area - intersection_area);
 }
 
-// Implements (Single-Class) Soft NMS (with Gaussian weighting).
-// Supports functionality of TensorFlow ops NonMaxSuppressionV4 & V5.
-// Reference: "Soft-NMS - Improving Object Detection With One Line of Code"
-//            [Bodla et al, https://arxiv.org/abs/1704.04503]
-// Implementation adapted from the TensorFlow NMS code at
-// tensorflow/core/kernels/non_max_suppression_op.cc.
+// Implements (hard) NMS over candidates that are sorted once by score.
+// Supports functionality of TensorFlow op NonMaxSuppressionV4, optionally
+// class aware: then boxes only suppress boxes of the same class, so all
+// classes go through a single call.
 //
 // Arguments:
 //  boxes: box encodings in format [y1, x1, y2, x2], shape: [num_boxes, 4]
 //  num_boxes: number of candidates
 //  scores: scores for candidate boxes, in the same order. shape: [num_boxes]
-//  max_output_size: the maximum number of selections.
+//  classes: class of the candidate boxes, in the same order. If null, boxes
+//    of all classes suppress each other.
+//  max_output_size: the maximum number of selections. Stops as soon as it
+//    is reached.
 //  iou_threshold: Intersection-over-Union (IoU) threshold for NMS
 //  score_threshold: All candidate scores below this value are rejected
-//  soft_nms_sigma: Soft NMS parameter, used for decaying scores
+//  sorted_indices: scratch, array must have length >= num_boxes
+//  candidate_boxes: scratch, array must have length >= num_boxes
 //
 // Outputs:
-//  selected_indices: all the selected indices. Underlying array must have
-//    length >= max_output_size. Cannot be null.
-//  selected_scores: scores of selected indices. Defer from original value for
-//    Soft NMS. If not null, array must have length >= max_output_size.
+//  selected_indices: all the selected indices, by descending score.
+//    Underlying array must have length >= max_output_size. Cannot be null.
+//  selected_scores: scores of selected indices. If not null, array must have
+//    length >= max_output_size.
 //  num_selected_indices: Number of selections. Only these many elements are
 //    set in selected_indices, selected_scores. Cannot be null.
 //
 // Assumes inputs are valid (for eg, iou_threshold must be >= 0).
 static inline void NonMaxSuppression(const float* boxes, const int num_boxes,
-                              const float* scores, const int max_output_size,
+                              const float* scores, const int* classes,
+                              const int max_output_size,
                               const float iou_threshold,
                               const float score_threshold,
-                              const float soft_nms_sigma, int* selected_indices,
+                              int* sorted_indices,
+                              NmsCandidateBox* candidate_boxes,
+                              int* selected_indices,
                               float* selected_scores,
                               int* num_selected_indices) {
-  struct Candidate {
-    int index;
-    float score;
-    int suppress_begin_index;
-  };
+  *num_selected_indices = 0;
 
-  // Priority queue to hold candidates.
-  auto cmp = [](const Candidate bs_i, const Candidate bs_j) {
-    return bs_i.score < bs_j.score;
-  };
-  std::priority_queue<Candidate, std::deque<Candidate>, decltype(cmp)>
-      candidate_priority_queue(cmp);
-  // Populate queue with candidates above the score threshold.
+  // Candidates above the score threshold, with their corners ordered once.
+  int num_candidates = 0;
   for (int i = 0; i < num_boxes; ++i) {
     if (scores[i] > score_threshold) {
-      candidate_priority_queue.emplace(Candidate({i, scores[i], 0}));
+      auto& box = reinterpret_cast<const BoxCornerEncoding*>(boxes)[i];
+      NmsCandidateBox& candidate = candidate_boxes[i];
+      candidate.y_min = std::min<float>(box.y1, box.y2);
+      candidate.y_max = std::max<float>(box.y1, box.y2);
+      candidate.x_min = std::min<float>(box.x1, box.x2);
+      candidate.x_max = std::max<float>(box.x1, box.x2);
+      candidate.area = (candidate.y_max - candidate.y_min) *
+                       (candidate.x_max - candidate.x_min);
+      sorted_indices[num_candidates++] = i;
     }
   }
 
-  *num_selected_indices = 0;
-  int num_outputs = std::min(static_cast<int>(candidate_priority_queue.size()),
-                             max_output_size);
-  if (num_outputs == 0) return;
-
-  // NMS loop.
-  float scale = 0;
-  if (soft_nms_sigma > 0.0) {
-    scale = -0.5 / soft_nms_sigma;
-  }
-  while (*num_selected_indices < num_outputs &&
-         !candidate_priority_queue.empty()) {
-    Candidate next_candidate = candidate_priority_queue.top();
-    const float original_score = next_candidate.score;
-    candidate_priority_queue.pop();
+  if (num_candidates == 0 || max_output_size <= 0) return;
+
+  // Highest score first, ties keep the order of the input.
+  std::sort(sorted_indices, sorted_indices + num_candidates,
+            [scores](const int i, const int j) {
+              return scores[i] > scores[j] || (scores[i] == scores[j] && i < j);
+            });
+
+  for (int c = 0; c < num_candidates; ++c) {
+    const int index = sorted_indices[c];
+    const NmsCandidateBox& candidate = candidate_boxes[index];
 
     // Overlapping boxes are likely to have similar scores, therefore we
     // iterate through the previously selected boxes backwards in order to
-    // see if `next_candidate` should be suppressed. We also enforce a property
-    // that a candidate can be suppressed by another candidate no more than
-    // once via `suppress_begin_index` which tracks which previously selected
-    // boxes have already been compared against next_candidate prior to a given
-    // iteration.  These previous selected boxes are then skipped over in the
-    // following loop.
+    // see if the candidate should be suppressed.
     bool should_hard_suppress = false;
-    for (int j = *num_selected_indices - 1;
-         j >= next_candidate.suppress_begin_index; --j) {
-      const float iou = ComputeIntersectionOverUnion(
-          boxes, next_candidate.index, selected_indices[j]);
-
-      // First decide whether to perform hard suppression.
-      if (iou >= iou_threshold) {
+    for (int j = *num_selected_indices - 1; j >= 0; --j) {
+      const int selected = selected_indices[j];
+      if (classes && classes[selected] != classes[index]) continue;
+      if (ComputeIntersectionOverUnion(candidate, candidate_boxes[selected]) >=
+          iou_threshold) {
         should_hard_suppress = true;
         break;
       }
+    }
+    if (should_hard_suppress) continue;
 
-      // Suppress score if NMS sigma > 0.
-      if (soft_nms_sigma > 0.0) {
-        next_candidate.score =
-            next_candidate.score * std::exp(scale * iou * iou);
-      }
+    selected_indices[*num_selected_indices] = index;
+    if (selected_scores) {
+      selected_scores[*num_selected_indices] = scores[index];
+    }
+    if (++*num_selected_indices == max_output_size) break;
+  }
+}
 
-      // If score has fallen below score_threshold, it won't be pushed back into
-      // the queue.
-      if (next_candidate.score <= score_threshold) break;
+/**
+ * Scratch for ei_run_nms, sized for a number of candidate boxes. It grows
+ * when a call has more candidates than it holds and is kept afterwards, so
+ * NMS stops allocating once it has seen the largest candidate count.
+ * Callers that want to control its size and lifetime pass their own, e.g.
+ * reserved once for the model's maximum number of candidates.
+ */
+class ei_nms_scratch {
+public:
+    ei_nms_scratch()
+        : boxes(nullptr), scores(nullptr), classes(nullptr), indices(nullptr),
+          selected_scores(nullptr), candidate_boxes(nullptr), _capacity(0)
+    {
     }
-    // If `next_candidate.score` has not dropped below `score_threshold`
-    // by this point, then we know that we went through all of the previous
-    // selections and can safely update `suppress_begin_index` to
-    // `selected.size()`. If on the other hand `next_candidate.score`
-    // *has* dropped below the score threshold, then since `suppress_weight`
-    // always returns values in [0, 1], further suppression by items that were
-    // not covered in the above for loop would not have caused the algorithm
-    // to select this item. We thus do the same update to
-    // `suppress_begin_index`, but really, this element will not be added back
-    // into the priority queue.
-    next_candidate.suppress_begin_index = *num_selected_indices;
-
-    if (!should_hard_suppress) {
-      if (next_candidate.score == original_score) {
-        // Suppression has not occurred, so select next_candidate.
-        selected_indices[*num_selected_indices] = next_candidate.index;
-        if (selected_scores) {
-          selected_scores[*num_selected_indices] = next_candidate.score;
+
+    ~ei_nms_scratch() {
+        release();
+    }
+
+    ei_nms_scratch(const ei_nms_scratch&) = delete;
+    ei_nms_scratch& operator=(const ei_nms_scratch&) = delete;
+
+    /**
+     * Make room for count candidates, keeps the buffers if they are big enough
+     * @returns false if out of memory
+     */
+    bool reserve(size_t count) {
+        if (count <= _capacity) {
+            return true;
         }
-        ++*num_selected_indices;
-      }
-      if ((soft_nms_sigma > 0.0) && (next_candidate.score > score_threshold)) {
-        // Soft suppression might have occurred and current score is still
-        // greater than score_threshold; add next_candidate back onto priority
-        // queue.
-        candidate_priority_queue.push(next_candidate);
-      }
+        release();
+
+        boxes = (float*)ei_malloc(4 * count * sizeof(float));
+        scores = (float*)ei_malloc(count * sizeof(float));
+        classes = (int*)ei_malloc(count * sizeof(int));
+        indices = (int*)ei_malloc(2 * count * sizeof(int));
+        selected_scores = (float*)ei_malloc(count * sizeof(float));
+        candidate_boxes = (NmsCandidateBox*)ei_malloc(count * sizeof(NmsCandidateBox));
+        if (!boxes || !scores || !classes || !indices || !selected_scores || !candidate_boxes) {
+            release();
+            return false;
+        }
+        _capacity = count;
+        return true;
     }
-  }
+
+    // input of the results vector ei_run_nms
+    float *boxes;
+    float *scores;
+    int *classes;
+    // selected, then sorted indices
+    int *indices;
+    float *selected_scores;
+    NmsCandidateBox *candidate_boxes;
+
+private:
+    void release() {
+        ei_free(boxes);
+        ei_free(scores);
+        ei_free(classes);
+        ei_free(indices);
+        ei_free(selected_scores);
+        ei_free(candidate_boxes);
+        boxes = scores = selected_scores = nullptr;
+        classes = indices = nullptr;
+        candidate_boxes = nullptr;
+        _capacity = 0;
+    }
+
+    size_t _capacity;
+};
+
+/**
+ * Scratch used when the caller doesn't pass one, shared like the decoders'
+ * results arrays
+ */
+static ei_nms_scratch *ei_nms_shared_scratch() {
+    static ei_nms_scratch scratch;
+    return &scratch;
 }
 
 /**
  * Run non-max suppression over the results array (for bounding boxes)
+ * When class_aware is set, boxes only suppress boxes of the same class, so
+ * all classes can be passed in a single call
  */
 EI_IMPULSE_ERROR ei_run_nms(
     const ei_impulse_t *impulse,
@@ -211,28 +249,30 @@ EI_IMPULSE_ERROR ei_run_nms(
     int *classes,
     size_t bb_count,
     bool clip_boxes,
-    bool debug) {
+    bool debug,
+    bool class_aware = false,
+    ei_nms_scratch *scratch = nullptr) {
 
     if (bb_count < 1) {
         return EI_IMPULSE_OK;
     }
 
-    int *selected_indices = (int*)ei_malloc(1 * bb_count * sizeof(int));
-    float *selected_scores = (float*)ei_malloc(1 * bb_count * sizeof(float));
-
-    if (!scores || !boxes || !selected_indices || !selected_scores || !classes) {
-        ei_free(selected_indices);
-        ei_free(selected_scores);
+    if (!scratch) {
+        scratch = ei_nms_shared_scratch();
+    }
+    if (!scores || !boxes || !classes || !scratch->reserve(bb_count)) {
         return EI_IMPULSE_OUT_OF_MEMORY;
     }
+    int *selected_indices = scratch->indices;
+    float *selected_scores = scratch->selected_scores;
 
     //  boxes: box encodings in format [y1, x1, y2, x2], shape: [num_boxes, 4]
     //  num_boxes: number of candidates
     //  scores: scores for candidate boxes, in the same order. shape: [num_boxes]
+    //  classes: only suppress boxes of the same class when class aware
     //  max_output_size: the maximum number of selections.
     //  iou_threshold: Intersection-over-Union (IoU) threshold for NMS
     //  score_threshold: All candidate scores below this value are rejected
-    //  soft_nms_sigma: Soft NMS parameter, used for decaying scores
 
     int num_selected_indices;
 
@@ -240,15 +280,18 @@ EI_IMPULSE_ERROR ei_run_nms(
         (const float*)boxes, // boxes
         bb_count, // num_boxes
         (const float*)scores, // scores
+        class_aware ? classes : nullptr, // classes
         bb_count, // max_output_size
         impulse->object_detection_nms.iou_threshold, // iou_threshold
         impulse->object_detection_nms.confidence_threshold, // score_threshold
-        0.0f, // soft_nms_sigma
+        selected_indices + bb_count, // sorted_indices
+        scratch->candidate_boxes,
         selected_indices,
         selected_scores,
         &num_selected_indices);
 
-    std::vector<ei_impulse_result_bounding_box_t> new_results;
+    // the boxes are not read from results, so it can be refilled in place
+    results->clear();
 
     for (size_t ix = 0; ix < (size_t)num_selected_indices; ix++) {
 
@@ -273,7 +316,7 @@ EI_IMPULSE_ERROR ei_run_nms(
         bb.x      = static_cast<uint32_t>(xmin);
         bb.height = static_cast<uint32_t>(ymax) - bb.y;
         bb.width  = static_cast<uint32_t>(xmax) - bb.x;
-        new_results.push_back(bb);
+        results->push_back(bb);
 
         if (debug) {
           ei_printf("Found bb with label %s\n", bb.label);
@@ -281,15 +324,6 @@ EI_IMPULSE_ERROR ei_run_nms(
 
     }
 
-    results->clear();
-
-    for (size_t ix = 0; ix < new_results.size(); ix++) {
-        results->push_back(new_results[ix]);
-    }
-
-    ei_free(selected_indices);
-    ei_free(selected_scores);
-
     return EI_IMPULSE_OK;
 
 }
@@ -301,7 +335,8 @@ EI_IMPULSE_ERROR ei_run_nms(
     const ei_impulse_t *impulse,
     std::vector<ei_impulse_result_bounding_box_t> *results,
     bool clip_boxes,
-    bool debug) {
+    bool debug,
+    ei_nms_scratch *scratch = nullptr) {
 
     size_t bb_count = 0;
     for (size_t ix = 0; ix < results->size(); ix++) {
@@ -316,16 +351,15 @@ EI_IMPULSE_ERROR ei_run_nms(
         return EI_IMPULSE_OK;
     }
 
-    float *boxes = (float*)ei_malloc(4 * bb_count * sizeof(float));
-    float *scores = (float*)ei_malloc(1 * bb_count * sizeof(float));
-    int *classes = (int*) ei_malloc(bb_count * sizeof(int));
-
-    if (!scores || !boxes || !classes) {
-        ei_free(boxes);
-        ei_free(scores);
-        ei_free(classes);
+    if (!scratch) {
+        scratch = ei_nms_shared_scratch();
+    }
+    if (!scratch->reserve(bb_count)) {
         return EI_IMPULSE_OUT_OF_MEMORY;
     }
+    float *boxes = scratch->boxes;
+    float *scores = scratch->scores;
+    int *classes = scratch->classes;
 
     size_t box_ix = 0;
     for (size_t ix = 0; ix < results->size(); ix++) {
@@ -347,18 +381,13 @@ EI_IMPULSE_ERROR ei_run_nms(
         box_ix++;
     }
 
-    EI_IMPULSE_ERROR nms_res = ei_run_nms(impulse, results,
-                                          boxes, scores,
-                                          classes, bb_count,
-                                          clip_boxes,
-                                          debug);
-
-
-    ei_free(boxes);
-    ei_free(scores);
-    ei_free(classes);
-
-    return nms_res;
+    return ei_run_nms(impulse, results,
+                      boxes, scores,
+                      classes, bb_count,
+                      clip_boxes,
+                      debug,
+                      false,
+                      scratch);
 
 }
 
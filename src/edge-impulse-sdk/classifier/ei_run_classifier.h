@@ -179,10 +179,15 @@ extern "C" EI_IMPULSE_ERROR run_inference(
 
 #if EI_CLASSIFIER_LOAD_IMAGE_SCALING
         // we do not plan to have multiple dsp blocks with image
-        // so just apply scaling to the first one
-        EI_IMPULSE_ERROR scale_res = ei_scale_fmatrix(&block, fmatrix[0].matrix);
-        if (scale_res != EI_IMPULSE_OK) {
-            return scale_res;
+        // so just apply scaling to the first one, unless the DSP block
+        // already produced the features in this block's scaling
+        const bool needs_scaling = fmatrix[0].image_scaling != block.image_scaling;
+        EI_IMPULSE_ERROR scale_res = EI_IMPULSE_OK;
+        if (needs_scaling) {
+            scale_res = ei_scale_fmatrix(&block, fmatrix[0].matrix);
+            if (scale_res != EI_IMPULSE_OK) {
+                return scale_res;
+            }
         }
 #endif
 
@@ -195,9 +200,11 @@ extern "C" EI_IMPULSE_ERROR run_inference(
 
 #if EI_CLASSIFIER_LOAD_IMAGE_SCALING
         // undo scaling
-        scale_res = ei_unscale_fmatrix(&block, fmatrix[0].matrix);
-        if (scale_res != EI_IMPULSE_OK) {
-            return scale_res;
+        if (needs_scaling) {
+            scale_res = ei_unscale_fmatrix(&block, fmatrix[0].matrix);
+            if (scale_res != EI_IMPULSE_OK) {
+                return scale_res;
+            }
         }
 #endif
     }
@@ -229,6 +236,9 @@ extern "C" EI_IMPULSE_ERROR process_impulse(ei_impulse_handle_t *handle,
         return EI_IMPULSE_INFERENCE_ERROR;
     }
 
+    // features, DSP scratch and tensor arena share one region if EIDSP_SHARED_SCRATCH_SIZE is set
+    EI_DSP_SCRATCH_SESSION();
+
 #if (EI_CLASSIFIER_QUANTIZATION_ENABLED == 1 && (EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_TFLITE || EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_TENSAIFLOW || EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_ONNX_TIDL)) || EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_DRPAI
     // Shortcut for quantized image models
     ei_learning_block_t block = handle->impulse->learning_blocks[0];
@@ -241,7 +251,7 @@ extern "C" EI_IMPULSE_ERROR process_impulse(ei_impulse_handle_t *handle,
     uint32_t block_num = handle->impulse->dsp_blocks_size + handle->impulse->learning_blocks_size;
 
     // smart pointer to features array
-    std::unique_ptr<ei_feature_t[]> features_ptr(new ei_feature_t[block_num]);
+    std::unique_ptr<ei_feature_t[]> features_ptr(new ei_feature_t[block_num]());
     ei_feature_t* features = features_ptr.get();
     memset(features, 0, sizeof(ei_feature_t) * block_num);
 
@@ -252,6 +262,34 @@ extern "C" EI_IMPULSE_ERROR process_impulse(ei_impulse_handle_t *handle,
 
     size_t out_features_index = 0;
 
+#if EI_CLASSIFIER_LOAD_IMAGE_SCALING
+    // run_inference scales the first feature matrix for every learning block;
+    // if they all want the same scaling, unpack the pixels straight into it
+    int image_scaling = handle->impulse->learning_blocks_size > 0 ?
+        handle->impulse->learning_blocks[0].image_scaling : EI_CLASSIFIER_IMAGE_SCALING_NONE;
+    for (size_t ix = 1; ix < handle->impulse->learning_blocks_size; ix++) {
+        if (handle->impulse->learning_blocks[ix].image_scaling != image_scaling) {
+            image_scaling = EI_CLASSIFIER_IMAGE_SCALING_NONE;
+        }
+    }
+#endif
+
+#if !EIDSP_SIGNAL_C_FN_POINTER && EI_CLASSIFIER_SHARED_SIGNAL_READ == 1
+    // read the window once if DSP blocks overlap in the axes they select
+    SharedSignalWindow shared_window(signal, handle->impulse);
+    shared_window.load();
+
+    // and preprocess axes once for blocks that do it the same way
+    SharedPreprocessing shared_preprocessing(handle->impulse->dsp_blocks_size);
+    for (size_t ix = 0; ix < handle->impulse->dsp_blocks_size; ix++) {
+        ei_dsp_preprocessing_t preprocessing;
+        if (ei_dsp_block_preprocessing(handle->impulse, &handle->impulse->dsp_blocks[ix], &preprocessing)) {
+            shared_preprocessing.add(ix, &preprocessing);
+        }
+    }
+    shared_preprocessing.plan();
+#endif
+
     for (size_t ix = 0; ix < handle->impulse->dsp_blocks_size; ix++) {
         ei_model_dsp_t block = handle->impulse->dsp_blocks[ix];
         matrix_ptrs[ix] = std::unique_ptr<ei::matrix_t>(new ei::matrix_t(1, block.n_output_features));
@@ -271,6 +309,10 @@ extern "C" EI_IMPULSE_ERROR process_impulse(ei_impulse_handle_t *handle,
             return EI_IMPULSE_DSP_ERROR;
         }
         auto internal_signal = signal;
+#elif EI_CLASSIFIER_SHARED_SIGNAL_READ == 1
+        SignalWithAxes swa(signal, block.axes, block.axes_size, handle->impulse, &shared_window);
+        auto internal_signal = swa.get_signal();
+        shared_preprocessing.begin_block(ix, internal_signal);
 #else
         SignalWithAxes swa(signal, block.axes, block.axes_size, handle->impulse);
         auto internal_signal = swa.get_signal();
@@ -292,10 +334,22 @@ extern "C" EI_IMPULSE_ERROR process_impulse(ei_impulse_handle_t *handle,
             } else {
                 return EI_IMPULSE_OUT_OF_MEMORY;
             }
-        } else {
+        }
+#if EI_CLASSIFIER_LOAD_IMAGE_SCALING
+        else if (ix == 0 && block.extract_fn == extract_image_features) {
+            ret = extract_image_features_scaled(internal_signal, features[ix].matrix, block.config, handle->impulse->frequency,
+                image_scaling);
+            features[ix].image_scaling = image_scaling;
+        }
+#endif
+        else {
             ret = block.extract_fn(internal_signal, features[ix].matrix, block.config, handle->impulse->frequency);
         }
 
+#if !EIDSP_SIGNAL_C_FN_POINTER && EI_CLASSIFIER_SHARED_SIGNAL_READ == 1
+        shared_preprocessing.end_block();
+#endif
+
         if (ret != EIDSP_OK) {
             ei_printf("ERR: Failed to run DSP process (%d)\n", ret);
             delete[] matrix_ptrs;
@@ -310,6 +364,11 @@ extern "C" EI_IMPULSE_ERROR process_impulse(ei_impulse_handle_t *handle,
         out_features_index += block.n_output_features;
     }
 
+#if !EIDSP_SIGNAL_C_FN_POINTER && EI_CLASSIFIER_SHARED_SIGNAL_READ == 1
+    // free before the learning blocks allocate
+    shared_window.release();
+#endif
+
 #if EI_CLASSIFIER_SINGLE_FEATURE_INPUT == 0
     for (size_t ix = 0; ix < handle->impulse->learning_blocks_size; ix++) {
         ei_learning_block_t block = handle->impulse->learning_blocks[ix];
@@ -385,6 +444,9 @@ extern "C" EI_IMPULSE_ERROR process_impulse_continuous(ei_impulse_handle_t *hand
         return EI_IMPULSE_ALLOC_FAILED;
     }
 
+    // opened after the static matrix so that one stays out of the shared region
+    EI_DSP_SCRATCH_SESSION();
+
     memset(result, 0, sizeof(ei_impulse_result_t));
 
     EI_IMPULSE_ERROR ei_impulse_error = EI_IMPULSE_OK;
@@ -416,6 +478,12 @@ extern "C" EI_IMPULSE_ERROR process_impulse_continuous(ei_impulse_handle_t *hand
         else if (block.extract_fn == extract_mfe_features) {
             extract_fn_slice = &extract_mfe_per_slice_features;
         }
+        else if (block.extract_fn == extract_mfcc_q15_features) {
+            extract_fn_slice = &extract_mfcc_q15_per_slice_features;
+        }
+        else if (block.extract_fn == extract_mfe_q15_features) {
+            extract_fn_slice = &extract_mfe_q15_per_slice_features;
+        }
         else {
             ei_printf("ERR: Unknown extract function, only MFCC, MFE and spectrogram supported\n");
             return EI_IMPULSE_DSP_ERROR;
@@ -457,7 +525,7 @@ extern "C" EI_IMPULSE_ERROR process_impulse_continuous(ei_impulse_handle_t *hand
         uint32_t block_num = impulse->dsp_blocks_size + impulse->learning_blocks_size;
 
         // smart pointer to features array
-        std::unique_ptr<ei_feature_t[]> features_ptr(new ei_feature_t[block_num]);
+        std::unique_ptr<ei_feature_t[]> features_ptr(new ei_feature_t[block_num]());
         ei_feature_t* features = features_ptr.get();
         memset(features, 0, sizeof(ei_feature_t) * block_num);
 
@@ -477,7 +545,7 @@ extern "C" EI_IMPULSE_ERROR process_impulse_continuous(ei_impulse_handle_t *hand
                 features[ix].matrix->buffer[m_ix] = static_features_matrix.buffer[out_features_index + m_ix];
             }
 
-            if (block.extract_fn == extract_mfcc_features) {
+            if (block.extract_fn == extract_mfcc_features || block.extract_fn == extract_mfcc_q15_features) {
                 calc_cepstral_mean_and_var_normalization_mfcc(features[ix].matrix, block.config);
             }
             else if (block.extract_fn == extract_spectrogram_features) {
@@ -486,6 +554,9 @@ extern "C" EI_IMPULSE_ERROR process_impulse_continuous(ei_impulse_handle_t *hand
             else if (block.extract_fn == extract_mfe_features) {
                 calc_cepstral_mean_and_var_normalization_mfe(features[ix].matrix, block.config);
             }
+            else if (block.extract_fn == extract_mfe_q15_features) {
+                calc_cepstral_mean_and_var_normalization_mfe_q15(features[ix].matrix, block.config);
+            }
             out_features_index += block.n_output_features;
         }
 
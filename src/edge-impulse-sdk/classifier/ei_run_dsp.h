@@ -21,7 +21,9 @@
 #include "edge-impulse-sdk/classifier/ei_model_types.h"
 #include "edge-impulse-sdk/dsp/spectral/spectral.hpp"
 #include "edge-impulse-sdk/dsp/speechpy/speechpy.hpp"
+#include "edge-impulse-sdk/dsp/image/convert.hpp"
 #include "edge-impulse-sdk/classifier/ei_signal_with_range.h"
+#include "edge-impulse-sdk/classifier/ei_signal_with_axes.h"
 #include "edge-impulse-sdk/dsp/ei_flatten.h"
 #include "model-parameters/model_metadata.h"
 
@@ -69,7 +71,10 @@ __attribute__((unused)) int extract_hr_features(
 #endif
 }
 
-__attribute__((unused)) int extract_spectral_analysis_features(
+/**
+ * Spectral analysis on any config, the reference for the specialised path below
+ */
+__attribute__((unused)) int extract_spectral_analysis_features_generic(
     signal_t *signal,
     matrix_t *output_matrix,
     void *config_ptr,
@@ -134,6 +139,164 @@ __attribute__((unused)) int extract_spectral_analysis_features(
     return EIDSP_NOT_SUPPORTED;
 }
 
+#if EI_DSP_PARAMS_SPECTRAL_ANALYSIS_ANALYSIS_TYPE_FFT || EI_DSP_PARAMS_ALL
+/**
+ * Spectral analysis configs that get a specialised implementation
+ * (spectral::fixed_feature), as X(axes, fft_length, filter, filter_order)
+ * with filter a spectral::filter_t. The window is always
+ * EI_CLASSIFIER_RAW_SAMPLE_COUNT. Every entry adds code, define this from the
+ * build flags to list only the configs of your impulses, or as empty to
+ * always use the generic implementation.
+ */
+#ifndef EI_SPECTRAL_ANALYSIS_FIXED_VARIANTS
+#define EI_SPECTRAL_ANALYSIS_FIXED_VARIANTS(X) \
+    X(3, 16, filter_none, 6) \
+    X(3, 32, filter_none, 6) \
+    X(3, 64, filter_none, 6) \
+    X(3, 128, filter_none, 6) \
+    X(3, 16, filter_lowpass, 6) \
+    X(3, 32, filter_lowpass, 6) \
+    X(3, 64, filter_lowpass, 6) \
+    X(3, 128, filter_lowpass, 6)
+#endif
+
+/**
+ * Whether spectral::fixed_feature with these parameters computes the same
+ * features as the generic implementation for this config and signal. The
+ * filter order is not used without a filter. Decimating configs are left to
+ * the generic path.
+ */
+template<size_t AXES, size_t WINDOW, size_t FFT_LENGTH, spectral::filter_t FILTER, uint8_t FILTER_ORDER>
+static bool spectral_analysis_fixed_matches(const signal_t *signal, const ei_dsp_config_spectral_analysis_t *config)
+{
+    return spectral::fixed_feature<AXES, WINDOW, FFT_LENGTH, FILTER, FILTER_ORDER>::fits_on_stack &&
+        config->axes == AXES && config->fft_length == FFT_LENGTH &&
+        spectral::filter_from_name(config->filter_type) == FILTER &&
+        (FILTER == spectral::filter_none || config->filter_order == FILTER_ORDER) &&
+        config->input_decimation_ratio == 1 && signal->total_length == AXES * WINDOW &&
+        (config->implementation_version == 2 || config->implementation_version == 3) &&
+        strcmp(config->analysis_type, "FFT") == 0;
+}
+
+/**
+ * Spectral analysis specialised on the template parameters, see
+ * spectral::fixed_feature. Falls back to the generic implementation when the
+ * config or the signal does not match them, or when the buffers would take
+ * more than EIDSP_SPECTRAL_FIXED_MAX_STACK of stack.
+ */
+template<size_t AXES, size_t WINDOW, size_t FFT_LENGTH, spectral::filter_t FILTER, uint8_t FILTER_ORDER>
+__attribute__((unused)) int extract_spectral_analysis_features_fixed(
+    signal_t *signal,
+    matrix_t *output_matrix,
+    void *config_ptr,
+    const float frequency)
+{
+    typedef spectral::fixed_feature<AXES, WINDOW, FFT_LENGTH, FILTER, FILTER_ORDER> fixed_feature_t;
+    ei_dsp_config_spectral_analysis_t *config = (ei_dsp_config_spectral_analysis_t *)config_ptr;
+
+    if (!spectral_analysis_fixed_matches<AXES, WINDOW, FFT_LENGTH, FILTER, FILTER_ORDER>(signal, config)) {
+        return extract_spectral_analysis_features_generic(signal, output_matrix, config_ptr, frequency);
+    }
+
+    return fixed_feature_t::extract(signal, output_matrix, config, frequency);
+}
+
+/**
+ * @brief      Specialised implementation for a spectral analysis config, looked
+ *             up in EI_SPECTRAL_ANALYSIS_FIXED_VARIANTS
+ *
+ * @return     The extract function, or nullptr if none matches
+ */
+__attribute__((unused)) static extract_fn_t spectral_analysis_fixed_fn(
+    const signal_t *signal,
+    const ei_dsp_config_spectral_analysis_t *config)
+{
+#define EI_SPECTRAL_ANALYSIS_FIXED_LOOKUP(axes, fft_length, filter, filter_order) \
+    if (spectral_analysis_fixed_matches<axes, EI_CLASSIFIER_RAW_SAMPLE_COUNT, fft_length, \
+            spectral::filter, filter_order>(signal, config)) { \
+        return &extract_spectral_analysis_features_fixed<axes, EI_CLASSIFIER_RAW_SAMPLE_COUNT, \
+            fft_length, spectral::filter, filter_order>; \
+    }
+
+    EI_SPECTRAL_ANALYSIS_FIXED_VARIANTS(EI_SPECTRAL_ANALYSIS_FIXED_LOOKUP)
+#undef EI_SPECTRAL_ANALYSIS_FIXED_LOOKUP
+
+    (void)signal;
+    (void)config;
+    return nullptr;
+}
+#endif // EI_DSP_PARAMS_SPECTRAL_ANALYSIS_ANALYSIS_TYPE_FFT || EI_DSP_PARAMS_ALL
+
+#if !EIDSP_SIGNAL_C_FN_POINTER && EI_CLASSIFIER_SHARED_SIGNAL_READ == 1
+/**
+ * Spectral analysis (FFT) of a block whose transpose, scale and filter are
+ * shared with other blocks of the impulse. The first block of the group
+ * preprocesses the window and stores it, the others start from the stored
+ * copy. extract_spec_features then runs with the filter already applied, as
+ * the decimating v4 path does.
+ */
+static int extract_spectral_analysis_features_shared(
+    SharedPreprocessing *shared,
+    signal_t *signal,
+    matrix_t *output_matrix,
+    ei_dsp_config_spectral_analysis_t *config,
+    const float frequency)
+{
+    // one row per axis
+    matrix_t input_matrix(config->axes, signal->total_length / config->axes);
+    if (!input_matrix.buffer) {
+        EIDSP_ERR(EIDSP_OUT_OF_MEM);
+    }
+    const size_t size = input_matrix.rows * input_matrix.cols;
+
+    const float *preprocessed = shared->get(size);
+    if (preprocessed) {
+        memcpy(input_matrix.buffer, preprocessed, size * sizeof(float));
+    }
+    else {
+        input_matrix.rows = signal->total_length / config->axes;
+        input_matrix.cols = config->axes;
+        EI_TRY(signal->get_data(0, size, input_matrix.buffer));
+        numpy::transpose_in_place(&input_matrix);
+        EI_TRY(numpy::scale(&input_matrix, config->scale_axes));
+        EI_TRY(spectral::feature::filter_spec_input(&input_matrix, config, frequency));
+        shared->put(input_matrix.buffer, size);
+    }
+
+    ei_dsp_config_spectral_analysis_t filtered_config = *config;
+    filtered_config.filter_order = 0;
+    size_t n_features = spectral::feature::extract_spec_features(
+        &input_matrix, output_matrix, &filtered_config, frequency, true, false);
+    return n_features == output_matrix->cols ? EIDSP_OK : EIDSP_MATRIX_SIZE_MISMATCH;
+}
+#endif // !EIDSP_SIGNAL_C_FN_POINTER && EI_CLASSIFIER_SHARED_SIGNAL_READ == 1
+
+__attribute__((unused)) int extract_spectral_analysis_features(
+    signal_t *signal,
+    matrix_t *output_matrix,
+    void *config_ptr,
+    const float frequency)
+{
+#if !EIDSP_SIGNAL_C_FN_POINTER && EI_CLASSIFIER_SHARED_SIGNAL_READ == 1
+    // only set for blocks ei_dsp_block_preprocessing accepted
+    SharedPreprocessing *shared = SharedPreprocessing::active(signal);
+    if (shared) {
+        return extract_spectral_analysis_features_shared(
+            shared, signal, output_matrix, (ei_dsp_config_spectral_analysis_t *)config_ptr, frequency);
+    }
+#endif
+
+#if EI_DSP_PARAMS_SPECTRAL_ANALYSIS_ANALYSIS_TYPE_FFT || EI_DSP_PARAMS_ALL
+    extract_fn_t fixed_fn = spectral_analysis_fixed_fn(
+        signal, (ei_dsp_config_spectral_analysis_t *)config_ptr);
+    if (fixed_fn) {
+        return fixed_fn(signal, output_matrix, config_ptr, frequency);
+    }
+#endif
+
+    return extract_spectral_analysis_features_generic(signal, output_matrix, config_ptr, frequency);
+}
+
 __attribute__((unused)) int extract_raw_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float frequency) {
     ei_dsp_config_raw_t config = *((ei_dsp_config_raw_t*)config_ptr);
 
@@ -169,7 +332,7 @@ static int preemphasized_audio_signal_get_data(size_t offset, size_t length, flo
     return preemphasis->get_data(offset, length, out_ptr);
 }
 
-__attribute__((unused)) int extract_mfcc_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency) {
+static int extract_mfcc_features_impl(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency, bool fixed_point) {
     ei_dsp_config_mfcc_t config = *((ei_dsp_config_mfcc_t*)config_ptr);
 
     if (config.axes != 1) {
@@ -209,7 +372,8 @@ __attribute__((unused)) int extract_mfcc_features(signal_t *signal, matrix_t *ou
     output_matrix->cols = out_matrix_size.cols;
 
     // and run the MFCC extraction
-    int ret = speechpy::feature::mfcc(output_matrix, &preemphasized_audio_signal,
+    auto mfcc_fn = fixed_point ? &speechpy::feature_q15::mfcc : &speechpy::feature::mfcc;
+    int ret = mfcc_fn(output_matrix, &preemphasized_audio_signal,
         frequency, config.frame_length, config.frame_stride, config.num_cepstral, config.num_filters, config.fft_length,
         config.low_frequency, config.high_frequency, true, config.implementation_version);
     if (ret != EIDSP_OK) {
@@ -230,8 +394,20 @@ __attribute__((unused)) int extract_mfcc_features(signal_t *signal, matrix_t *ou
     return EIDSP_OK;
 }
 
+__attribute__((unused)) int extract_mfcc_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency) {
+    return extract_mfcc_features_impl(signal, output_matrix, config_ptr, sampling_frequency, false);
+}
 
-__attribute__((unused)) static int extract_mfcc_run_slice(signal_t *signal, matrix_t *output_matrix, ei_dsp_config_mfcc_t *config, const float sampling_frequency, matrix_size_t *matrix_size_out, int implementation_version) {
+/**
+ * MFCC with the fixed-point pipeline (speechpy::feature_q15), select it per
+ * block by putting it in extract_fn of the block in model_variables.h
+ */
+__attribute__((unused)) int extract_mfcc_q15_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency) {
+    return extract_mfcc_features_impl(signal, output_matrix, config_ptr, sampling_frequency, true);
+}
+
+
+__attribute__((unused)) static int extract_mfcc_run_slice(signal_t *signal, matrix_t *output_matrix, ei_dsp_config_mfcc_t *config, const float sampling_frequency, matrix_size_t *matrix_size_out, int implementation_version, bool fixed_point) {
     uint32_t frequency = (uint32_t)sampling_frequency;
 
     int x;
@@ -257,7 +433,8 @@ __attribute__((unused)) static int extract_mfcc_run_slice(signal_t *signal, matr
     matrix_t output_matrix_slice(out_matrix_size.rows, out_matrix_size.cols, output_matrix->buffer + output_matrix_offset);
 
     // and run the MFCC extraction
-    x = speechpy::feature::mfcc(&output_matrix_slice, signal,
+    auto mfcc_fn = fixed_point ? &speechpy::feature_q15::mfcc : &speechpy::feature::mfcc;
+    x = mfcc_fn(&output_matrix_slice, signal,
         frequency, config->frame_length, config->frame_stride, config->num_cepstral, config->num_filters, config->fft_length,
         config->low_frequency, config->high_frequency, true, implementation_version);
     if (x != EIDSP_OK) {
@@ -273,7 +450,7 @@ __attribute__((unused)) static int extract_mfcc_run_slice(signal_t *signal, matr
     return EIDSP_OK;
 }
 
-__attribute__((unused)) int extract_mfcc_per_slice_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency, matrix_size_t *matrix_size_out) {
+static int extract_mfcc_per_slice_features_impl(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency, matrix_size_t *matrix_size_out, bool fixed_point) {
 #if defined(__cplusplus) && EI_C_LINKAGE == 1
     ei_printf("ERR: Continuous audio is not supported when EI_C_LINKAGE is defined\n");
     EIDSP_ERR(EIDSP_NOT_SUPPORTED);
@@ -376,7 +553,7 @@ __attribute__((unused)) int extract_mfcc_per_slice_features(signal_t *signal, ma
             EIDSP_ERR(x);
         }
 
-        x = extract_mfcc_run_slice(&frame_signal, output_matrix, &config, sampling_frequency, matrix_size_out, implementation_version);
+        x = extract_mfcc_run_slice(&frame_signal, output_matrix, &config, sampling_frequency, matrix_size_out, implementation_version, fixed_point);
         if (x != EIDSP_OK) {
             EIDSP_ERR(x);
         }
@@ -406,7 +583,7 @@ __attribute__((unused)) int extract_mfcc_per_slice_features(signal_t *signal, ma
     size_t range_signal_orig_length = range_signal->total_length;
 
     // then we'll just go through normal processing of the signal:
-    x = extract_mfcc_run_slice(range_signal, output_matrix, &config, sampling_frequency, matrix_size_out, implementation_version);
+    x = extract_mfcc_run_slice(range_signal, output_matrix, &config, sampling_frequency, matrix_size_out, implementation_version, fixed_point);
     if (x != EIDSP_OK) {
         EIDSP_ERR(x);
     }
@@ -442,6 +619,14 @@ __attribute__((unused)) int extract_mfcc_per_slice_features(signal_t *signal, ma
 #endif
 }
 
+__attribute__((unused)) int extract_mfcc_per_slice_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency, matrix_size_t *matrix_size_out) {
+    return extract_mfcc_per_slice_features_impl(signal, output_matrix, config_ptr, sampling_frequency, matrix_size_out, false);
+}
+
+__attribute__((unused)) int extract_mfcc_q15_per_slice_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency, matrix_size_t *matrix_size_out) {
+    return extract_mfcc_per_slice_features_impl(signal, output_matrix, config_ptr, sampling_frequency, matrix_size_out, true);
+}
+
 __attribute__((unused)) int extract_spectrogram_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency) {
     ei_dsp_config_spectrogram_t config = *((ei_dsp_config_spectrogram_t*)config_ptr);
 
@@ -711,7 +896,7 @@ __attribute__((unused)) int extract_spectrogram_per_slice_features(signal_t *sig
 }
 
 
-__attribute__((unused)) int extract_mfe_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency) {
+static int extract_mfe_features_impl(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency, bool fixed_point) {
     ei_dsp_config_mfe_t config = *((ei_dsp_config_mfe_t*)config_ptr);
 
     if (config.axes != 1) {
@@ -770,7 +955,8 @@ __attribute__((unused)) int extract_mfe_features(signal_t *signal, matrix_t *out
     // So for v2 and v1, we'll just use the old code
     // (the new mfe does away with the intermediate filterbank matrix)
     if (config.implementation_version > 2) {
-        ret = speechpy::feature::mfe(output_matrix, nullptr, &preemphasized_audio_signal,
+        auto mfe_fn = fixed_point ? &speechpy::feature_q15::mfe : &speechpy::feature::mfe;
+        ret = mfe_fn(output_matrix, nullptr, &preemphasized_audio_signal,
             frequency, config.frame_length, config.frame_stride, config.num_filters, config.fft_length,
             config.low_frequency, config.high_frequency, config.implementation_version);
     } else {
@@ -797,7 +983,8 @@ __attribute__((unused)) int extract_mfe_features(signal_t *signal, matrix_t *out
     }
     else {
         // normalization
-        ret = speechpy::processing::mfe_normalization(output_matrix, config.noise_floor_db);
+        auto normalization_fn = fixed_point ? &speechpy::feature_q15::mfe_normalization : &speechpy::processing::mfe_normalization;
+        ret = normalization_fn(output_matrix, config.noise_floor_db);
         if (ret != EIDSP_OK) {
             ei_printf("ERR: normalization failed (%d)\n", ret);
             EIDSP_ERR(ret);
@@ -810,7 +997,20 @@ __attribute__((unused)) int extract_mfe_features(signal_t *signal, matrix_t *out
     return EIDSP_OK;
 }
 
-__attribute__((unused)) static int extract_mfe_run_slice(signal_t *signal, matrix_t *output_matrix, ei_dsp_config_mfe_t *config, const float sampling_frequency, matrix_size_t *matrix_size_out) {
+__attribute__((unused)) int extract_mfe_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency) {
+    return extract_mfe_features_impl(signal, output_matrix, config_ptr, sampling_frequency, false);
+}
+
+/**
+ * MFE with the fixed-point pipeline (speechpy::feature_q15), select it per
+ * block by putting it in extract_fn of the block in model_variables.h.
+ * Implementation versions 1 and 2 still run in float.
+ */
+__attribute__((unused)) int extract_mfe_q15_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency) {
+    return extract_mfe_features_impl(signal, output_matrix, config_ptr, sampling_frequency, true);
+}
+
+__attribute__((unused)) static int extract_mfe_run_slice(signal_t *signal, matrix_t *output_matrix, ei_dsp_config_mfe_t *config, const float sampling_frequency, matrix_size_t *matrix_size_out, bool fixed_point) {
     uint32_t frequency = (uint32_t)sampling_frequency;
 
     int x;
@@ -841,7 +1041,8 @@ __attribute__((unused)) static int extract_mfe_run_slice(signal_t *signal, matri
     // So for v2 and v1, we'll just use the old code
     // (the new mfe does away with the intermediate filterbank matrix)
     if (config->implementation_version > 2) {
-         x = speechpy::feature::mfe(&output_matrix_slice, nullptr, signal,
+        auto mfe_fn = fixed_point ? &speechpy::feature_q15::mfe : &speechpy::feature::mfe;
+        x = mfe_fn(&output_matrix_slice, nullptr, signal,
             frequency, config->frame_length, config->frame_stride, config->num_filters, config->fft_length,
             config->low_frequency, config->high_frequency, config->implementation_version);
     } else {
@@ -862,7 +1063,7 @@ __attribute__((unused)) static int extract_mfe_run_slice(signal_t *signal, matri
     return EIDSP_OK;
 }
 
-__attribute__((unused)) int extract_mfe_per_slice_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency, matrix_size_t *matrix_size_out) {
+static int extract_mfe_per_slice_features_impl(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency, matrix_size_t *matrix_size_out, bool fixed_point) {
 #if defined(__cplusplus) && EI_C_LINKAGE == 1
     ei_printf("ERR: Continuous audio is not supported when EI_C_LINKAGE is defined\n");
     EIDSP_ERR(EIDSP_NOT_SUPPORTED);
@@ -1000,7 +1201,7 @@ __attribute__((unused)) int extract_mfe_per_slice_features(signal_t *signal, mat
             EIDSP_ERR(x);
         }
 
-        x = extract_mfe_run_slice(&frame_signal, output_matrix, &config, sampling_frequency, matrix_size_out);
+        x = extract_mfe_run_slice(&frame_signal, output_matrix, &config, sampling_frequency, matrix_size_out, fixed_point);
         if (x != EIDSP_OK) {
             if (preemphasis) {
                 delete preemphasis;
@@ -1036,7 +1237,7 @@ __attribute__((unused)) int extract_mfe_per_slice_features(signal_t *signal, mat
     size_t range_signal_orig_length = range_signal->total_length;
 
     // then we'll just go through normal processing of the signal:
-    x = extract_mfe_run_slice(range_signal, output_matrix, &config, sampling_frequency, matrix_size_out);
+    x = extract_mfe_run_slice(range_signal, output_matrix, &config, sampling_frequency, matrix_size_out, fixed_point);
     if (x != EIDSP_OK) {
         if (preemphasis) {
             delete preemphasis;
@@ -1087,7 +1288,38 @@ __attribute__((unused)) int extract_mfe_per_slice_features(signal_t *signal, mat
 #endif
 }
 
-__attribute__((unused)) int extract_image_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float frequency) {
+__attribute__((unused)) int extract_mfe_per_slice_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency, matrix_size_t *matrix_size_out) {
+    return extract_mfe_per_slice_features_impl(signal, output_matrix, config_ptr, sampling_frequency, matrix_size_out, false);
+}
+
+__attribute__((unused)) int extract_mfe_q15_per_slice_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float sampling_frequency, matrix_size_t *matrix_size_out) {
+    return extract_mfe_per_slice_features_impl(signal, output_matrix, config_ptr, sampling_frequency, matrix_size_out, true);
+}
+
+/**
+ * Map a learning block's image_scaling to the per channel scaling applied
+ * while unpacking pixels
+ */
+static const ei::image::convert::pixel_scaling_t *image_scaling_to_pixel_scaling(int image_scaling) {
+    switch (image_scaling) {
+        case EI_CLASSIFIER_IMAGE_SCALING_0_255:
+            return &ei::image::convert::SCALING_0_255;
+        case EI_CLASSIFIER_IMAGE_SCALING_TORCH:
+            return &ei::image::convert::SCALING_TORCH;
+        case EI_CLASSIFIER_IMAGE_SCALING_MIN1_1:
+            return &ei::image::convert::SCALING_MIN1_1;
+        case EI_CLASSIFIER_IMAGE_SCALING_MIN128_127:
+            return &ei::image::convert::SCALING_MIN128_127;
+        case EI_CLASSIFIER_IMAGE_SCALING_BGR_SUBTRACT_IMAGENET_MEAN:
+            return &ei::image::convert::SCALING_BGR_SUBTRACT_IMAGENET_MEAN;
+        case EI_CLASSIFIER_IMAGE_SCALING_NONE:
+        default:
+            return &ei::image::convert::SCALING_0_1;
+    }
+}
+
+static int extract_image_features_impl(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float frequency,
+                                       const ei::image::convert::pixel_scaling_t *scaling) {
     ei_dsp_config_image_t config = *((ei_dsp_config_image_t*)config_ptr);
 
     int16_t channel_count = strcmp(config.channels, "Grayscale") == 0 ? 1 : 3;
@@ -1115,26 +1347,9 @@ __attribute__((unused)) int extract_image_features(signal_t *signal, matrix_t *o
         }
         signal->get_data(ix, elements_to_read, input_matrix.buffer);
 
-        for (size_t jx = 0; jx < elements_to_read; jx++) {
-            uint32_t pixel = static_cast<uint32_t>(input_matrix.buffer[jx]);
-
-            // rgb to 0..1
-            float r = static_cast<float>(pixel >> 16 & 0xff) / 255.0f;
-            float g = static_cast<float>(pixel >> 8 & 0xff) / 255.0f;
-            float b = static_cast<float>(pixel & 0xff) / 255.0f;
-
-            if (channel_count == 3) {
-                output_matrix->buffer[output_ix++] = r;
-                output_matrix->buffer[output_ix++] = g;
-                output_matrix->buffer[output_ix++] = b;
-            }
-            else {
-                // ITU-R 601-2 luma transform
-                // see: https://pillow.readthedocs.io/en/stable/reference/Image.html#PIL.Image.Image.convert
-                float v = (0.299f * r) + (0.587f * g) + (0.114f * b);
-                output_matrix->buffer[output_ix++] = v;
-            }
-        }
+        ei::image::convert::to_float(input_matrix.buffer, ei::image::convert::FORMAT_PACKED, elements_to_read,
+            channel_count == 1, scaling, output_matrix->buffer + output_ix);
+        output_ix += elements_to_read * channel_count;
 
         bytes_left -= elements_to_read;
     }
@@ -1142,6 +1357,21 @@ __attribute__((unused)) int extract_image_features(signal_t *signal, matrix_t *o
     return EIDSP_OK;
 }
 
+__attribute__((unused)) int extract_image_features(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float frequency) {
+    // rgb to 0..1
+    return extract_image_features_impl(signal, output_matrix, config_ptr, frequency, &ei::image::convert::SCALING_0_1);
+}
+
+/**
+ * Image features with the learning block's image scaling already applied,
+ * so the features can be handed to the model without another pass
+ */
+__attribute__((unused)) int extract_image_features_scaled(signal_t *signal, matrix_t *output_matrix, void *config_ptr, const float frequency,
+                                                          int image_scaling) {
+    return extract_image_features_impl(signal, output_matrix, config_ptr, frequency,
+        image_scaling_to_pixel_scaling(image_scaling));
+}
+
 #if (EI_CLASSIFIER_QUANTIZATION_ENABLED == 1) && (EI_CLASSIFIER_INFERENCING_ENGINE == EI_CLASSIFIER_DRPAI)
 
 __attribute__((unused)) int extract_drpai_features_quantized(signal_t *signal, matrix_u8_t *output_matrix, void *config_ptr, const float frequency) {
@@ -1206,12 +1436,7 @@ __attribute__((unused)) int extract_image_features_quantized(signal_t *signal, m
 
     size_t output_ix = 0;
 
-    const int32_t iRedToGray = (int32_t)(0.299f * 65536.0f);
-    const int32_t iGreenToGray = (int32_t)(0.587f * 65536.0f);
-    const int32_t iBlueToGray = (int32_t)(0.114f * 65536.0f);
-
-    static const float torch_mean[] = { 0.485, 0.456, 0.406 };
-    static const float torch_std[] = { 0.229, 0.224, 0.225 };
+    const ei::image::convert::pixel_scaling_t *scaling = image_scaling_to_pixel_scaling(image_scaling);
 
 #if defined(EI_DSP_IMAGE_BUFFER_STATIC_SIZE)
     const size_t page_size = EI_DSP_IMAGE_BUFFER_STATIC_SIZE;
@@ -1234,100 +1459,9 @@ __attribute__((unused)) int extract_image_features_quantized(signal_t *signal, m
         }
         signal->get_data(ix, elements_to_read, input_matrix.buffer);
 
-        for (size_t jx = 0; jx < elements_to_read; jx++) {
-            uint32_t pixel = static_cast<uint32_t>(input_matrix.buffer[jx]);
-
-            if (channel_count == 3) {
-                // fast code path
-                if (scale == 0.003921568859368563f && zero_point == -128 && image_scaling == EI_CLASSIFIER_IMAGE_SCALING_NONE) {
-                    int32_t r = static_cast<int32_t>(pixel >> 16 & 0xff);
-                    int32_t g = static_cast<int32_t>(pixel >> 8 & 0xff);
-                    int32_t b = static_cast<int32_t>(pixel & 0xff);
-
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(r + zero_point);
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(g + zero_point);
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(b + zero_point);
-                }
-                // slow code path
-                else {
-                    float r = static_cast<float>(pixel >> 16 & 0xff);
-                    float g = static_cast<float>(pixel >> 8 & 0xff);
-                    float b = static_cast<float>(pixel & 0xff);
-
-                    if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_NONE) {
-                        r /= 255.0f;
-                        g /= 255.0f;
-                        b /= 255.0f;
-                    }
-                    else if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_TORCH) {
-                        r /= 255.0f;
-                        g /= 255.0f;
-                        b /= 255.0f;
-
-                        r = (r - torch_mean[0]) / torch_std[0];
-                        g = (g - torch_mean[1]) / torch_std[1];
-                        b = (b - torch_mean[2]) / torch_std[2];
-                    }
-                    else if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_MIN128_127) {
-                        r -= 128.0f;
-                        g -= 128.0f;
-                        b -= 128.0f;
-                    }
-
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(round(r / scale) + zero_point);
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(round(g / scale) + zero_point);
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(round(b / scale) + zero_point);
-                }
-            }
-            else {
-                // fast code path
-                if (scale == 0.003921568859368563f && zero_point == -128 && image_scaling == EI_CLASSIFIER_IMAGE_SCALING_NONE) {
-                    int32_t r = static_cast<int32_t>(pixel >> 16 & 0xff);
-                    int32_t g = static_cast<int32_t>(pixel >> 8 & 0xff);
-                    int32_t b = static_cast<int32_t>(pixel & 0xff);
-
-                    // ITU-R 601-2 luma transform
-                    // see: https://pillow.readthedocs.io/en/stable/reference/Image.html#PIL.Image.Image.convert
-                    int32_t gray = (iRedToGray * r) + (iGreenToGray * g) + (iBlueToGray * b);
-                    gray >>= 16; // scale down to int8_t
-                    gray += zero_point;
-                    if (gray < - 128) gray = -128;
-                    else if (gray > 127) gray = 127;
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(gray);
-                }
-                // slow code path
-                else {
-                    float r = static_cast<float>(pixel >> 16 & 0xff);
-                    float g = static_cast<float>(pixel >> 8 & 0xff);
-                    float b = static_cast<float>(pixel & 0xff);
-
-                    if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_NONE) {
-                        r /= 255.0f;
-                        g /= 255.0f;
-                        b /= 255.0f;
-                    }
-                    else if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_TORCH) {
-                        r /= 255.0f;
-                        g /= 255.0f;
-                        b /= 255.0f;
-
-                        r = (r - torch_mean[0]) / torch_std[0];
-                        g = (g - torch_mean[1]) / torch_std[1];
-                        b = (b - torch_mean[2]) / torch_std[2];
-                    }
-                    else if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_MIN128_127) {
-                        r -= 128.0f;
-                        g -= 128.0f;
-                        b -= 128.0f;
-                    }
-
-                    // ITU-R 601-2 luma transform
-                    // see: https://pillow.readthedocs.io/en/stable/reference/Image.html#PIL.Image.Image.convert
-                    float v = (0.299f * r) + (0.587f * g) + (0.114f * b);
-                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(round(v / scale) + zero_point);
-                }
-            }
-        }
+        ei::image::convert::to_int8(input_matrix.buffer, ei::image::convert::FORMAT_PACKED, elements_to_read,
+            channel_count == 1, scaling, scale, zero_point, output_matrix->buffer + output_ix);
+        output_ix += elements_to_read * channel_count;
 
         bytes_left -= elements_to_read;
 
@@ -1385,7 +1519,7 @@ __attribute__((unused)) void calc_cepstral_mean_and_var_normalization_mfcc(ei_ma
  * @param      matrix      Source and destination matrix
  * @param      config_ptr  ei_dsp_config_mfe_t struct pointer
  */
-__attribute__((unused)) void calc_cepstral_mean_and_var_normalization_mfe(ei_matrix *matrix, void *config_ptr)
+static void calc_cepstral_mean_and_var_normalization_mfe_impl(ei_matrix *matrix, void *config_ptr, bool fixed_point)
 {
     ei_dsp_config_mfe_t *config = (ei_dsp_config_mfe_t *)config_ptr;
 
@@ -1405,7 +1539,8 @@ __attribute__((unused)) void calc_cepstral_mean_and_var_normalization_mfe(ei_mat
     }
     else {
         // normalization
-        int ret = speechpy::processing::mfe_normalization(matrix, config->noise_floor_db);
+        auto normalization_fn = fixed_point ? &speechpy::feature_q15::mfe_normalization : &speechpy::processing::mfe_normalization;
+        int ret = normalization_fn(matrix, config->noise_floor_db);
         if (ret != EIDSP_OK) {
             ei_printf("ERR: normalization failed (%d)\n", ret);
             return;
@@ -1417,6 +1552,22 @@ __attribute__((unused)) void calc_cepstral_mean_and_var_normalization_mfe(ei_mat
     matrix->cols = (original_matrix_size);
 }
 
+__attribute__((unused)) void calc_cepstral_mean_and_var_normalization_mfe(ei_matrix *matrix, void *config_ptr)
+{
+    calc_cepstral_mean_and_var_normalization_mfe_impl(matrix, config_ptr, false);
+}
+
+/**
+ * @brief      Normalization for blocks that use extract_mfe_q15_features
+ *
+ * @param      matrix      Source and destination matrix
+ * @param      config_ptr  ei_dsp_config_mfe_t struct pointer
+ */
+__attribute__((unused)) void calc_cepstral_mean_and_var_normalization_mfe_q15(ei_matrix *matrix, void *config_ptr)
+{
+    calc_cepstral_mean_and_var_normalization_mfe_impl(matrix, config_ptr, true);
+}
+
 /**
  * @brief      Calculates the cepstral mean and variable normalization.
  *
@@ -1454,6 +1605,94 @@ __attribute__((unused)) void calc_cepstral_mean_and_var_normalization_spectrogra
     matrix->cols = (original_matrix_size);
 }
 
+/**
+ * @brief      Size of the config struct an extract function expects, so two
+ *             blocks can be compared by their config contents.
+ *
+ * @param      extract_fn  Extract function of a DSP block
+ *
+ * @return     sizeof the config struct, or 0 if the function is not a stock
+ *             DSP block (custom blocks)
+ */
+__attribute__((unused)) size_t ei_dsp_config_size(int (*extract_fn)(signal_t*, matrix_t*, void*, const float))
+{
+    if (extract_fn == extract_raw_features) {
+        return sizeof(ei_dsp_config_raw_t);
+    }
+    if (extract_fn == extract_flatten_features) {
+        return sizeof(ei_dsp_config_flatten_t);
+    }
+    if (extract_fn == extract_mfcc_features || extract_fn == extract_mfcc_q15_features) {
+        return sizeof(ei_dsp_config_mfcc_t);
+    }
+    if (extract_fn == extract_mfe_features || extract_fn == extract_mfe_q15_features) {
+        return sizeof(ei_dsp_config_mfe_t);
+    }
+    if (extract_fn == extract_spectrogram_features) {
+        return sizeof(ei_dsp_config_spectrogram_t);
+    }
+    if (extract_fn == extract_image_features) {
+        return sizeof(ei_dsp_config_image_t);
+    }
+    if (extract_fn == extract_spectral_analysis_features) {
+        return sizeof(ei_dsp_config_spectral_analysis_t);
+    }
+    return 0;
+}
+
+#if !EIDSP_SIGNAL_C_FN_POINTER && EI_CLASSIFIER_SHARED_SIGNAL_READ == 1
+/**
+ * @brief      Preprocessing of a DSP block that other blocks may share, see
+ *             SharedPreprocessing. Spectral analysis (FFT, not decimating)
+ *             blocks that take the generic path: the fixed implementations
+ *             keep their buffers on the stack.
+ *
+ * @param      impulse        Impulse of the block
+ * @param      block          The DSP block
+ * @param[out] preprocessing  Filled in if the block has one
+ *
+ * @return     true if the block preprocesses its axes in a shareable way
+ */
+__attribute__((unused)) static bool ei_dsp_block_preprocessing(
+    const ei_impulse_t *impulse,
+    const ei_model_dsp_t *block,
+    ei_dsp_preprocessing_t *preprocessing)
+{
+    if (block->factory || block->extract_fn != extract_spectral_analysis_features) {
+        return false;
+    }
+
+    ei_dsp_config_spectral_analysis_t *config = (ei_dsp_config_spectral_analysis_t *)block->config;
+    if (strcmp(config->analysis_type, "FFT") != 0 || config->axes != (int)block->axes_size ||
+        config->input_decimation_ratio != 1) {
+        return false;
+    }
+    if (config->implementation_version != 2 && config->implementation_version != 3 &&
+        !(config->implementation_version == 4 && !config->extra_low_freq)) {
+        return false;
+    }
+
+#if EI_DSP_PARAMS_SPECTRAL_ANALYSIS_ANALYSIS_TYPE_FFT || EI_DSP_PARAMS_ALL
+    signal_t block_signal;
+    block_signal.total_length = impulse->dsp_input_frame_size / impulse->raw_samples_per_frame * block->axes_size;
+    if (spectral_analysis_fixed_fn(&block_signal, config)) {
+        return false;
+    }
+#endif
+
+    const bool filtered = config->filter_order != 0 &&
+        (strcmp(config->filter_type, "low") == 0 || strcmp(config->filter_type, "high") == 0);
+
+    preprocessing->axes = block->axes;
+    preprocessing->axes_size = block->axes_size;
+    preprocessing->scale = config->scale_axes;
+    preprocessing->filter_type = filtered ? config->filter_type : "none";
+    preprocessing->filter_cutoff = filtered ? config->filter_cutoff : 0.0f;
+    preprocessing->filter_order = filtered ? config->filter_order : 0;
+    return true;
+}
+#endif // !EIDSP_SIGNAL_C_FN_POINTER && EI_CLASSIFIER_SHARED_SIGNAL_READ == 1
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
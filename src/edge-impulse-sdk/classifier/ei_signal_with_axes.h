@@ -21,21 +21,398 @@
 #include "edge-impulse-sdk/dsp/numpy_types.h"
 #include "edge-impulse-sdk/dsp/returntypes.hpp"
 #include "edge-impulse-sdk/classifier/ei_model_types.h"
+#include "edge-impulse-sdk/dsp/memory.hpp"
+#include <string.h>
+
+/**
+ * Read the window once in process_impulse when several DSP blocks select
+ * the same axes, instead of once per block, and transpose, scale and filter
+ * axes once for blocks that preprocess them the same way (see
+ * SharedPreprocessing). Costs (frames * axes used) floats for the duration of
+ * the DSP blocks, so it's opt-in.
+ */
+#ifndef EI_CLASSIFIER_SHARED_SIGNAL_READ
+#define EI_CLASSIFIER_SHARED_SIGNAL_READ 0
+#endif
 
 #if !EIDSP_SIGNAL_C_FN_POINTER
 
 using namespace ei;
 
-class SignalWithAxes {
+/**
+ * The window of an impulse, read once for all of its DSP blocks.
+ * Only axes that any block selects are kept, interleaved per frame like the
+ * original signal. Blocks read it through SignalWithAxes.
+ */
+class SharedSignalWindow {
 public:
-    SignalWithAxes(signal_t *original_signal, uint8_t *axes, size_t axes_count, const ei_impulse_t *impulse):
-        _original_signal(original_signal), _axes(axes), _axes_count(axes_count), _impulse(impulse)
+    SharedSignalWindow(signal_t *original_signal, const ei_impulse_t *impulse):
+        _original_signal(original_signal), _impulse(impulse),
+        _buffer(nullptr), _column(nullptr), _columns(0), _frames(0)
     {
 
     }
 
+    ~SharedSignalWindow() {
+        release();
+    }
+
+    /**
+     * Read the window if at least two DSP blocks share an axis
+     * @returns true if the window is loaded, false if blocks should read the
+     *          original signal (no overlap, out of memory or read failure)
+     */
+    bool load() {
+        const size_t per_frame = _impulse->raw_samples_per_frame;
+
+        if (_impulse->dsp_blocks_size < 2 || per_frame == 0) {
+            return false;
+        }
+
+        // number of blocks using every axis, turned into the column map below
+        _column = (uint16_t*)ei_calloc(per_frame, sizeof(uint16_t));
+        if (!_column) {
+            return false;
+        }
+
+        bool overlap = false;
+        for (size_t ix = 0; ix < _impulse->dsp_blocks_size; ix++) {
+            const ei_model_dsp_t *block = &_impulse->dsp_blocks[ix];
+            for (size_t axis_ix = 0; axis_ix < block->axes_size; axis_ix++) {
+                uint8_t axis = block->axes[axis_ix];
+                if (axis >= per_frame) {
+                    release();
+                    return false;
+                }
+                if (_column[axis] > 0) {
+                    overlap = true;
+                }
+                _column[axis] = 1;
+            }
+        }
+
+        if (!overlap) {
+            release();
+            return false;
+        }
+
+        _columns = 0;
+        for (size_t axis = 0; axis < per_frame; axis++) {
+            _column[axis] = _column[axis] ? static_cast<uint16_t>(_columns++) : UNUSED_COLUMN;
+        }
+
+        _frames = _original_signal->total_length / per_frame;
+        _buffer = (float*)ei_dsp_heap_malloc(_frames * _columns * sizeof(float));
+        if (!_buffer) {
+            release();
+            return false;
+        }
+
+        int r = _columns == per_frame ? read_all() : read_used();
+        if (r != 0) {
+            release();
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Free the window; call once the DSP blocks are done so the memory can be
+     * reused for inference
+     */
+    void release() {
+        if (_buffer) {
+            ei_dsp_heap_free(_buffer);
+            _buffer = nullptr;
+        }
+        if (_column) {
+            ei_free(_column);
+            _column = nullptr;
+        }
+        _columns = 0;
+        _frames = 0;
+    }
+
+    bool loaded() const {
+        return _buffer != nullptr;
+    }
+
+    /** Column of an original axis in the window */
+    size_t column(uint8_t axis) const {
+        return _column[axis];
+    }
+
+    size_t columns() const {
+        return _columns;
+    }
+
+    const float *buffer() const {
+        return _buffer;
+    }
+
+private:
+    // axes are uint8_t, so there are at most 256 columns and this is never one
+    static const uint16_t UNUSED_COLUMN = 0xffff;
+
+    int read_all() {
+        return _original_signal->get_data(0, _frames * _columns, _buffer);
+    }
+
+    int read_used() {
+        const size_t per_frame = _impulse->raw_samples_per_frame;
+        const size_t frames_per_read = 32;
+
+        float *frames_buffer = (float*)ei_dsp_heap_malloc(frames_per_read * per_frame * sizeof(float));
+        if (!frames_buffer) {
+            return EIDSP_OUT_OF_MEM;
+        }
+
+        float *out_ptr = _buffer;
+        for (size_t frame = 0; frame < _frames; frame += frames_per_read) {
+            size_t frames_to_read = _frames - frame > frames_per_read ? frames_per_read : _frames - frame;
+
+            int r = _original_signal->get_data(frame * per_frame, frames_to_read * per_frame, frames_buffer);
+            if (r != 0) {
+                ei_dsp_heap_free(frames_buffer);
+                return r;
+            }
+
+            for (size_t ix = 0; ix < frames_to_read; ix++) {
+                const float *in_ptr = frames_buffer + ix * per_frame;
+                for (size_t axis = 0; axis < per_frame; axis++) {
+                    if (_column[axis] != UNUSED_COLUMN) {
+                        *out_ptr++ = in_ptr[axis];
+                    }
+                }
+            }
+        }
+
+        ei_dsp_heap_free(frames_buffer);
+        return 0;
+    }
+
+    signal_t *_original_signal;
+    const ei_impulse_t *_impulse;
+    float *_buffer;
+    uint16_t *_column;
+    size_t _columns;
+    size_t _frames;
+};
+
+/**
+ * Transpose (to one row per axis), scale and filter a DSP block applies to
+ * its axes before extracting features. Two blocks that describe it equally
+ * produce the same preprocessed matrix. filter_type is "none" when the block
+ * does not filter.
+ */
+typedef struct {
+    const uint8_t *axes;
+    size_t axes_size;
+    float scale;
+    const char *filter_type;
+    float filter_cutoff;
+    int filter_order;
+} ei_dsp_preprocessing_t;
+
+#ifndef EI_CLASSIFIER_SHARED_PREPROCESSING_MAX
+#define EI_CLASSIFIER_SHARED_PREPROCESSING_MAX 4
+#endif
+
+/**
+ * Preprocessed axes shared by the DSP blocks of one impulse.
+ * process_impulse adds the preprocessing of every block that has one (see
+ * ei_dsp_block_preprocessing), plan() keeps the ones used by two blocks or
+ * more. The first block of such a group stores its preprocessed matrix with
+ * put(), the others copy it with get() instead of reading, transposing,
+ * scaling and filtering the window again. The matrix is freed after the last
+ * block of the group ran.
+ *
+ * Extract functions find it through active(signal), which is set by
+ * begin_block() for the signal of the block being run. Like the rest of
+ * process_impulse this is not reentrant.
+ */
+class SharedPreprocessing {
+public:
+    SharedPreprocessing(size_t blocks):
+        _groups_count(0), _active_group(-1), _active_signal(nullptr)
+    {
+        _block_group = (int8_t*)ei_malloc(blocks * sizeof(int8_t));
+        _blocks = _block_group ? blocks : 0;
+        for (size_t ix = 0; ix < _blocks; ix++) {
+            _block_group[ix] = -1;
+        }
+    }
+
+    ~SharedPreprocessing() {
+        if (current() == this) {
+            current() = nullptr;
+        }
+        for (size_t ix = 0; ix < _groups_count; ix++) {
+            if (_groups[ix].buffer) {
+                ei_dsp_heap_free(_groups[ix].buffer);
+            }
+        }
+        if (_block_group) {
+            ei_free(_block_group);
+        }
+    }
+
+    /**
+     * Register the preprocessing of a block, before plan()
+     */
+    void add(size_t block_ix, const ei_dsp_preprocessing_t *preprocessing) {
+        if (block_ix >= _blocks) {
+            return;
+        }
+
+        size_t gx = 0;
+        for (; gx < _groups_count; gx++) {
+            if (equal(&_groups[gx].preprocessing, preprocessing)) {
+                break;
+            }
+        }
+        if (gx == _groups_count) {
+            if (_groups_count == EI_CLASSIFIER_SHARED_PREPROCESSING_MAX) {
+                return;
+            }
+            _groups[gx].preprocessing = *preprocessing;
+            _groups[gx].blocks = 0;
+            _groups[gx].buffer = nullptr;
+            _groups[gx].size = 0;
+            _groups_count++;
+        }
+
+        _groups[gx].blocks++;
+        _block_group[block_ix] = (int8_t)gx;
+    }
+
+    /**
+     * Drop the preprocessings only one block uses, nothing to share there
+     */
+    void plan() {
+        for (size_t ix = 0; ix < _blocks; ix++) {
+            if (_block_group[ix] >= 0 && _groups[_block_group[ix]].blocks < 2) {
+                _block_group[ix] = -1;
+            }
+        }
+    }
+
+    /**
+     * The block is about to run on signal, make its group active
+     */
+    void begin_block(size_t block_ix, const signal_t *signal) {
+        end_block();
+        if (block_ix < _blocks && _block_group[block_ix] >= 0) {
+            _active_group = _block_group[block_ix];
+            _active_signal = signal;
+            current() = this;
+        }
+    }
+
+    /**
+     * The block is done, frees the matrix of its group after the last block
+     */
+    void end_block() {
+        if (_active_group < 0) {
+            return;
+        }
+
+        group_t *group = &_groups[_active_group];
+        if (--group->blocks == 0 && group->buffer) {
+            ei_dsp_heap_free(group->buffer);
+            group->buffer = nullptr;
+        }
+        _active_group = -1;
+        _active_signal = nullptr;
+        if (current() == this) {
+            current() = nullptr;
+        }
+    }
+
+    /**
+     * The shared preprocessing of the block running on signal, or nullptr if
+     * it doesn't share one
+     */
+    static SharedPreprocessing *active(const signal_t *signal) {
+        SharedPreprocessing *shared = current();
+        return shared && shared->_active_signal == signal ? shared : nullptr;
+    }
+
+    /**
+     * Preprocessed matrix of the active group, nullptr until a block put() it
+     */
+    const float *get(size_t size) const {
+        const group_t *group = &_groups[_active_group];
+        return group->size == size ? group->buffer : nullptr;
+    }
+
+    /**
+     * Keep the preprocessed matrix of the active block for the rest of its
+     * group. Out of memory is not an error, the next block then preprocesses
+     * on its own.
+     */
+    void put(const float *data, size_t size) {
+        group_t *group = &_groups[_active_group];
+        if (group->buffer || group->blocks < 2) {
+            return;
+        }
+        group->buffer = (float*)ei_dsp_heap_malloc(size * sizeof(float));
+        if (group->buffer) {
+            memcpy(group->buffer, data, size * sizeof(float));
+            group->size = size;
+        }
+    }
+
+private:
+    typedef struct {
+        ei_dsp_preprocessing_t preprocessing;
+        size_t blocks;
+        float *buffer;
+        size_t size;
+    } group_t;
+
+    static SharedPreprocessing *&current() {
+        static SharedPreprocessing *shared = nullptr;
+        return shared;
+    }
+
+    static bool equal(const ei_dsp_preprocessing_t *a, const ei_dsp_preprocessing_t *b) {
+        return a->axes_size == b->axes_size &&
+            memcmp(a->axes, b->axes, a->axes_size * sizeof(a->axes[0])) == 0 &&
+            a->scale == b->scale &&
+            strcmp(a->filter_type, b->filter_type) == 0 &&
+            a->filter_cutoff == b->filter_cutoff &&
+            a->filter_order == b->filter_order;
+    }
+
+    group_t _groups[EI_CLASSIFIER_SHARED_PREPROCESSING_MAX];
+    size_t _groups_count;
+    int8_t *_block_group;
+    size_t _blocks;
+    int _active_group;
+    const signal_t *_active_signal;
+};
+
+class SignalWithAxes {
+public:
+    SignalWithAxes(signal_t *original_signal, uint8_t *axes, size_t axes_count, const ei_impulse_t *impulse,
+                   const SharedSignalWindow *window = nullptr):
+        _original_signal(original_signal), _axes(axes), _axes_count(axes_count), _impulse(impulse),
+        _window(window && window->loaded() ? window : nullptr), _window_in_order(false)
+    {
+        if (_window && _axes_count == _window->columns()) {
+            _window_in_order = true;
+            for (size_t axis_ix = 0; axis_ix < _axes_count; axis_ix++) {
+                if (_window->column(_axes[axis_ix]) != axis_ix) {
+                    _window_in_order = false;
+                }
+            }
+        }
+    }
+
     signal_t * get_signal() {
-        if (this->_axes_count == _impulse->raw_samples_per_frame) {
+        if (this->_axes_count == _impulse->raw_samples_per_frame && !_window) {
             return this->_original_signal;
         }
 
@@ -51,6 +428,10 @@ public:
     }
 
     int get_data(size_t offset, size_t length, float *out_ptr) {
+        if (_window) {
+            return get_data_from_window(offset, length, out_ptr);
+        }
+
         size_t offset_on_original_signal = offset / _axes_count * _impulse->raw_samples_per_frame;
         size_t length_on_original_signal = length / _axes_count * _impulse->raw_samples_per_frame;
 
@@ -69,10 +450,35 @@ public:
     }
 
 private:
+    int get_data_from_window(size_t offset, size_t length, float *out_ptr) {
+        const float *window = _window->buffer();
+
+        // the block selects every column of the window, in the same order
+        if (_window_in_order) {
+            memcpy(out_ptr, window + offset, length * sizeof(float));
+            return 0;
+        }
+
+        const size_t columns = _window->columns();
+        const size_t first_frame = offset / _axes_count;
+        const size_t frames = length / _axes_count;
+
+        for (size_t frame = first_frame; frame < first_frame + frames; frame++) {
+            const float *in_ptr = window + frame * columns;
+            for (size_t axis_ix = 0; axis_ix < _axes_count; axis_ix++) {
+                *out_ptr++ = in_ptr[_window->column(_axes[axis_ix])];
+            }
+        }
+
+        return 0;
+    }
+
     signal_t *_original_signal;
     uint8_t *_axes;
     size_t _axes_count;
     const ei_impulse_t *_impulse;
+    const SharedSignalWindow *_window;
+    bool _window_in_order;
     signal_t wrapped_signal;
 };
 
@@ -222,7 +222,7 @@ EI_IMPULSE_ERROR run_gmm_anomaly(
 
     ei_impulse_result_t anomaly_result = { 0 };
 
-    std::unique_ptr<ei_feature_t[]> input_ptr(new ei_feature_t[1]);
+    std::unique_ptr<ei_feature_t[]> input_ptr(new ei_feature_t[1]());
     ei_feature_t* input = input_ptr.get();
 
     memset(&anomaly_result, 0, sizeof(ei_impulse_result_t));
@@ -51,7 +51,7 @@ static EI_IMPULSE_ERROR inference_tflite_setup(
 
     *ctx_start_us = ei_read_timer_us();
 
-    TfLiteStatus init_status = graph_config->model_init(ei_aligned_calloc);
+    TfLiteStatus init_status = graph_config->model_init(ei_dsp_arena_calloc);
     if (init_status != kTfLiteOk) {
         ei_printf("Failed to initialize the model (error code %d)\n", init_status);
         return EI_IMPULSE_TFLITE_ARENA_ALLOC_FAILED;
@@ -107,6 +107,11 @@ static EI_IMPULSE_ERROR inference_tflite_run(
 
     ei_config_tflite_eon_graph_t *graph_config = (ei_config_tflite_eon_graph_t*)block_config->graph_config;
 
+#if EI_CLASSIFIER_PROFILE_OPS == 1
+    // the kernels record their ops, see ei_profiler_wrap_kernel
+    ei_profiler_reset();
+#endif
+
     if (graph_config->model_invoke() != kTfLiteOk) {
         return EI_IMPULSE_TFLITE_ERROR;
     }
@@ -115,6 +120,9 @@ static EI_IMPULSE_ERROR inference_tflite_run(
 
     result->timing.classification_us = ctx_end_us - ctx_start_us;
     result->timing.classification = (int)(result->timing.classification_us / 1000);
+#if EI_CLASSIFIER_PROFILE_OPS == 1
+    result->timing.ops = ei_profiler_get();
+#endif
 
     // Read the predicted y value from the model's output tensor
     if (debug) {
@@ -154,7 +162,7 @@ EI_IMPULSE_ERROR run_nn_inference_from_dsp(
     TfLiteTensor output_scores;
     TfLiteTensor output_labels;
     uint64_t ctx_start_us = ei_read_timer_us();
-    ei_unique_ptr_t p_tensor_arena(nullptr, ei_aligned_free);
+    ei_unique_ptr_t p_tensor_arena(nullptr, ei_dsp_arena_free);
     ei_config_tflite_eon_graph_t *graph_config = (ei_config_tflite_eon_graph_t*)block_config->graph_config;
 
     EI_IMPULSE_ERROR init_res = inference_tflite_setup(
@@ -185,7 +193,7 @@ EI_IMPULSE_ERROR run_nn_inference_from_dsp(
         return output_res;
     }
 
-    if (graph_config->model_reset(ei_aligned_free) != kTfLiteOk) {
+    if (graph_config->model_reset(ei_dsp_arena_free) != kTfLiteOk) {
         return EI_IMPULSE_TFLITE_ERROR;
     }
 
@@ -220,7 +228,7 @@ EI_IMPULSE_ERROR run_nn_inference(
     TfLiteTensor output_labels;
 
     uint64_t ctx_start_us = ei_read_timer_us();
-    ei_unique_ptr_t p_tensor_arena(nullptr, ei_aligned_free);
+    ei_unique_ptr_t p_tensor_arena(nullptr, ei_dsp_arena_free);
 
     EI_IMPULSE_ERROR init_res = inference_tflite_setup(
         block_config,
@@ -259,7 +267,7 @@ EI_IMPULSE_ERROR run_nn_inference(
         }
     }
 
-    graph_config->model_reset(ei_aligned_free);
+    graph_config->model_reset(ei_dsp_arena_free);
 
     result->timing.classification_us = ei_read_timer_us() - ctx_start_us;
 
@@ -294,7 +302,7 @@ EI_IMPULSE_ERROR run_nn_inference_image_quantized(
     TfLiteTensor output_scores;
     TfLiteTensor output_labels;
 
-    ei_unique_ptr_t p_tensor_arena(nullptr, ei_aligned_free);
+    ei_unique_ptr_t p_tensor_arena(nullptr, ei_dsp_arena_free);
 
     EI_IMPULSE_ERROR init_res = inference_tflite_setup(
         block_config,
@@ -355,7 +363,7 @@ EI_IMPULSE_ERROR run_nn_inference_image_quantized(
         result,
         debug);
 
-    graph_config->model_reset(ei_aligned_free);
+    graph_config->model_reset(ei_dsp_arena_free);
 
     if (run_res != EI_IMPULSE_OK) {
         return run_res;
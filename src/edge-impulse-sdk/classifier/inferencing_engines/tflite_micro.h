@@ -77,12 +77,12 @@ static EI_IMPULSE_ERROR inference_tflite_setup(
     p_tensor_arena = ei_unique_ptr_t(tensor_arena, [](void*){});
 #else
     // Create an area of memory to use for input, output, and intermediate arrays.
-    uint8_t *tensor_arena = (uint8_t*)ei_aligned_calloc(16, graph_config->arena_size);
+    uint8_t *tensor_arena = (uint8_t*)ei_dsp_arena_calloc(16, graph_config->arena_size);
     if (tensor_arena == NULL) {
         ei_printf("Failed to allocate TFLite arena (%zu bytes)\n", graph_config->arena_size);
         return EI_IMPULSE_TFLITE_ARENA_ALLOC_FAILED;
     }
-    p_tensor_arena = ei_unique_ptr_t(tensor_arena, ei_aligned_free);
+    p_tensor_arena = ei_unique_ptr_t(tensor_arena, ei_dsp_arena_free);
 #endif
 
     static bool tflite_first_run = true;
@@ -173,6 +173,9 @@ static EI_IMPULSE_ERROR inference_tflite_run(
     ei_impulse_result_t *result,
     bool debug) {
 
+#if EI_CLASSIFIER_PROFILE_OPS == 1
+    ei_profiler_reset();
+#endif
 
     // Run inference, and report any error
     TfLiteStatus invoke_status = interpreter->Invoke();
@@ -186,6 +189,9 @@ static EI_IMPULSE_ERROR inference_tflite_run(
 
     result->timing.classification_us = ctx_end_us - ctx_start_us;
     result->timing.classification = (int)(result->timing.classification_us / 1000);
+#if EI_CLASSIFIER_PROFILE_OPS == 1
+    result->timing.ops = ei_profiler_get();
+#endif
 
     // Read the predicted y value from the model's output tensor
     if (debug) {
@@ -228,7 +234,7 @@ EI_IMPULSE_ERROR run_nn_inference_from_dsp(
     TfLiteTensor* output_scores;
     TfLiteTensor* output_labels;
     uint64_t ctx_start_us = ei_read_timer_us();
-    ei_unique_ptr_t p_tensor_arena(nullptr, ei_aligned_free);
+    ei_unique_ptr_t p_tensor_arena(nullptr, ei_dsp_arena_free);
 
     tflite::MicroInterpreter* interpreter;
     EI_IMPULSE_ERROR init_res = inference_tflite_setup(
@@ -291,7 +297,7 @@ EI_IMPULSE_ERROR run_nn_inference(
     TfLiteTensor* output_scores;
     TfLiteTensor* output_labels;
     uint64_t ctx_start_us = ei_read_timer_us();
-    ei_unique_ptr_t p_tensor_arena(nullptr, ei_aligned_free);
+    ei_unique_ptr_t p_tensor_arena(nullptr, ei_dsp_arena_free);
 
     tflite::MicroInterpreter* interpreter;
     EI_IMPULSE_ERROR init_res = inference_tflite_setup(
@@ -362,7 +368,7 @@ EI_IMPULSE_ERROR run_nn_inference_image_quantized(
     TfLiteTensor* output;
     TfLiteTensor* output_scores;
     TfLiteTensor* output_labels;
-    ei_unique_ptr_t p_tensor_arena(nullptr, ei_aligned_free);
+    ei_unique_ptr_t p_tensor_arena(nullptr, ei_dsp_arena_free);
 
     tflite::MicroInterpreter* interpreter;
     EI_IMPULSE_ERROR init_res = inference_tflite_setup(
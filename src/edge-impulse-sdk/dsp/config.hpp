@@ -85,6 +85,16 @@
 #define EIDSP_PRINT_ALLOCATIONS      1
 #endif
 
+// size in bytes of a preallocated region shared by the DSP scratch buffers, the
+// feature matrix and the tensor arena while an impulse runs (0 = use the heap).
+// Blocks are handed out as a stack, so the arena reuses the DSP scratch space
+// once the features are computed. Peak use of the region is reported in
+// ei_memory_peak_use. The region has a single owner for the whole program,
+// see ei::scratch_planner before running impulses on several threads.
+#ifndef EIDSP_SHARED_SCRATCH_SIZE
+#define EIDSP_SHARED_SCRATCH_SIZE    0
+#endif // EIDSP_SHARED_SCRATCH_SIZE
+
 #ifndef EIDSP_SIGNAL_C_FN_POINTER
 #define EIDSP_SIGNAL_C_FN_POINTER    0
 #endif // EIDSP_SIGNAL_C_FN_POINTER
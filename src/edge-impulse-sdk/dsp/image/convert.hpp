@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS
+ * IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language
+ * governing permissions and limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __EIDSP_IMAGE_CONVERT__H__
+#define __EIDSP_IMAGE_CONVERT__H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include "edge-impulse-sdk/dsp/returntypes.hpp"
+
+/**
+ * Batched pixel conversion for image features.
+ *
+ * Every converter works on a run of pixels (typically one or more whole rows)
+ * and writes one of three outputs in a single pass:
+ *  - packed features, (r << 16) + (g << 8) + b stored in a float, the format
+ *    signal_t::get_data hands to the image DSP block
+ *  - normalized floats, one (or three) per pixel
+ *  - int8 tensor values, quantized with the input tensor scale / zero point
+ *
+ * Format and mode checks are hoisted out of the pixel loops, so each loop body
+ * is branch free and the compiler can unroll (or vectorize on hosts) it.
+ */
+namespace ei { namespace image { namespace convert {
+
+enum PIXEL_FORMAT
+{
+    FORMAT_PACKED = 0, // float per pixel, 0xRRGGBB as produced by signal_t::get_data
+    FORMAT_RGB565_BE = 1, // 2 bytes per pixel, high byte first (OV767x output)
+    FORMAT_RGB888 = 2, // 3 bytes per pixel, R, G, B
+    FORMAT_GRAYSCALE = 3, // 1 byte per pixel
+};
+
+/**
+ * Per channel scaling applied before normalization / quantization:
+ * value = ((channel / divisor) - mean[c]) / std[c]
+ * Identity values (divisor 1, mean 0, std 1) are exact in float, so every
+ * image scaling mode can be expressed without changing its rounding.
+ * With bgr set, output channel 0 is blue and channel 2 is red, and mean / std
+ * are indexed by output channel.
+ */
+typedef struct {
+    float divisor;
+    float mean[3];
+    float std[3];
+    bool bgr;
+} pixel_scaling_t;
+
+/** Scale 0..255 to 0..1 */
+static const pixel_scaling_t SCALING_0_1 = { 255.0f, { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f }, false };
+
+/** Keep 0..255 */
+static const pixel_scaling_t SCALING_0_255 = { 1.0f, { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f }, false };
+
+/** Scale 0..255 to 0..1, then normalize with the ImageNet mean / std */
+static const pixel_scaling_t SCALING_TORCH = { 255.0f, { 0.485f, 0.456f, 0.406f }, { 0.229f, 0.224f, 0.225f }, false };
+
+/** Scale 0..255 to -1..1 */
+static const pixel_scaling_t SCALING_MIN1_1 = { 127.5f, { 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f }, false };
+
+/** Shift 0..255 to -128..127 */
+static const pixel_scaling_t SCALING_MIN128_127 = { 1.0f, { 128.0f, 128.0f, 128.0f }, { 1.0f, 1.0f, 1.0f }, false };
+
+/** Swap to BGR and subtract the ImageNet mean (in 0..255 units, ordered BGR) */
+static const pixel_scaling_t SCALING_BGR_SUBTRACT_IMAGENET_MEAN = {
+    1.0f, { 103.939f, 116.779f, 123.68f }, { 1.0f, 1.0f, 1.0f }, true };
+
+namespace detail {
+
+// ITU-R 601-2 luma transform
+// see: https://pillow.readthedocs.io/en/stable/reference/Image.html#PIL.Image.Image.convert
+static const int32_t iRedToGray = (int32_t)(0.299f * 65536.0f);
+static const int32_t iGreenToGray = (int32_t)(0.587f * 65536.0f);
+static const int32_t iBlueToGray = (int32_t)(0.114f * 65536.0f);
+
+/**
+ * Source readers, each yields the 8 bit r, g, b of pixel ix
+ */
+struct packed_reader {
+    typedef float type;
+    static inline void read(const float *src, size_t ix, int32_t *r, int32_t *g, int32_t *b)
+    {
+        uint32_t pixel = static_cast<uint32_t>(src[ix]);
+        *r = static_cast<int32_t>(pixel >> 16 & 0xff);
+        *g = static_cast<int32_t>(pixel >> 8 & 0xff);
+        *b = static_cast<int32_t>(pixel & 0xff);
+    }
+};
+
+struct rgb565be_reader {
+    typedef uint8_t type;
+    static inline void read(const uint8_t *src, size_t ix, int32_t *r, int32_t *g, int32_t *b)
+    {
+        uint32_t pixel = (static_cast<uint32_t>(src[ix * 2]) << 8) | src[ix * 2 + 1];
+        *r = static_cast<int32_t>(((pixel >> 11) & 0x1f) << 3);
+        *g = static_cast<int32_t>(((pixel >> 5) & 0x3f) << 2);
+        *b = static_cast<int32_t>((pixel & 0x1f) << 3);
+    }
+};
+
+struct rgb888_reader {
+    typedef uint8_t type;
+    static inline void read(const uint8_t *src, size_t ix, int32_t *r, int32_t *g, int32_t *b)
+    {
+        *r = src[ix * 3];
+        *g = src[ix * 3 + 1];
+        *b = src[ix * 3 + 2];
+    }
+};
+
+struct gray_reader {
+    typedef uint8_t type;
+    static inline void read(const uint8_t *src, size_t ix, int32_t *r, int32_t *g, int32_t *b)
+    {
+        *r = *g = *b = src[ix];
+    }
+};
+
+template<typename SRC>
+static inline void to_packed(const typename SRC::type *src, size_t pixels, float *dst)
+{
+    size_t ix = 0;
+    int32_t r[4], g[4], b[4];
+
+    for (; ix + 4 <= pixels; ix += 4) {
+        for (size_t k = 0; k < 4; k++) {
+            SRC::read(src, ix + k, &r[k], &g[k], &b[k]);
+        }
+        for (size_t k = 0; k < 4; k++) {
+            dst[ix + k] = static_cast<float>((r[k] << 16) + (g[k] << 8) + b[k]);
+        }
+    }
+    for (; ix < pixels; ix++) {
+        SRC::read(src, ix, &r[0], &g[0], &b[0]);
+        dst[ix] = static_cast<float>((r[0] << 16) + (g[0] << 8) + b[0]);
+    }
+}
+
+static inline float scale_channel(int32_t v, const pixel_scaling_t *scaling, int c)
+{
+    return ((static_cast<float>(v) / scaling->divisor) - scaling->mean[c]) / scaling->std[c];
+}
+
+template<typename SRC>
+static inline void to_float(
+    const typename SRC::type *src,
+    size_t pixels,
+    bool grayscale,
+    const pixel_scaling_t *scaling,
+    float *dst)
+{
+    int32_t r, g, b;
+    // output channel of red and blue
+    const int rc = scaling->bgr ? 2 : 0;
+    const int bc = scaling->bgr ? 0 : 2;
+
+    if (grayscale) {
+        for (size_t ix = 0; ix < pixels; ix++) {
+            SRC::read(src, ix, &r, &g, &b);
+            dst[ix] = (0.299f * scale_channel(r, scaling, rc)) +
+                (0.587f * scale_channel(g, scaling, 1)) +
+                (0.114f * scale_channel(b, scaling, bc));
+        }
+    }
+    else {
+        for (size_t ix = 0; ix < pixels; ix++) {
+            SRC::read(src, ix, &r, &g, &b);
+            dst[ix * 3 + rc] = scale_channel(r, scaling, rc);
+            dst[ix * 3 + 1] = scale_channel(g, scaling, 1);
+            dst[ix * 3 + bc] = scale_channel(b, scaling, bc);
+        }
+    }
+}
+
+template<typename SRC>
+static inline void to_int8(
+    const typename SRC::type *src,
+    size_t pixels,
+    bool grayscale,
+    const pixel_scaling_t *scaling,
+    float scale,
+    float zero_point,
+    int8_t *dst)
+{
+    int32_t r, g, b;
+    // output channel of red and blue
+    const int rc = scaling->bgr ? 2 : 0;
+    const int bc = scaling->bgr ? 0 : 2;
+
+    // 0..1 input with a 1/255 scale maps every channel value onto its own
+    // quantized step, so quantizing is an integer offset
+    const bool identity = scale == 0.003921568859368563f && zero_point == -128 &&
+        scaling->divisor == 255.0f && !scaling->bgr &&
+        scaling->mean[0] == 0.0f && scaling->mean[1] == 0.0f && scaling->mean[2] == 0.0f &&
+        scaling->std[0] == 1.0f && scaling->std[1] == 1.0f && scaling->std[2] == 1.0f;
+
+    if (identity) {
+        const int32_t zp = static_cast<int32_t>(zero_point);
+        if (grayscale) {
+            for (size_t ix = 0; ix < pixels; ix++) {
+                SRC::read(src, ix, &r, &g, &b);
+                int32_t gray = (iRedToGray * r) + (iGreenToGray * g) + (iBlueToGray * b);
+                gray >>= 16; // scale down to int8_t
+                gray += zp;
+                if (gray < -128) gray = -128;
+                else if (gray > 127) gray = 127;
+                dst[ix] = static_cast<int8_t>(gray);
+            }
+        }
+        else {
+            for (size_t ix = 0; ix < pixels; ix++) {
+                SRC::read(src, ix, &r, &g, &b);
+                dst[ix * 3] = static_cast<int8_t>(r + zp);
+                dst[ix * 3 + 1] = static_cast<int8_t>(g + zp);
+                dst[ix * 3 + 2] = static_cast<int8_t>(b + zp);
+            }
+        }
+        return;
+    }
+
+    if (grayscale) {
+        for (size_t ix = 0; ix < pixels; ix++) {
+            SRC::read(src, ix, &r, &g, &b);
+            float v = (0.299f * scale_channel(r, scaling, rc)) +
+                (0.587f * scale_channel(g, scaling, 1)) +
+                (0.114f * scale_channel(b, scaling, bc));
+            dst[ix] = static_cast<int8_t>(round(v / scale) + zero_point);
+        }
+    }
+    else {
+        for (size_t ix = 0; ix < pixels; ix++) {
+            SRC::read(src, ix, &r, &g, &b);
+            dst[ix * 3 + rc] = static_cast<int8_t>(round(scale_channel(r, scaling, rc) / scale) + zero_point);
+            dst[ix * 3 + 1] = static_cast<int8_t>(round(scale_channel(g, scaling, 1) / scale) + zero_point);
+            dst[ix * 3 + bc] = static_cast<int8_t>(round(scale_channel(b, scaling, bc) / scale) + zero_point);
+        }
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief Convert raw pixels to packed features (0xRRGGBB as float)
+ *
+ * @param src Source pixels
+ * @param format Source format (not FORMAT_PACKED)
+ * @param pixels Number of pixels to convert
+ * @param dst Output, one float per pixel
+ * @return EIDSP_OK or EIDSP_PARAMETER_INVALID for an unknown format
+ */
+static inline int to_packed(const uint8_t *src, PIXEL_FORMAT format, size_t pixels, float *dst)
+{
+    switch (format) {
+        case FORMAT_RGB565_BE:
+            detail::to_packed<detail::rgb565be_reader>(src, pixels, dst);
+            break;
+        case FORMAT_RGB888:
+            detail::to_packed<detail::rgb888_reader>(src, pixels, dst);
+            break;
+        case FORMAT_GRAYSCALE:
+            detail::to_packed<detail::gray_reader>(src, pixels, dst);
+            break;
+        default:
+            return EIDSP_PARAMETER_INVALID;
+    }
+    return EIDSP_OK;
+}
+
+/**
+ * @brief Convert pixels to normalized float features
+ *
+ * @param src Source pixels, a float * for FORMAT_PACKED, bytes otherwise
+ * @param format Source format
+ * @param pixels Number of pixels to convert
+ * @param grayscale Write one luma value per pixel instead of r, g, b
+ * @param scaling Per channel scaling, e.g. SCALING_0_1
+ * @param dst Output, 1 or 3 floats per pixel
+ * @return EIDSP_OK or EIDSP_PARAMETER_INVALID for an unknown format
+ */
+static inline int to_float(
+    const void *src,
+    PIXEL_FORMAT format,
+    size_t pixels,
+    bool grayscale,
+    const pixel_scaling_t *scaling,
+    float *dst)
+{
+    switch (format) {
+        case FORMAT_PACKED:
+            detail::to_float<detail::packed_reader>(
+                static_cast<const float *>(src), pixels, grayscale, scaling, dst);
+            break;
+        case FORMAT_RGB565_BE:
+            detail::to_float<detail::rgb565be_reader>(
+                static_cast<const uint8_t *>(src), pixels, grayscale, scaling, dst);
+            break;
+        case FORMAT_RGB888:
+            detail::to_float<detail::rgb888_reader>(
+                static_cast<const uint8_t *>(src), pixels, grayscale, scaling, dst);
+            break;
+        case FORMAT_GRAYSCALE:
+            detail::to_float<detail::gray_reader>(
+                static_cast<const uint8_t *>(src), pixels, grayscale, scaling, dst);
+            break;
+        default:
+            return EIDSP_PARAMETER_INVALID;
+    }
+    return EIDSP_OK;
+}
+
+/**
+ * @brief Convert pixels to int8 tensor values
+ *
+ * @param src Source pixels, a float * for FORMAT_PACKED, bytes otherwise
+ * @param format Source format
+ * @param pixels Number of pixels to convert
+ * @param grayscale Write one luma value per pixel instead of r, g, b
+ * @param scaling Per channel scaling applied before quantization
+ * @param scale Input tensor scale
+ * @param zero_point Input tensor zero point
+ * @param dst Output, 1 or 3 values per pixel
+ * @return EIDSP_OK or EIDSP_PARAMETER_INVALID for an unknown format
+ */
+static inline int to_int8(
+    const void *src,
+    PIXEL_FORMAT format,
+    size_t pixels,
+    bool grayscale,
+    const pixel_scaling_t *scaling,
+    float scale,
+    float zero_point,
+    int8_t *dst)
+{
+    switch (format) {
+        case FORMAT_PACKED:
+            detail::to_int8<detail::packed_reader>(
+                static_cast<const float *>(src), pixels, grayscale, scaling, scale, zero_point, dst);
+            break;
+        case FORMAT_RGB565_BE:
+            detail::to_int8<detail::rgb565be_reader>(
+                static_cast<const uint8_t *>(src), pixels, grayscale, scaling, scale, zero_point, dst);
+            break;
+        case FORMAT_RGB888:
+            detail::to_int8<detail::rgb888_reader>(
+                static_cast<const uint8_t *>(src), pixels, grayscale, scaling, scale, zero_point, dst);
+            break;
+        case FORMAT_GRAYSCALE:
+            detail::to_int8<detail::gray_reader>(
+                static_cast<const uint8_t *>(src), pixels, grayscale, scaling, scale, zero_point, dst);
+            break;
+        default:
+            return EIDSP_PARAMETER_INVALID;
+    }
+    return EIDSP_OK;
+}
+
+}}} // namespaces
+
+#endif // __EIDSP_IMAGE_CONVERT__H__
@@ -19,5 +19,6 @@
 #define _EIDSP_IMAGE_H_
 
 #include "edge-impulse-sdk/dsp/image/processing.hpp"
+#include "edge-impulse-sdk/dsp/image/convert.hpp"
 
 #endif
\ No newline at end of file
@@ -15,9 +15,6 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-#ifndef __EIDSP_IMAGE_PROCESSING__H__
-#define __EIDSP_IMAGE_PROCESSING__H__
-
 #include "edge-impulse-sdk/dsp/ei_utils.h"
 #include "edge-impulse-sdk/porting/ei_classifier_porting.h"
 #include "edge-impulse-sdk/dsp/returntypes.hpp"
@@ -25,12 +22,6 @@
 
 namespace ei { namespace image { namespace processing {
 
-enum YUV_OPTIONS
-{
-    BIG_ENDIAN_ORDER = 1, //RGB reading from low to high memory.  Otherwise, uses native encoding
-    PAD_4B = 2, // pad 0x00 on the high B. ie 0x00RRGGBB
-};
-
 /**
  * @brief Convert YUV to RGB
  *
@@ -347,31 +338,177 @@ void calculate_crop_dims(
     }
 }
 
-int crop_and_interpolate_rgb888(
+/**
+ * @brief Bilinear crop and resize that reads straight from the crop window
+ * in the source image, one output row at a time. Same fixed point maths as
+ * resize_image, but the neighbours are clamped to the crop window.
+ */
+class crop_resizer {
+public:
+    int init(
+        int srcWidth,
+        int srcHeight,
+        int cropX,
+        int cropY,
+        int cropWidth,
+        int cropHeight,
+        int dstWidth,
+        int dstHeight,
+        int pixel_size_B)
+    {
+        if (cropX < 0 || cropY < 0 || cropWidth < 1 || cropHeight < 1 ||
+            (cropX + cropWidth) > srcWidth || (cropY + cropHeight) > srcHeight) {
+            return EIDSP_PARAMETER_INVALID;
+        }
+        if (dstWidth < 1 || dstHeight < 1 || pixel_size_B < 1) {
+            return EIDSP_PARAMETER_INVALID;
+        }
+
+        this->srcWidth = srcWidth;
+        this->cropX = cropX;
+        this->cropY = cropY;
+        this->cropWidth = cropWidth;
+        this->cropHeight = cropHeight;
+        this->dstWidth = dstWidth;
+        this->pixel_size_B = pixel_size_B;
+        src_x_frac = ((uint32_t)cropWidth * FRAC_VAL) / dstWidth;
+        src_y_frac = ((uint32_t)cropHeight * FRAC_VAL) / dstHeight;
+
+        return EIDSP_OK;
+    }
+
+    /**
+     * @brief Compute output row dstY from the full source image. Output row
+     * y can be written over the source when the crop window is at least as
+     * large as the output in both dimensions.
+     */
+    void resize_row(const uint8_t *srcImage, int dstY, uint8_t *dstRow) const
+    {
+        const int stride = srcWidth * pixel_size_B;
+        // start at 1/2 pixel in, same as resize_image
+        const uint32_t src_y_accum = FRAC_VAL / 2 + (uint32_t)dstY * src_y_frac;
+        const uint32_t y_frac = src_y_accum & FRAC_MASK;
+        const uint32_t ny_frac = FRAC_VAL - y_frac;
+        // when upscaling, the half pixel offset puts the last rows and
+        // columns past the window
+        int ty = src_y_accum >> FRAC_BITS;
+        if (ty > cropHeight - 1) {
+            ty = cropHeight - 1;
+        }
+        const int ny = (ty + 1 < cropHeight) ? ty + 1 : cropHeight - 1;
+
+        // the neighbours are clamped to the crop window, never read outside of it
+        const uint8_t *s0 = srcImage + (cropY + ty) * stride + cropX * pixel_size_B;
+        const uint8_t *s1 = srcImage + (cropY + ny) * stride + cropX * pixel_size_B;
+        const int last_x = (cropWidth - 1) * pixel_size_B;
+
+        uint8_t *d = dstRow;
+        // start at 1/2 pixel in to account for integer downsampling which might miss pixels
+        uint32_t src_x_accum = FRAC_VAL / 2;
+        for (int x = 0; x < dstWidth; x++) {
+            int tx = (src_x_accum >> FRAC_BITS) * pixel_size_B;
+            if (tx > last_x) {
+                tx = last_x;
+            }
+            const int nx = (tx < last_x) ? tx + pixel_size_B : last_x;
+            const uint32_t x_frac = src_x_accum & FRAC_MASK;
+            const uint32_t nx_frac = FRAC_VAL - x_frac;
+            src_x_accum += src_x_frac;
+
+            for (int color = 0; color < pixel_size_B; color++) {
+                uint32_t p00 = s0[tx + color];
+                uint32_t p10 = s0[nx + color];
+                uint32_t p01 = s1[tx + color];
+                uint32_t p11 = s1[nx + color];
+                p00 = ((p00 * nx_frac) + (p10 * x_frac) + FRAC_VAL / 2) >> FRAC_BITS; // top line
+                p01 = ((p01 * nx_frac) + (p11 * x_frac) + FRAC_VAL / 2) >> FRAC_BITS; // bottom line
+                p00 = ((p00 * ny_frac) + (p01 * y_frac) + FRAC_VAL / 2) >> FRAC_BITS; //top + bottom
+                *d++ = (uint8_t)p00;
+            }
+        }
+    }
+
+private:
+    // Fixed point position of source pixels, same as resize_image
+    static constexpr int FRAC_BITS = 14;
+    static constexpr uint32_t FRAC_VAL = (1 << FRAC_BITS);
+    static constexpr uint32_t FRAC_MASK = (FRAC_VAL - 1);
+
+    int srcWidth;
+    int cropX;
+    int cropY;
+    int cropWidth;
+    int cropHeight;
+    int dstWidth;
+    int pixel_size_B;
+    uint32_t src_x_frac;
+    uint32_t src_y_frac;
+};
+
+/**
+ * @brief Crops and resizes a full frame with crop_resizer, one output row
+ * at a time. In place is only safe when not upscaling, otherwise fall back
+ * to a crop into dstImage followed by resize_image.
+ */
+static int crop_and_resize(
     const uint8_t *srcImage,
     int srcWidth,
     int srcHeight,
     uint8_t *dstImage,
     int dstWidth,
-    int dstHeight)
+    int dstHeight,
+    int pixel_size_B)
 {
     int cropWidth, cropHeight;
     // What are dimensions that maintain aspect ratio?
     calculate_crop_dims(srcWidth, srcHeight, dstWidth, dstHeight, cropWidth, cropHeight);
-    // Now crop to that dimension
-    int res = crop_image_rgb888_packed(
-        srcImage,
+    const int cropX = (srcWidth - cropWidth) / 2;
+    const int cropY = (srcHeight - cropHeight) / 2;
+
+    if (srcImage == dstImage && (cropWidth < dstWidth || cropHeight < dstHeight)) {
+        int res = cropImage(
+            srcImage,
+            srcWidth * pixel_size_B,
+            srcHeight,
+            cropX * pixel_size_B,
+            cropY,
+            dstImage,
+            cropWidth * pixel_size_B,
+            cropHeight,
+            8);
+        if (res != EIDSP_OK) { return res; }
+        return resize_image(dstImage, cropWidth, cropHeight, dstImage, dstWidth, dstHeight, pixel_size_B);
+    }
+
+    crop_resizer resizer;
+    int res = resizer.init(
         srcWidth,
         srcHeight,
-        (srcWidth - cropWidth) / 2,
-        (srcHeight - cropHeight) / 2,
-        dstImage,
+        cropX,
+        cropY,
         cropWidth,
-        cropHeight);
+        cropHeight,
+        dstWidth,
+        dstHeight,
+        pixel_size_B);
+    if (res != EIDSP_OK) { return res; }
+
+    for (int y = 0; y < dstHeight; y++) {
+        resizer.resize_row(srcImage, y, &dstImage[y * dstWidth * pixel_size_B]);
+    }
 
-    if( res != EIDSP_OK) { return res; }
-    // Finally, interpolate down to desired dimensions, in place
-    return resize_image(dstImage, cropWidth, cropHeight, dstImage, dstWidth, dstHeight, 3);
+    return EIDSP_OK;
+}
+
+int crop_and_interpolate_rgb888(
+    const uint8_t *srcImage,
+    int srcWidth,
+    int srcHeight,
+    uint8_t *dstImage,
+    int dstWidth,
+    int dstHeight)
+{
+    return crop_and_resize(srcImage, srcWidth, srcHeight, dstImage, dstWidth, dstHeight, 3);
 }
 
 int crop_and_interpolate_image(
@@ -383,27 +520,7 @@ int crop_and_interpolate_image(
     int dstHeight,
     int pixel_size_B)
 {
-    int cropWidth, cropHeight;
-    // What are dimensions that maintain aspect ratio?
-    calculate_crop_dims(srcWidth, srcHeight, dstWidth, dstHeight, cropWidth, cropHeight);
-
-    // Now crop to that dimension
-    int res =  cropImage(
-        srcImage,
-        srcWidth * pixel_size_B,
-        srcHeight,
-        ((srcWidth - cropWidth) / 2) * pixel_size_B,
-        (srcHeight - cropHeight) / 2,
-        dstImage,
-        cropWidth * pixel_size_B,
-        cropHeight,
-        8);
-
-    if( res != EIDSP_OK) { return res; }
-
-    // Finally, interpolate down to desired dimensions, in place
-    return resize_image(dstImage, cropWidth, cropHeight, dstImage, dstWidth, dstHeight, pixel_size_B);
+    return crop_and_resize(srcImage, srcWidth, srcHeight, dstImage, dstWidth, dstHeight, pixel_size_B);
 }
 
-}}} //namespaces
-#endif //!__EI_IMAGE_PROCESSING__H__
\ No newline at end of file
+}}} //namespaces
\ No newline at end of file
@@ -81,7 +81,7 @@ int cropImage(
     uint8_t *dstImage,
     int iBpp)
  */
-void crop_image_rgb888_packed(
+int crop_image_rgb888_packed(
     const uint8_t *srcImage,
     int srcWidth,
     int srcHeight,
@@ -108,7 +108,7 @@ constexpr int MONO_B_SIZE = 1;
  * @param dstImage Output buffer, can be same as input buffer
  * @param pixel_size_B Size of pixels in Bytes.  3 for RGB, 1 for mono
  */
-void resize_image(
+int resize_image(
     const uint8_t *srcImage,
     int srcWidth,
     int srcHeight,
@@ -138,7 +138,8 @@ void calculate_crop_dims(
     int &cropHeight);
 
 /**
- * @brief Crops, then interpolates to a desired new image size
+ * @brief Crops, then interpolates to a desired new image size, in a single
+ * pass over the crop window
  * Can be done in place (set srcImage == dstImage)
  *
  * @param srcImage Input image buffer
@@ -157,7 +158,8 @@ int crop_and_interpolate_rgb888(
     int dstHeight);
 
 /**
- * @brief Crops, then interpolates to a desired new image size
+ * @brief Crops, then interpolates to a desired new image size, in a single
+ * pass over the crop window
  * Can be done in place (set srcImage == dstImage)
  * A more beneric version of the previously used
  * crop_and_interpolate_rgb888
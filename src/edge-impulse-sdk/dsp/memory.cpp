@@ -16,6 +16,219 @@
  */
 
 #include "memory.hpp"
+#include <string.h>
 
 size_t ei_memory_in_use = 0;
 size_t ei_memory_peak_use = 0;
+
+#if EIDSP_SHARED_SCRATCH_SIZE > 0
+
+namespace ei {
+
+// every block starts with a header, payloads are 16 byte aligned for the arena
+#define SCRATCH_ALIGN           16
+#define SCRATCH_NO_BLOCK        0xffffffff
+
+typedef struct {
+    uint32_t prev;      // offset of the block below, SCRATCH_NO_BLOCK for the first
+    uint32_t size;      // header + payload
+    uint32_t freed;
+    uint32_t reserved;
+} scratch_header_t;
+
+static_assert(sizeof(scratch_header_t) == SCRATCH_ALIGN, "scratch header must keep payloads aligned");
+
+static uint8_t scratch_region[EIDSP_SHARED_SCRATCH_SIZE] __attribute__((aligned(SCRATCH_ALIGN)));
+static size_t scratch_top = 0;
+static uint32_t scratch_last = SCRATCH_NO_BLOCK;
+static size_t scratch_high_water = 0;
+static size_t scratch_fallbacks = 0;
+// set while a session owns the region, cleared by the owner only
+static uint8_t scratch_owned = 0;
+// guards scratch_top / scratch_last, never waited on: allocations that find it
+// taken go to the heap, frees leave the unwinding to the next holder
+static uint8_t scratch_lock = 0;
+
+static inline bool scratch_try_lock()
+{
+    return !__atomic_test_and_set(&scratch_lock, __ATOMIC_ACQUIRE);
+}
+
+static inline void scratch_unlock()
+{
+    __atomic_clear(&scratch_lock, __ATOMIC_RELEASE);
+}
+
+// release the top of the stack, including blocks that were freed out of order
+static void scratch_unwind()
+{
+    while (scratch_last != SCRATCH_NO_BLOCK) {
+        scratch_header_t *last = (scratch_header_t *)&scratch_region[scratch_last];
+        if (!__atomic_load_n(&last->freed, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+        scratch_top = scratch_last;
+        scratch_last = last->prev;
+    }
+}
+
+static void *scratch_alloc(size_t size)
+{
+    size_t block_size = sizeof(scratch_header_t) + align_up(size, SCRATCH_ALIGN);
+
+    if (!__atomic_load_n(&scratch_owned, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    if (!scratch_try_lock()) {
+        __atomic_fetch_add(&scratch_fallbacks, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    scratch_unwind();
+
+    if (scratch_top + block_size > EIDSP_SHARED_SCRATCH_SIZE) {
+        __atomic_fetch_add(&scratch_fallbacks, 1, __ATOMIC_RELAXED);
+        scratch_unlock();
+        return NULL;
+    }
+
+    scratch_header_t *hdr = (scratch_header_t *)&scratch_region[scratch_top];
+    hdr->prev = scratch_last;
+    hdr->size = block_size;
+    hdr->freed = 0;
+
+    scratch_last = scratch_top;
+    scratch_top += block_size;
+
+    if (scratch_top > scratch_high_water) {
+        scratch_high_water = scratch_top;
+    }
+    // the region is one allocation as far as the peak is concerned, matrices
+    // in it are also tracked in ei_memory_in_use so it is not added on top
+    if (scratch_high_water > ei_memory_peak_use) {
+        ei_memory_peak_use = scratch_high_water;
+    }
+
+    scratch_unlock();
+
+    return hdr + 1;
+}
+
+bool scratch_planner::owns(void *ptr)
+{
+    return ((uint8_t *)ptr >= scratch_region) && ((uint8_t *)ptr < scratch_region + EIDSP_SHARED_SCRATCH_SIZE);
+}
+
+void *scratch_planner::malloc(size_t size)
+{
+    void *ptr = scratch_alloc(size);
+    return ptr ? ptr : ei_malloc(size);
+}
+
+void *scratch_planner::calloc(size_t num, size_t size)
+{
+    void *ptr = scratch_alloc(num * size);
+    if (!ptr) {
+        return ei_calloc(num, size);
+    }
+
+    memset(ptr, 0, num * size);
+    return ptr;
+}
+
+void scratch_planner::free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    if (!owns(ptr)) {
+        ei_free(ptr);
+        return;
+    }
+
+    scratch_header_t *hdr = (scratch_header_t *)ptr - 1;
+    __atomic_store_n(&hdr->freed, 1, __ATOMIC_RELEASE);
+
+    // if someone else holds the lock, they or the next allocation unwind
+    if (scratch_try_lock()) {
+        scratch_unwind();
+        scratch_unlock();
+    }
+}
+
+void *scratch_planner::aligned_calloc(size_t align, size_t size)
+{
+    if (align > SCRATCH_ALIGN) {
+        return ei_aligned_calloc(align, size);
+    }
+
+    void *ptr = scratch_alloc(size);
+    if (!ptr) {
+        return ei_aligned_calloc(align, size);
+    }
+
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+void scratch_planner::aligned_free(void *ptr)
+{
+    if (ptr && !owns(ptr)) {
+        ei_aligned_free(ptr);
+        return;
+    }
+
+    free(ptr);
+}
+
+bool scratch_planner::session_begin()
+{
+    uint8_t expected = 0;
+
+    return __atomic_compare_exchange_n(&scratch_owned, &expected, 1, false,
+        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+void scratch_planner::session_end()
+{
+    // stop handing out blocks first, so nothing lands between the check and the release
+    __atomic_store_n(&scratch_owned, 0, __ATOMIC_RELEASE);
+
+    // a free or allocation racing with the close holds the lock and unwinds itself
+    if (!scratch_try_lock()) {
+        return;
+    }
+    scratch_unwind();
+    size_t left = scratch_top;
+    scratch_unlock();
+
+    // everything allocated in a session must be freed before it closes,
+    // a block left behind pins the bottom of the region for later sessions
+    if (left != 0) {
+        ei_printf("ERR: %u bytes of shared scratch still in use at session end\n", (unsigned)left);
+#if EIDSP_USE_ASSERTS == 1
+        assert(false);
+#endif
+    }
+}
+
+size_t scratch_planner::in_use()
+{
+    return scratch_top;
+}
+
+size_t scratch_planner::high_water()
+{
+    return scratch_high_water;
+}
+
+size_t scratch_planner::heap_fallbacks()
+{
+    return scratch_fallbacks;
+}
+
+} // namespace ei
+
+#endif // EIDSP_SHARED_SCRATCH_SIZE > 0
@@ -47,6 +47,91 @@ typedef std::unique_ptr<void, void(*)(void*)> ei_unique_ptr_t;
 
 namespace ei {
 
+#if EIDSP_SHARED_SCRATCH_SIZE > 0
+/**
+ * Stack allocator over one preallocated region (EIDSP_SHARED_SCRATCH_SIZE bytes).
+ * While a session is open (see scratch_session) matrices, DSP scratch buffers
+ * and the tensor arena are carved from the region in allocation order. The
+ * feature matrices stay at the bottom, the DSP scratch on top of them is
+ * released when a block finishes, and the arena then takes its place.
+ * Frees that are not in LIFO order are deferred until the blocks above are gone.
+ * Requests that don't fit, come outside of a session, or race with another
+ * thread on the region go to the heap.
+ * There is one region and one session owner for the whole program, not one
+ * per thread. A process_impulse started on a second thread while a session is
+ * open does not own it: its buffers come from the region when the lock is
+ * free and from the heap otherwise (counted in heap_fallbacks()), and they
+ * are reported as leaked if the owner closes the session first. Serialize
+ * impulses, or build with EIDSP_SHARED_SCRATCH_SIZE 0, to run them concurrently.
+ * The high-water mark of the region is folded into ei_memory_peak_use.
+ */
+class scratch_planner {
+public:
+    static void *malloc(size_t size);
+    static void *calloc(size_t num, size_t size);
+    static void free(void *ptr);
+
+    /**
+     * Same signature as ei_aligned_calloc / ei_aligned_free so it can be
+     * handed to the inferencing engines for the tensor arena
+     */
+    static void *aligned_calloc(size_t align, size_t size);
+    static void aligned_free(void *ptr);
+
+    /**
+     * Open a session. Only one session owns the region at a time, whichever
+     * thread it runs on.
+     * @return true if the caller now owns the region and has to call
+     * session_end(), false if a session was already open (nested, or on
+     * another thread)
+     */
+    static bool session_begin();
+    /** Close the owned session, everything allocated in it must be freed */
+    static void session_end();
+
+    /** Bytes of the region currently in use (including deferred frees) */
+    static size_t in_use();
+    /**
+     * Highest number of bytes of the region ever in use, ei_memory_peak_use
+     * is raised to it as well
+     */
+    static size_t high_water();
+    /** Number of requests that did not fit and fell back to the heap */
+    static size_t heap_fallbacks();
+
+private:
+    static bool owns(void *ptr);
+};
+
+/**
+ * Opens a scratch_planner session for the lifetime of the object. Nested
+ * sessions (e.g. process_impulse called by the multi impulse scheduler) don't
+ * own the region and leave it to the outer one to close.
+ */
+class scratch_session {
+public:
+    scratch_session() : owner(scratch_planner::session_begin()) {}
+    ~scratch_session() { if (owner) { scratch_planner::session_end(); } }
+
+private:
+    const bool owner;
+};
+
+    #define ei_dsp_heap_malloc(size) ei::scratch_planner::malloc(size)
+    #define ei_dsp_heap_calloc(num, size) ei::scratch_planner::calloc(num, size)
+    #define ei_dsp_heap_free(ptr) ei::scratch_planner::free(ptr)
+    #define ei_dsp_arena_calloc ei::scratch_planner::aligned_calloc
+    #define ei_dsp_arena_free ei::scratch_planner::aligned_free
+    #define EI_DSP_SCRATCH_SESSION() ei::scratch_session __scratch_session__
+#else
+    #define ei_dsp_heap_malloc ei_malloc
+    #define ei_dsp_heap_calloc ei_calloc
+    #define ei_dsp_heap_free ei_free
+    #define ei_dsp_arena_calloc ei_aligned_calloc
+    #define ei_dsp_arena_free ei_aligned_free
+    #define EI_DSP_SCRATCH_SESSION() (void)0
+#endif // EIDSP_SHARED_SCRATCH_SIZE > 0
+
 /**
  * These are macros used to track allocations when running DSP processes.
  * Enable memory tracking through the EIDSP_TRACK_ALLOCATIONS macro.
@@ -120,9 +205,9 @@ namespace ei {
     #define ei_dsp_register_matrix_alloc(...) (void)0
     #define ei_dsp_register_free(...) (void)0
     #define ei_dsp_register_matrix_free(...) (void)0
-    #define ei_dsp_malloc ei_malloc
-    #define ei_dsp_calloc ei_calloc
-    #define ei_dsp_free(ptr, size) ei_free(ptr)
+    #define ei_dsp_malloc ei_dsp_heap_malloc
+    #define ei_dsp_calloc ei_dsp_heap_calloc
+    #define ei_dsp_free(ptr, size) ei_dsp_heap_free(ptr)
     #define EI_DSP_MATRIX(name, ...) matrix_t name(__VA_ARGS__); if (!name.buffer) { EIDSP_ERR(EIDSP_OUT_OF_MEM); }
     #define EI_DSP_MATRIX_B(name, ...) matrix_t name(__VA_ARGS__); if (!name.buffer) { EIDSP_ERR(EIDSP_OUT_OF_MEM); }
     #define EI_DSP_QUANTIZED_MATRIX(name, ...) quantized_matrix_t name(__VA_ARGS__); if (!name.buffer) { EIDSP_ERR(EIDSP_OUT_OF_MEM); }
@@ -139,7 +224,7 @@ public:
      * @param size The size of the memory block, in bytes.
      */
     static void *ei_wrapped_malloc(const char *fn, const char *file, int line, size_t size) {
-        void *ptr = ei_malloc(size);
+        void *ptr = ei_dsp_heap_malloc(size);
         if (ptr) {
             ei_dsp_register_alloc_internal(fn, file, line, size, ptr);
         }
@@ -153,7 +238,7 @@ public:
      * @param size Size of each element
      */
     static void *ei_wrapped_calloc(const char *fn, const char *file, int line, size_t num, size_t size) {
-        void *ptr = ei_calloc(num, size);
+        void *ptr = ei_dsp_heap_calloc(num, size);
         if (ptr) {
             ei_dsp_register_alloc_internal(fn, file, line, num * size, ptr);
         }
@@ -166,7 +251,7 @@ public:
      * @param size Size of the block of memory previously allocated.
      */
     static void ei_wrapped_free(const char *fn, const char *file, int line, void *ptr, size_t size) {
-        ei_free(ptr);
+        ei_dsp_heap_free(ptr);
         ei_dsp_register_free_internal(fn, file, line, size, ptr);
     }
 };
@@ -1492,6 +1492,32 @@ public:
         return EIDSP_OK;
     }
 
+    /**
+     * Create a signal structure from a window in a ring buffer.
+     * Reads are mapped onto the ring with at most two copies, so overlapping
+     * windows can be classified without moving the data.
+     * @param ring Ring and window start, make sure to keep this pointer alive
+     * @param data_size Number of samples in the window, at most ring->size
+     * @param signal Output signal
+     * @returns EIDSP_OK if ok
+     */
+    static int signal_from_ring_buffer(const signal_ring_t *ring, size_t data_size, signal_t *signal)
+    {
+        if (data_size > ring->size || ring->start >= ring->size) {
+            EIDSP_ERR(EIDSP_PARAMETER_INVALID);
+        }
+
+        signal->total_length = data_size;
+#ifdef __MBED__
+        signal->get_data = mbed::callback(&numpy::signal_ring_get_data, ring);
+#else
+        signal->get_data = [ring](size_t offset, size_t length, float *out_ptr) {
+            return numpy::signal_ring_get_data(ring, offset, length, out_ptr);
+        };
+#endif
+        return EIDSP_OK;
+    }
+
 #endif
 
 #if defined ( __GNUC__ )
@@ -1754,6 +1780,22 @@ public:
         return 0;
     }
 
+    static int signal_ring_get_data(const signal_ring_t *ring, size_t offset, size_t length, float *out_ptr)
+    {
+        size_t ix = ring->start + offset;
+        if (ix >= ring->size) {
+            ix -= ring->size;
+        }
+
+        size_t first = ring->size - ix;
+        if (first > length) {
+            first = length;
+        }
+        memcpy(out_ptr, ring->buffer + ix, first * sizeof(float));
+        memcpy(out_ptr + first, ring->buffer, (length - first) * sizeof(float));
+        return 0;
+    }
+
     static int signal_get_data_i16(int16_t *in_buffer, size_t offset, size_t length, int16_t *out_ptr)
     {
         memcpy(out_ptr, in_buffer + offset, length * sizeof(int16_t));
@@ -32,10 +32,18 @@
 #include "config.hpp"
 #include "edge-impulse-sdk/dsp/returntypes.h"
 
-#if EIDSP_TRACK_ALLOCATIONS
+#if EIDSP_TRACK_ALLOCATIONS || (EIDSP_SHARED_SCRATCH_SIZE > 0)
 #include "memory.hpp"
 #endif
 
+#if EIDSP_SHARED_SCRATCH_SIZE > 0
+#define EIDSP_MATRIX_CALLOC(num, size)  ei::scratch_planner::calloc(num, size)
+#define EIDSP_MATRIX_FREE(ptr)          ei::scratch_planner::free(ptr)
+#else
+#define EIDSP_MATRIX_CALLOC             ei_calloc
+#define EIDSP_MATRIX_FREE               ei_free
+#endif
+
 #ifdef __cplusplus
 namespace ei {
 #endif // __cplusplus
@@ -91,7 +99,7 @@ typedef struct ei_matrix {
             buffer_managed_by_me = false;
         }
         else {
-            buffer = (float*)ei_calloc(n_rows * n_cols * sizeof(float), 1);
+            buffer = (float*)EIDSP_MATRIX_CALLOC(n_rows * n_cols * sizeof(float), 1);
             buffer_managed_by_me = true;
         }
         rows = n_rows;
@@ -116,7 +124,7 @@ typedef struct ei_matrix {
 
     ~ei_matrix() {
         if (buffer && buffer_managed_by_me) {
-            ei_free(buffer);
+            EIDSP_MATRIX_FREE(buffer);
 
 #if EIDSP_TRACK_ALLOCATIONS
             if (_fn) {
@@ -190,7 +198,7 @@ typedef struct ei_matrix_i8 {
             buffer_managed_by_me = false;
         }
         else {
-            buffer = (int8_t*)ei_calloc(n_rows * n_cols * sizeof(int8_t), 1);
+            buffer = (int8_t*)EIDSP_MATRIX_CALLOC(n_rows * n_cols * sizeof(int8_t), 1);
             buffer_managed_by_me = true;
         }
         rows = n_rows;
@@ -215,7 +223,7 @@ typedef struct ei_matrix_i8 {
 
     ~ei_matrix_i8() {
         if (buffer && buffer_managed_by_me) {
-            ei_free(buffer);
+            EIDSP_MATRIX_FREE(buffer);
 
 #if EIDSP_TRACK_ALLOCATIONS
             if (_fn) {
@@ -286,7 +294,7 @@ typedef struct ei_matrix_i32 {
             buffer_managed_by_me = false;
         }
         else {
-            buffer = (int32_t*)ei_calloc(n_rows * n_cols * sizeof(int32_t), 1);
+            buffer = (int32_t*)EIDSP_MATRIX_CALLOC(n_rows * n_cols * sizeof(int32_t), 1);
             buffer_managed_by_me = true;
         }
         rows = n_rows;
@@ -311,7 +319,7 @@ typedef struct ei_matrix_i32 {
 
     ~ei_matrix_i32() {
         if (buffer && buffer_managed_by_me) {
-            ei_free(buffer);
+            EIDSP_MATRIX_FREE(buffer);
 
 #if EIDSP_TRACK_ALLOCATIONS
             if (_fn) {
@@ -393,7 +401,7 @@ typedef struct ei_quantized_matrix {
             buffer_managed_by_me = false;
         }
         else {
-            buffer = (uint8_t*)ei_calloc(n_rows * n_cols * sizeof(uint8_t), 1);
+            buffer = (uint8_t*)EIDSP_MATRIX_CALLOC(n_rows * n_cols * sizeof(uint8_t), 1);
             buffer_managed_by_me = true;
         }
         rows = n_rows;
@@ -418,7 +426,7 @@ typedef struct ei_quantized_matrix {
 
     ~ei_quantized_matrix() {
         if (buffer && buffer_managed_by_me) {
-            ei_free(buffer);
+            EIDSP_MATRIX_FREE(buffer);
 
 #if EIDSP_TRACK_ALLOCATIONS
             if (_fn) {
@@ -489,7 +497,7 @@ typedef struct ei_matrix_u8 {
             buffer_managed_by_me = false;
         }
         else {
-            buffer = (uint8_t*)ei_calloc(n_rows * n_cols * sizeof(uint8_t), 1);
+            buffer = (uint8_t*)EIDSP_MATRIX_CALLOC(n_rows * n_cols * sizeof(uint8_t), 1);
             buffer_managed_by_me = true;
         }
         rows = n_rows;
@@ -514,7 +522,7 @@ typedef struct ei_matrix_u8 {
 
     ~ei_matrix_u8() {
         if (buffer && buffer_managed_by_me) {
-            ei_free(buffer);
+            EIDSP_MATRIX_FREE(buffer);
 
 #if EIDSP_TRACK_ALLOCATIONS
             if (_fn) {
@@ -616,6 +624,24 @@ typedef struct ei_signal_t {
     size_t total_length;
 } signal_t;
 
+/**
+ * @brief Window into a circular sample buffer.
+ *
+ *  Lets a signal read a window straight from an acquisition ring, so sliding
+ *  windows do not need to be moved to the front of a linear buffer first.
+ *  Logical sample 0 of the window lives at `buffer[start]`, reads past the
+ *  end of the ring wrap around to `buffer[0]`. Use
+ *  `numpy::signal_from_ring_buffer()` to create a `signal_t` from it.
+ */
+typedef struct ei_signal_ring_t {
+    /** Ring storage, `size` samples */
+    const float *buffer;
+    /** Number of samples in the ring */
+    size_t size;
+    /** Index in `buffer` of the first sample of the window */
+    size_t start;
+} signal_ring_t;
+
 /** @} */
 
 #ifdef __cplusplus
@@ -320,6 +320,35 @@ public:
         }
     }
 
+    /**
+     * @brief Apply the filter of the config (if any) to the transposed and
+     * scaled input of extract_spec_features
+     */
+    static int filter_spec_input(
+        matrix_t *input_matrix,
+        ei_dsp_config_spectral_analysis_t *config,
+        const float sampling_freq)
+    {
+        if (config->filter_order == 0) {
+            return EIDSP_OK;
+        }
+        if (strcmp(config->filter_type, "low") == 0) {
+            return spectral::processing::butterworth_lowpass_filter(
+                input_matrix,
+                sampling_freq,
+                config->filter_cutoff,
+                config->filter_order);
+        }
+        if (strcmp(config->filter_type, "high") == 0) {
+            return spectral::processing::butterworth_highpass_filter(
+                input_matrix,
+                sampling_freq,
+                config->filter_cutoff,
+                config->filter_order);
+        }
+        return EIDSP_OK;
+    }
+
     /**
      * @brief Calculates the spectral analysis features.
      *
@@ -346,25 +375,12 @@ public:
 
         // apply filter, if enabled
         // "zero" order filter allowed.  will still remove unwanted fft bins later
+        EI_TRY(filter_spec_input(input_matrix, config, sampling_freq));
         if (strcmp(config->filter_type, "low") == 0) {
-            if( config->filter_order ) {
-                EI_TRY(spectral::processing::butterworth_lowpass_filter(
-                    input_matrix,
-                    sampling_freq,
-                    config->filter_cutoff,
-                    config->filter_order));
-            }
             do_filter = true;
             is_high_pass = false;
         }
         else if (strcmp(config->filter_type, "high") == 0) {
-            if( config->filter_order ) {
-                EI_TRY(spectral::processing::butterworth_highpass_filter(
-                    input_matrix,
-                    sampling_freq,
-                    config->filter_cutoff,
-                    config->filter_order));
-            }
             do_filter = true;
             is_high_pass = true;
         }
@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2022 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS
+ * IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language
+ * governing permissions and limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _EIDSP_SPECTRAL_FIXED_FEATURE_H_
+#define _EIDSP_SPECTRAL_FIXED_FEATURE_H_
+
+#include <stdint.h>
+#include "processing.hpp"
+#include "feature.hpp"
+
+/**
+ * Largest FFT length that is evaluated as a direct DFT over a twiddle table.
+ * Longer FFTs go through numpy::power_spectrum.
+ */
+#ifndef EIDSP_SPECTRAL_FIXED_DFT_MAX
+#define EIDSP_SPECTRAL_FIXED_DFT_MAX    64
+#endif
+
+/**
+ * Largest stack use (bytes) of the specialised path. Configs that need more
+ * use the generic implementation, which keeps its buffers on the heap.
+ */
+#ifndef EIDSP_SPECTRAL_FIXED_MAX_STACK
+#define EIDSP_SPECTRAL_FIXED_MAX_STACK  2048
+#endif
+
+namespace ei {
+namespace spectral {
+
+namespace fixed_detail {
+
+    static constexpr double pi = 3.14159265358979323846;
+
+    /**
+     * sin(x) for x in [-pi, pi], evaluated by the compiler
+     */
+    static constexpr double sin_series(double x)
+    {
+        double term = x;
+        double sum = x;
+        for (int i = 1; i < 14; i++) {
+            term *= -x * x / ((2.0 * i) * (2.0 * i + 1.0));
+            sum += term;
+        }
+        return sum;
+    }
+
+    static constexpr double wrap(double x)
+    {
+        return x > pi ? x - 2.0 * pi : x;
+    }
+
+    /**
+     * cos(2 pi j / N) and sin(2 pi j / N) for j in [0, N), placed in flash.
+     * Bin k of sample n uses entry (k * n) mod N.
+     */
+    template<size_t N>
+    struct twiddle_table {
+        float cos_t[N];
+        float sin_t[N];
+
+        constexpr twiddle_table() : cos_t(), sin_t()
+        {
+            for (size_t j = 0; j < N; j++) {
+                const double angle = 2.0 * pi * static_cast<double>(j) / static_cast<double>(N);
+                cos_t[j] = static_cast<float>(sin_series(wrap(wrap(angle) + pi / 2.0)));
+                sin_t[j] = static_cast<float>(sin_series(wrap(angle)));
+            }
+        }
+    };
+
+    template<size_t N>
+    struct twiddle {
+        static constexpr twiddle_table<N> table {};
+    };
+
+    template<size_t N>
+    constexpr twiddle_table<N> twiddle<N>::table;
+
+    static constexpr bool name_equals(const char *a, const char *b)
+    {
+        while (*a && *a == *b) {
+            a++;
+            b++;
+        }
+        return *a == *b;
+    }
+
+} // namespace fixed_detail
+
+/**
+ * @brief Filter of a spectral analysis config, mapped the same way as
+ * feature::extract_spec_features does ("low", "high", anything else is none)
+ */
+static constexpr filter_t filter_from_name(const char *filter_type)
+{
+    return fixed_detail::name_equals(filter_type, "low") ? filter_lowpass :
+        fixed_detail::name_equals(filter_type, "high") ? filter_highpass : filter_none;
+}
+
+/**
+ * Spectral analysis (FFT, implementation version 2) specialised on the
+ * generated DSP config. Produces the same features as
+ * feature::extract_spec_features, but all buffers live on the stack, the
+ * filter and bin selection are resolved at compile time and every loop has
+ * a constant trip count. The signal is read one axis at a time in chunks, so
+ * the stack holds one axis, not the whole window.
+ *
+ * @tparam AXES Number of interleaved axes in the input
+ * @tparam WINDOW Number of samples per axis
+ * @tparam FFT_LENGTH FFT length, power of two
+ * @tparam FILTER Filter type
+ * @tparam FILTER_ORDER Butterworth filter order
+ */
+template<size_t AXES, size_t WINDOW, size_t FFT_LENGTH, filter_t FILTER, uint8_t FILTER_ORDER>
+class fixed_feature {
+public:
+    static_assert(AXES > 0 && WINDOW > 0, "Spectral analysis needs at least one sample");
+    static_assert(FFT_LENGTH >= 2 && (FFT_LENGTH & (FFT_LENGTH - 1)) == 0,
+        "FFT length needs to be a power of two");
+
+    static constexpr size_t fft_out_size = FFT_LENGTH / 2 + 1;
+    static constexpr size_t chunk_rows = 16;
+
+    /** Bytes of stack taken by the feature buffers */
+    static constexpr size_t stack_bytes =
+        sizeof(float) * (WINDOW + 2 * fft_out_size + chunk_rows * AXES);
+    /** Whether the buffers fit in EIDSP_SPECTRAL_FIXED_MAX_STACK */
+    static constexpr bool fits_on_stack = stack_bytes <= EIDSP_SPECTRAL_FIXED_MAX_STACK;
+
+    /**
+     * @brief Calculate the spectral features over an interleaved signal
+     * @param signal Signal, WINDOW rows of AXES samples
+     * @param output_matrix Output features, one row
+     * @param config Runtime part of the config (scale, cutoff, log, overlap)
+     * @param sampling_freq Sampling frequency of the signal
+     * @returns 0 if OK, EIDSP_NOT_SUPPORTED if the buffers don't fit on the stack
+     */
+    static int extract(
+        signal_t *signal,
+        matrix_t *output_matrix,
+        const ei_dsp_config_spectral_analysis_t *config,
+        const float sampling_freq)
+    {
+        if (!fits_on_stack || signal->total_length != AXES * WINDOW) {
+            EIDSP_ERR(EIDSP_NOT_SUPPORTED);
+        }
+
+        size_t start_bin = 1;
+        size_t stop_bin = fft_out_size;
+        if (FILTER != filter_none) {
+            feature::get_start_stop_bin(
+                sampling_freq,
+                FFT_LENGTH,
+                config->filter_cutoff,
+                &start_bin,
+                &stop_bin,
+                FILTER == filter_highpass);
+        }
+        const size_t num_bins = stop_bin - start_bin;
+
+        if (output_matrix->rows * output_matrix->cols != AXES * (3 + num_bins)) {
+            EIDSP_ERR(EIDSP_MATRIX_SIZE_MISMATCH);
+        }
+
+        // sized down when they don't fit, extract() bails out above then
+        float axis[fits_on_stack ? WINDOW : 1];
+        float power[fits_on_stack ? fft_out_size : 1];
+        float chunk[fits_on_stack ? chunk_rows * AXES : 1];
+        float *feature_out = output_matrix->buffer;
+
+        for (size_t a = 0; a < AXES; a++) {
+            // de-interleave and scale in one pass
+            const float scale = config->scale_axes;
+            for (size_t row = 0; row < WINDOW; row += chunk_rows) {
+                const size_t rows = row + chunk_rows <= WINDOW ? chunk_rows : WINDOW - row;
+                EI_TRY(signal->get_data(row * AXES, rows * AXES, chunk));
+                for (size_t i = 0; i < rows; i++) {
+                    axis[row + i] = chunk[i * AXES + a] * scale;
+                }
+            }
+
+            if (FILTER != filter_none && FILTER_ORDER > 0) {
+                matrix_t axis_matrix(1, WINDOW, axis);
+                if (FILTER == filter_lowpass) {
+                    EI_TRY(processing::butterworth_lowpass_filter(
+                        &axis_matrix, sampling_freq, config->filter_cutoff, FILTER_ORDER));
+                }
+                else {
+                    EI_TRY(processing::butterworth_highpass_filter(
+                        &axis_matrix, sampling_freq, config->filter_cutoff, FILTER_ORDER));
+                }
+            }
+
+            float mean = 0.0f;
+            for (size_t i = 0; i < WINDOW; i++) {
+                mean += axis[i];
+            }
+            mean /= static_cast<float>(WINDOW);
+
+            // mean removal, RMS, skewness and kurtosis in one pass
+            float sum_2 = 0.0f;
+            float sum_3 = 0.0f;
+            float sum_4 = 0.0f;
+            for (size_t i = 0; i < WINDOW; i++) {
+                const float v = axis[i] - mean;
+                const float v_2 = v * v;
+                axis[i] = v;
+                sum_2 += v_2;
+                sum_3 += v_2 * v;
+                sum_4 += v_2 * v_2;
+            }
+
+            float stddev = sqrtf(sum_2 / static_cast<float>(WINDOW));
+            *feature_out++ = stddev;
+            if (stddev == 0.0f) {
+                stddev = 1e-10f;
+            }
+            const float stddev_3 = stddev * stddev * stddev;
+            *feature_out++ = (sum_3 / WINDOW) / stddev_3;
+            *feature_out++ = ((sum_4 / WINDOW) / (stddev_3 * stddev)) - 3;
+
+            EI_TRY(welch_max_hold(axis, power, config->do_fft_overlap));
+
+            for (size_t i = 0; i < num_bins; i++) {
+                float v = power[start_bin + i];
+                if (config->do_log) {
+                    v = numpy::log10(v == 0.0f ? 1e-10f : v);
+                }
+                feature_out[i] = v;
+            }
+            feature_out += num_bins;
+        }
+
+        return EIDSP_OK;
+    }
+
+private:
+    /**
+     * @brief Max hold over the power spectrum of every (zero padded) frame
+     */
+    static int welch_max_hold(const float *axis, float *power, bool do_overlap)
+    {
+        const size_t step = do_overlap ? FFT_LENGTH / 2 : FFT_LENGTH;
+        float frame_power[fits_on_stack ? fft_out_size : 1];
+
+        for (size_t k = 0; k < fft_out_size; k++) {
+            power[k] = 0.0f;
+        }
+
+        for (size_t ix = 0; ix < WINDOW; ix += step) {
+            const size_t n_points = ix + FFT_LENGTH <= WINDOW ? FFT_LENGTH : WINDOW - ix;
+            EI_TRY(frame_power_spectrum(axis + ix, n_points, frame_power));
+            for (size_t k = 0; k < fft_out_size; k++) {
+                power[k] = frame_power[k] > power[k] ? frame_power[k] : power[k];
+            }
+        }
+
+        return EIDSP_OK;
+    }
+
+    static int frame_power_spectrum(const float *frame, size_t n_points, float *out)
+    {
+        if (FFT_LENGTH > EIDSP_SPECTRAL_FIXED_DFT_MAX) {
+            EI_TRY(numpy::power_spectrum(
+                const_cast<float *>(frame), n_points, out, fft_out_size, FFT_LENGTH));
+            return EIDSP_OK;
+        }
+
+        const fixed_detail::twiddle_table<FFT_LENGTH> &tw =
+            fixed_detail::twiddle<FFT_LENGTH>::table;
+
+        for (size_t k = 0; k < fft_out_size; k++) {
+            float re = 0.0f;
+            float im = 0.0f;
+            size_t phase = 0;
+            for (size_t n = 0; n < n_points; n++) {
+                re += frame[n] * tw.cos_t[phase];
+                im -= frame[n] * tw.sin_t[phase];
+                phase = (phase + k) & (FFT_LENGTH - 1);
+            }
+            out[k] = (re * re + im * im) * (1.0f / static_cast<float>(FFT_LENGTH));
+        }
+
+        return EIDSP_OK;
+    }
+};
+
+} // namespace spectral
+} // namespace ei
+
+#endif // _EIDSP_SPECTRAL_FIXED_FEATURE_H_
@@ -25,6 +25,8 @@
 #include "edge-impulse-sdk/dsp/ei_vector.h"
 #include <assert.h>
 #include <string.h>
+#include <stddef.h>
+#include <algorithm>
 
 namespace ei {
 
@@ -230,63 +232,161 @@ public:
     }
 
     /**
-     * @brief Upsample, FIR and downsample.
-     * This is the counterpart of scipy.signal.upfirdn without the padding.
-     * @param y Input signal
-     * @param y Output signal
-     * @param h FIR coefficients
+     * @brief Polyphase form of an upfirdn FIR.
+     * The filter is split into `up` sub-filters once, every retained output
+     * then only needs the taps of its own phase: nh / up multiply-adds
+     * instead of building and convolving the zero stuffed signal.
      */
-    static void upfirdn(const float * x, size_t x_size, fvec &y, int up, int down, const fvec &h)
-    {
-        assert(up > 0);
-        assert(down > 0);
-        assert(h.size() > 0);
-
-#if 0 // bug in optimized version
-        const int N = (h.size() - 1) / 2;
+    class upfirdn_filter {
+    public:
+        upfirdn_filter(const fvec &h, int up, int down)
+            : up(up), down(down), skip((h.size() - 1) / 2),
+              taps((h.size() + up - 1) / up), phases(up * taps)
+        {
+            assert(up > 0);
+            assert(down > 0);
+            assert(h.size() > 0);
 
-        for (size_t n = 0; n < y.size(); n++) {
-            float acc = 0.0f;
-            for (size_t k = 0; k < h.size(); k += up) {
-                const size_t x_ind = n * down + k - N;
-                if (x_ind >= 0 && x_ind < x.size()) {
-                    acc += h[k] * x[x_ind];
-                }
+            // phase p holds h[p], h[p + up], h[p + 2 * up], ... zero padded to taps
+            for (size_t j = 0; j < h.size(); j++) {
+                phases[(j % up) * taps + j / up] = h[j];
             }
-            y[n] = acc;
         }
-#else
-        int nx = x_size;
-        int nh = h.size();
 
-        // Upsample the input signal by inserting zeros
-        fvec r(up * nx);
-        for (int i = 0; i < nx; i++)
+        /**
+         * @brief Number of outputs for nx inputs, same as scipy.signal.resample_poly
+         */
+        size_t output_size(size_t nx) const
         {
-            r[i * up] = x[i];
+            size_t n_out = nx * up;
+            return n_out / down + (n_out % down == 0 ? 0 : 1);
         }
 
-        // Filter the upsampled signal using the given filter coefficients
-        fvec z(nh + up * nx - 1);
-        for (int i = 0; i < up * nx; i++)
+        /**
+         * @brief Filter one block of input, outputs past the end of the
+         * upsampled input are zero
+         * @param x Input signal
+         * @param nx Input size
+         * @param y Output signal
+         * @param ny Number of outputs to calculate
+         */
+        void apply(const float *x, size_t nx, float *y, size_t ny) const
         {
-            for (int j = 0; j < nh; j++)
-            {
-                if (i - j >= 0 && i - j < up * nx)
-                {
-                    z[i] += r[i - j] * h[j];
+            size_t m = skip;
+            for (size_t n = 0; n < ny; n++, m += down) {
+                if (m >= nx * up) {
+                    y[n] = 0.0f;
+                    continue;
+                }
+                const size_t base = m / up;
+                const float *hp = &phases[(m % up) * taps];
+                const size_t k_end = base + 1 < taps ? base + 1 : taps;
+                float acc = 0.0f;
+                for (size_t k = 0; k < k_end; k++) {
+                    acc += hp[k] * x[base - k];
                 }
+                y[n] = acc;
             }
         }
 
-        // Downsample the filtered signal by skipping samples
-        int skip = (nh - 1) / 2;
-        for (size_t i = 0; i < y.size(); i++)
+    protected:
+        const size_t up;
+        const size_t down;
+        const size_t skip;
+        const size_t taps;
+        fvec phases;
+    };
+
+    /**
+     * @brief Streaming upfirdn. Keeps the last input samples and the output
+     * phase between calls, so consecutive windows give the same result as
+     * filtering the concatenated signal at once.
+     */
+    class upfirdn_stream : public upfirdn_filter {
+    public:
+        upfirdn_stream(const fvec &h, int up, int down)
+            : upfirdn_filter(h, up, down), history(taps - 1)
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            std::fill(history.begin(), history.end(), 0.0f);
+            consumed = 0;
+            next_m = skip;
+        }
+
+        /**
+         * @brief Upper bound of the outputs produced for nx new inputs
+         */
+        size_t max_output_size(size_t nx) const
         {
-            y[i] = z[i * down + skip];
+            return (nx * up) / down + 1;
         }
-#endif
 
+        /**
+         * @brief Filter the next block of input
+         * @param x Input signal, continues the previous block
+         * @param nx Input size
+         * @param y Output signal, at least max_output_size(nx) long
+         * @returns number of outputs written
+         */
+        size_t process(const float *x, size_t nx, float *y)
+        {
+            const size_t hist_size = history.size();
+            const size_t end = (consumed + nx) * up;
+            size_t n = 0;
+
+            for (; next_m < end; next_m += down) {
+                const size_t base = next_m / up;
+                const float *hp = &phases[(next_m % up) * taps];
+                // taps that fall into this block, the rest come from history
+                const size_t in_block = base - consumed + 1;
+                const size_t k_block = in_block < taps ? in_block : taps;
+                const float *xb = x + (base - consumed);
+                float acc = 0.0f;
+                size_t k = 0;
+                for (; k < k_block; k++) {
+                    acc += hp[k] * xb[-(ptrdiff_t)k];
+                }
+                for (; k < taps; k++) {
+                    acc += hp[k] * history[hist_size - (k - in_block) - 1];
+                }
+                y[n++] = acc;
+            }
+
+            // keep the last taps - 1 inputs for the next block
+            if (nx >= hist_size) {
+                memcpy(history.data(), x + nx - hist_size, hist_size * sizeof(float));
+            }
+            else {
+                memmove(history.data(), history.data() + nx, (hist_size - nx) * sizeof(float));
+                memcpy(history.data() + hist_size - nx, x, nx * sizeof(float));
+            }
+            consumed += nx;
+
+            return n;
+        }
+
+    private:
+        fvec history;
+        size_t consumed;
+        size_t next_m;
+    };
+
+    /**
+     * @brief Upsample, FIR and downsample.
+     * This is the counterpart of scipy.signal.upfirdn without the padding.
+     * Use upfirdn_filter directly to reuse the polyphase split across calls.
+     * @param x Input signal
+     * @param y Output signal
+     * @param h FIR coefficients
+     */
+    static void upfirdn(const float * x, size_t x_size, fvec &y, int up, int down, const fvec &h)
+    {
+        upfirdn_filter filter(h, up, down);
+        filter.apply(x, x_size, y.data(), y.size());
     }
 
     /**
@@ -41,246 +41,223 @@ inline float dot(const float *x, const float *y, size_t sz)
     return sum;
 }
 
-inline void histo(const fvec &x, size_t nbins, fvec &h, bool normalize = false)
-{
-    float min = *std::min_element(x.begin(), x.end());
-    float max = *std::max_element(x.begin(), x.end());
-    float step = (max - min) / nbins;
-    h.resize(nbins);
-    for (size_t i = 0; i < x.size(); i++) {
-        size_t bin = (x[i] - min) / step;
-        if (bin >= nbins)
-            bin = nbins - 1;
-        h[bin]++;
-    }
-    if (normalize) {
-        float s = numpy::sum(h.data(), h.size());
-        for (size_t i = 0; i < nbins; i++) {
-            h[i] /= s;
-        }
-    }
-}
-
 class wavelet {
 
     static constexpr size_t NUM_FEATHERS_PER_COMP = 14;
+    static constexpr size_t MAX_FILTER_SIZE = 20;
+    static constexpr size_t NUM_HISTOGRAM_BINS = 100;
 
-    template <size_t wave_size>
-    static void get_filter(const std::array<std::array<float, wave_size>, 2> wav, fvec &h, fvec &g)
-    {
-        size_t n = wav[0].size();
-        h.resize(n);
-        g.resize(n);
-        for (size_t i = 0; i < n; i++) {
-            h[i] = wav[0][n - i - 1];
-            g[i] = wav[1][n - i - 1];
-        }
-    }
+    typedef struct {
+        const char *name;
+        size_t size;
+        const float *dec_lo;
+        const float *dec_hi;
+    } wavelet_filter_t;
 
-    static void find_filter(const char *wav, fvec &h, fvec &g)
+    static const wavelet_filter_t *find_filter(const char *wav)
     {
-        if (strcmp(wav, "bior1.3") == 0) get_filter<6>(bior1p3, h, g);
-        else if (strcmp(wav, "bior1.5") == 0) get_filter<10>(bior1p5, h, g);
-        else if (strcmp(wav, "bior2.2") == 0) get_filter<6>(bior2p2, h, g);
-        else if (strcmp(wav, "bior2.4") == 0) get_filter<10>(bior2p4, h, g);
-        else if (strcmp(wav, "bior2.6") == 0) get_filter<14>(bior2p6, h, g);
-        else if (strcmp(wav, "bior2.8") == 0) get_filter<18>(bior2p8, h, g);
-        else if (strcmp(wav, "bior3.1") == 0) get_filter<4>(bior3p1, h, g);
-        else if (strcmp(wav, "bior3.3") == 0) get_filter<8>(bior3p3, h, g);
-        else if (strcmp(wav, "bior3.5") == 0) get_filter<12>(bior3p5, h, g);
-        else if (strcmp(wav, "bior3.7") == 0) get_filter<16>(bior3p7, h, g);
-        else if (strcmp(wav, "bior3.9") == 0) get_filter<20>(bior3p9, h, g);
-        else if (strcmp(wav, "bior4.4") == 0) get_filter<10>(bior4p4, h, g);
-        else if (strcmp(wav, "bior5.5") == 0) get_filter<12>(bior5p5, h, g);
-        else if (strcmp(wav, "bior6.8") == 0) get_filter<18>(bior6p8, h, g);
-        else if (strcmp(wav, "coif1") == 0) get_filter<6>(coif1, h, g);
-        else if (strcmp(wav, "coif2") == 0) get_filter<12>(coif2, h, g);
-        else if (strcmp(wav, "coif3") == 0) get_filter<18>(coif3, h, g);
-        else if (strcmp(wav, "db2") == 0) get_filter<4>(db2, h, g);
-        else if (strcmp(wav, "db3") == 0) get_filter<6>(db3, h, g);
-        else if (strcmp(wav, "db4") == 0) get_filter<8>(db4, h, g);
-        else if (strcmp(wav, "db5") == 0) get_filter<10>(db5, h, g);
-        else if (strcmp(wav, "db6") == 0) get_filter<12>(db6, h, g);
-        else if (strcmp(wav, "db7") == 0) get_filter<14>(db7, h, g);
-        else if (strcmp(wav, "db8") == 0) get_filter<16>(db8, h, g);
-        else if (strcmp(wav, "db9") == 0) get_filter<18>(db9, h, g);
-        else if (strcmp(wav, "db10") == 0) get_filter<20>(db10, h, g);
-        else if (strcmp(wav, "haar") == 0) get_filter<2>(haar, h, g);
-        else if (strcmp(wav, "rbio1.3") == 0) get_filter<6>(rbio1p3, h, g);
-        else if (strcmp(wav, "rbio1.5") == 0) get_filter<10>(rbio1p5, h, g);
-        else if (strcmp(wav, "rbio2.2") == 0) get_filter<6>(rbio2p2, h, g);
-        else if (strcmp(wav, "rbio2.4") == 0) get_filter<10>(rbio2p4, h, g);
-        else if (strcmp(wav, "rbio2.6") == 0) get_filter<14>(rbio2p6, h, g);
-        else if (strcmp(wav, "rbio2.8") == 0) get_filter<18>(rbio2p8, h, g);
-        else if (strcmp(wav, "rbio3.1") == 0) get_filter<4>(rbio3p1, h, g);
-        else if (strcmp(wav, "rbio3.3") == 0) get_filter<8>(rbio3p3, h, g);
-        else if (strcmp(wav, "rbio3.5") == 0) get_filter<12>(rbio3p5, h, g);
-        else if (strcmp(wav, "rbio3.7") == 0) get_filter<16>(rbio3p7, h, g);
-        else if (strcmp(wav, "rbio3.9") == 0) get_filter<20>(rbio3p9, h, g);
-        else if (strcmp(wav, "rbio4.4") == 0) get_filter<10>(rbio4p4, h, g);
-        else if (strcmp(wav, "rbio5.5") == 0) get_filter<12>(rbio5p5, h, g);
-        else if (strcmp(wav, "rbio6.8") == 0) get_filter<18>(rbio6p8, h, g);
-        else if (strcmp(wav, "sym2") == 0) get_filter<4>(sym2, h, g);
-        else if (strcmp(wav, "sym3") == 0) get_filter<6>(sym3, h, g);
-        else if (strcmp(wav, "sym4") == 0) get_filter<8>(sym4, h, g);
-        else if (strcmp(wav, "sym5") == 0) get_filter<10>(sym5, h, g);
-        else if (strcmp(wav, "sym6") == 0) get_filter<12>(sym6, h, g);
-        else if (strcmp(wav, "sym7") == 0) get_filter<14>(sym7, h, g);
-        else if (strcmp(wav, "sym8") == 0) get_filter<16>(sym8, h, g);
-        else if (strcmp(wav, "sym9") == 0) get_filter<18>(sym9, h, g);
-        else if (strcmp(wav, "sym10") == 0) get_filter<20>(sym10, h, g);
-        else assert(0); // wavelet not in the list
-    }
-
-    static void calculate_entropy(const fvec &y, fvec &features)
-    {
-        fvec h;
-        histo(y, 100, h, true);
-        // entropy = -sum(prob * log(prob)
-        float entropy = 0.0f;
-        for (size_t i = 0; i < h.size(); i++) {
-            if (h[i] > 0.0f) {
-                entropy -= h[i] * log(h[i]);
+        static const wavelet_filter_t filters[] = {
+            { "bior1.3", 6, &bior1p3[0][0], &bior1p3[1][0] },
+            { "bior1.5", 10, &bior1p5[0][0], &bior1p5[1][0] },
+            { "bior2.2", 6, &bior2p2[0][0], &bior2p2[1][0] },
+            { "bior2.4", 10, &bior2p4[0][0], &bior2p4[1][0] },
+            { "bior2.6", 14, &bior2p6[0][0], &bior2p6[1][0] },
+            { "bior2.8", 18, &bior2p8[0][0], &bior2p8[1][0] },
+            { "bior3.1", 4, &bior3p1[0][0], &bior3p1[1][0] },
+            { "bior3.3", 8, &bior3p3[0][0], &bior3p3[1][0] },
+            { "bior3.5", 12, &bior3p5[0][0], &bior3p5[1][0] },
+            { "bior3.7", 16, &bior3p7[0][0], &bior3p7[1][0] },
+            { "bior3.9", 20, &bior3p9[0][0], &bior3p9[1][0] },
+            { "bior4.4", 10, &bior4p4[0][0], &bior4p4[1][0] },
+            { "bior5.5", 12, &bior5p5[0][0], &bior5p5[1][0] },
+            { "bior6.8", 18, &bior6p8[0][0], &bior6p8[1][0] },
+            { "coif1", 6, &coif1[0][0], &coif1[1][0] },
+            { "coif2", 12, &coif2[0][0], &coif2[1][0] },
+            { "coif3", 18, &coif3[0][0], &coif3[1][0] },
+            { "db2", 4, &db2[0][0], &db2[1][0] },
+            { "db3", 6, &db3[0][0], &db3[1][0] },
+            { "db4", 8, &db4[0][0], &db4[1][0] },
+            { "db5", 10, &db5[0][0], &db5[1][0] },
+            { "db6", 12, &db6[0][0], &db6[1][0] },
+            { "db7", 14, &db7[0][0], &db7[1][0] },
+            { "db8", 16, &db8[0][0], &db8[1][0] },
+            { "db9", 18, &db9[0][0], &db9[1][0] },
+            { "db10", 20, &db10[0][0], &db10[1][0] },
+            { "haar", 2, &haar[0][0], &haar[1][0] },
+            { "rbio1.3", 6, &rbio1p3[0][0], &rbio1p3[1][0] },
+            { "rbio1.5", 10, &rbio1p5[0][0], &rbio1p5[1][0] },
+            { "rbio2.2", 6, &rbio2p2[0][0], &rbio2p2[1][0] },
+            { "rbio2.4", 10, &rbio2p4[0][0], &rbio2p4[1][0] },
+            { "rbio2.6", 14, &rbio2p6[0][0], &rbio2p6[1][0] },
+            { "rbio2.8", 18, &rbio2p8[0][0], &rbio2p8[1][0] },
+            { "rbio3.1", 4, &rbio3p1[0][0], &rbio3p1[1][0] },
+            { "rbio3.3", 8, &rbio3p3[0][0], &rbio3p3[1][0] },
+            { "rbio3.5", 12, &rbio3p5[0][0], &rbio3p5[1][0] },
+            { "rbio3.7", 16, &rbio3p7[0][0], &rbio3p7[1][0] },
+            { "rbio3.9", 20, &rbio3p9[0][0], &rbio3p9[1][0] },
+            { "rbio4.4", 10, &rbio4p4[0][0], &rbio4p4[1][0] },
+            { "rbio5.5", 12, &rbio5p5[0][0], &rbio5p5[1][0] },
+            { "rbio6.8", 18, &rbio6p8[0][0], &rbio6p8[1][0] },
+            { "sym2", 4, &sym2[0][0], &sym2[1][0] },
+            { "sym3", 6, &sym3[0][0], &sym3[1][0] },
+            { "sym4", 8, &sym4[0][0], &sym4[1][0] },
+            { "sym5", 10, &sym5[0][0], &sym5[1][0] },
+            { "sym6", 12, &sym6[0][0], &sym6[1][0] },
+            { "sym7", 14, &sym7[0][0], &sym7[1][0] },
+            { "sym8", 16, &sym8[0][0], &sym8[1][0] },
+            { "sym9", 18, &sym9[0][0], &sym9[1][0] },
+            { "sym10", 20, &sym10[0][0], &sym10[1][0] },
+        };
+
+        // once per call to extract_wavelet_features, not worth caching
+        for (size_t ix = 0; ix < sizeof(filters) / sizeof(filters[0]); ix++) {
+            if (strcmp(wav, filters[ix].name) == 0) {
+                return &filters[ix];
             }
         }
-        features.push_back(entropy);
+        return nullptr; // wavelet not in the list
     }
 
-    static float get_percentile_from_sorted(const fvec &sorted, float percentile)
+    static size_t get_percentile_index(size_t size, float percentile)
     {
         // adding 0.5 is a trick to get rounding out of C flooring behavior during cast
-        size_t index = (size_t) ((percentile * (sorted.size()-1)) + 0.5);
-        return sorted[index];
+        return (size_t) ((percentile * (size - 1)) + 0.5);
     }
 
-    static void calculate_statistics(const fvec &y, fvec &features, float mean)
+    /**
+     * @brief Get y[k] as it would be after sorting y. Only [first, last) is
+     * partitioned, the rest of y is already split around earlier selections.
+     */
+    static float select(float *y, size_t first, size_t last, size_t k)
     {
-        fvec sorted = y;
-        std::sort(sorted.begin(), sorted.end());
-        features.push_back(get_percentile_from_sorted(sorted,0.05));
-        features.push_back(get_percentile_from_sorted(sorted,0.25));
-        features.push_back(get_percentile_from_sorted(sorted,0.75));
-        features.push_back(get_percentile_from_sorted(sorted,0.95));
-        features.push_back(get_percentile_from_sorted(sorted,0.5));
-
-        matrix_t x(1, y.size(), const_cast<float *>(y.data()));
-        matrix_t out(1, 1);
-
-        features.push_back(mean);
-        if (numpy::stdev(&x, &out) == EIDSP_OK)
-            features.push_back(out.get_row_ptr(0)[0]);
-        features.push_back(numpy::variance(const_cast<float *>(y.data()), y.size()));
-        if (numpy::rms(&x, &out) == EIDSP_OK)
-            features.push_back(out.get_row_ptr(0)[0]);
-        if (numpy::skew(&x, &out) == EIDSP_OK)
-            features.push_back(out.get_row_ptr(0)[0]);
-        if (numpy::kurtosis(&x, &out) == EIDSP_OK)
-            features.push_back(out.get_row_ptr(0)[0]);
+        if (k >= first && k < last) {
+            std::nth_element(y + first, y + k, y + last);
+        }
+        return y[k];
     }
 
-    static void calculate_crossings(const fvec &y, fvec &features, float mean)
+    /**
+     * @brief Calculate the 14 features of one component. Two passes over the
+     * coefficients for the moments, crossings and histogram, then selection
+     * for the percentiles (reorders y).
+     */
+    static void extract_features(float *y, size_t n, float *features)
     {
+        float sum = 0.0f;
+        float min = y[0];
+        float max = y[0];
         size_t zc = 0;
-        for (size_t i = 1; i < y.size(); i++) {
-            if (y[i] * y[i - 1] < 0) {
+        for (size_t i = 0; i < n; i++) {
+            sum += y[i];
+            min = y[i] < min ? y[i] : min;
+            max = y[i] > max ? y[i] : max;
+            if (i > 0 && y[i] * y[i - 1] < 0) {
                 zc++;
             }
         }
-        features.push_back(zc / (float)y.size());
-
+        const float mean = sum / n;
+
+        uint32_t histogram[NUM_HISTOGRAM_BINS] = { 0 };
+        const float step = (max - min) / NUM_HISTOGRAM_BINS;
+        float sum_sq = 0.0f;
+        float m_2 = 0.0f;
+        float m_3 = 0.0f;
+        float m_4 = 0.0f;
         size_t mc = 0;
-        for (size_t i = 1; i < y.size(); i++) {
-            if ((y[i] - mean) * (y[i - 1] - mean) < 0) {
+        for (size_t i = 0; i < n; i++) {
+            const float diff = y[i] - mean;
+            const float square_diff = diff * diff;
+            sum_sq += y[i] * y[i];
+            m_2 += square_diff;
+            m_3 += square_diff * diff;
+            m_4 += square_diff * square_diff;
+            if (i > 0 && diff * (y[i - 1] - mean) < 0) {
                 mc++;
             }
+
+            size_t bin = step > 0.0f ? (size_t)((y[i] - min) / step) : 0;
+            if (bin >= NUM_HISTOGRAM_BINS) {
+                bin = NUM_HISTOGRAM_BINS - 1;
+            }
+            histogram[bin]++;
+        }
+
+        // entropy = -sum(prob * log(prob)
+        float entropy = 0.0f;
+        for (size_t i = 0; i < NUM_HISTOGRAM_BINS; i++) {
+            if (histogram[i] > 0) {
+                float prob = histogram[i] / (float)n;
+                entropy -= prob * log(prob);
+            }
         }
-        features.push_back(mc / (float)y.size());
+
+        // percentiles, every selection narrows the range for the next one
+        const size_t ix_5 = get_percentile_index(n, 0.05);
+        const size_t ix_25 = get_percentile_index(n, 0.25);
+        const size_t ix_50 = get_percentile_index(n, 0.5);
+        const size_t ix_75 = get_percentile_index(n, 0.75);
+        const size_t ix_95 = get_percentile_index(n, 0.95);
+        const float p_50 = select(y, 0, n, ix_50);
+        const float p_25 = select(y, 0, ix_50, ix_25);
+        const float p_5 = select(y, 0, ix_25, ix_5);
+        const float p_75 = select(y, ix_50 + 1, n, ix_75);
+        const float p_95 = select(y, ix_75 + 1, n, ix_95);
+
+        const float skew_m_2 = sqrt((m_2 / n) * (m_2 / n) * (m_2 / n));
+        const float kurt_m_2 = (m_2 / n) * (m_2 / n);
+
+        *features++ = entropy;
+        *features++ = zc / (float)n;
+        *features++ = mc / (float)n;
+        *features++ = p_5;
+        *features++ = p_25;
+        *features++ = p_75;
+        *features++ = p_95;
+        *features++ = p_50;
+        *features++ = mean;
+        *features++ = sqrt(m_2 / n);
+        *features++ = m_2 / (n - 1);
+        *features++ = sqrt(sum_sq / static_cast<float>(n));
+        *features++ = skew_m_2 == 0.0f ? 0.0f : (m_3 / n) / skew_m_2;
+        *features++ = kurt_m_2 == 0.0f ? -3.0f : ((m_4 / n) / kurt_m_2) - 3.0f;
     }
 
-    static void
-    dwt(const float *x, size_t nx, const float *h, const float *g, size_t nh, fvec &a, fvec &d)
+    /**
+     * @brief Symmetric padding (default in PyWavelet) around the nx samples
+     * stored at x_padded + nh - 2
+     */
+    static void pad(float *x_padded, size_t nx, size_t nh)
     {
-        assert(nh <= 20 && nh > 0 && nx > 0);
-        size_t nx_padded = nx + nh * 2 - 2;
-        fvec x_padded(nx_padded);
-
-        // symmetric padding (default in PyWavelet)
+        const float *x = x_padded + nh - 2;
         for (size_t i = 0; i < nh - 2; i++)
             x_padded[i] = x[nh - 3 - i];
-        for (size_t i = 0; i < nx; i++)
-            x_padded[i + nh - 2] = x[i];
         for (size_t i = 0; i < nh; i++)
             x_padded[i + nx + nh - 2] = x[nx - 1 - i];
+    }
 
+    /**
+     * @brief One decomposition level. Reads the padded input, writes the
+     * approximation straight into the data part of the next padded buffer
+     * and the details into d.
+     * @returns number of coefficients per output
+     */
+    static size_t
+    dwt(const float *x_padded, size_t nx, const float *h, const float *g, size_t nh, float *a_padded, float *d)
+    {
         size_t ny = (nx + nh - 1) / 2;
-        a.resize(ny);
-        d.resize(ny);
+        float *a = a_padded + nh - 2;
 
         // decimate and filter
-        const float *xx = x_padded.data();
         for (size_t i = 0; i < ny; i++) {
-            a[i] = dot(xx + 2 * i, h, nh);
-            d[i] = dot(xx + 2 * i, g, nh);
+            a[i] = dot(x_padded + 2 * i, h, nh);
+            d[i] = dot(x_padded + 2 * i, g, nh);
         }
 
-        numpy::underflow_handling(d.data(), d.size());
-        numpy::underflow_handling(a.data(), a.size());
-    }
+        numpy::underflow_handling(d, ny);
+        numpy::underflow_handling(a, ny);
 
-    static void extract_features(fvec& y, fvec &features)
-    {
-        matrix_t x(1, y.size(), const_cast<float *>(y.data()));
-        matrix_t out(1, 1);
-        if (numpy::mean(&x, &out) != EIDSP_OK)
-            assert(0);
-        float mean = out.get_row_ptr(0)[0];
-
-        calculate_entropy(y, features);
-        calculate_crossings(y, features, mean);
-        calculate_statistics(y, features, mean);
-    }
-
-    static void
-    wavedec_features(const float *x, int len, const char *wav, int level, fvec &features)
-    {
-        assert(level > 0 && level < 8);
-
-        fvec h;
-        fvec g;
-        find_filter(wav, h, g);
-
-        features.clear();
-        fvec a;
-        fvec d;
-        dwt(x, len, h.data(), g.data(), h.size(), a, d);
-        extract_features(d, features);
-
-        for (int l = 1; l < level; l++) {
-            dwt(a.data(), a.size(), h.data(), g.data(), h.size(), a, d);
-            extract_features(d, features);
-        }
-
-        extract_features(a, features);
-
-        for (int l = 0; l <= level / 2; l++) { // reverse order to match python results.
-            for (int i = 0; i < (int)NUM_FEATHERS_PER_COMP; i++) {
-                std::swap(
-                    features[l * NUM_FEATHERS_PER_COMP + i],
-                    features[(level - l) * NUM_FEATHERS_PER_COMP + i]);
-            }
-        }
-    }
-
-    static int dwt_features(const float *x, int len, const char *wav, int level, fvec &features)
-    {
-        assert(level <= 7);
-
-        assert(features.size() == 0); // make sure features is empty
-        features.reserve((level + 1) * NUM_FEATHERS_PER_COMP);
-
-        wavedec_features(x, len, wav, level, features);
-
-        return features.size();
+        pad(a_padded, ny, nh);
+        return ny;
     }
 
     static bool check_min_size(int len, int level)
@@ -325,26 +302,52 @@ public:
 
         EI_TRY(processing::subtract_mean(input_matrix));
 
-        int out_idx = 0;
+        const int level = config->wavelet_level;
+        const size_t data_size = input_matrix->cols;
+        if (level <= 0 || level >= 8 || !check_min_size(data_size, level)) {
+            EIDSP_ERR(EIDSP_BUFFER_SIZE_MISMATCH);
+        }
+
+        const size_t num_features = (level + 1) * NUM_FEATHERS_PER_COMP;
+        if (output_matrix->rows * output_matrix->cols != input_matrix->rows * num_features) {
+            EIDSP_ERR(EIDSP_MATRIX_SIZE_MISMATCH);
+        }
+
+        const wavelet_filter_t *filter = find_filter(config->wavelet);
+        if (!filter) {
+            EIDSP_ERR(EIDSP_PARAMETER_INVALID);
+        }
+
+        // decomposition filters, reversed for the dot product
+        const size_t nh = filter->size;
+        float h[MAX_FILTER_SIZE];
+        float g[MAX_FILTER_SIZE];
+        for (size_t i = 0; i < nh; i++) {
+            h[i] = filter->dec_lo[nh - i - 1];
+            g[i] = filter->dec_hi[nh - i - 1];
+        }
+
+        // two padded level buffers used in turns, plus the detail coefficients
+        const size_t level_size = (data_size + nh - 1) / 2;
+        fvec work((data_size + 2 * nh - 2) + (level_size + 2 * nh - 2) + level_size);
+        float *padded[2] = { work.data(), work.data() + data_size + 2 * nh - 2 };
+        float *d = padded[1] + level_size + 2 * nh - 2;
+
         for (size_t row = 0; row < input_matrix->rows; row++) {
-            float *data_window = input_matrix->get_row_ptr(row);
-            size_t data_size = input_matrix->cols;
-
-            if (!check_min_size(data_size, config->wavelet_level))
-                EIDSP_ERR(EIDSP_BUFFER_SIZE_MISMATCH);
-
-            fvec features;
-            size_t num_features = dwt_features(
-                data_window,
-                data_size,
-                config->wavelet,
-                config->wavelet_level,
-                features);
-
-            assert(num_features == output_matrix->cols / input_matrix->rows);
-            for (size_t i = 0; i < num_features; i++) {
-                output_matrix->buffer[out_idx++] = features[i];
+            float *out = output_matrix->buffer + row * num_features;
+
+            memcpy(padded[0] + nh - 2, input_matrix->get_row_ptr(row), data_size * sizeof(float));
+            pad(padded[0], data_size, nh);
+
+            // components go out in reverse order to match python results: a_n, d_n, ..., d_1
+            size_t nx = data_size;
+            int cur = 0;
+            for (int l = 0; l < level; l++) {
+                nx = dwt(padded[cur], nx, h, g, nh, padded[cur ^ 1], d);
+                cur ^= 1;
+                extract_features(d, nx, out + (level - l) * NUM_FEATHERS_PER_COMP);
             }
+            extract_features(padded[cur] + nh - 2, nx, out);
         }
         return EIDSP_OK;
     }
@@ -0,0 +1,689 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS
+ * IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language
+ * governing permissions and limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _EIDSP_SPEECHPY_FEATURE_Q15_H_
+#define _EIDSP_SPEECHPY_FEATURE_Q15_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "../config.hpp"
+#include "feature.hpp"
+#if EIDSP_USE_CMSIS_DSP
+#include "edge-impulse-sdk/CMSIS/DSP/Include/arm_math.h"
+#include "edge-impulse-sdk/CMSIS/DSP/Include/arm_common_tables.h"
+#include "edge-impulse-sdk/CMSIS/DSP/Include/arm_const_structs.h"
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846264338327950288
+#endif // M_PI
+
+/** Samples read from the signal at a time while a frame is converted to q15 */
+#define EIDSP_Q15_READ_CHUNK            32
+
+namespace ei {
+namespace speechpy {
+
+namespace q15_detail {
+
+    // log2(1 + i / 32) in Q16
+    static const int32_t log2_table[33] = {
+        0, 2909, 5732, 8473, 11136, 13727, 16248, 18704, 21098, 23433, 25711,
+        27936, 30109, 32234, 34312, 36346, 38336, 40286, 42196, 44068, 45904,
+        47705, 49472, 51207, 52911, 54584, 56229, 57845, 59434, 60997, 62534,
+        64047, 65536
+    };
+
+    static const int64_t ln2_q31 = 1488522236;          // ln(2)
+    static const int64_t db_per_log2_q28 = 808071242;   // 10 * log10(2)
+    static const int32_t ln_zero_q16 = -1509022;        // ln(1e-10), what zero_handling puts in for 0
+    static const uint64_t mel_floor = 1 << 14;          // power LSB / 2 times a q15 weight of 1.0
+
+    /**
+     * log2 of a Q32 fraction with an implicit leading one, in Q16
+     */
+    static inline int32_t log2_fraction_q16(uint32_t frac)
+    {
+        const uint32_t ix = frac >> 27;
+        const int32_t t = (int32_t)((frac >> 11) & 0xffff);
+        return log2_table[ix] + (((log2_table[ix + 1] - log2_table[ix]) * t) >> 16);
+    }
+
+#if EIDSP_USE_CMSIS_DSP
+    /**
+     * Initialize a CMSIS-DSP q15 rfft structure, like numpy::cmsis_rfft_init_f32
+     * only the complex FFT tables of the lengths the model uses are referenced
+     */
+    static int cmsis_rfft_init_q15(arm_rfft_instance_q15 *rfft_instance, const size_t n_fft)
+    {
+#if EI_CLASSIFIER_HAS_FFT_INFO == 1 && !defined(ARM_MATH_MVEI) && !defined(EI_CLASSIFIER_LOAD_ALL_FFTS)
+        const arm_cfft_instance_q15 *cfft;
+        switch (n_fft) {
+#if EI_CLASSIFIER_LOAD_FFT_32 == 1
+            case 32: cfft = &arm_cfft_sR_q15_len16; break;
+#endif
+#if EI_CLASSIFIER_LOAD_FFT_64 == 1
+            case 64: cfft = &arm_cfft_sR_q15_len32; break;
+#endif
+#if EI_CLASSIFIER_LOAD_FFT_128 == 1
+            case 128: cfft = &arm_cfft_sR_q15_len64; break;
+#endif
+#if EI_CLASSIFIER_LOAD_FFT_256 == 1
+            case 256: cfft = &arm_cfft_sR_q15_len128; break;
+#endif
+#if EI_CLASSIFIER_LOAD_FFT_512 == 1
+            case 512: cfft = &arm_cfft_sR_q15_len256; break;
+#endif
+#if EI_CLASSIFIER_LOAD_FFT_1024 == 1
+            case 1024: cfft = &arm_cfft_sR_q15_len512; break;
+#endif
+#if EI_CLASSIFIER_LOAD_FFT_2048 == 1
+            case 2048: cfft = &arm_cfft_sR_q15_len1024; break;
+#endif
+#if EI_CLASSIFIER_LOAD_FFT_4096 == 1
+            case 4096: cfft = &arm_cfft_sR_q15_len2048; break;
+#endif
+            default:
+                return EIDSP_FFT_TABLE_NOT_LOADED;
+        }
+
+        // same as arm_rfft_init_q15 for a forward transform in natural order
+        rfft_instance->fftLenReal = n_fft;
+        rfft_instance->ifftFlagR = 0;
+        rfft_instance->bitReverseFlagR = 1;
+        rfft_instance->twidCoefRModifier = 8192U / n_fft;
+        rfft_instance->pTwiddleAReal = realCoefAQ15;
+        rfft_instance->pTwiddleBReal = realCoefBQ15;
+        rfft_instance->pCfft = cfft;
+
+        return EIDSP_OK;
+#else
+        if (arm_rfft_init_q15(rfft_instance, n_fft, 0, 1) != ARM_MATH_SUCCESS) {
+            return EIDSP_FFT_TABLE_NOT_LOADED;
+        }
+        return EIDSP_OK;
+#endif
+    }
+#endif // EIDSP_USE_CMSIS_DSP
+
+    /**
+     * Scratch buffers of one run over a signal. A frame is read from the
+     * signal straight into q15, the power spectrum is written over the FFT
+     * output, so apart from the FFT buffers there is no per frame storage.
+     * With CMSIS-DSP the FFT is arm_rfft_q15, otherwise a portable radix-2
+     * FFT with the same X / N output scaling.
+     */
+    class mel_q15 {
+    public:
+        mel_q15(uint16_t fft_length)
+            : fft_length(fft_length), fft_length_log2(0), fft_in(nullptr), fft_out(nullptr)
+#if !EIDSP_USE_CMSIS_DSP
+              , twiddle(nullptr)
+#endif
+        {
+            while ((1U << fft_length_log2) < fft_length) {
+                fft_length_log2++;
+            }
+        }
+
+        ~mel_q15()
+        {
+#if EIDSP_USE_CMSIS_DSP
+            ei_free(fft_in);
+#else
+            ei_free(twiddle);
+#endif
+            ei_free(fft_out);
+        }
+
+        static bool supported(uint16_t fft_length)
+        {
+            return fft_length >= 32 && fft_length <= 4096 && (fft_length & (fft_length - 1)) == 0;
+        }
+
+        int init()
+        {
+            // N complex q15 values, the power spectrum goes over the first
+            // N / 2 + 1 of them as uint32
+            fft_out = (uint32_t*)ei_calloc(fft_length, sizeof(uint32_t));
+            if (!fft_out) {
+                EIDSP_ERR(EIDSP_OUT_OF_MEM);
+            }
+
+#if EIDSP_USE_CMSIS_DSP
+            int ret = cmsis_rfft_init_q15(&rfft_instance, fft_length);
+            if (ret != EIDSP_OK) {
+                EIDSP_ERR(ret);
+            }
+            // real input, arm_rfft_q15 can't run in place
+            fft_in = (int16_t*)ei_calloc(fft_length, sizeof(int16_t));
+            if (!fft_in) {
+                EIDSP_ERR(EIDSP_OUT_OF_MEM);
+            }
+#else
+            // in place over the complex values, cos / sin of 2 pi j / N for
+            // the first half of the circle
+            fft_in = reinterpret_cast<int16_t*>(fft_out);
+            twiddle = (int16_t*)ei_calloc(fft_length, sizeof(int16_t));
+            if (!twiddle) {
+                EIDSP_ERR(EIDSP_OUT_OF_MEM);
+            }
+            for (size_t j = 0; j < fft_length / 2U; j++) {
+                const double angle = 2.0 * M_PI * (double)j / (double)fft_length;
+                twiddle[2 * j] = saturate(lround(cos(angle) * 32768.0));
+                twiddle[2 * j + 1] = saturate(lround(sin(angle) * 32768.0));
+            }
+#endif
+
+            return EIDSP_OK;
+        }
+
+        /**
+         * Power spectrum of a frame as |X|^2 / N, the same as numpy::power_spectrum.
+         * The frame is brought to q15 with a block exponent, the result is
+         * power[k] * 2^shift.
+         * @param signal signal to read the frame from, zero padded past its end
+         * @param offset first sample of the frame
+         * @param frame_length number of samples, truncated to the FFT length
+         * @param shift out, exponent of the power spectrum
+         */
+        int power_spectrum(signal_t *signal, size_t offset, size_t frame_length, int *shift)
+        {
+            if (frame_length > fft_length) {
+                frame_length = fft_length;
+            }
+            if (offset + frame_length > signal->total_length) {
+                frame_length = offset < signal->total_length ? signal->total_length - offset : 0;
+            }
+
+            float chunk[EIDSP_Q15_READ_CHUNK];
+            float max_abs = 0.0f;
+
+            // the signal is read twice in small chunks instead of holding the frame as float
+            for (size_t ix = 0; ix < frame_length; ix += EIDSP_Q15_READ_CHUNK) {
+                const size_t n = frame_length - ix < EIDSP_Q15_READ_CHUNK ? frame_length - ix : EIDSP_Q15_READ_CHUNK;
+                int ret = signal->get_data(offset + ix, n, chunk);
+                if (ret != 0) {
+                    EIDSP_ERR(ret);
+                }
+                for (size_t c = 0; c < n; c++) {
+                    const float v = fabsf(chunk[c]);
+                    if (v > max_abs) {
+                        max_abs = v;
+                    }
+                }
+            }
+
+            // |frame| < 2^exponent, so the samples fit in q15 after scaling by 2^(15 - exponent)
+            int exponent = 0;
+            frexpf(max_abs, &exponent);
+
+#if EIDSP_USE_CMSIS_DSP
+            const size_t stride = 1;
+#else
+            // straight into the real parts of the complex FFT input
+            const size_t stride = 2;
+            memset(fft_in, 0, 2 * fft_length * sizeof(int16_t));
+#endif
+            for (size_t ix = 0; ix < frame_length; ix += EIDSP_Q15_READ_CHUNK) {
+                const size_t n = frame_length - ix < EIDSP_Q15_READ_CHUNK ? frame_length - ix : EIDSP_Q15_READ_CHUNK;
+                int ret = signal->get_data(offset + ix, n, chunk);
+                if (ret != 0) {
+                    EIDSP_ERR(ret);
+                }
+                for (size_t c = 0; c < n; c++) {
+                    fft_in[(ix + c) * stride] = saturate(lrintf(ldexpf(chunk[c], 15 - exponent)));
+                }
+            }
+
+#if EIDSP_USE_CMSIS_DSP
+            memset(fft_in + frame_length, 0, (fft_length - frame_length) * sizeof(int16_t));
+            // output is X / N, see the format table of arm_rfft_q15
+            arm_rfft_q15(&rfft_instance, fft_in, reinterpret_cast<int16_t*>(fft_out));
+#else
+            complex_fft();
+#endif
+
+            // bin k is written over its own re / im pair
+            const int16_t *spectrum = reinterpret_cast<const int16_t*>(fft_out);
+            for (size_t k = 0; k <= fft_length / 2U; k++) {
+                const int32_t re = spectrum[2 * k];
+                const int32_t im = spectrum[2 * k + 1];
+                const uint32_t power = (uint32_t)(re * re) + (uint32_t)(im * im);
+                memcpy(&fft_out[k], &power, sizeof(power));
+            }
+
+            // |X|^2 / N = (power * N^2 * 2^(2 * exponent - 30)) / N
+            *shift = 2 * exponent - 30 + fft_length_log2;
+
+            return EIDSP_OK;
+        }
+
+        /** Power spectrum of the last frame, fft_length / 2 + 1 values */
+        const uint32_t *power_buffer() const { return fft_out; }
+
+    private:
+        static int16_t saturate(long v)
+        {
+            return (int16_t)(v > 32767 ? 32767 : (v < -32768 ? -32768 : v));
+        }
+
+#if !EIDSP_USE_CMSIS_DSP
+        /**
+         * In place radix-2 FFT over interleaved q15, halves every stage so the
+         * output is X / N, like arm_rfft_q15
+         */
+        void complex_fft()
+        {
+            int16_t *fft = fft_in;
+            const size_t n = fft_length;
+
+            for (size_t i = 1, j = 0; i < n; i++) {
+                size_t bit = n >> 1;
+                for (; j & bit; bit >>= 1) {
+                    j ^= bit;
+                }
+                j ^= bit;
+                if (i < j) {
+                    int16_t re = fft[2 * i], im = fft[2 * i + 1];
+                    fft[2 * i] = fft[2 * j];
+                    fft[2 * i + 1] = fft[2 * j + 1];
+                    fft[2 * j] = re;
+                    fft[2 * j + 1] = im;
+                }
+            }
+
+            for (size_t len = 2; len <= n; len <<= 1) {
+                const size_t half = len >> 1;
+                const size_t step = n / len;
+                for (size_t i = 0; i < n; i += len) {
+                    for (size_t k = 0; k < half; k++) {
+                        const int32_t wr = twiddle[2 * k * step];
+                        const int32_t wi = -twiddle[2 * k * step + 1];
+                        int16_t *a = &fft[2 * (i + k)];
+                        int16_t *b = &fft[2 * (i + k + half)];
+                        const int32_t tr = (b[0] * wr - b[1] * wi + (1 << 14)) >> 15;
+                        const int32_t ti = (b[0] * wi + b[1] * wr + (1 << 14)) >> 15;
+                        const int32_t ar = a[0], ai = a[1];
+                        a[0] = saturate((ar + tr + 1) >> 1);
+                        a[1] = saturate((ai + ti + 1) >> 1);
+                        b[0] = saturate((ar - tr + 1) >> 1);
+                        b[1] = saturate((ai - ti + 1) >> 1);
+                    }
+                }
+            }
+        }
+
+#endif // !EIDSP_USE_CMSIS_DSP
+
+        uint16_t fft_length;
+        int fft_length_log2;
+        int16_t *fft_in;
+        uint32_t *fft_out;
+#if EIDSP_USE_CMSIS_DSP
+        arm_rfft_instance_q15 rfft_instance;
+#else
+        int16_t *twiddle;
+#endif
+    };
+
+} // namespace q15_detail
+
+/**
+ * MFE and MFCC in fixed point: the power spectrum comes from a q15 FFT with
+ * a block exponent per frame (arm_rfft_q15 with EIDSP_USE_CMSIS_DSP), mel
+ * weights are q15, energies are accumulated in 64 bits and logarithms come
+ * from a table. No float frame is held, the frame is read from the signal in
+ * EIDSP_Q15_READ_CHUNK samples and the power spectrum is written over the FFT
+ * output. Results are returned as float so normalization and continuous mode
+ * work unchanged.
+ *
+ * Against speechpy::feature (test/test_feature_q15.cpp, speech at 16 kHz,
+ * 256 point FFT):
+ * - log2 table: 12 Q16 LSB
+ * - FFT: 2.5 LSB of the X / N output, so bins more than about 40 dB under
+ *   the loudest sample of the frame lose their precision
+ * - MFE after mfe_normalization: 4 steps of 1/256
+ * - MFCC: mean error 0.013, max 1.6 where a narrow band sits under the FFT
+ *   resolution (it is held at mel_floor), 0.7 after cmvnw
+ *
+ * FFT lengths that are not a power of two between 32 and 4096 go through
+ * speechpy::feature.
+ */
+class feature_q15 {
+public:
+    /**
+     * log2 in Q16 of a non-zero 64 bit value
+     */
+    static int32_t log2_q16(uint64_t value)
+    {
+        const int msb = 63 - __builtin_clzll(value);
+        const uint32_t frac = msb >= 32 ? (uint32_t)(value >> (msb - 32)) : (uint32_t)(value << (32 - msb));
+        return (msb << 16) + q15_detail::log2_fraction_q16(frac);
+    }
+
+    /**
+     * log2 in Q16 of a float, values under 1e-30 are clamped like
+     * processing::mfe_normalization does
+     */
+    static int32_t log2_q16(float value)
+    {
+        if (!(value >= 1e-30f)) {
+            value = 1e-30f;
+        }
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        const int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127;
+        return (exponent << 16) + q15_detail::log2_fraction_q16((bits & 0x7fffff) << 9);
+    }
+
+    /**
+     * Fixed-point version of feature::mfe, same parameters and output
+     */
+    static int mfe(matrix_t *out_features, matrix_t *out_energies,
+        signal_t *signal,
+        uint32_t sampling_frequency,
+        float frame_length, float frame_stride, uint16_t num_filters,
+        uint16_t fft_length, uint32_t low_frequency, uint32_t high_frequency,
+        uint16_t version
+        )
+    {
+        if (!q15_detail::mel_q15::supported(fft_length)) {
+            return feature::mfe(out_features, out_energies, signal, sampling_frequency,
+                frame_length, frame_stride, num_filters, fft_length, low_frequency, high_frequency, version);
+        }
+
+        return run(out_features, out_energies, nullptr, 0, false, signal, sampling_frequency,
+            frame_length, frame_stride, num_filters, fft_length, low_frequency, high_frequency, version);
+    }
+
+    /**
+     * Fixed-point version of feature::mfcc, same parameters and output.
+     * The DCT runs on the natural log of the mel energies in Q16.
+     */
+    static int mfcc(matrix_t *out_features, signal_t *signal,
+        uint32_t sampling_frequency, float frame_length, float frame_stride,
+        uint8_t num_cepstral, uint16_t num_filters, uint16_t fft_length,
+        uint32_t low_frequency, uint32_t high_frequency, bool dc_elimination,
+        uint16_t version)
+    {
+        if (!q15_detail::mel_q15::supported(fft_length) || num_cepstral > num_filters) {
+            return feature::mfcc(out_features, signal, sampling_frequency, frame_length, frame_stride,
+                num_cepstral, num_filters, fft_length, low_frequency, high_frequency, dc_elimination, version);
+        }
+
+        if (out_features->cols != num_cepstral) {
+            EIDSP_ERR(EIDSP_MATRIX_SIZE_MISMATCH);
+        }
+
+        // orthonormal DCT-II, scale folded into a q31 table
+        int32_t *dct = (int32_t*)ei_calloc(num_cepstral * num_filters, sizeof(int32_t));
+        EI_ERR_AND_RETURN_ON_NULL(dct, EIDSP_OUT_OF_MEM);
+        ei_unique_ptr_t __ptr__(dct, ei_free);
+
+        for (size_t k = 0; k < num_cepstral; k++) {
+            const double scale = sqrt((k == 0 ? 1.0 : 2.0) / num_filters);
+            for (size_t n = 0; n < num_filters; n++) {
+                double v = scale * cos(M_PI * k * (2 * n + 1) / (2.0 * num_filters));
+                int64_t q = llround(v * 2147483648.0);
+                dct[k * num_filters + n] = (int32_t)(q > INT32_MAX ? INT32_MAX : q);
+            }
+        }
+
+        return run(out_features, nullptr, dct, num_cepstral, dc_elimination, signal, sampling_frequency,
+            frame_length, frame_stride, num_filters, fft_length, low_frequency, high_frequency, version);
+    }
+
+    /**
+     * Fixed-point version of processing::mfe_normalization: log from the
+     * table, scaling and quantization to 1/256 in integers
+     */
+    static int mfe_normalization(matrix_t *features_matrix, int noise_floor_db)
+    {
+        const int64_t noise = -noise_floor_db;
+        const int64_t divisor = (noise + 12) << 16;
+
+        if (divisor <= 0) {
+            return processing::mfe_normalization(features_matrix, noise_floor_db);
+        }
+
+        for (size_t ix = 0; ix < features_matrix->rows * features_matrix->cols; ix++) {
+            const int64_t db_q16 = ((int64_t)log2_q16(features_matrix->buffer[ix]) * q15_detail::db_per_log2_q28) >> 28;
+            // round((db + noise) / (noise + 12) * 256), half away from zero like roundf
+            const int64_t num = (db_q16 + (noise << 16)) * 256;
+            int64_t k = num >= 0 ? (num + divisor / 2) / divisor : -((-num + divisor / 2) / divisor);
+
+            if (k < 0) k = 0;
+            else if (k > 256) k = 256;
+            features_matrix->buffer[ix] = (float)k / 256.0f;
+        }
+
+        return EIDSP_OK;
+    }
+
+private:
+    /**
+     * Shared by mfe() and mfcc(). Without dct, out_features gets the mel
+     * energies as float. With dct, out_features gets the cepstral
+     * coefficients of ln(mel energies).
+     */
+    static int run(matrix_t *out_features, matrix_t *out_energies,
+        const int32_t *dct, uint8_t num_cepstral, bool dc_elimination,
+        signal_t *signal,
+        uint32_t sampling_frequency,
+        float frame_length, float frame_stride, uint16_t num_filters,
+        uint16_t fft_length, uint32_t low_frequency, uint32_t high_frequency,
+        uint16_t version)
+    {
+        int ret = 0;
+
+        if (high_frequency == 0) {
+            high_frequency = sampling_frequency / 2;
+        }
+
+        if (version<4) {
+            if (low_frequency == 0) {
+                low_frequency = 300;
+            }
+        }
+
+        stack_frames_info_t stack_frame_info = { 0 };
+        stack_frame_info.signal = signal;
+
+        ret = processing::stack_frames(
+            &stack_frame_info,
+            sampling_frequency,
+            frame_length,
+            frame_stride,
+            false,
+            version
+        );
+        if (ret != 0) {
+            EIDSP_ERR(ret);
+        }
+
+        if (stack_frame_info.frame_ixs.size() != out_features->rows) {
+            EIDSP_ERR(EIDSP_MATRIX_SIZE_MISMATCH);
+        }
+
+        if (out_features->cols != (dct ? num_cepstral : num_filters)) {
+            EIDSP_ERR(EIDSP_MATRIX_SIZE_MISMATCH);
+        }
+
+        if (out_energies) {
+            if (stack_frame_info.frame_ixs.size() != out_energies->rows || out_energies->cols != 1) {
+                EIDSP_ERR(EIDSP_MATRIX_SIZE_MISMATCH);
+            }
+        }
+
+        // same bins as feature::mfe
+        const size_t power_spectrum_frame_size = (fft_length / 2 + 1);
+        const int MELS_SIZE = num_filters + 2;
+        float *mels = (float*)ei_calloc(MELS_SIZE, sizeof(float));
+        EI_ERR_AND_RETURN_ON_NULL(mels, EIDSP_OUT_OF_MEM);
+        ei_unique_ptr_t __mels_ptr__(mels, ei_free);
+        uint16_t *bins = reinterpret_cast<uint16_t*>(mels);
+
+        numpy::linspace(
+            functions::frequency_to_mel(static_cast<float>(low_frequency)),
+            functions::frequency_to_mel(static_cast<float>(high_frequency)),
+            num_filters + 2,
+            mels);
+
+        uint16_t max_bin = version >= 4 ? fft_length : power_spectrum_frame_size; // preserve a bug in v<4
+        for (uint16_t ix = 0; ix < MELS_SIZE-1; ix++) {
+            mels[ix] = functions::mel_to_frequency(mels[ix]);
+            if (mels[ix] < low_frequency) {
+                mels[ix] = low_frequency;
+            }
+            if (mels[ix] > high_frequency) {
+                mels[ix] = high_frequency;
+            }
+            bins[ix] = feature::get_fft_bin_from_hertz(max_bin, mels[ix], sampling_frequency);
+        }
+
+        mels[MELS_SIZE-1] = functions::mel_to_frequency(mels[MELS_SIZE-1]);
+        if (mels[MELS_SIZE-1] > high_frequency) {
+            mels[MELS_SIZE-1] = high_frequency;
+        }
+        mels[MELS_SIZE-1] -= 0.001;
+        bins[MELS_SIZE-1] = feature::get_fft_bin_from_hertz(max_bin, mels[MELS_SIZE-1], sampling_frequency);
+
+        for (int ix = 0; ix < MELS_SIZE; ix++) {
+            if (bins[ix] >= power_spectrum_frame_size) {
+                EIDSP_ERR(EIDSP_PARAMETER_INVALID);
+            }
+        }
+
+        // q30 reciprocals of the rising and falling slope widths, so weights
+        // are a multiply instead of a divide per bin
+        uint32_t *slopes = (uint32_t*)ei_calloc(2 * num_filters, sizeof(uint32_t));
+        EI_ERR_AND_RETURN_ON_NULL(slopes, EIDSP_OUT_OF_MEM);
+        ei_unique_ptr_t __slopes_ptr__(slopes, ei_free);
+        for (size_t i = 0; i < num_filters; i++) {
+            slopes[2 * i] = bins[i + 1] > bins[i] ? (1U << 30) / (bins[i + 1] - bins[i]) : 0;
+            slopes[2 * i + 1] = bins[i + 2] > bins[i + 1] ? (1U << 30) / (bins[i + 2] - bins[i + 1]) : 0;
+        }
+
+        uint64_t *mel = (uint64_t*)ei_calloc(num_filters, sizeof(uint64_t));
+        EI_ERR_AND_RETURN_ON_NULL(mel, EIDSP_OUT_OF_MEM);
+        ei_unique_ptr_t __mel_ptr__(mel, ei_free);
+
+        int32_t *log_mel = nullptr;
+        if (dct) {
+            log_mel = (int32_t*)ei_calloc(num_filters, sizeof(int32_t));
+            EI_ERR_AND_RETURN_ON_NULL(log_mel, EIDSP_OUT_OF_MEM);
+        }
+        ei_unique_ptr_t __log_mel_ptr__(log_mel, ei_free);
+
+        q15_detail::mel_q15 engine(fft_length);
+        ret = engine.init();
+        if (ret != EIDSP_OK) {
+            EIDSP_ERR(ret);
+        }
+        const uint32_t *power = engine.power_buffer();
+
+        for (size_t ix = 0; ix < stack_frame_info.frame_ixs.size(); ix++) {
+            // frames past the end of the audio buffer are zero padded
+            int shift;
+            ret = engine.power_spectrum(stack_frame_info.signal, stack_frame_info.frame_ixs.at(ix),
+                stack_frame_info.frame_length, &shift);
+            if (ret != EIDSP_OK) {
+                EIDSP_ERR(ret);
+            }
+
+            uint64_t energy = 0;
+            for (size_t bin = 0; bin < power_spectrum_frame_size; bin++) {
+                energy += power[bin];
+            }
+
+            if (out_energies) {
+                out_energies->buffer[ix] = energy ? ldexpf((float)energy, shift) : 1e-10f;
+            }
+
+            // mel weights in q15, middle always has a weight of 1.0
+            for (size_t i = 0; i < num_filters; i++) {
+                const size_t left = bins[i];
+                const size_t middle = bins[i + 1];
+                const size_t right = bins[i + 2];
+
+                uint64_t sum = (uint64_t)power[middle] << 15;
+                for (size_t bin = left + 1; bin < middle; bin++) {
+                    const uint32_t w = (uint32_t)(((uint64_t)(bin - left) * slopes[2 * i] + (1 << 14)) >> 15);
+                    sum += (uint64_t)w * power[bin];
+                }
+                for (size_t bin = middle + 1; bin < right; bin++) {
+                    const uint32_t w = (uint32_t)(((uint64_t)(right - bin) * slopes[2 * i + 1] + (1 << 14)) >> 15);
+                    sum += (uint64_t)w * power[bin];
+                }
+                mel[i] = sum;
+            }
+
+            const int mel_shift = shift - 15;
+            auto row_ptr = out_features->get_row_ptr(ix);
+
+            if (!dct) {
+                for (size_t i = 0; i < num_filters; i++) {
+                    // 0 is replaced by 1e-10 like numpy::zero_handling
+                    row_ptr[i] = mel[i] ? ldexpf((float)mel[i], mel_shift) : 1e-10f;
+                }
+                continue;
+            }
+
+            for (size_t i = 0; i < num_filters; i++) {
+                // a band under the resolution of the FFT would go to ln(1e-10) and swing
+                // the whole DCT, it is held at half a power LSB at full weight instead
+                log_mel[i] = ln_q16(mel[i] > q15_detail::mel_floor ? mel[i] : q15_detail::mel_floor, mel_shift);
+            }
+
+            for (size_t k = 0; k < num_cepstral; k++) {
+                const int32_t *cos_row = &dct[k * num_filters];
+                int64_t acc = 0;
+                for (size_t n = 0; n < num_filters; n++) {
+                    acc += (int64_t)log_mel[n] * cos_row[n];
+                }
+                // Q16 * Q31
+                row_ptr[k] = ldexpf((float)acc, -47);
+            }
+
+            // replace first cepstral coefficient with log of frame energy for DC elimination
+            if (dc_elimination) {
+                row_ptr[0] = ldexpf((float)ln_q16(energy, shift), -16);
+            }
+        }
+
+        return EIDSP_OK;
+    }
+
+    /**
+     * Natural log in Q16 of value * 2^shift
+     */
+    static int32_t ln_q16(uint64_t value, int shift)
+    {
+        if (value == 0) {
+            return q15_detail::ln_zero_q16;
+        }
+        const int64_t log2_value = (int64_t)log2_q16(value) + ((int64_t)shift << 16);
+        return (int32_t)((log2_value * q15_detail::ln2_q31) >> 31);
+    }
+};
+
+} // namespace speechpy
+} // namespace ei
+
+#endif // _EIDSP_SPEECHPY_FEATURE_Q15_H_
@@ -370,6 +370,53 @@ namespace processing {
         return numframes;
     }
 
+    /**
+     * Row of the features that row q of the symmetric padded features
+     * (numpy.pad mode 'symmetric') maps to, q is relative to the first row.
+     */
+    static size_t symmetric_pad_index(int32_t q, size_t rows)
+    {
+        const int32_t period = 2 * static_cast<int32_t>(rows);
+        int32_t r = q % period;
+        if (r < 0) {
+            r += period;
+        }
+        return r < static_cast<int32_t>(rows) ? r : period - 1 - r;
+    }
+
+    /**
+     * Per column mean, and optionally the sum of squared differences from
+     * the mean, of win_size rows of the symmetric padded src starting at q
+     */
+    static void cmvnw_window_stats(matrix_t *src, int32_t q, uint16_t win_size, float *mean, float *m2)
+    {
+        const float one_over_win = 1.0f / static_cast<float>(win_size);
+
+        memset(mean, 0, src->cols * sizeof(float));
+        for (int32_t ix = q; ix < q + win_size; ix++) {
+            const float *row = src->get_row_ptr(symmetric_pad_index(ix, src->rows));
+            for (size_t col = 0; col < src->cols; col++) {
+                mean[col] += row[col];
+            }
+        }
+        for (size_t col = 0; col < src->cols; col++) {
+            mean[col] *= one_over_win;
+        }
+
+        if (!m2) {
+            return;
+        }
+
+        memset(m2, 0, src->cols * sizeof(float));
+        for (int32_t ix = q; ix < q + win_size; ix++) {
+            const float *row = src->get_row_ptr(symmetric_pad_index(ix, src->rows));
+            for (size_t col = 0; col < src->cols; col++) {
+                const float diff = row[col] - mean[col];
+                m2[col] += diff * diff;
+            }
+        }
+    }
+
     /**
      * This function performs local cepstral mean and
      * variance normalization on a sliding window. The code assumes that
@@ -390,80 +437,93 @@ namespace processing {
             return EIDSP_OK;
         }
 
-        uint16_t pad_size = (win_size - 1) / 2;
+        const size_t rows = features_matrix->rows;
+        const size_t cols = features_matrix->cols;
+        const int32_t pad_size = (win_size - 1) / 2;
 
-        int ret;
-        float *features_buffer_ptr;
+        if (rows == 0) {
+            EIDSP_ERR(EIDSP_INPUT_MATRIX_EMPTY);
+        }
 
-        // mean & variance normalization
-        EI_DSP_MATRIX(vec_pad, features_matrix->rows + (pad_size * 2), features_matrix->cols);
-        if (!vec_pad.buffer) {
+        // The window over the symmetric padded features slides one row per
+        // output, so the per column window mean (and spread) is updated with
+        // the row entering and the row leaving the window, instead of summing
+        // win_size rows for every output. The padding is never materialized,
+        // padded rows are mapped back onto the features. The statistics are
+        // recomputed every win_size rows so rounding errors do not pile up.
+        // The features are normalized in place, the window slides over a copy.
+        EI_DSP_MATRIX(window_src, rows, cols);
+        if (!window_src.buffer) {
             EIDSP_ERR(EIDSP_OUT_OF_MEM);
         }
 
-        ret = numpy::pad_1d_symmetric(features_matrix, &vec_pad, pad_size, pad_size);
-        if (ret != EIDSP_OK) {
-            EIDSP_ERR(ret);
+        EI_DSP_MATRIX(window_mean, 1, cols);
+        if (!window_mean.buffer) {
+            EIDSP_ERR(EIDSP_OUT_OF_MEM);
         }
 
-        EI_DSP_MATRIX(mean_matrix, vec_pad.cols, 1);
-        if (!mean_matrix.buffer) {
+        EI_DSP_MATRIX(window_m2, 1, cols);
+        if (!window_m2.buffer) {
             EIDSP_ERR(EIDSP_OUT_OF_MEM);
         }
 
-        EI_DSP_MATRIX(window_variance, vec_pad.cols, 1);
-        if (!window_variance.buffer) {
-            return EIDSP_OUT_OF_MEM;
-        }
+        const float one_over_win = 1.0f / static_cast<float>(win_size);
 
-        for (size_t ix = 0; ix < features_matrix->rows; ix++) {
-            // create a slice on the vec_pad
-            EI_DSP_MATRIX_B(window, win_size, vec_pad.cols, vec_pad.buffer + (ix * vec_pad.cols));
-            if (!window.buffer) {
-                EIDSP_ERR(EIDSP_OUT_OF_MEM);
-            }
+        // mean normalization
+        memcpy(window_src.buffer, features_matrix->buffer, rows * cols * sizeof(float));
 
-            ret = numpy::mean_axis0(&window, &mean_matrix);
-            if (ret != EIDSP_OK) {
-                EIDSP_ERR(ret);
+        for (size_t ix = 0; ix < rows; ix++) {
+            const int32_t first = static_cast<int32_t>(ix) - pad_size;
+            if (ix % win_size == 0) {
+                cmvnw_window_stats(&window_src, first, win_size, window_mean.buffer, nullptr);
             }
-
-            // subtract the mean for the features
-            for (size_t fm_col = 0; fm_col < features_matrix->cols; fm_col++) {
-                features_matrix->buffer[(ix * features_matrix->cols) + fm_col] =
-                    features_matrix->buffer[(ix * features_matrix->cols) + fm_col] - mean_matrix.buffer[fm_col];
+            else {
+                const float *leaving = window_src.get_row_ptr(symmetric_pad_index(first - 1, rows));
+                const float *entering = window_src.get_row_ptr(symmetric_pad_index(first - 1 + win_size, rows));
+                for (size_t col = 0; col < cols; col++) {
+                    window_mean.buffer[col] += (entering[col] - leaving[col]) * one_over_win;
+                }
             }
-        }
 
-        ret = numpy::pad_1d_symmetric(features_matrix, &vec_pad, pad_size, pad_size);
-        if (ret != EIDSP_OK) {
-            EIDSP_ERR(ret);
+            float *features = features_matrix->get_row_ptr(ix);
+            for (size_t col = 0; col < cols; col++) {
+                features[col] -= window_mean.buffer[col];
+            }
         }
 
-        for (size_t ix = 0; ix < features_matrix->rows; ix++) {
-            // create a slice on the vec_pad
-            EI_DSP_MATRIX_B(window, win_size, vec_pad.cols, vec_pad.buffer + (ix * vec_pad.cols));
-            if (!window.buffer) {
-                EIDSP_ERR(EIDSP_OUT_OF_MEM);
-            }
+        // variance normalization, over the mean normalized features. Slides
+        // the mean and the sum of squared differences from it (Welford), raw
+        // sums of squares lose too much precision in float
+        if (variance_normalization == true) {
+            memcpy(window_src.buffer, features_matrix->buffer, rows * cols * sizeof(float));
 
-            if (variance_normalization == true) {
-                ret = numpy::std_axis0(&window, &window_variance);
-                if (ret != EIDSP_OK) {
-                    EIDSP_ERR(ret);
+            for (size_t ix = 0; ix < rows; ix++) {
+                const int32_t first = static_cast<int32_t>(ix) - pad_size;
+                if (ix % win_size == 0) {
+                    cmvnw_window_stats(&window_src, first, win_size, window_mean.buffer, window_m2.buffer);
+                }
+                else {
+                    const float *leaving = window_src.get_row_ptr(symmetric_pad_index(first - 1, rows));
+                    const float *entering = window_src.get_row_ptr(symmetric_pad_index(first - 1 + win_size, rows));
+                    for (size_t col = 0; col < cols; col++) {
+                        const float delta = entering[col] - leaving[col];
+                        const float prev_mean = window_mean.buffer[col];
+                        window_mean.buffer[col] += delta * one_over_win;
+                        window_m2.buffer[col] +=
+                            delta * (entering[col] - window_mean.buffer[col] + leaving[col] - prev_mean);
+                    }
                 }
 
-                features_buffer_ptr = &features_matrix->buffer[ix * vec_pad.cols];
-                for (size_t col = 0; col < vec_pad.cols; col++) {
-                    *(features_buffer_ptr) = (*(features_buffer_ptr)) /
-                                             (window_variance.buffer[col] + 1e-10);
-                    features_buffer_ptr++;
+                float *features = features_matrix->get_row_ptr(ix);
+                for (size_t col = 0; col < cols; col++) {
+                    const float variance = window_m2.buffer[col] > 0.0f ? window_m2.buffer[col] * one_over_win : 0.0f;
+                    features[col] = features[col] / (sqrt(variance) + 1e-10);
                 }
             }
         }
 
         if (scale) {
-            ret = numpy::normalize(features_matrix);
+            int ret = numpy::normalize(features_matrix);
             if (ret != EIDSP_OK) {
                 EIDSP_ERR(ret);
             }
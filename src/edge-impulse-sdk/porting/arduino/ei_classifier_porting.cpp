@@ -21,6 +21,11 @@
 #include <Arduino.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include "../ei_log_ring.h"
+#include "../ei_tlsf.h"
+#if (EI_PORTING_DEFERRED_LOG == 1 || EI_PORTING_TLSF_HEAP_SIZE > 0) && defined(ARDUINO_ARCH_MBED)
+#include "mbed.h"
+#endif
 
 #define EI_WEAK_FN __attribute__((weak))
 
@@ -46,8 +51,131 @@ void ei_serial_set_baudrate(int baudrate)
 
 }
 
+#if EI_PORTING_DEFERRED_LOG == 1
+static EiLogRing<EI_LOG_RING_SIZE> log_ring;
+
+static void log_ring_write(const char *data, size_t length)
+{
+    Serial.write(data, length);
+}
+
+#if defined(ARDUINO_ARCH_MBED)
+static rtos::Thread log_thread(osPriorityLow, 2048, nullptr, "log");
+static rtos::EventFlags log_flags;
+static bool log_thread_started = false;
+
+#define LOG_FLAG_PRINTED            0x1
+#define LOG_FLAG_DRAINED            0x2
+
+static void log_thread_main(void)
+{
+    while (1) {
+        log_flags.wait_any(LOG_FLAG_PRINTED, EI_LOG_DRAIN_INTERVAL_MS);
+        log_ring.drain(&log_ring_write);
+        log_flags.set(LOG_FLAG_DRAINED);
+    }
+}
+
+static void log_ring_notify(void)
+{
+    if (log_thread_started) {
+        log_flags.set(LOG_FLAG_PRINTED);
+    }
+    else {
+        log_ring.drain(&log_ring_write);
+    }
+}
+
+void ei_log_deferred_start(void)
+{
+    if (!log_thread_started) {
+        log_thread_started = log_thread.start(&log_thread_main) == osOK;
+    }
+}
+
+void ei_log_deferred_flush(void)
+{
+    while (!log_ring.empty()) {
+        if (log_ring.drain(&log_ring_write) > 0) {
+            continue;
+        }
+        // the drain thread holds the ring, or a producer has not committed
+        // yet (its commit wakes the drain thread), wait for the next pass
+        log_flags.clear(LOG_FLAG_DRAINED);
+        if (!log_ring.empty()) {
+            log_flags.set(LOG_FLAG_PRINTED);
+            log_flags.wait_any(LOG_FLAG_DRAINED, EI_LOG_DRAIN_INTERVAL_MS);
+        }
+    }
+}
+#else
+// no threads, the ring is written out right away
+static void log_ring_notify(void)
+{
+    log_ring.drain(&log_ring_write);
+}
+
+void ei_log_deferred_start(void)
+{
+}
+
+void ei_log_deferred_flush(void)
+{
+    // nothing else drains, if this makes no progress the writer is the
+    // context this was called from (an interrupt), waiting would not help
+    while (!log_ring.empty() && log_ring.drain(&log_ring_write) > 0) {
+    }
+}
+#endif
+
+void ei_log_deferred_get_stats(ei_log_ring_stats_t *stats)
+{
+    log_ring.get_stats(stats);
+}
+
+static void log_ring_vprintf(const char *format, va_list args)
+{
+    // formatted on the stack of the calling thread, only the copy into the
+    // ring is shared
+    char buf[EI_LOG_FORMAT_BUFFER_SIZE];
+    va_list args_copy;
+
+    va_copy(args_copy, args);
+    int r = vsnprintf(buf, sizeof(buf), format, args_copy);
+    va_end(args_copy);
+
+    if (r <= 0) {
+        return;
+    }
+
+    if ((size_t)r < sizeof(buf)) {
+        log_ring.write(buf, r);
+    }
+    else {
+        // too long for the stack buffer, format again straight into the ring
+        uint32_t position;
+        char *dest = log_ring.reserve(r, &position);
+        if (dest == nullptr) {
+            return;
+        }
+        vsnprintf(dest, r + 1, format, args);
+        log_ring.commit(position, r);
+    }
+
+    log_ring_notify();
+}
+#endif // EI_PORTING_DEFERRED_LOG == 1
+
 EI_WEAK_FN void ei_putchar(char c)
 {
+#if EI_PORTING_DEFERRED_LOG == 1
+    // raw output (base64, binary transfers) bypasses the ring, keep it in
+    // order. Only the first character after a print waits, the rest of the
+    // transfer finds the ring empty.
+    if (!log_ring.empty()) {
+        ei_log_deferred_flush();
+    }
+#endif
     Serial.write(c);
 }
 
@@ -64,6 +192,12 @@ EI_WEAK_FN char ei_getchar()
  *  Printf function uses vsnprintf and output using Arduino Serial
  */
 __attribute__((weak)) void ei_printf(const char *format, ...) {
+#if EI_PORTING_DEFERRED_LOG == 1
+    va_list args;
+    va_start(args, format);
+    log_ring_vprintf(format, args);
+    va_end(args);
+#else
     static char print_buf[1024] = { 0 };
 
     va_list args;
@@ -74,12 +208,45 @@ __attribute__((weak)) void ei_printf(const char *format, ...) {
     if (r > 0) {
         Serial.write(print_buf);
     }
+#endif
 }
 
 __attribute__((weak)) void ei_printf_float(float f) {
+#if EI_PORTING_DEFERRED_LOG == 1
+    char buf[48];
+    int r = ei_log_format_float(buf, sizeof(buf), f, 6);
+    log_ring.write(buf, r);
+    log_ring_notify();
+#else
     Serial.print(f, 6);
+#endif
+}
+
+#if EI_PORTING_TLSF_HEAP_SIZE > 0
+#if defined(ARDUINO_ARCH_MBED)
+// heap operations are short and bounded, a critical section keeps them
+// usable from any thread without priority inversion on a mutex
+void ei_tlsf_heap_lock(void) {
+    core_util_critical_section_enter();
+}
+
+void ei_tlsf_heap_unlock(void) {
+    core_util_critical_section_exit();
+}
+#endif
+
+__attribute__((weak)) void *ei_malloc(size_t size) {
+    return ei_tlsf_heap_malloc(size, __builtin_return_address(0));
+}
+
+__attribute__((weak)) void *ei_calloc(size_t nitems, size_t size) {
+    return ei_tlsf_heap_calloc(nitems, size, __builtin_return_address(0));
 }
 
+__attribute__((weak)) void ei_free(void *ptr) {
+    ei_tlsf_heap_free(ptr);
+}
+#else
 __attribute__((weak)) void *ei_malloc(size_t size) {
     return malloc(size);
 }
@@ -91,6 +258,7 @@ __attribute__((weak)) void *ei_calloc(size_t nitems, size_t size) {
 __attribute__((weak)) void ei_free(void *ptr) {
     free(ptr);
 }
+#endif // EI_PORTING_TLSF_HEAP_SIZE > 0
 
 #if defined(__cplusplus) && EI_C_LINKAGE == 1
 extern "C"
@@ -0,0 +1,362 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS
+ * IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language
+ * governing permissions and limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _EI_LOG_RING_H_
+#define _EI_LOG_RING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * Deferred logging: ei_printf() formats on the calling thread and only copies
+ * the text into a lock-free ring, a low priority thread writes the ring out.
+ * Printing results then no longer blocks inference or sampling threads on the
+ * serial port. Enabled per porting layer (arduino, posix) with
+ * -DEI_PORTING_DEFERRED_LOG=1.
+ */
+#ifndef EI_PORTING_DEFERRED_LOG
+#define EI_PORTING_DEFERRED_LOG         0
+#endif
+
+/** Size of the ring, must be a power of two */
+#ifndef EI_LOG_RING_SIZE
+#define EI_LOG_RING_SIZE                4096
+#endif
+
+/**
+ * Stack buffer ei_printf() formats into, so every thread formats into its own
+ * buffer. Longer messages are formatted straight into the ring.
+ */
+#ifndef EI_LOG_FORMAT_BUFFER_SIZE
+#define EI_LOG_FORMAT_BUFFER_SIZE       128
+#endif
+
+/** Interval at which the drain thread checks the ring when nobody wakes it */
+#ifndef EI_LOG_DRAIN_INTERVAL_MS
+#define EI_LOG_DRAIN_INTERVAL_MS        10
+#endif
+
+typedef struct {
+    uint32_t written_messages;  /*!< messages put in the ring */
+    uint32_t dropped_messages;  /*!< messages dropped because the ring was full */
+    uint32_t dropped_bytes;     /*!< bytes of the dropped messages */
+    uint32_t high_watermark;    /*!< most bytes ever waiting in the ring */
+} ei_log_ring_stats_t;
+
+typedef void (*ei_log_ring_write_t)(const char *data, size_t length);
+
+/**
+ * Multi-producer, single-consumer ring of text records.
+ *
+ * A producer reserves room with one compare-and-swap on the head, copies its
+ * text in and then commits the record by publishing its header. Records never
+ * wrap: if a record does not fit before the end of the buffer, the rest of the
+ * buffer is reserved as padding. The consumer writes out committed records in
+ * order, stops at the first record that is reserved but not yet committed, and
+ * zeroes what it consumed, so a zero header always means "not committed".
+ *
+ * Producers never block, when the ring is full the message is dropped and
+ * counted. Safe to call from interrupts.
+ */
+template<size_t N>
+class EiLogRing {
+    static_assert((N & (N - 1)) == 0, "EI_LOG_RING_SIZE must be a power of two");
+    static_assert(N >= 64, "EI_LOG_RING_SIZE too small");
+
+public:
+    EiLogRing() : head(0), tail(0), draining(0)
+    {
+        memset(buffer, 0, sizeof(buffer));
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    /**
+     * @brief Reserve room for a message of length bytes, plus a null
+     * terminator so the message can be formatted in place with vsnprintf
+     * @param length message length
+     * @param position set to the position of the record, pass to commit()
+     * @return where to write the message, nullptr if the ring is full
+     */
+    char *reserve(size_t length, uint32_t *position)
+    {
+        const uint32_t needed = record_size(length);
+
+        if (length > LENGTH_MASK || needed > N) {
+            drop(length);
+            return nullptr;
+        }
+
+        uint32_t current = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        uint32_t offset, pad;
+        do {
+            uint32_t consumed = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+            offset = current & (N - 1);
+            pad = (offset + needed > N) ? (N - offset) : 0;
+            if ((current + pad + needed) - consumed > N) {
+                drop(length);
+                return nullptr;
+            }
+        } while (!__atomic_compare_exchange_n(&head, &current, current + pad + needed,
+                    true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+        if (pad > 0) {
+            publish(offset, HEADER_COMMITTED | HEADER_PADDING | pad);
+        }
+
+        *position = current + pad;
+        update_high_watermark((current + pad + needed) - __atomic_load_n(&tail, __ATOMIC_RELAXED));
+
+        return (char *)&buffer[((*position & (N - 1)) / 4) + 1];
+    }
+
+    /**
+     * @brief Make a reserved message visible to the consumer
+     */
+    void commit(uint32_t position, size_t length)
+    {
+        __atomic_fetch_add(&stats.written_messages, 1, __ATOMIC_RELAXED);
+        publish(position & (N - 1), HEADER_COMMITTED | (uint32_t)length);
+    }
+
+    /**
+     * @brief Copy a message into the ring
+     * @return false if the message was dropped
+     */
+    bool write(const char *data, size_t length)
+    {
+        uint32_t position;
+        char *dest = reserve(length, &position);
+
+        if (dest == nullptr) {
+            return false;
+        }
+
+        memcpy(dest, data, length);
+        commit(position, length);
+
+        return true;
+    }
+
+    /**
+     * @brief Write out all committed messages. Only one caller drains at a
+     * time, others return straight away.
+     * @return number of bytes written
+     */
+    size_t drain(ei_log_ring_write_t write_fn)
+    {
+        size_t written = 0;
+
+        if (__atomic_exchange_n(&draining, 1, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+
+        uint32_t consumed = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+        while (consumed != __atomic_load_n(&head, __ATOMIC_ACQUIRE)) {
+            uint32_t offset = consumed & (N - 1);
+            uint32_t header = __atomic_load_n(&buffer[offset / 4], __ATOMIC_ACQUIRE);
+
+            if (!(header & HEADER_COMMITTED)) {
+                break;
+            }
+
+            uint32_t length = header & LENGTH_MASK;
+            uint32_t size = length;
+            if (!(header & HEADER_PADDING)) {
+                size = record_size(length);
+                write_fn((const char *)&buffer[(offset / 4) + 1], length);
+                written += length;
+            }
+
+            memset(&buffer[offset / 4], 0, size);
+            consumed += size;
+            __atomic_store_n(&tail, consumed, __ATOMIC_RELEASE);
+        }
+
+        __atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+
+        return written;
+    }
+
+    bool empty(void) const
+    {
+        return __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    }
+
+    void get_stats(ei_log_ring_stats_t *out) const
+    {
+        out->written_messages = __atomic_load_n(&stats.written_messages, __ATOMIC_RELAXED);
+        out->dropped_messages = __atomic_load_n(&stats.dropped_messages, __ATOMIC_RELAXED);
+        out->dropped_bytes = __atomic_load_n(&stats.dropped_bytes, __ATOMIC_RELAXED);
+        out->high_watermark = __atomic_load_n(&stats.high_watermark, __ATOMIC_RELAXED);
+    }
+
+private:
+    static const uint32_t HEADER_COMMITTED = 0x80000000;
+    static const uint32_t HEADER_PADDING = 0x40000000;
+    static const uint32_t LENGTH_MASK = 0x3fffffff;
+
+    // header, message and room for the terminator, in whole words
+    static uint32_t record_size(size_t length)
+    {
+        return (uint32_t)((sizeof(uint32_t) + length + 1 + 3) & ~(size_t)3);
+    }
+
+    void publish(uint32_t offset, uint32_t header)
+    {
+        __atomic_store_n(&buffer[offset / 4], header, __ATOMIC_RELEASE);
+    }
+
+    void drop(size_t length)
+    {
+        __atomic_fetch_add(&stats.dropped_messages, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stats.dropped_bytes, (uint32_t)length, __ATOMIC_RELAXED);
+    }
+
+    void update_high_watermark(uint32_t used)
+    {
+        uint32_t current = __atomic_load_n(&stats.high_watermark, __ATOMIC_RELAXED);
+        while (used > current &&
+               !__atomic_compare_exchange_n(&stats.high_watermark, &current, used,
+                    true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+
+    // record headers live in the buffer, so it is kept in 32 bit words
+    uint32_t buffer[N / 4];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t draining;
+    ei_log_ring_stats_t stats;
+};
+
+/**
+ * @brief Format a float with a fixed number of decimals, without going
+ * through printf %f (which is often not linked in on embedded targets)
+ * @param buf output, always null terminated
+ * @param size size of buf
+ * @param f value
+ * @param decimals number of decimals, at most 9
+ * @return length of the formatted value
+ */
+static inline int ei_log_format_float(char *buf, size_t size, float f, int decimals)
+{
+    char tmp[48];
+    int n = 0;
+
+    if (decimals < 0) {
+        decimals = 0;
+    }
+    else if (decimals > 9) {
+        decimals = 9;
+    }
+
+    if (isnan(f)) {
+        memcpy(tmp, "nan", 3);
+        n = 3;
+    }
+    else {
+        double value = f;
+        if (signbit(f)) {
+            tmp[n++] = '-';
+            value = -value;
+        }
+
+        if (isinf(f)) {
+            memcpy(&tmp[n], "inf", 3);
+            n += 3;
+        }
+        else {
+            int exponent = 0;
+            bool scientific = value >= 1e18;
+            if (scientific) {
+                exponent = (int)floor(log10(value));
+                value /= pow(10.0, exponent);
+            }
+
+            uint64_t scale = 1;
+            for (int i = 0; i < decimals; i++) {
+                scale *= 10;
+            }
+
+            uint64_t int_part = (uint64_t)value;
+            double frac_scaled = (value - (double)int_part) * (double)scale;
+            uint64_t frac_part = (uint64_t)frac_scaled;
+            // round half to even, like printf, on the last printed digit
+            double remainder = frac_scaled - (double)frac_part;
+            uint64_t last_digit = (decimals > 0) ? frac_part : int_part;
+            if (remainder > 0.5 || (remainder == 0.5 && (last_digit & 1))) {
+                frac_part++;
+            }
+            if (frac_part >= scale) {
+                int_part++;
+                frac_part -= scale;
+            }
+
+            char digits[20];
+            int n_digits = 0;
+            do {
+                digits[n_digits++] = (char)('0' + (int_part % 10));
+                int_part /= 10;
+            } while (int_part > 0);
+            while (n_digits > 0) {
+                tmp[n++] = digits[--n_digits];
+            }
+
+            if (decimals > 0) {
+                tmp[n++] = '.';
+                for (int i = decimals - 1; i >= 0; i--) {
+                    tmp[n + i] = (char)('0' + (frac_part % 10));
+                    frac_part /= 10;
+                }
+                n += decimals;
+            }
+
+            if (scientific) {
+                tmp[n++] = 'e';
+                tmp[n++] = '+';
+                tmp[n++] = (char)('0' + exponent / 10);
+                tmp[n++] = (char)('0' + exponent % 10);
+            }
+        }
+    }
+
+    if (size == 0) {
+        return n;
+    }
+    size_t copy = ((size_t)n < size) ? (size_t)n : (size - 1);
+    memcpy(buf, tmp, copy);
+    buf[copy] = '\0';
+
+    return n;
+}
+
+#if EI_PORTING_DEFERRED_LOG == 1
+/**
+ * Implemented by the porting layer.
+ * ei_log_deferred_start() starts the drain thread, messages printed before
+ * that wait in the ring. ei_log_deferred_flush() blocks until everything
+ * printed so far is written out, call it before writing to the serial port
+ * directly (e.g. binary transfers) so the output does not interleave.
+ */
+void ei_log_deferred_start(void);
+void ei_log_deferred_flush(void);
+void ei_log_deferred_get_stats(ei_log_ring_stats_t *stats);
+#endif
+
+#endif // _EI_LOG_RING_H_
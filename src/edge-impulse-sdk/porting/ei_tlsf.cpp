@@ -0,0 +1,584 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS
+ * IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language
+ * governing permissions and limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "edge-impulse-sdk/porting/ei_tlsf.h"
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#if EI_PORTING_TLSF_HEAP_SIZE > 0
+#include "edge-impulse-sdk/porting/ei_classifier_porting.h"
+#endif
+
+static_assert(EI_TLSF_FL_INDEX_MAX < 31, "EI_TLSF_FL_INDEX_MAX must be below 31");
+static_assert(EiTlsfAllocator::FL_COUNT > 0, "EI_TLSF_FL_INDEX_MAX too small");
+
+typedef EiTlsfAllocator::block_t block_t;
+
+static const size_t BLOCK_FREE = 0x1;
+static const size_t BLOCK_PREV_FREE = 0x2;
+static const size_t BLOCK_FLAGS = EiTlsfAllocator::ALIGN - 1;
+
+// prev_phys and size, the free list pointers overlap the payload
+static const size_t BLOCK_HEADER = offsetof(block_t, next_free);
+static const size_t BLOCK_MIN = (sizeof(block_t) - BLOCK_HEADER) > EiTlsfAllocator::ALIGN ?
+    (sizeof(block_t) - BLOCK_HEADER) : EiTlsfAllocator::ALIGN;
+static const size_t BLOCK_MAX = ((size_t)1 << (EI_TLSF_FL_INDEX_MAX + 1)) - EiTlsfAllocator::ALIGN;
+
+static_assert((BLOCK_HEADER % EiTlsfAllocator::ALIGN) == 0, "header must keep payloads aligned");
+
+static inline size_t block_get_size(const block_t *block)
+{
+    return block->size & ~BLOCK_FLAGS;
+}
+
+static inline uint8_t *block_payload(const block_t *block)
+{
+    return (uint8_t *)block + BLOCK_HEADER;
+}
+
+static inline block_t *block_from_payload(const void *ptr)
+{
+    return (block_t *)((uint8_t *)ptr - BLOCK_HEADER);
+}
+
+static inline block_t *block_next(const block_t *block)
+{
+    return (block_t *)(block_payload(block) + block_get_size(block));
+}
+
+static inline int fls32(uint32_t x)
+{
+    return 31 - __builtin_clz(x);
+}
+
+static inline int ffs32(uint32_t x)
+{
+    return __builtin_ctz(x);
+}
+
+EiTlsfAllocator::EiTlsfAllocator() :
+    pool_start(nullptr),
+    pool_end(nullptr),
+    pool_size(0)
+{
+    init(nullptr, 0);
+}
+
+bool EiTlsfAllocator::init(void *region, size_t size)
+{
+    fl_bitmap = 0;
+    memset(sl_bitmap, 0, sizeof(sl_bitmap));
+    memset(blocks, 0, sizeof(blocks));
+    used_bytes = 0;
+    high_water = 0;
+    free_bytes = 0;
+    allocations = 0;
+    frees = 0;
+    failures = 0;
+    pool_start = nullptr;
+    pool_end = nullptr;
+    pool_size = 0;
+
+    if (region == nullptr) {
+        return false;
+    }
+
+    uintptr_t start = ((uintptr_t)region + ALIGN - 1) & ~(uintptr_t)(ALIGN - 1);
+    size_t skipped = start - (uintptr_t)region;
+    if (size < skipped + 2 * BLOCK_HEADER + BLOCK_MIN) {
+        return false;
+    }
+
+    // one free block spanning the region, closed by a zero sized used block
+    // so merging never looks past the end
+    size_t payload = (size - skipped - 2 * BLOCK_HEADER) & ~(ALIGN - 1);
+    if (payload > BLOCK_MAX) {
+        payload = BLOCK_MAX;
+    }
+
+    block_t *block = (block_t *)start;
+    block->prev_phys = nullptr;
+    block->size = payload | BLOCK_FREE;
+
+    block_t *sentinel = block_next(block);
+    sentinel->prev_phys = block;
+    sentinel->size = 0 | BLOCK_PREV_FREE;
+
+    pool_start = (uint8_t *)start;
+    pool_end = (uint8_t *)sentinel + BLOCK_HEADER;
+    pool_size = payload + BLOCK_HEADER;
+
+    insert(block);
+
+    return true;
+}
+
+/**
+ * @brief First and second level list for a block size
+ */
+void EiTlsfAllocator::mapping(size_t size, int *fl, int *sl)
+{
+    if (size < SMALL_BLOCK) {
+        *fl = 0;
+        *sl = (int)(size >> ALIGN_LOG2);
+    }
+    else {
+        int f = fls32((uint32_t)size);
+        *sl = (int)((size >> (f - SL_COUNT_LOG2)) ^ SL_COUNT);
+        *fl = f - FL_SHIFT + 1;
+    }
+}
+
+/**
+ * @brief Find a free block of at least size bytes. The size is rounded up to
+ * the next list first, so any block in the list found is big enough.
+ */
+block_t *EiTlsfAllocator::find_suitable(size_t size, int *fl, int *sl)
+{
+    if (size >= SMALL_BLOCK) {
+        size += ((size_t)1 << (fls32((uint32_t)size) - SL_COUNT_LOG2)) - 1;
+    }
+    mapping(size, fl, sl);
+    if (*fl >= FL_COUNT) {
+        return nullptr;
+    }
+
+    uint32_t sl_map = sl_bitmap[*fl] & (~0U << *sl);
+    if (!sl_map) {
+        uint32_t fl_map = fl_bitmap & (~0U << (*fl + 1));
+        if (!fl_map) {
+            return nullptr;
+        }
+        *fl = ffs32(fl_map);
+        sl_map = sl_bitmap[*fl];
+    }
+    *sl = ffs32(sl_map);
+
+    return blocks[*fl][*sl];
+}
+
+void EiTlsfAllocator::insert(block_t *block)
+{
+    int fl, sl;
+    mapping(block_get_size(block), &fl, &sl);
+
+    block_t *head = blocks[fl][sl];
+    block->next_free = head;
+    block->prev_free = nullptr;
+    if (head) {
+        head->prev_free = block;
+    }
+    blocks[fl][sl] = block;
+
+    fl_bitmap |= (1U << fl);
+    sl_bitmap[fl] |= (1U << sl);
+    free_bytes += block_get_size(block);
+}
+
+void EiTlsfAllocator::remove(block_t *block, int fl, int sl)
+{
+    if (block->prev_free) {
+        block->prev_free->next_free = block->next_free;
+    }
+    else {
+        blocks[fl][sl] = block->next_free;
+        if (!blocks[fl][sl]) {
+            sl_bitmap[fl] &= ~(1U << sl);
+            if (!sl_bitmap[fl]) {
+                fl_bitmap &= ~(1U << fl);
+            }
+        }
+    }
+    if (block->next_free) {
+        block->next_free->prev_free = block->prev_free;
+    }
+
+    free_bytes -= block_get_size(block);
+}
+
+void EiTlsfAllocator::remove(block_t *block)
+{
+    int fl, sl;
+    mapping(block_get_size(block), &fl, &sl);
+    remove(block, fl, sl);
+}
+
+block_t *EiTlsfAllocator::merge_prev(block_t *block)
+{
+    if (!(block->size & BLOCK_PREV_FREE)) {
+        return block;
+    }
+
+    block_t *prev = block->prev_phys;
+    remove(prev);
+    prev->size += block_get_size(block) + BLOCK_HEADER;
+    block_next(prev)->prev_phys = prev;
+
+    return prev;
+}
+
+block_t *EiTlsfAllocator::merge_next(block_t *block)
+{
+    block_t *next = block_next(block);
+    if (!(next->size & BLOCK_FREE)) {
+        return block;
+    }
+
+    remove(next);
+    block->size += block_get_size(next) + BLOCK_HEADER;
+    block_next(block)->prev_phys = block;
+
+    return block;
+}
+
+void *EiTlsfAllocator::malloc(size_t size)
+{
+    if (size > BLOCK_MAX) {
+        failures++;
+        return nullptr;
+    }
+
+    size_t adjusted = (size + ALIGN - 1) & ~(ALIGN - 1);
+    if (adjusted < BLOCK_MIN) {
+        adjusted = BLOCK_MIN;
+    }
+
+    int fl, sl;
+    block_t *block = find_suitable(adjusted, &fl, &sl);
+    if (!block) {
+        failures++;
+        return nullptr;
+    }
+    remove(block, fl, sl);
+
+    if (block_get_size(block) >= adjusted + BLOCK_HEADER + BLOCK_MIN) {
+        // give the tail back, it stays marked as the previous block of the next one
+        block_t *rest = (block_t *)(block_payload(block) + adjusted);
+        rest->prev_phys = block;
+        rest->size = (block_get_size(block) - adjusted - BLOCK_HEADER) | BLOCK_FREE;
+        block_next(rest)->prev_phys = rest;
+        block->size = adjusted | (block->size & BLOCK_FLAGS);
+        insert(rest);
+    }
+    else {
+        block_next(block)->size &= ~BLOCK_PREV_FREE;
+    }
+    block->size &= ~BLOCK_FREE;
+
+    used_bytes += block_get_size(block) + BLOCK_HEADER;
+    if (used_bytes > high_water) {
+        high_water = used_bytes;
+    }
+    allocations++;
+
+    return block_payload(block);
+}
+
+void EiTlsfAllocator::free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    block_t *block = block_from_payload(ptr);
+    used_bytes -= block_get_size(block) + BLOCK_HEADER;
+    frees++;
+
+    block->size |= BLOCK_FREE;
+    block = merge_prev(block);
+    block = merge_next(block);
+    block_next(block)->size |= BLOCK_PREV_FREE;
+    insert(block);
+}
+
+bool EiTlsfAllocator::owns(const void *ptr) const
+{
+    return ((const uint8_t *)ptr >= pool_start) && ((const uint8_t *)ptr < pool_end);
+}
+
+size_t EiTlsfAllocator::block_size(const void *ptr) const
+{
+    return block_get_size(block_from_payload(ptr));
+}
+
+void EiTlsfAllocator::get_stats(ei_tlsf_stats_t *stats) const
+{
+    size_t largest = 0;
+
+    if (fl_bitmap) {
+        // the blocks in the highest list differ in size, look at all of them
+        int fl = fls32(fl_bitmap);
+        int sl = fls32(sl_bitmap[fl]);
+        for (const block_t *block = blocks[fl][sl]; block; block = block->next_free) {
+            if (block_get_size(block) > largest) {
+                largest = block_get_size(block);
+            }
+        }
+    }
+
+    stats->pool_size = pool_size;
+    stats->used_bytes = used_bytes;
+    stats->high_water = high_water;
+    stats->free_bytes = free_bytes;
+    stats->largest_free = largest;
+    stats->fragmentation_pct = free_bytes ?
+        (uint32_t)(100 - (uint64_t)largest * 100 / free_bytes) : 0;
+    stats->allocations = allocations;
+    stats->frees = frees;
+    stats->failures = failures;
+}
+
+bool EiTlsfAllocator::check(void) const
+{
+    if (!pool_start) {
+        return true;
+    }
+
+    size_t free_sum = 0;
+    size_t used_sum = 0;
+    size_t listed = 0;
+    bool prev_free = false;
+    const block_t *prev = nullptr;
+    const block_t *block = (const block_t *)pool_start;
+
+    while (block_get_size(block) > 0) {
+        bool is_free = block->size & BLOCK_FREE;
+        if (block->prev_phys != prev
+            || (bool)(block->size & BLOCK_PREV_FREE) != prev_free
+            || (is_free && prev_free)) {
+            return false;
+        }
+        if ((uint8_t *)block_next(block) >= pool_end) {
+            return false;
+        }
+
+        if (is_free) {
+            int fl, sl;
+            mapping(block_get_size(block), &fl, &sl);
+            const block_t *entry = blocks[fl][sl];
+            while (entry && entry != block) {
+                entry = entry->next_free;
+            }
+            if (!entry) {
+                return false;
+            }
+            free_sum += block_get_size(block);
+        }
+        else {
+            used_sum += block_get_size(block) + BLOCK_HEADER;
+        }
+
+        prev_free = is_free;
+        prev = block;
+        block = block_next(block);
+    }
+
+    // sentinel
+    if (block->prev_phys != prev || (bool)(block->size & BLOCK_PREV_FREE) != prev_free
+        || (uint8_t *)block + BLOCK_HEADER != pool_end) {
+        return false;
+    }
+
+    for (int fl = 0; fl < FL_COUNT; fl++) {
+        if ((bool)(fl_bitmap & (1U << fl)) != (sl_bitmap[fl] != 0)) {
+            return false;
+        }
+        for (int sl = 0; sl < SL_COUNT; sl++) {
+            if ((bool)(sl_bitmap[fl] & (1U << sl)) != (blocks[fl][sl] != nullptr)) {
+                return false;
+            }
+            for (const block_t *entry = blocks[fl][sl]; entry; entry = entry->next_free) {
+                if (!(entry->size & BLOCK_FREE)) {
+                    return false;
+                }
+                listed++;
+            }
+        }
+    }
+
+    size_t free_blocks = 0;
+    for (block = (const block_t *)pool_start; block_get_size(block) > 0; block = block_next(block)) {
+        free_blocks += (block->size & BLOCK_FREE) ? 1 : 0;
+    }
+
+    return free_sum == free_bytes && used_sum == used_bytes && listed == free_blocks;
+}
+
+#if EI_PORTING_TLSF_HEAP_SIZE > 0
+
+static uint8_t heap_region[EI_PORTING_TLSF_HEAP_SIZE] __attribute__((aligned(8)));
+// constructed on first use, ei_malloc can be called before static constructors ran
+static uint8_t heap_storage[sizeof(EiTlsfAllocator)] __attribute__((aligned(8)));
+static EiTlsfAllocator *heap = nullptr;
+static uint32_t heap_fallbacks = 0;
+static ei_tlsf_call_site_t call_sites[EI_TLSF_CALL_SITES];
+
+__attribute__((weak)) void ei_tlsf_heap_lock(void)
+{
+}
+
+__attribute__((weak)) void ei_tlsf_heap_unlock(void)
+{
+}
+
+/**
+ * The heap, constructed on first use. Only called with the heap lock held, so
+ * threads racing on the first allocation construct it exactly once.
+ */
+static EiTlsfAllocator *get_heap(void)
+{
+    if (!heap) {
+        heap = new (heap_storage) EiTlsfAllocator();
+        heap->init(heap_region, sizeof(heap_region));
+    }
+    return heap;
+}
+
+/**
+ * true if ptr is in the static region, which does not need the heap to be
+ * constructed or the lock to be held
+ */
+static bool heap_region_owns(const void *ptr)
+{
+    return (const uint8_t *)ptr >= heap_region && (const uint8_t *)ptr < heap_region + sizeof(heap_region);
+}
+
+static void record_call_site(const void *site, size_t size, bool failed)
+{
+    for (int i = 0; i < EI_TLSF_CALL_SITES; i++) {
+        ei_tlsf_call_site_t *entry = &call_sites[i];
+        if (entry->site != site && entry->site != nullptr) {
+            continue;
+        }
+        // sites past the table size are not tracked
+        entry->site = site;
+        entry->calls++;
+        entry->bytes += size;
+        if (size > entry->largest) {
+            entry->largest = size;
+        }
+        if (failed) {
+            entry->failures++;
+        }
+        return;
+    }
+}
+
+static void *heap_malloc_locked(size_t size, const void *site)
+{
+    ei_tlsf_heap_lock();
+    void *ptr = get_heap()->malloc(size);
+    record_call_site(site, size, ptr == nullptr);
+    if (!ptr) {
+        heap_fallbacks++;
+    }
+    ei_tlsf_heap_unlock();
+
+    return ptr;
+}
+
+void *ei_tlsf_heap_malloc(size_t size, const void *site)
+{
+    void *ptr = heap_malloc_locked(size, site);
+
+    return ptr ? ptr : ::malloc(size);
+}
+
+void *ei_tlsf_heap_calloc(size_t nitems, size_t size, const void *site)
+{
+    if (size && nitems > SIZE_MAX / size) {
+        return nullptr;
+    }
+
+    void *ptr = heap_malloc_locked(nitems * size, site);
+    if (!ptr) {
+        return ::calloc(nitems, size);
+    }
+    memset(ptr, 0, nitems * size);
+
+    return ptr;
+}
+
+void ei_tlsf_heap_free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    if (!heap_region_owns(ptr)) {
+        ::free(ptr);
+        return;
+    }
+
+    ei_tlsf_heap_lock();
+    get_heap()->free(ptr);
+    ei_tlsf_heap_unlock();
+}
+
+void ei_tlsf_heap_get_stats(ei_tlsf_stats_t *stats)
+{
+    ei_tlsf_heap_lock();
+    get_heap()->get_stats(stats);
+    ei_tlsf_heap_unlock();
+}
+
+int ei_tlsf_heap_get_call_sites(ei_tlsf_call_site_t *sites, int max_sites)
+{
+    int n = 0;
+
+    ei_tlsf_heap_lock();
+    for (int i = 0; i < EI_TLSF_CALL_SITES && n < max_sites; i++) {
+        if (call_sites[i].site) {
+            sites[n++] = call_sites[i];
+        }
+    }
+    ei_tlsf_heap_unlock();
+
+    return n;
+}
+
+uint32_t ei_tlsf_heap_fallbacks(void)
+{
+    ei_tlsf_heap_lock();
+    uint32_t fallbacks = heap_fallbacks;
+    ei_tlsf_heap_unlock();
+
+    return fallbacks;
+}
+
+void ei_tlsf_heap_print_stats(void)
+{
+    ei_tlsf_stats_t stats;
+    ei_tlsf_call_site_t sites[EI_TLSF_CALL_SITES];
+
+    ei_tlsf_heap_get_stats(&stats);
+    int n_sites = ei_tlsf_heap_get_call_sites(sites, EI_TLSF_CALL_SITES);
+
+    ei_printf("TLSF heap: %u/%u bytes used, high water %u, largest free %u, fragmentation %u%%\n",
+        (unsigned int)stats.used_bytes, (unsigned int)stats.pool_size, (unsigned int)stats.high_water,
+        (unsigned int)stats.largest_free, (unsigned int)stats.fragmentation_pct);
+    ei_printf("  %u allocations, %u frees, %u did not fit (served by malloc)\n",
+        (unsigned int)stats.allocations, (unsigned int)stats.frees, (unsigned int)ei_tlsf_heap_fallbacks());
+    for (int i = 0; i < n_sites; i++) {
+        ei_printf("  site %p: %u calls, %u bytes, largest %u, %u did not fit\n",
+            sites[i].site, (unsigned int)sites[i].calls, (unsigned int)sites[i].bytes,
+            (unsigned int)sites[i].largest, (unsigned int)sites[i].failures);
+    }
+}
+
+#endif // EI_PORTING_TLSF_HEAP_SIZE > 0
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS
+ * IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language
+ * governing permissions and limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _EI_TLSF_H_
+#define _EI_TLSF_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Size of a static region that ei_malloc / ei_calloc / ei_free allocate from
+ * with a two-level segregated fit allocator instead of the C library heap.
+ * Allocation and free are O(1), and the same sequence of sizes every
+ * inference always ends up in the same place, so there is no creeping
+ * fragmentation. Requests that do not fit fall back to malloc. 0 (default)
+ * keeps the C library heap.
+ */
+#ifndef EI_PORTING_TLSF_HEAP_SIZE
+#define EI_PORTING_TLSF_HEAP_SIZE       0
+#endif
+
+/** Number of distinct call sites (return addresses) ei_malloc keeps statistics for */
+#ifndef EI_TLSF_CALL_SITES
+#define EI_TLSF_CALL_SITES              16
+#endif
+
+/** log2 of the largest block, limits the size of the free list table */
+#ifndef EI_TLSF_FL_INDEX_MAX
+#define EI_TLSF_FL_INDEX_MAX            20
+#endif
+
+typedef struct {
+    size_t pool_size;           /*!< bytes available for blocks */
+    size_t used_bytes;          /*!< bytes in allocated blocks, headers included */
+    size_t high_water;          /*!< highest used_bytes */
+    size_t free_bytes;          /*!< bytes in free blocks */
+    size_t largest_free;        /*!< largest block that can be allocated right now */
+    uint32_t fragmentation_pct; /*!< 100 * (1 - largest_free / free_bytes) */
+    uint32_t allocations;       /*!< successful allocations */
+    uint32_t frees;
+    uint32_t failures;          /*!< requests that did not fit */
+} ei_tlsf_stats_t;
+
+typedef struct {
+    const void *site;           /*!< return address of the ei_malloc / ei_calloc caller */
+    uint32_t calls;
+    uint32_t failures;          /*!< calls that did not fit in the region */
+    size_t bytes;               /*!< total bytes requested */
+    size_t largest;             /*!< largest single request */
+} ei_tlsf_call_site_t;
+
+/**
+ * Two-level segregated fit allocator over a caller provided region.
+ *
+ * Free blocks are kept in lists by size class: the first level is the power
+ * of two of the size, the second level splits each power of two in
+ * EI_TLSF_SL_COUNT linear steps. Two bitmaps tell which lists hold blocks, so
+ * finding a fitting block is two find-first-set operations. Freed blocks are
+ * merged with their free neighbours straight away.
+ *
+ * Every block starts with a two word header (previous physical block, size
+ * and flags), payloads are 8 byte aligned. Not thread safe, the porting layer
+ * serialises calls.
+ */
+class EiTlsfAllocator {
+public:
+    EiTlsfAllocator();
+
+    /**
+     * @brief Hand the allocator its region, drops everything allocated before
+     * @return false if the region is too small
+     */
+    bool init(void *region, size_t size);
+
+    void *malloc(size_t size);
+    void free(void *ptr);
+
+    /** @brief true if ptr was allocated from the region */
+    bool owns(const void *ptr) const;
+
+    /** @brief Payload size of an allocated block (at least the requested size) */
+    size_t block_size(const void *ptr) const;
+
+    void get_stats(ei_tlsf_stats_t *stats) const;
+
+    /**
+     * @brief Walk all blocks and check the headers, free lists and bitmaps
+     * agree with each other
+     * @return false on any inconsistency
+     */
+    bool check(void) const;
+
+    static const int SL_COUNT_LOG2 = 4;
+    static const int SL_COUNT = 1 << SL_COUNT_LOG2;
+    static const int ALIGN_LOG2 = 3;
+    static const size_t ALIGN = 1 << ALIGN_LOG2;
+    static const int FL_SHIFT = SL_COUNT_LOG2 + ALIGN_LOG2;
+    static const int FL_COUNT = EI_TLSF_FL_INDEX_MAX - FL_SHIFT + 1;
+    static const size_t SMALL_BLOCK = (size_t)1 << FL_SHIFT;
+
+    struct block_t {
+        block_t *prev_phys;     // previous block in memory
+        size_t size;            // payload size | flags
+        block_t *next_free;     // free blocks only, lives in the payload
+        block_t *prev_free;
+    };
+
+private:
+    static void mapping(size_t size, int *fl, int *sl);
+    block_t *find_suitable(size_t size, int *fl, int *sl);
+    void insert(block_t *block);
+    void remove(block_t *block, int fl, int sl);
+    void remove(block_t *block);
+    block_t *merge_prev(block_t *block);
+    block_t *merge_next(block_t *block);
+
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[FL_COUNT];
+    block_t *blocks[FL_COUNT][SL_COUNT];
+
+    uint8_t *pool_start;
+    uint8_t *pool_end;
+    size_t pool_size;
+    size_t used_bytes;
+    size_t high_water;
+    size_t free_bytes;
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failures;
+};
+
+#if EI_PORTING_TLSF_HEAP_SIZE > 0
+/**
+ * The heap behind ei_malloc / ei_calloc / ei_free, over a static region of
+ * EI_PORTING_TLSF_HEAP_SIZE bytes. site is the return address of the caller,
+ * statistics are kept per site (symbolise with addr2line).
+ */
+void *ei_tlsf_heap_malloc(size_t size, const void *site);
+void *ei_tlsf_heap_calloc(size_t nitems, size_t size, const void *site);
+void ei_tlsf_heap_free(void *ptr);
+void ei_tlsf_heap_get_stats(ei_tlsf_stats_t *stats);
+/** @return number of sites filled in */
+int ei_tlsf_heap_get_call_sites(ei_tlsf_call_site_t *sites, int max_sites);
+/** Requests that did not fit and were served by malloc */
+uint32_t ei_tlsf_heap_fallbacks(void);
+void ei_tlsf_heap_print_stats(void);
+
+/**
+ * Serialise heap access between threads. Weak no-op by default, the porting
+ * layer of a threaded platform overrides them.
+ */
+void ei_tlsf_heap_lock(void);
+void ei_tlsf_heap_unlock(void);
+#endif // EI_PORTING_TLSF_HEAP_SIZE > 0
+
+#endif // _EI_TLSF_H_
@@ -22,6 +22,7 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include "us_ticker_api.h"
+#include "../ei_tlsf.h"
 
 #define EI_WEAK_FN __attribute__((weak))
 
@@ -74,6 +75,31 @@ __attribute__((weak)) void ei_printf_float(float f) {
     ei_printf("%f", f);
 }
 
+#if EI_PORTING_TLSF_HEAP_SIZE > 0
+#if EI_PORTING_ARDUINO == 0
+// heap operations are short and bounded, a critical section keeps them
+// usable from any thread without priority inversion on a mutex
+void ei_tlsf_heap_lock(void) {
+    core_util_critical_section_enter();
+}
+
+void ei_tlsf_heap_unlock(void) {
+    core_util_critical_section_exit();
+}
+#endif
+
+__attribute__((weak)) void *ei_malloc(size_t size) {
+    return ei_tlsf_heap_malloc(size, __builtin_return_address(0));
+}
+
+__attribute__((weak)) void *ei_calloc(size_t nitems, size_t size) {
+    return ei_tlsf_heap_calloc(nitems, size, __builtin_return_address(0));
+}
+
+__attribute__((weak)) void ei_free(void *ptr) {
+    ei_tlsf_heap_free(ptr);
+}
+#else
 __attribute__((weak)) void *ei_malloc(size_t size) {
     return malloc(size);
 }
@@ -85,6 +111,7 @@ __attribute__((weak)) void *ei_calloc(size_t nitems, size_t size) {
 __attribute__((weak)) void ei_free(void *ptr) {
     free(ptr);
 }
+#endif // EI_PORTING_TLSF_HEAP_SIZE > 0
 
 #if defined(__cplusplus) && EI_C_LINKAGE == 1
 extern "C"
@@ -25,6 +25,11 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include "edge-impulse-sdk/porting/ei_log_ring.h"
+#include "edge-impulse-sdk/porting/ei_tlsf.h"
+#if EI_PORTING_DEFERRED_LOG == 1 || EI_PORTING_TLSF_HEAP_SIZE > 0
+#include <pthread.h>
+#endif
 
 __attribute__((weak)) EI_IMPULSE_ERROR ei_run_impulse_check_canceled() {
     return EI_IMPULSE_OK;
@@ -59,19 +64,177 @@ uint64_t ei_read_timer_us() {
     return (s * 1000000) + us;
 }
 
+#if EI_PORTING_DEFERRED_LOG == 1
+static EiLogRing<EI_LOG_RING_SIZE> log_ring;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t log_drained_cond = PTHREAD_COND_INITIALIZER;
+static bool log_thread_started = false;
+
+static void log_ring_write(const char *data, size_t length)
+{
+    fwrite(data, 1, length, stdout);
+}
+
+static void log_ring_drain(void)
+{
+    if (log_ring.drain(&log_ring_write) > 0) {
+        fflush(stdout);
+    }
+}
+
+static void log_drain_deadline(struct timespec *deadline)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_nsec += EI_LOG_DRAIN_INTERVAL_MS * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+static void *log_thread_main(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        struct timespec deadline;
+        log_drain_deadline(&deadline);
+
+        pthread_mutex_lock(&log_mutex);
+        if (log_ring.empty()) {
+            pthread_cond_timedwait(&log_cond, &log_mutex, &deadline);
+        }
+        pthread_mutex_unlock(&log_mutex);
+
+        log_ring_drain();
+
+        pthread_mutex_lock(&log_mutex);
+        pthread_cond_broadcast(&log_drained_cond);
+        pthread_mutex_unlock(&log_mutex);
+    }
+
+    return NULL;
+}
+
+static void log_ring_notify(void)
+{
+    if (log_thread_started) {
+        // the drain thread also wakes up on its own, so a missed signal
+        // only delays the output
+        pthread_cond_signal(&log_cond);
+    }
+    else {
+        log_ring_drain();
+    }
+}
+
+void ei_log_deferred_flush(void)
+{
+    if (log_ring.empty()) {
+        return;
+    }
+
+    while (!log_ring.empty()) {
+        if (log_ring.drain(&log_ring_write) > 0) {
+            continue;
+        }
+        // the drain thread holds the ring, or a producer has not committed
+        // yet (its commit wakes the drain thread), wait for the next pass
+        struct timespec deadline;
+        log_drain_deadline(&deadline);
+
+        pthread_mutex_lock(&log_mutex);
+        if (!log_ring.empty()) {
+            pthread_cond_signal(&log_cond);
+            pthread_cond_timedwait(&log_drained_cond, &log_mutex, &deadline);
+        }
+        pthread_mutex_unlock(&log_mutex);
+    }
+    fflush(stdout);
+}
+
+void ei_log_deferred_start(void)
+{
+    pthread_t thread;
+
+    if (log_thread_started) {
+        return;
+    }
+
+    if (pthread_create(&thread, NULL, &log_thread_main, NULL) == 0) {
+        pthread_detach(thread);
+        log_thread_started = true;
+        atexit(&ei_log_deferred_flush);
+    }
+}
+
+void ei_log_deferred_get_stats(ei_log_ring_stats_t *stats)
+{
+    log_ring.get_stats(stats);
+}
+#endif // EI_PORTING_DEFERRED_LOG == 1
+
 __attribute__((weak)) void ei_printf(const char *format, ...) {
+#if EI_PORTING_DEFERRED_LOG == 1
+    // formatted on the stack of the calling thread, only the copy into the
+    // ring is shared
+    char buf[EI_LOG_FORMAT_BUFFER_SIZE];
+    va_list myargs;
+
+    va_start(myargs, format);
+    int r = vsnprintf(buf, sizeof(buf), format, myargs);
+    va_end(myargs);
+
+    if (r <= 0) {
+        return;
+    }
+
+    if ((size_t)r < sizeof(buf)) {
+        log_ring.write(buf, r);
+    }
+    else {
+        // too long for the stack buffer, format again straight into the ring
+        uint32_t position;
+        char *dest = log_ring.reserve(r, &position);
+        if (dest == NULL) {
+            return;
+        }
+        va_start(myargs, format);
+        vsnprintf(dest, r + 1, format, myargs);
+        va_end(myargs);
+        log_ring.commit(position, r);
+    }
+
+    log_ring_notify();
+#else
     va_list myargs;
     va_start(myargs, format);
     vprintf(format, myargs);
     va_end(myargs);
+#endif
 }
 
 __attribute__((weak)) void ei_printf_float(float f) {
+#if EI_PORTING_DEFERRED_LOG == 1
+    char buf[48];
+    int r = ei_log_format_float(buf, sizeof(buf), f, 6);
+    log_ring.write(buf, r);
+    log_ring_notify();
+#else
     ei_printf("%f", f);
+#endif
 }
 
 __attribute__((weak)) void ei_putchar(char data)
 {
+#if EI_PORTING_DEFERRED_LOG == 1
+    // raw output bypasses the ring, keep it in order. Only the first
+    // character after a print waits, the rest finds the ring empty.
+    if (!log_ring.empty()) {
+        ei_log_deferred_flush();
+    }
+#endif
     putchar(data);
 }
 
@@ -80,6 +243,29 @@ __attribute__((weak)) char ei_getchar(void)
     return getchar();
 }
 
+#if EI_PORTING_TLSF_HEAP_SIZE > 0
+static pthread_mutex_t heap_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void ei_tlsf_heap_lock(void) {
+    pthread_mutex_lock(&heap_mutex);
+}
+
+void ei_tlsf_heap_unlock(void) {
+    pthread_mutex_unlock(&heap_mutex);
+}
+
+__attribute__((weak)) void *ei_malloc(size_t size) {
+    return ei_tlsf_heap_malloc(size, __builtin_return_address(0));
+}
+
+__attribute__((weak)) void *ei_calloc(size_t nitems, size_t size) {
+    return ei_tlsf_heap_calloc(nitems, size, __builtin_return_address(0));
+}
+
+__attribute__((weak)) void ei_free(void *ptr) {
+    ei_tlsf_heap_free(ptr);
+}
+#else
 __attribute__((weak)) void *ei_malloc(size_t size) {
     return malloc(size);
 }
@@ -91,6 +277,7 @@ __attribute__((weak)) void *ei_calloc(size_t nitems, size_t size) {
 __attribute__((weak)) void ei_free(void *ptr) {
     free(ptr);
 }
+#endif // EI_PORTING_TLSF_HEAP_SIZE > 0
 
 #if defined(__cplusplus) && EI_C_LINKAGE == 1
 extern "C"
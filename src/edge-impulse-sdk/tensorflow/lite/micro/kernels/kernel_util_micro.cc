@@ -19,6 +19,7 @@ limitations under the License.
 #include "edge-impulse-sdk/tensorflow/lite/kernels/internal/portable_tensor_utils.h"
 #include "edge-impulse-sdk/tensorflow/lite/micro/memory_helpers.h"
 #include "edge-impulse-sdk/tensorflow/lite/micro/micro_log.h"
+#include "edge-impulse-sdk/classifier/ei_model_profiler.h"
 
 namespace tflite {
 namespace micro {
@@ -43,6 +44,11 @@ TfLiteRegistration RegisterOp(
     TfLiteStatus (*prepare)(TfLiteContext* context, TfLiteNode* node),
     TfLiteStatus (*invoke)(TfLiteContext* context, TfLiteNode* node),
     void (*free)(TfLiteContext* context, void* buffer)) {
+#if EI_CLASSIFIER_PROFILE_OPS == 1
+  // Edge Impulse: record every op of this kernel, for the interpreter and
+  // for compiled (EON) models
+  invoke = ei_profiler_wrap_kernel(prepare, invoke);
+#endif
   return {/*init=*/init,
           /*free=*/free,
           /*prepare=*/prepare,
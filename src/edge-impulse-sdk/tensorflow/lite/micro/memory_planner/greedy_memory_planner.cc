@@ -15,6 +15,8 @@ limitations under the License.
 
 #include "edge-impulse-sdk/tensorflow/lite/micro/memory_planner/greedy_memory_planner.h"
 
+#include <climits>
+
 #include "edge-impulse-sdk/tensorflow/lite/micro/micro_log.h"
 #include "edge-impulse-sdk/tensorflow/lite/micro/micro_string.h"
 
@@ -35,27 +37,111 @@ char GetOrdinalCharacter(int i) {
   return '*';
 }
 
+// Value of interval index leaves for buffers that aren't placed yet, lower
+// than any time a buffer can be used at.
+constexpr int kNotPlaced = INT_MIN;
+
 }  // namespace
 
-// Simple stable in-place sort function. Not time-efficient for large arrays.
-// Would normally be in an anonymous namespace to keep it private, but we want
-// to be able to test it externally.
-void ReverseSortInPlace(int* values, int* ids, int size) {
-  bool any_swapped;
-  do {
-    any_swapped = false;
-    for (int i = 1; i < size; ++i) {
-      if (values[i - 1] < values[i]) {
-        const int value_temp = values[i - 1];
-        values[i - 1] = values[i];
-        values[i] = value_temp;
-        const int id_temp = ids[i - 1];
-        ids[i - 1] = ids[i];
-        ids[i] = id_temp;
-        any_swapped = true;
-      }
+namespace {
+
+// Orders entries for ReverseSort(), larger values first.
+inline bool SortsBefore(const int* values, int a, int b) {
+  return values[a] > values[b];
+}
+
+inline void SwapEntries(int* values, int* ids, int a, int b) {
+  const int value_temp = values[a];
+  values[a] = values[b];
+  values[b] = value_temp;
+  const int id_temp = ids[a];
+  ids[a] = ids[b];
+  ids[b] = id_temp;
+}
+
+void InsertionSort(int* values, int* ids, int begin, int end) {
+  for (int i = begin + 1; i < end; ++i) {
+    for (int j = i; j > begin && SortsBefore(values, j, j - 1); --j) {
+      SwapEntries(values, ids, j, j - 1);
+    }
+  }
+}
+
+// Merges the sorted runs [begin, middle) and [middle, end) of from_values
+// into to_values, ids are moved along. Equal entries are taken from the
+// first run first, so the sort stays stable.
+void MergeRuns(const int* from_values, const int* from_ids, int* to_values,
+               int* to_ids, int begin, int middle, int end) {
+  int left = begin;
+  int right = middle;
+  for (int out = begin; out < end; ++out) {
+    if (left < middle &&
+        (right >= end || !SortsBefore(from_values, right, left))) {
+      to_values[out] = from_values[left];
+      to_ids[out] = from_ids[left++];
+    } else {
+      to_values[out] = from_values[right];
+      to_ids[out] = from_ids[right++];
+    }
+  }
+}
+
+// Moves ids[root] down the min-heap of ids ordered by offset held in
+// ids[0, end), for GreedyMemoryPlanner::PopActiveBuffer().
+void SiftDownByOffset(int* ids, const int* offsets, int root, const int end) {
+  const int id = ids[root];
+  for (int child = 2 * root + 1; child < end; child = 2 * root + 1) {
+    if (child + 1 < end && offsets[ids[child + 1]] < offsets[ids[child]]) {
+      ++child;
+    }
+    if (offsets[ids[child]] >= offsets[id]) {
+      break;
     }
-  } while (any_swapped);
+    ids[root] = ids[child];
+    root = child;
+  }
+  ids[root] = id;
+}
+
+}  // namespace
+
+// Stable sort in descending order of value, ids are moved along. Sorts
+// blocks with insertion sort, then merges them back and forth between the
+// arrays and the scratch arrays (each at least size entries), O(n log n)
+// comparisons. Would normally be in an anonymous namespace to keep it
+// private, but we want to be able to test it externally.
+void ReverseSort(int* values, int* ids, int size, int* values_scratch,
+                 int* ids_scratch) {
+  constexpr int kBlockSize = 16;
+  for (int begin = 0; begin < size; begin += kBlockSize) {
+    InsertionSort(values, ids, begin,
+                  begin + kBlockSize < size ? begin + kBlockSize : size);
+  }
+
+  int* from_values = values;
+  int* from_ids = ids;
+  int* to_values = values_scratch;
+  int* to_ids = ids_scratch;
+  for (int width = kBlockSize; width < size; width *= 2) {
+    for (int begin = 0; begin < size; begin += 2 * width) {
+      const int middle = begin + width < size ? begin + width : size;
+      const int end = begin + 2 * width < size ? begin + 2 * width : size;
+      MergeRuns(from_values, from_ids, to_values, to_ids, begin, middle, end);
+    }
+    int* temp = from_values;
+    from_values = to_values;
+    to_values = temp;
+    temp = from_ids;
+    from_ids = to_ids;
+    to_ids = temp;
+  }
+
+  if (from_values != values) {
+    for (int i = 0; i < size; ++i) {
+      values[i] = from_values[i];
+      ids[i] = from_ids[i];
+    }
+  }
 }
 
 GreedyMemoryPlanner::GreedyMemoryPlanner() {}
@@ -64,6 +150,7 @@ TfLiteStatus GreedyMemoryPlanner::Init(unsigned char* scratch_buffer,
                                        int scratch_buffer_size) {
   // Reset internal states
   buffer_count_ = 0;
+  active_buffer_count_ = 0;
   need_to_calculate_offsets_ = true;
 
   // Allocate the arrays we need within the scratch buffer arena.
@@ -79,10 +166,19 @@ TfLiteStatus GreedyMemoryPlanner::Init(unsigned char* scratch_buffer,
   buffer_ids_sorted_ = reinterpret_cast<int*>(next_free);
   next_free += sizeof(int) * max_buffer_count_;
 
-  buffers_sorted_by_offset_ = reinterpret_cast<ListEntry*>(next_free);
-  next_free += sizeof(ListEntry) * max_buffer_count_;
-
   buffer_offsets_ = reinterpret_cast<int*>(next_free);
+  next_free += sizeof(int) * max_buffer_count_;
+
+  buffers_by_first_time_ = reinterpret_cast<int*>(next_free);
+  next_free += sizeof(int) * max_buffer_count_;
+
+  first_time_rank_ = reinterpret_cast<int*>(next_free);
+  next_free += sizeof(int) * max_buffer_count_;
+
+  active_last_time_used_ = reinterpret_cast<int*>(next_free);
+  next_free += sizeof(int) * 2 * max_buffer_count_;
+
+  active_buffers_ = reinterpret_cast<int*>(next_free);
   return kTfLiteOk;
 }
 
@@ -117,47 +213,76 @@ TfLiteStatus GreedyMemoryPlanner::AddBuffer(int size, int first_time_used,
   return kTfLiteOk;
 }
 
-bool GreedyMemoryPlanner::DoesEntryOverlapInTime(
-    const GreedyMemoryPlanner::ListEntry* entry, const int first_time_used,
-    const int last_time_used) const {
-  const BufferRequirements* entry_requirements =
-      &requirements_[entry->requirements_index];
-  if (entry_requirements->first_time_used > last_time_used) {
-    return false;
+void GreedyMemoryPlanner::MarkBufferPlaced(const int buffer_id) {
+  int node = buffer_count_ + first_time_rank_[buffer_id];
+  active_last_time_used_[node] = requirements_[buffer_id].last_time_used;
+  for (node /= 2; node >= 1; node /= 2) {
+    const int left = active_last_time_used_[2 * node];
+    const int right = active_last_time_used_[2 * node + 1];
+    active_last_time_used_[node] = left > right ? left : right;
   }
-  if (first_time_used > entry_requirements->last_time_used) {
-    return false;
-  }
-  return true;
 }
 
-GreedyMemoryPlanner::ListEntry*
-GreedyMemoryPlanner::NextSimultaneouslyActiveBuffer(
-    const GreedyMemoryPlanner::ListEntry* start, const int first_time_used,
-    const int last_time_used) {
-  ListEntry* result = nullptr;
-  ListEntry* candidate_next_entry;
-  if (start == nullptr) {
-    candidate_next_entry = &buffers_sorted_by_offset_[first_entry_index_];
-  } else {
-    if (start->next_entry_index == -1) {
-      return nullptr;
+void GreedyMemoryPlanner::FindActiveBuffers(const int first_time_used,
+                                            const int last_time_used) {
+  // Buffers that start after the range can't overlap it, binary search for
+  // the end of the prefix of buffers that start within or before it.
+  int low = 0;
+  int high = buffer_count_;
+  while (low < high) {
+    const int middle = low + (high - low) / 2;
+    if (requirements_[buffers_by_first_time_[middle]].first_time_used >
+        last_time_used) {
+      high = middle;
+    } else {
+      low = middle + 1;
     }
-    candidate_next_entry = &buffers_sorted_by_offset_[start->next_entry_index];
   }
-  do {
-    if (DoesEntryOverlapInTime(candidate_next_entry, first_time_used,
-                               last_time_used)) {
-      result = candidate_next_entry;
-      break;
+
+  // Of those, collect the placed ones that end within or after the range,
+  // visiting only the index nodes that lead to one.
+  active_buffer_count_ = 0;
+  int left = buffer_count_;
+  int right = buffer_count_ + low;
+  while (left < right) {
+    if (left & 1) {
+      CollectActiveBuffers(left++, first_time_used);
     }
-    if (candidate_next_entry->next_entry_index == -1) {
-      break;
+    if (right & 1) {
+      CollectActiveBuffers(--right, first_time_used);
     }
-    candidate_next_entry =
-        &buffers_sorted_by_offset_[candidate_next_entry->next_entry_index];
-  } while (true);
-  return result;
+    left /= 2;
+    right /= 2;
+  }
+
+  // Heap ordered by offset, the gap search usually stops long before it has
+  // looked at all of them, so they aren't fully sorted.
+  for (int i = active_buffer_count_ / 2 - 1; i >= 0; --i) {
+    SiftDownByOffset(active_buffers_, buffer_offsets_, i,
+                     active_buffer_count_);
+  }
+}
+
+void GreedyMemoryPlanner::CollectActiveBuffers(const int node,
+                                               const int first_time_used) {
+  if (active_last_time_used_[node] < first_time_used) {
+    return;
+  }
+  if (node >= buffer_count_) {
+    active_buffers_[active_buffer_count_++] =
+        buffers_by_first_time_[node - buffer_count_];
+    return;
+  }
+  CollectActiveBuffers(2 * node, first_time_used);
+  CollectActiveBuffers(2 * node + 1, first_time_used);
+}
+
+int GreedyMemoryPlanner::PopActiveBuffer() {
+  const int id = active_buffers_[0];
+  --active_buffer_count_;
+  active_buffers_[0] = active_buffers_[active_buffer_count_];
+  SiftDownByOffset(active_buffers_, buffer_offsets_, 0, active_buffer_count_);
+  return id;
 }
 
 void GreedyMemoryPlanner::CalculateOffsetsIfNeeded() {
@@ -188,125 +313,74 @@ void GreedyMemoryPlanner::CalculateOffsetsIfNeeded() {
     }
   }
 
-  // This sorting algorithm is naive, and may end up taking a very long time
-  // with hundreds of buffers. Do not sort the offline planned offsets.
-  ReverseSortInPlace(&buffer_sizes_sorted_[idx_from_head],
-                     &buffer_ids_sorted_[idx_from_head],
-                     buffer_count_ - idx_from_head);
+  // Do not sort the offline planned offsets. The interval index isn't built
+  // yet, its 2 * buffer_count_ entries are the sort's scratch.
+  ReverseSort(&buffer_sizes_sorted_[idx_from_head],
+              &buffer_ids_sorted_[idx_from_head],
+              buffer_count_ - idx_from_head, active_last_time_used_,
+              active_last_time_used_ + buffer_count_);
+
+  // Build the interval index, ordering the buffers by first_time_used with
+  // the same sort (larger values first, so the times are negated). The index
+  // doesn't hold a value yet, so its first half is used for the sort keys,
+  // its second half and first_time_rank_ as the scratch.
+  for (int i = 0; i < buffer_count_; ++i) {
+    active_last_time_used_[i] = -requirements_[i].first_time_used;
+    buffers_by_first_time_[i] = i;
+  }
+  ReverseSort(active_last_time_used_, buffers_by_first_time_, buffer_count_,
+              active_last_time_used_ + buffer_count_, first_time_rank_);
+  for (int i = 0; i < buffer_count_; ++i) {
+    first_time_rank_[buffers_by_first_time_[i]] = i;
+  }
+  for (int i = 0; i < 2 * buffer_count_; ++i) {
+    active_last_time_used_[i] = kNotPlaced;
+  }
 
-  // Initialize the first entry to the first buffer in
-  // buffer_ids_sorted_.
+  // Buffers are placed in the order of buffer_ids_sorted_.
   //   - If there are no offline planned offsets, the largest buffer will be
   //     first, and the buffers will be handled in size order.
   //   - If offline offsets are present, these will be handled first in order
   //     for the greedy algorithm to utilized gaps in the offline plan.
-  first_entry_index_ = 0;
-  next_free_entry_ = 1;
-  ListEntry* first_entry = &buffers_sorted_by_offset_[first_entry_index_];
-  first_entry->next_entry_index = -1;  // to mark the entry as end of list
-  int buffer_id = buffer_ids_sorted_[0];
-  first_entry->requirements_index = buffer_id;
-  if (requirements_[buffer_id].offline_offset == kOnlinePlannedBuffer) {
-    buffer_offsets_[buffer_id] = 0;
-  }
-  first_entry->offset = buffer_offsets_[buffer_id];
 
-  // Work through the rest of the buffers to find a good gap to place each one.
-  for (int i = 1; i < buffer_count_; ++i) {
+  // Work through the buffers to find a good gap to place each one.
+  for (int i = 0; i < buffer_count_; ++i) {
     // The id is the order the buffer was originally added by the client.
-    buffer_id = buffer_ids_sorted_[i];
+    const int buffer_id = buffer_ids_sorted_[i];
     // Look at what size and time range the buffer needs to be active.
     BufferRequirements* wanted_requirements = &requirements_[buffer_id];
     const int wanted_size = wanted_requirements->size;
     const int wanted_first_time_used = wanted_requirements->first_time_used;
     const int wanted_last_time_used = wanted_requirements->last_time_used;
 
-    // Find the first buffer that's active in our time range. All placed
-    // buffers are stored in the order of their starting position in the arena
-    // so that it's easy to find the next buffer in memory, and so the gap.
-    // The candidate_entry variable holds the buffer that we're considering
-    // placing the current buffer after.
-
     int candidate_offset = 0;
-    // Loop through the offset-ordered list of buffers, looking for gaps.
     if (wanted_requirements->offline_offset == kOnlinePlannedBuffer) {
-      ListEntry* prior_entry = nullptr;
-      while (true) {
-        // Find out what the next active buffer is.
-        ListEntry* next_entry = NextSimultaneouslyActiveBuffer(
-            prior_entry, wanted_first_time_used, wanted_last_time_used);
-
-        if (prior_entry) {
-          BufferRequirements* candidate_requirements =
-              &requirements_[prior_entry->requirements_index];
-          const int prior_entry_offset =
-              prior_entry->offset + candidate_requirements->size;
-          if (prior_entry_offset > candidate_offset) {
-            candidate_offset = prior_entry_offset;
-          }
-        }
-        if (next_entry == nullptr) {
-          // We're at the end of the list, so we can always append the buffer
-          // here.
-          break;
-        }
-        // Find out how much space there is between us and the next buffer.
-        const int gap = next_entry->offset - candidate_offset;
+      // Walk the placed buffers that are active in our time range in offset
+      // order. The first gap between them (or before the first one) that's
+      // big enough is used, otherwise the buffer goes after the last one.
+      FindActiveBuffers(wanted_first_time_used, wanted_last_time_used);
+      while (active_buffer_count_ > 0) {
+        const int active_id = PopActiveBuffer();
+        const int active_offset = buffer_offsets_[active_id];
+        const int gap = active_offset - candidate_offset;
         if (gap >= wanted_size) {
-          // This entry has a big enough gap between it and the next, so
-          // use it!
           break;
         }
-        // The gap wasn't big enough, so move on to another candidate.
-        prior_entry = next_entry;
+        const int active_end = active_offset + requirements_[active_id].size;
+        if (active_end > candidate_offset) {
+          candidate_offset = active_end;
+        }
       }
     } else {
       // Offline planned offset are to be considered constant
       candidate_offset = wanted_requirements->offline_offset;
     }
-    // At this point, we've either found a gap (possibly at the end of the
-    // list) and want to place the buffer there, or there are no other active
-    // buffers in this time range and so we can put it at offset zero.
     // Record the buffer's offset in our plan.
     buffer_offsets_[buffer_id] = candidate_offset;
-    // Add the newly-placed buffer to our offset-ordered list, so that
-    // subsequent passes can fit in their buffers around it.
-    ListEntry* new_entry = &buffers_sorted_by_offset_[next_free_entry_];
-    new_entry->offset = candidate_offset;
-    new_entry->requirements_index = buffer_id;
-    const int new_entry_index = next_free_entry_;
-    ++next_free_entry_;
-
-    if (first_entry->offset > candidate_offset) {
-      // The new entry offset is smaller than the first entry offset =>
-      // replace the first entry
-      first_entry = new_entry;
-      first_entry->next_entry_index = first_entry_index_;
-      first_entry_index_ = new_entry_index;
-    } else {
-      ListEntry* current_entry = first_entry;
-      // Make sure that we insert the buffer at the correct place in the
-      // buffer-offset-ordered list
-      while (true) {
-        const int next_entry_index = current_entry->next_entry_index;
-        if (next_entry_index == -1) {
-          // We're at the end of the list, so just add the new entry here.
-          current_entry->next_entry_index = new_entry_index;
-          new_entry->next_entry_index = -1;
-          break;
-        }
-        // not at the end of the list -> take a look at next entry
-        ListEntry* next_entry = &buffers_sorted_by_offset_[next_entry_index];
-        if (next_entry->offset > candidate_offset) {
-          // We're at the right spot to do an insertion and retain the sorting
-          // order, so place the new entry here.
-          new_entry->next_entry_index = current_entry->next_entry_index;
-          current_entry->next_entry_index = new_entry_index;
-          break;
-        }
-        current_entry = next_entry;
-      }
-    }
+
+    // Add the newly-placed buffer to the interval index, so that subsequent
+    // passes can fit in their buffers around it.
+    MarkBufferPlaced(buffer_id);
   }
 }
 
@@ -315,19 +389,12 @@ size_t GreedyMemoryPlanner::GetMaximumMemorySize() {
   if (buffer_count_ == 0) {
     return 0;
   }
-  ListEntry* entry = &buffers_sorted_by_offset_[first_entry_index_];
   size_t max_size = 0;
-  while (entry) {
-    BufferRequirements* requirements =
-        &requirements_[entry->requirements_index];
-    const size_t current_size = entry->offset + requirements->size;
+  for (int i = 0; i < buffer_count_; ++i) {
+    const size_t current_size = buffer_offsets_[i] + requirements_[i].size;
     if (current_size > max_size) {
       max_size = current_size;
     }
-    if (entry->next_entry_index == -1) {
-      break;
-    }
-    entry = &buffers_sorted_by_offset_[entry->next_entry_index];
   }
   return max_size;
 }
@@ -31,10 +31,12 @@ constexpr int kOnlinePlannedBuffer = -1;
 //  - When a function like GetOffsetForBuffer() is called, the
 //    CalculateOffsetsIfNeeded() method is invoked.
 //  - If an up to date plan is not already present, one will be calculated.
-//  - The buffers are sorted in descending order of size.
+//  - The buffers are sorted in descending order of size (stable merge sort,
+//    with scratch that isn't in use yet at that point).
 //  - The largest buffer is placed at offset zero.
 //  - The rest of the buffers are looped through in descending size order.
-//  - The other buffers that need to be in memory at the same time are found.
+//  - The other buffers that need to be in memory at the same time are found,
+//    with an interval index over the buffer lifetimes, and sorted by offset.
 //  - The first gap between simultaneously active buffers that the current
 //    buffer fits into will be used.
 //  - If no large-enough gap is found, the current buffer is placed after the
@@ -56,8 +58,10 @@ class GreedyMemoryPlanner : public MicroMemoryPlanner {
   // planned for will depend on the size of this scratch memory, so you should
   // enlarge it if you see an error when calling AddBuffer(). The memory can be
   // reused once you're done with the planner, as long as you copy the
-  // calculated offsets to another location. Each buffer requires about 36 bytes
-  // of scratch.
+  // calculated offsets to another location. Each buffer requires 48 bytes of
+  // scratch (see per_buffer_size()), up from 40 for the linked list planner:
+  // the interval index over buffer lifetimes and the heap of active buffers
+  // take 5 ints per buffer, in place of the 3 int list entry.
   TfLiteStatus Init(unsigned char* scratch_buffer,
                     int scratch_buffer_size) override;
 
@@ -89,34 +93,35 @@ class GreedyMemoryPlanner : public MicroMemoryPlanner {
   // is an O(N^2) complexity operation, so only use for testing.
   bool DoAnyBuffersOverlap();
 
-  // Used to store a list of buffers ordered by their offset.
-  struct ListEntry {
-    int offset;
-    int requirements_index;
-    int next_entry_index;
-  };
-
   // Number of bytes required in order to plan a buffer.
   static size_t per_buffer_size() {
     const int per_buffer_size =
         sizeof(BufferRequirements) +  // requirements_
         sizeof(int) +                 // buffer_sizes_sorted_
         sizeof(int) +                 // buffer_ids_sorted_
-        sizeof(ListEntry) +           // buffers_sorted_by_offset_
-        sizeof(int);                  // buffer_offsets_;
+        sizeof(int) +                 // buffer_offsets_
+        sizeof(int) +                 // buffers_by_first_time_
+        sizeof(int) +                 // first_time_rank_
+        sizeof(int) * 2 +             // active_last_time_used_
+        sizeof(int);                  // active_buffers_
     return per_buffer_size;
   }
 
  private:
-  // Whether a buffer is active in a given time range.
-  bool DoesEntryOverlapInTime(const ListEntry* entry, const int first_time_used,
-                              const int last_time_used) const;
+  // Marks a buffer as placed in the interval index.
+  void MarkBufferPlaced(const int buffer_id);
+
+  // Fills active_buffers_ with the placed buffers that are active at some
+  // point in the given time range, as a heap ordered by offset.
+  void FindActiveBuffers(const int first_time_used, const int last_time_used);
 
-  // Walks the list to return the next buffer that is active in a given time
-  // range, or a null pointer if there are none.
-  ListEntry* NextSimultaneouslyActiveBuffer(const ListEntry* start,
-                                            const int first_time_used,
-                                            const int last_time_used);
+  // Adds the placed buffers below a node of the interval index that are
+  // still in use at first_time_used to active_buffers_.
+  void CollectActiveBuffers(const int node, const int first_time_used);
+
+  // Removes and returns the buffer with the lowest offset from
+  // active_buffers_.
+  int PopActiveBuffer();
 
   // If there isn't an up to date plan, calculate a new one.
   void CalculateOffsetsIfNeeded();
@@ -145,11 +150,20 @@ class GreedyMemoryPlanner : public MicroMemoryPlanner {
   //   }
   int* buffer_sizes_sorted_;
   int* buffer_ids_sorted_;
-  ListEntry* buffers_sorted_by_offset_;
-  int next_free_entry_;    // Index of the next free entry of
-                           // buffers_sorted_by_offset_
-  int first_entry_index_;  // Index of the first entry (smallest offset) of
-                           // buffers_sorted_by_offset_
+
+  // Interval index over the buffer lifetimes: the buffer ids in order of
+  // first_time_used, the position of each buffer in that order, and a max
+  // segment tree over it (2 * buffer_count_ entries, leaves last) holding the
+  // last_time_used of placed buffers. The buffers that can overlap a time
+  // range [first, last] are a prefix of the order, the ones among them that
+  // are placed and overlap are the leaves holding a value >= first.
+  int* buffers_by_first_time_;
+  int* first_time_rank_;
+  int* active_last_time_used_;
+
+  // Result of FindActiveBuffers(), a min-heap of buffer ids keyed on offset.
+  int* active_buffers_;
+  int active_buffer_count_;
 
   // Stores the outcome of the plan, the location of each buffer in the arena.
   int* buffer_offsets_;
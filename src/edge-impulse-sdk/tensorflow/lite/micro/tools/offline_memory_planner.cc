@@ -0,0 +1,231 @@
+/* Copyright 2023 EdgeImpulse Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Host tool that computes the arena plan of a model once, with the same
+// GreedyMemoryPlanner the runtime uses, and stores it in the model as the
+// "OfflineMemoryAllocation" metadata buffer. AllocationInfoBuilder::
+// GetOfflinePlannedOffsets() picks the plan up, so AllocateTensors() on the
+// device no longer has to sort and place the buffers itself (see
+// micro/docs/memory_management.md for the metadata layout).
+//
+// Only built for the host, the firmware build never defines the flag. From
+// src/, as one command line (split here for reading):
+//
+//   g++ -std=c++14 -O2 -DEI_OFFLINE_MEMORY_PLANNER_TOOL=1 -DEI_PORTING_POSIX=1
+//       -DEI_CLASSIFIER_TFLITE_ENABLE_CMSIS_NN=0 -DTF_LITE_DISABLE_X86_NEON=1
+//       -I. -Iedge-impulse-sdk
+//       -Iedge-impulse-sdk/third_party/flatbuffers/include
+//       -Iedge-impulse-sdk/third_party/gemmlowp
+//       -Iedge-impulse-sdk/third_party/ruy
+//       $(find edge-impulse-sdk/tensorflow/lite -name '*.cc' -o -name '*.c')
+//       edge-impulse-sdk/dsp/kissfft/*.cpp
+//       edge-impulse-sdk/porting/posix/*.cpp edge-impulse-sdk/porting/*.cpp
+//       -lpthread -o offline_memory_planner
+//
+// Usage:
+//
+//   offline_memory_planner model.tflite model_planned.tflite
+//
+// The planned offsets are also printed as a C array, for models that are
+// compiled into the firmware as a byte array.
+
+#if EI_OFFLINE_MEMORY_PLANNER_TOOL == 1
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+
+#include "edge-impulse-sdk/tensorflow/lite/micro/all_ops_resolver.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/memory_planner/greedy_memory_planner.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/micro_allocator.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/micro_interpreter.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/single_arena_buffer_allocator.h"
+#include "edge-impulse-sdk/tensorflow/lite/schema/schema_generated_full.h"
+
+namespace {
+
+// Planning runs on the host, so the arena only needs to be big enough.
+constexpr size_t kPlanningArenaSize = 64 * 1024 * 1024;
+
+constexpr uint32_t kOfflinePlanVersion = 1;
+constexpr char kOfflinePlanMetadataName[] = "OfflineMemoryAllocation";
+
+// Allocates the model in a planning arena and reads back where every tensor
+// of the first subgraph was placed, relative to the start of the planned
+// (non persistent) section.
+TfLiteStatus PlanOfflineOffsets(const tflite::Model* model,
+                                uint8_t* arena, size_t arena_size,
+                                int32_t* offsets, size_t max_offsets,
+                                size_t* tensor_count, size_t* planned_size) {
+  if (model->subgraphs()->size() != 1) {
+    fprintf(stderr, "Offline plans are only supported for one subgraph\n");
+    return kTfLiteError;
+  }
+
+  tflite::SingleArenaBufferAllocator* memory_allocator =
+      tflite::SingleArenaBufferAllocator::Create(arena, arena_size);
+  tflite::GreedyMemoryPlanner planner;
+  tflite::MicroAllocator* allocator =
+      tflite::MicroAllocator::Create(memory_allocator, &planner);
+  tflite::AllOpsResolver resolver;
+  tflite::MicroInterpreter interpreter(model, resolver, allocator);
+
+  if (interpreter.AllocateTensors(true) != kTfLiteOk) {
+    fprintf(stderr, "AllocateTensors() failed\n");
+    return kTfLiteError;
+  }
+  if (planner.DoAnyBuffersOverlap()) {
+    fprintf(stderr, "Planner produced overlapping buffers\n");
+    return kTfLiteError;
+  }
+
+  const uint8_t* planned_start = memory_allocator->GetOverlayMemoryAddress();
+  *planned_size = planner.GetMaximumMemorySize();
+  *tensor_count = interpreter.tensors_size();
+  if (*tensor_count > max_offsets) {
+    fprintf(stderr, "Too many tensors (%zu)\n", *tensor_count);
+    return kTfLiteError;
+  }
+
+  for (size_t i = 0; i < *tensor_count; i++) {
+    const TfLiteTensor* tensor = interpreter.tensor(i);
+    const uint8_t* data = tensor ? tensor->data.uint8 : nullptr;
+    // Weights live in the model, variables in the persistent section,
+    // neither is part of the plan.
+    if (data == nullptr || data < planned_start ||
+        data >= planned_start + *planned_size) {
+      offsets[i] = tflite::kOnlinePlannedBuffer;
+    } else {
+      offsets[i] = static_cast<int32_t>(data - planned_start);
+    }
+  }
+  return kTfLiteOk;
+}
+
+bool ReadFile(const char* path, uint8_t** data, size_t* size) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  *size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  *data = new (std::nothrow) uint8_t[*size];
+  bool ok = *data && fread(*data, 1, *size, f) == *size;
+  fclose(f);
+  return ok;
+}
+
+// Replaces (or adds) the offline plan metadata of the model.
+void SetOfflinePlan(tflite::ModelT* model, const int32_t* offsets,
+                    size_t tensor_count) {
+  const uint32_t header[3] = {kOfflinePlanVersion, 0,
+                              static_cast<uint32_t>(tensor_count)};
+
+  std::unique_ptr<tflite::BufferT> buffer(new tflite::BufferT());
+  buffer->data.resize(sizeof(header) + tensor_count * sizeof(int32_t));
+  memcpy(buffer->data.data(), header, sizeof(header));
+  memcpy(buffer->data.data() + sizeof(header), offsets,
+         tensor_count * sizeof(int32_t));
+
+  for (auto& metadata : model->metadata) {
+    if (metadata->name == kOfflinePlanMetadataName) {
+      model->buffers[metadata->buffer] = std::move(buffer);
+      return;
+    }
+  }
+
+  std::unique_ptr<tflite::MetadataT> metadata(new tflite::MetadataT());
+  metadata->name = kOfflinePlanMetadataName;
+  metadata->buffer = static_cast<uint32_t>(model->buffers.size());
+  model->buffers.push_back(std::move(buffer));
+  model->metadata.push_back(std::move(metadata));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s model.tflite model_planned.tflite\n", argv[0]);
+    return 1;
+  }
+
+  uint8_t* model_data = nullptr;
+  size_t model_size = 0;
+  if (!ReadFile(argv[1], &model_data, &model_size)) {
+    fprintf(stderr, "Failed to read %s\n", argv[1]);
+    return 1;
+  }
+  const tflite::Model* model = tflite::GetModel(model_data);
+
+  uint8_t* arena = new (std::nothrow) uint8_t[kPlanningArenaSize + 16];
+  const size_t max_offsets = model->subgraphs()->Get(0)->tensors()->size();
+  int32_t* offsets = new (std::nothrow) int32_t[max_offsets + 1];
+  if (!arena || !offsets) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+  // the arena needs to be 16 byte aligned, like on the device
+  uint8_t* aligned_arena = reinterpret_cast<uint8_t*>(
+      (reinterpret_cast<uintptr_t>(arena) + 15) & ~static_cast<uintptr_t>(15));
+
+  size_t tensor_count = 0;
+  size_t planned_size = 0;
+  if (PlanOfflineOffsets(model, aligned_arena, kPlanningArenaSize, offsets,
+                         max_offsets, &tensor_count,
+                         &planned_size) != kTfLiteOk) {
+    return 1;
+  }
+
+  // The metadata words are read in host byte order by the allocator, both
+  // the host and the device are little endian.
+  std::unique_ptr<tflite::ModelT> model_t(model->UnPack());
+  SetOfflinePlan(model_t.get(), offsets, tensor_count);
+  // this flatbuffers copy has no implicit default allocator
+  flatbuffers::DefaultAllocator fb_allocator;
+  flatbuffers::FlatBufferBuilder builder(model_size, &fb_allocator);
+  tflite::FinishModelBuffer(builder, tflite::Model::Pack(builder, model_t.get()));
+
+  FILE* out = fopen(argv[2], "wb");
+  bool ok = out != nullptr &&
+            fwrite(builder.GetBufferPointer(), 1, builder.GetSize(), out) ==
+                builder.GetSize();
+  if (out) {
+    fclose(out);
+  }
+  if (!ok) {
+    fprintf(stderr, "Failed to write %s\n", argv[2]);
+    return 1;
+  }
+
+  printf("// %zu tensors, %zu bytes planned\n", tensor_count, planned_size);
+  printf("const int32_t offline_memory_allocation[] = {\n    %u, 0, %zu,",
+         kOfflinePlanVersion, tensor_count);
+  for (size_t i = 0; i < tensor_count; i++) {
+    printf("%s%d,", (i % 8) == 0 ? "\n    " : " ", offsets[i]);
+  }
+  printf("\n};\n");
+
+  delete[] offsets;
+  delete[] arena;
+  delete[] model_data;
+  return 0;
+}
+
+#endif  // EI_OFFLINE_MEMORY_PLANNER_TOOL == 1
@@ -1205,6 +1205,37 @@ static void QCBOREncode_AddDoubleToMap(QCBOREncodeContext *pCtx, const char *szL
 static void QCBOREncode_AddDoubleToMapN(QCBOREncodeContext *pCtx, int64_t nLabel, double dNum);
 
 
+/**
+ @brief  Add a single-precision floating-point number to the encoded output.
+
+ @param[in] pCtx  The encoding context to add the float to.
+ @param[in] fNum  The single precision number to add.
+
+ This is the same as QCBOREncode_AddDouble() for a number that is
+ already single-precision, it outputs half-precision when no precision
+ is lost and single-precision otherwise. It avoids the promotion to
+ double and the double-precision checks, which matters when encoding
+ many sensor samples.
+
+ Error handling is the same as QCBOREncode_AddInt64().
+ */
+void QCBOREncode_AddFloat(QCBOREncodeContext *pCtx, float fNum);
+
+
+/**
+ @brief  Add a single-precision floating-point number without preferred serialization.
+
+ @param[in] pCtx  The encoding context to add the float to.
+ @param[in] fNum  The single precision number to add.
+
+ This always outputs a single-precision number (5 bytes), no
+ conversion to half-precision is attempted.
+
+ Error handling is the same as QCBOREncode_AddInt64().
+ */
+void QCBOREncode_AddFloatNoPreferred(QCBOREncodeContext *pCtx, float fNum);
+
+
 /**
  @brief Add an optional tag.
 
@@ -434,8 +434,8 @@ IEEE754_union IEEE754_FloatToSmallest(float f)
     const uint64_t uDroppedSingleBits = SINGLE_SIGNIFICAND_MASK >> HALF_NUM_SIGNIFICAND_BITS;
 
     // Optimizer will re organize so there is only one call to IEEE754_FloatToHalf()
-    if(uSingle == 0) {
-        // Value is 0.0000, not a a subnormal
+    if((uSingle & ~SINGLE_SIGN_MASK) == 0) {
+        // Value is +/- 0.0000, not a a subnormal
         result.uSize = IEEE754_UNION_IS_HALF;
         result.uValue  = IEEE754_FloatToHalf(f);
     } else if(nSingleExponent == SINGLE_EXPONENT_INF_OR_NAN) {
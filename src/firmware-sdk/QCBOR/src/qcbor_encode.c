@@ -490,6 +490,25 @@ void QCBOREncode_AddDouble(QCBOREncodeContext *me, double dNum)
 }
 
 
+/*
+ Public functions for adding single-precision floats. See header qcbor.h
+ */
+void QCBOREncode_AddFloat(QCBOREncodeContext *me, float fNum)
+{
+   const IEEE754_union uNum = IEEE754_FloatToSmallest(fNum);
+
+   QCBOREncode_AddType7(me, uNum.uSize, uNum.uValue);
+}
+
+void QCBOREncode_AddFloatNoPreferred(QCBOREncodeContext *me, float fNum)
+{
+   uint32_t uNum;
+   memcpy(&uNum, &fNum, sizeof(uNum));
+
+   QCBOREncode_AddType7(me, sizeof(uNum), uNum);
+}
+
+
 /*
  Semi-public function. It is exposed to user of the interface,
  but they will usually call one of the inline wrappers rather than this.
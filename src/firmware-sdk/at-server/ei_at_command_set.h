@@ -48,7 +48,7 @@
 #define AT_READFILE_ARGS             "FILENAME,[USEMAXRATE]"
 #define AT_READFILE_HELP_TEXT        "Read a specific file (as base64)"
 #define AT_READBUFFER                "READBUFFER"
-#define AT_READBUFFER_ARGS           "START,LENGTH,[USEMAXRATE]"
+#define AT_READBUFFER_ARGS           "START,LENGTH,[USEMAXRATE],[BINARY]"
 #define AT_READBUFFER_HELP_TEXT      "Read from the temporary buffer (as base64)"
 #define AT_UNLINKFILE                "UNLINKFILE"
 #define AT_UNLINKFILE_ARGS           "FILE"
@@ -93,12 +93,16 @@
 #define AT_LISTFILES            "LISTFILES"
 #define AT_LISTFILES_HELP_TEXT  "Lists all files on the device"
 #define AT_READRAW              "READRAW"
-#define AT_READRAW_ARS          "START,LENGTH"
+#define AT_READRAW_ARS          "START,LENGTH,[BINARY]"
 #define AT_READRAW_HELP_TEXT    "Read raw from flash"
+#define AT_BINARYTRANSFER       "BINARYTRANSFER"
+#define AT_BINARYTRANSFER_HELP_TEXT "Binary frame version and max payload, for READBUFFER/READRAW with BINARY=y"
 #define AT_BOOTMODE             "BOOTMODE"
 #define AT_BOOTMODE_HELP_TEXT   "Jump to bootloader"
 #define AT_INFO                 "INFO"
 #define AT_INFO_HELP_TEXT       "Prints details about compiled firmware and ML model"
+#define AT_PROFILE              "PROFILE"
+#define AT_PROFILE_HELP_TEXT    "Per operator timing of the last inference (needs EI_CLASSIFIER_PROFILE_OPS)"
 
 /*************************************************************************************************/
 /* HELP is not necessary as it is built-in into ATServer and
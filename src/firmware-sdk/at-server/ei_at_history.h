@@ -17,47 +17,67 @@
 
 #ifndef AT_HISTORY_H
 #define AT_HISTORY_H
-#include <string>
-#include <vector>
+#include <cstring>
 
+/* Most entries the history can hold, whatever max_size is passed in */
+#ifndef AT_HISTORY_MAX_SIZE
+#define AT_HISTORY_MAX_SIZE 10
+#endif
+
+/* Longest entry (without the null terminator), longer commands are not kept */
+#ifndef AT_HISTORY_ENTRY_SIZE
+#define AT_HISTORY_ENTRY_SIZE 127
+#endif
+
+/* Circular history of fixed size entries, the oldest entry is overwritten */
 class ATHistory {
 private:
-    std::vector<std::string> history;
+    char history[AT_HISTORY_MAX_SIZE][AT_HISTORY_ENTRY_SIZE + 1];
     const size_t history_max_size;
+    size_t history_size;
+    size_t history_oldest;
     size_t history_position;
 
+    const char *entry(size_t position)
+    {
+        return history[(history_oldest + position) % history_max_size];
+    }
+
 public:
     ATHistory(size_t max_size = 10)
-        : history_max_size(max_size)
+        : history_max_size(
+              max_size == 0 ? 1 : (max_size > AT_HISTORY_MAX_SIZE ? AT_HISTORY_MAX_SIZE : max_size))
+        , history_size(0)
+        , history_oldest(0)
         , history_position(0) {};
 
-    std::string go_back(void)
+    const char *go_back(void)
     {
         if (!is_at_begin()) {
             history_position--;
         }
 
-        if (history.size() == 0) {
-            return std::string("");
+        if (history_size == 0) {
+            return "";
         }
         else {
-            return history[history_position];
+            return entry(history_position);
         }
     }
 
-    std::string go_next(void)
+    const char *go_next(void)
     {
-        if (++history_position >= history.size()) {
-            history_position = history.size();
-            return std::string("");
+        if (++history_position >= history_size) {
+            history_position = history_size;
+            return "";
         }
 
-        return history[history_position];
+        return entry(history_position);
     }
 
     bool is_at_end(void)
     {
-        return history_position == history.size();
+        return history_position == history_size;
     }
 
     bool is_at_begin(void)
@@ -65,20 +85,25 @@ public:
         return history_position == 0;
     }
 
-    void add(std::string &entry)
+    void add(const char *entry)
     {
-        // don't add empty entries
-        if (entry == "") {
+        size_t len = strlen(entry);
+
+        // don't add empty entries, nor the ones that don't fit
+        if (len == 0 || len > AT_HISTORY_ENTRY_SIZE) {
             return;
         }
 
-        history.push_back(entry);
-
-        if (history.size() > history_max_size) {
-            history.erase(history.begin());
+        if (history_size < history_max_size) {
+            memcpy(history[(history_oldest + history_size) % history_max_size], entry, len + 1);
+            history_size++;
+        }
+        else {
+            memcpy(history[history_oldest], entry, len + 1);
+            history_oldest = (history_oldest + 1) % history_max_size;
         }
 
-        history_position = history.size();
+        history_position = history_size;
     }
 };
 
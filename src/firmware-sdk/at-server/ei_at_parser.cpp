@@ -16,84 +16,92 @@
  */
 
 #include "ei_at_parser.h"
-
-using namespace std;
+#include <cstring>
 
 void ATParser::init_result(void)
 {
     last_result.type = AT_UNKNOWN;
-    last_result.command.clear();
-    last_result.arguments.clear();
+    last_result.command = "";
+    last_result.arguments_count = 0;
     last_result.max_arg_len = 0;
 }
 
-const ATParseResult_t &ATParser::parse(string input)
+const ATParseResult_t &ATParser::parse(char *input)
 {
-    string tmp;
-    size_t pos = string::npos;
-    size_t delim1 = string::npos;
-    size_t delim2 = string::npos;
+    char *end;
+    char *pos;
 
     this->init_result();
 
-    if (input.size() == 0) {
-        last_result.type = AT_UNKNOWN;
-        return last_result;
-    }
-
     // trim leading whitespaces
-    input = input.substr(input.find_first_not_of(" \t"));
+    input += strspn(input, " \t");
 
-    if (input.rfind("AT+", 0) != 0) {
+    if (strncmp(input, "AT+", 3) != 0) {
         last_result.type = AT_UNKNOWN;
         return last_result;
     }
 
     //remove "AT+"
-    input = input.substr(3);
+    input += 3;
 
-    // trim spaces, newline and CR at the end
-    input = input.erase(input.find_last_not_of(" \r\n") + 1);
+    // trim spaces, newline and CR at the end (written below, once the line is valid)
+    end = input + strlen(input);
+    while (end > input && (end[-1] == ' ' || end[-1] == '\r' || end[-1] == '\n')) {
+        end--;
+    }
 
     // extract command itself
-    pos = input.find_first_of("?=");
-    last_result.command = input.substr(0, pos);
+    pos = input + strcspn(input, "?=");
+    if (pos > end) {
+        pos = end;
+    }
+    last_result.command = input;
 
-    if (pos == string::npos) {
+    if (pos == end) {
         last_result.type = AT_RUN;
+        *end = '\0';
+        return last_result;
     }
-    else if (input.at(pos) == '=') {
-        last_result.type = AT_WRITE;
-    }
-    else if (input.at(pos) == '?') {
+    else if (*pos == '?') {
         last_result.type = AT_READ;
+        *end = '\0';
+        *pos = '\0';
+        return last_result;
     }
-    else {
-        last_result.type = AT_UNKNOWN;
+
+    // write command, count the arguments before splitting on commas so a
+    // rejected line is still intact
+    //TODO: support args in a quote
+    unsigned int arguments_count = 1;
+    for (const char *c = pos + 1; c < end; c++) {
+        if (*c == ',') {
+            arguments_count++;
+        }
     }
+    if (arguments_count > AT_MAX_ARGUMENTS) {
+        last_result.type = AT_TOO_MANY_ARGUMENTS;
+        last_result.command = "";
+        return last_result;
+    }
+
+    last_result.type = AT_WRITE;
+    *end = '\0';
+    *pos = '\0';
+    do {
+        char *arg = pos + 1;
+        size_t arg_len = strcspn(arg, ",");
 
-    // check if command has arguments and extract them
-    if (pos != string::npos && input.at(pos) == '=') {
-        delim1 = pos;
-        delim2 = input.find_first_of(",", pos);
-        // we have arguments, let's extract them
-        while (delim2 != string::npos) {
-            //TODO: support args in a quote
-            tmp = string(input, delim1 + 1, delim2 - delim1 - 1);
-            last_result.arguments.push_back(tmp);
-            if (tmp.size() > last_result.max_arg_len) {
-                last_result.max_arg_len = tmp.size();
-            }
-            delim1 = delim2;
-            delim2 = input.find_first_of(",", delim1 + 1);
+        last_result.arguments[last_result.arguments_count++] = arg;
+        if (arg_len > last_result.max_arg_len) {
+            last_result.max_arg_len = arg_len;
         }
-        //there is one more argument, behind last comma so, get it until end of command
-        tmp = string(input, delim1 + 1);
-        last_result.arguments.push_back(tmp);
-        if (tmp.size() > last_result.max_arg_len) {
-            last_result.max_arg_len = tmp.size();
+
+        pos = arg + arg_len;
+        if (*pos == '\0') {
+            break;
         }
-    }
+        *pos = '\0';
+    } while (true);
 
     return last_result;
 }
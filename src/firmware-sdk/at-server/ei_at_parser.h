@@ -17,21 +17,29 @@
 
 #ifndef AT_PARSER_H
 #define AT_PARSER_H
-#include <string>
-#include <vector>
+#include <cstddef>
+
+/* Most arguments a write command can take */
+#ifndef AT_MAX_ARGUMENTS
+#define AT_MAX_ARGUMENTS 16
+#endif
 
 enum ATCommandType_t
 {
     AT_RUN,
     AT_READ,
     AT_WRITE,
-    AT_UNKNOWN
+    AT_UNKNOWN,
+    /* write command with more than AT_MAX_ARGUMENTS arguments */
+    AT_TOO_MANY_ARGUMENTS
 };
 
+/* Command and arguments point into the parsed line */
 typedef struct {
     ATCommandType_t type;
-    std::string command;
-    std::vector<std::string> arguments;
+    const char *command;
+    const char *arguments[AT_MAX_ARGUMENTS];
+    unsigned int arguments_count;
     unsigned int max_arg_len;
 } ATParseResult_t;
 
@@ -43,7 +51,15 @@ private:
 public:
     ATParser() {};
     ~ATParser() {};
-    const ATParseResult_t &parse(std::string command);
+    /**
+     * @brief Split a command line in place (no copies): separators and
+     * trailing whitespace are replaced by null terminators. A line that is
+     * not a valid command (AT_UNKNOWN, AT_TOO_MANY_ARGUMENTS) is left as is.
+     *
+     * @param input null terminated line, modified by the parser
+     * @return parsed command, valid as long as input is
+     */
+    const ATParseResult_t &parse(char *input);
 };
 
 #endif /* AT_PARSER_H */
\ No newline at end of file
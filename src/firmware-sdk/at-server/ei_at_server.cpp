@@ -22,6 +22,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
 #include <functional>
 #include <vector>
 
@@ -36,12 +37,16 @@ static bool print_help_handler(void)
 
 ATServer::ATServer()
     : history(default_history_size)
+    , in_ctrl_char(false)
+    , control_sequence_size(0)
 {
     register_default_commands();
 }
 
 ATServer::ATServer(ATCommand_t *commands, size_t length, size_t max_history_size)
     : history(max_history_size)
+    , in_ctrl_char(false)
+    , control_sequence_size(0)
 {
     if (length == 0 || commands == nullptr) {
         register_default_commands();
@@ -78,6 +83,42 @@ void ATServer::register_default_commands(void)
     tmp.run_handler = at_info;
 
     this->registered_commands.push_back(tmp);
+
+    build_command_lookup();
+}
+
+/**
+ * @brief Sort the command lookup table, done once per registration so
+ * resolving a command line is a binary search. Among commands with the same
+ * name the first registered one wins.
+ */
+void ATServer::build_command_lookup(void)
+{
+    command_lookup.resize(registered_commands.size());
+    for (size_t i = 0; i < command_lookup.size(); i++) {
+        command_lookup[i] = i;
+    }
+
+    std::stable_sort(command_lookup.begin(), command_lookup.end(), [this](size_t a, size_t b) {
+        return registered_commands[a].command < registered_commands[b].command;
+    });
+}
+
+ATCommand_t *ATServer::find_command(const char *command)
+{
+    auto it = std::lower_bound(
+        command_lookup.begin(),
+        command_lookup.end(),
+        command,
+        [this](size_t ix, const char *cmd) {
+            return strcmp(registered_commands[ix].command.c_str(), cmd) < 0;
+        });
+
+    if (it == command_lookup.end() || registered_commands[*it].command.compare(command) != 0) {
+        return nullptr;
+    }
+
+    return &registered_commands[*it];
 }
 
 /**
@@ -107,6 +148,8 @@ bool ATServer::register_command(ATCommand_t &command)
 
     this->registered_commands.push_back(command);
 
+    build_command_lookup();
+
     return true;
 }
 
@@ -139,21 +182,21 @@ bool ATServer::register_handlers(
     bool (*write_handler)(const char **, const int),
     const char *write_handler_args_list)
 {
-    for (auto it = registered_commands.begin(); it != registered_commands.end(); ++it) {
-        if (it->command.compare(cmd) == 0) {
-            //TODO: add sanity checks?
-            it->run_handler = run_handler;
-            it->read_handler = read_handler;
-            it->write_handler = write_handler;
-            //TODO: parse write_handler_args_list and update write_handler_arg_count
-            if (write_handler_args_list != nullptr) {
-                it->write_handler_args_list = string(write_handler_args_list);
-            }
-            return true;
-        }
+    ATCommand_t *it = find_command(cmd);
+
+    if (it == nullptr) {
+        return false;
     }
 
-    return false;
+    //TODO: add sanity checks?
+    it->run_handler = run_handler;
+    it->read_handler = read_handler;
+    it->write_handler = write_handler;
+    //TODO: parse write_handler_args_list and update write_handler_arg_count
+    if (write_handler_args_list != nullptr) {
+        it->write_handler_args_list = string(write_handler_args_list);
+    }
+    return true;
 }
 
 bool ATServer::print_help(void)
@@ -206,127 +249,118 @@ void ATServer::print_prompt(void)
     ei_printf("> ");
 }
 
+void ATServer::handle_control_sequence(void)
+{
+    const char *tmp;
+    const char *seq = control_sequence;
+    const size_t seq_size = control_sequence_size;
+
+    // up: \x1b[A
+    if (seq_size == 2 && seq[0] == 0x5b && seq[1] == 0x41) {
+        ei_printf("\x1b[u"); // restore current position
+        tmp = history.go_back();
+        // ei_printf("\r\x1b[K> %s", tmp);
+        ei_printf("\x1b[2K\r> %s", tmp);
+        buffer.clear();
+        buffer.add(tmp);
+    }
+    // down: \x1b[B
+    else if (seq_size == 2 && seq[0] == 0x5b && seq[1] == 0x42) {
+        ei_printf("\x1b[u"); // restore current position
+        tmp = history.go_next();
+        // reset cursor to 0, do \r, then write the new command...
+        // ei_printf("\r\x1b[K> %s", tmp);
+        ei_printf("\x1b[2K\r> %s", tmp);
+        buffer.clear();
+        buffer.add(tmp);
+    }
+    // left: \x1b[D
+    else if (seq_size == 2 && seq[0] == 0x5b && seq[1] == 0x44) {
+        size_t curr = buffer.get_position();
+
+        // at pos0? prevent moving to the left
+        if (curr == 0) {
+            ei_printf("\x1b[u"); // restore current position
+        }
+        // otherwise it's OK, move the cursor back
+        else {
+            buffer.set_position(curr - 1);
+            ei_putchar('\x1b');
+            for (size_t ix = 0; ix < seq_size; ix++) {
+                ei_putchar(seq[ix]);
+            }
+        }
+    }
+    // right: \x1b[C
+    else if (seq_size == 2 && seq[0] == 0x5b && seq[1] == 0x43) {
+        size_t curr = buffer.get_position();
+
+        // already at the end?
+        if (curr == buffer.size()) {
+            ei_printf("\x1b[u"); // restore current position
+        }
+        else {
+            buffer.set_position(curr + 1);
+            ei_putchar('\x1b');
+            for (size_t ix = 0; ix < seq_size; ix++) {
+                ei_putchar(seq[ix]);
+            }
+        }
+    }
+    // HOME key: \x1b[H
+    else if (seq_size == 2 && seq[0] == 0x5b && seq[1] == 0x48) {
+        // move to begining of the buffer...
+        buffer.set_position(0);
+        // ...and the line
+        ei_printf(
+            "\r\x1b[K> %s\x1b[%uG",
+            buffer.get_string(),
+            (unsigned int)buffer.get_position() + 3);
+    }
+    // END key: \x1b[F
+    else if (seq_size == 2 && seq[0] == 0x5b && seq[1] == 0x46) {
+        // move to end of the buffer...
+        buffer.set_position(buffer.size());
+        // ...and the line
+        ei_printf(
+            "\r\x1b[K> %s\x1b[%uG",
+            buffer.get_string(),
+            (unsigned int)buffer.get_position() + 3);
+    }
+    // DELETE key: \x1b[3\x7e
+    else if (seq_size == 3 && seq[0] == 0x5b && seq[1] == 0x33 && seq[2] == 0x7e) {
+        if (buffer.do_delete()) {
+            ei_printf(
+                "\r\x1b[K> %s\x1b[%uG",
+                buffer.get_string(),
+                (unsigned int)buffer.get_position() + 3);
+        }
+    }
+    else {
+        // not up/down? execute original control sequence
+        ei_putchar('\x1b');
+        for (size_t ix = 0; ix < seq_size; ix++) {
+            ei_putchar(seq[ix]);
+        }
+    }
+}
+
 void ATServer::handle(char c)
 {
-    string tmp;
     bool print_new_prompt = true;
-    static bool in_ctrl_char = false;
-    static vector<char> control_sequence;
 
     // control characters start with 0x1b and end with a-zA-Z
     // typically \x1b[<LETTER> eg. \x1b[A
     if (in_ctrl_char) {
-        control_sequence.push_back(c);
+        // sequences longer than we handle are cut, the tail is still consumed
+        if (control_sequence_size < max_control_sequence_size) {
+            control_sequence[control_sequence_size++] = c;
+        }
         // if a-zA-Z then it's the last one in the control char...
         if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c == 0x7e)) {
             in_ctrl_char = false;
-            // up: \x1b[A
-            if (control_sequence.size() == 2 && control_sequence.at(0) == 0x5b &&
-                control_sequence.at(1) == 0x41) {
-
-                ei_printf("\x1b[u"); // restore current position
-                tmp = history.go_back();
-                // ei_printf("\r\x1b[K> %s", tmp.c_str());
-                ei_printf("\x1b[2K\r> %s", tmp.c_str());
-                buffer.clear();
-                buffer.add(tmp);
-            }
-            // down: \x1b[B
-            else if (
-                control_sequence.size() == 2 && control_sequence.at(0) == 0x5b &&
-                control_sequence.at(1) == 0x42) {
-
-                ei_printf("\x1b[u"); // restore current position
-                tmp = history.go_next();
-                // reset cursor to 0, do \r, then write the new command...
-                // ei_printf("\r\x1b[K> %s", tmp.c_str());
-                ei_printf("\x1b[2K\r> %s", tmp.c_str());
-                buffer.clear();
-                buffer.add(tmp);
-            }
-            // left: \x1b[D
-            else if (
-                control_sequence.size() == 2 && control_sequence.at(0) == 0x5b &&
-                control_sequence.at(1) == 0x44) {
-
-                size_t curr = buffer.get_position();
-
-                // at pos0? prevent moving to the left
-                if (curr == 0) {
-                    ei_printf("\x1b[u"); // restore current position
-                }
-                // otherwise it's OK, move the cursor back
-                else {
-                    buffer.set_position(curr - 1);
-                    ei_putchar('\x1b');
-                    for (size_t ix = 0; ix < control_sequence.size(); ix++) {
-                        ei_putchar(control_sequence[ix]);
-                    }
-                }
-            }
-            // right: \x1b[C
-            else if (
-                control_sequence.size() == 2 && control_sequence.at(0) == 0x5b &&
-                control_sequence.at(1) == 0x43) {
-
-                size_t curr = buffer.get_position();
-
-                // already at the end?
-                if (curr == buffer.size()) {
-                    ei_printf("\x1b[u"); // restore current position
-                }
-                else {
-                    buffer.set_position(curr + 1);
-                    ei_putchar('\x1b');
-                    for (size_t ix = 0; ix < control_sequence.size(); ix++) {
-                        ei_putchar(control_sequence[ix]);
-                    }
-                }
-            }
-            // HOME key: \x1b[H
-            else if (
-                control_sequence.size() == 2 && control_sequence.at(0) == 0x5b &&
-                control_sequence.at(1) == 0x48) {
-                // move to begining of the buffer...
-                buffer.set_position(0);
-                // ...and the line
-                ei_printf(
-                    "\r\x1b[K> %s\x1b[%uG",
-                    buffer.get_string().c_str(),
-                    (unsigned int)buffer.get_position() + 3);
-            }
-            // END key: \x1b[F
-            else if (
-                control_sequence.size() == 2 && control_sequence.at(0) == 0x5b &&
-                control_sequence.at(1) == 0x46) {
-                // move to end of the buffer...
-                buffer.set_position(buffer.size());
-                // ...and the line
-                ei_printf(
-                    "\r\x1b[K> %s\x1b[%uG",
-                    buffer.get_string().c_str(),
-                    (unsigned int)buffer.get_position() + 3);
-            }
-            // DELETE key: \x1b[3\x7e
-            else if (
-                control_sequence.size() == 3 && control_sequence.at(0) == 0x5b &&
-                control_sequence.at(1) == 0x33 && control_sequence.at(2) == 0x7e) {
-                if (buffer.do_delete()) {
-                    ei_printf(
-                        "\r\x1b[K> %s\x1b[%uG",
-                        buffer.get_string().c_str(),
-                        (unsigned int)buffer.get_position() + 3);
-                }
-            }
-            else {
-                // not up/down? execute original control sequence
-                ei_putchar('\x1b');
-                for (size_t ix = 0; ix < control_sequence.size(); ix++) {
-                    ei_putchar(control_sequence[ix]);
-                }
-            }
-
-            control_sequence.clear();
+            handle_control_sequence();
+            control_sequence_size = 0;
         }
         return;
     }
@@ -337,11 +371,11 @@ void ATServer::handle(char c)
     case '\r': /* want to run the buffer */
         ei_putchar(c);
         ei_putchar('\n');
-        tmp = buffer.get_string();
 
-        history.add(tmp);
+        history.add(buffer.get_string());
 
-        print_new_prompt = execute(tmp);
+        // the parser splits the line in place, it is cleared right after
+        print_new_prompt = execute(buffer.get_string());
 
         buffer.clear();
 
@@ -354,83 +388,73 @@ void ATServer::handle(char c)
         if (buffer.do_backspace() == false) {
             break;
         }
-        ei_printf("\r\x1b[K> %s\x1b[%uG", buffer.get_string().c_str(), (unsigned int)buffer.get_position() + 3);
+        ei_printf("\r\x1b[K> %s\x1b[%uG", buffer.get_string(), (unsigned int)buffer.get_position() + 3);
         break;
     case 0x1b: /* control character */
         // start processing characters as they are control sequence
         in_ctrl_char = true;
+        control_sequence_size = 0;
         ei_printf("\x1b[s"); // save current position
         break;
     default:
         if (c >= 0x20 && c <= 0x7e) {
-            buffer.add(c);
+            if (buffer.add(c) == false) {
+                // line is full, drop the character
+                break;
+            }
             if (buffer.is_at_end()) {
                 ei_putchar(c);
             }
             else {
-                ei_printf("\r> %s\x1b[%uG", buffer.get_string().c_str(), (unsigned int)buffer.get_position() + 3);
+                ei_printf("\r> %s\x1b[%uG", buffer.get_string(), (unsigned int)buffer.get_position() + 3);
             }
         }
         break;
     }
 }
 
-bool ATServer::execute(string &input)
+bool ATServer::execute(char *input)
 {
-    bool new_prompt_required = false;
-    char **args = nullptr;
-    ATParseResult_t res;
+    ATCommand_t *cmd;
 
-    res = parser.parse(input);
+    // the parser leaves lines it rejects untouched, so they can be echoed
+    const ATParseResult_t &res = parser.parse(input);
     if (res.type == AT_UNKNOWN) {
-        ei_printf("Not a valid AT command (%s)\n", input.c_str());
+        ei_printf("Not a valid AT command (%s)\n", input);
+        return true;
+    }
+    if (res.type == AT_TOO_MANY_ARGUMENTS) {
+        ei_printf("Too many arguments, at most %d (%s)\n", AT_MAX_ARGUMENTS, input);
         return true;
     }
 
     // exception for HELP command which is built-in
-    if (res.command == AT_HELP && res.type == AT_RUN) {
+    if (res.type == AT_RUN && strcmp(res.command, AT_HELP) == 0) {
         return this->print_help();
     }
 
     // find a command to execute
-    for (auto it = this->registered_commands.begin(); it != this->registered_commands.end(); ++it) {
-        if (it->command == res.command) {
-            // we've got a hit!
-            if (res.type == AT_RUN && it->run_handler) {
-                // simple command like AT+HELP
-                new_prompt_required = it->run_handler();
-            }
-            else if (res.type == AT_READ && it->read_handler) {
-                // read command like AT+CONFIG?
-                new_prompt_required = it->read_handler();
-            }
-            else if (res.type == AT_WRITE && it->write_handler) {
-                // write command like AT+DEVICEID=abcde
-                args = (char **)ei_malloc(res.arguments.size() * sizeof(char *));
-                for (unsigned int i = 0; i < res.arguments.size(); i++) {
-                    // one more byte for null terminator (in case of zero-length = empty argument eg. AT+RUN=123,,5)
-                    args[i] = (char *)ei_malloc(res.max_arg_len + 1);
-                    strncpy(args[i], res.arguments.at(i).c_str(), res.max_arg_len + 1);
-                }
-
-                new_prompt_required =
-                    it->write_handler((const char **)args, (int)res.arguments.size());
-
-                // now we are freeing the memory
-                for (unsigned int i = 0; i < res.arguments.size(); i++) {
-                    ei_free(args[i]);
-                }
-                ei_free(args);
-            }
-            else {
-                ei_printf("No handler for command! (%s)\n", input.c_str());
-                return true;
-            }
-            return new_prompt_required;
-        }
+    cmd = find_command(res.command);
+    if (cmd == nullptr) {
+        // we shouldn't be here!
+        ei_printf("Command not found! (AT+%s)\n", res.command);
+        return true;
+    }
+
+    if (res.type == AT_RUN && cmd->run_handler) {
+        // simple command like AT+HELP
+        return cmd->run_handler();
+    }
+    else if (res.type == AT_READ && cmd->read_handler) {
+        // read command like AT+CONFIG?
+        return cmd->read_handler();
+    }
+    else if (res.type == AT_WRITE && cmd->write_handler) {
+        // write command like AT+DEVICEID=abcde
+        // arguments are null terminated in place by the parser
+        return cmd->write_handler(const_cast<const char **>(res.arguments), (int)res.arguments_count);
     }
 
-    // we shouldn't be here!
-    ei_printf("Command not found! (AT+%s)\n", res.command.c_str());
+    ei_printf("No handler for command! (AT+%s)\n", res.command);
     return true;
 }
@@ -30,6 +30,9 @@ typedef std::function<bool(const char **, const int)> ATWriteHandler_t;
 
 const size_t default_history_size = 10;
 
+/* Longest escape sequence handled, without the leading 0x1b */
+const size_t max_control_sequence_size = 8;
+
 typedef struct {
     std::string command;
     std::string help_text;
@@ -43,16 +46,24 @@ class ATServer {
 private:
     ATHistory history;
     std::vector<ATCommand_t> registered_commands;
+    // indexes into registered_commands, sorted by command for binary search
+    std::vector<size_t> command_lookup;
     LineBuffer buffer;
     ATParser parser;
+    bool in_ctrl_char;
+    char control_sequence[max_control_sequence_size];
+    size_t control_sequence_size;
     void register_default_commands(void);
+    void build_command_lookup(void);
+    ATCommand_t *find_command(const char *command);
+    void handle_control_sequence(void);
 
 protected:
     ATServer();
     ATServer(ATCommand_t *commands, size_t length, size_t max_history_size = default_history_size);
     ~ATServer();
     bool print_help(void);
-    bool execute(std::string &command);
+    bool execute(char *command);
 
 public:
     ATServer(ATServer &other) = delete;
@@ -18,44 +18,71 @@
 #ifndef LINEBUFFER_H
 #define LINEBUFFER_H
 
-#include <string>
+#include <cstring>
 
+/* Longest command line (without the null terminator), longer input is dropped */
+#ifndef AT_LINE_BUFFER_SIZE
+#define AT_LINE_BUFFER_SIZE 512
+#endif
+
+/* Fixed capacity line being edited, no allocations while typing */
 class LineBuffer {
 private:
-    std::string buffer;
+    char buffer[AT_LINE_BUFFER_SIZE + 1];
+    size_t length;
     size_t position;
 
 public:
     LineBuffer()
-        : buffer("")
-        , position(0) {};
+        : length(0)
+        , position(0)
+    {
+        buffer[0] = '\0';
+    };
 
     void clear()
     {
-        buffer.clear();
+        length = 0;
         position = 0;
+        buffer[0] = '\0';
     }
 
-    void add(std::string &s)
+    void add(const char *s)
     {
-        if (position == buffer.size()) {
-            buffer.append(s);
+        size_t s_len = strlen(s);
+
+        if (s_len > AT_LINE_BUFFER_SIZE - length) {
+            s_len = AT_LINE_BUFFER_SIZE - length;
         }
-        else {
-            buffer.insert(position, s);
+        if (s_len == 0) {
+            return;
         }
-        position += s.size();
+
+        // make room at the cursor, including the null terminator
+        memmove(&buffer[position + s_len], &buffer[position], length - position + 1);
+        memcpy(&buffer[position], s, s_len);
+        length += s_len;
+        position += s_len;
     }
 
-    void add(const char c)
+    bool add(const char c)
     {
-        if (position == buffer.size()) {
-            buffer.append(&c, 1);
+        if (length == AT_LINE_BUFFER_SIZE) {
+            return false;
+        }
+
+        if (position == length) {
+            buffer[length++] = c;
+            buffer[length] = '\0';
         }
         else {
-            buffer.insert(position, &c, 1);
+            memmove(&buffer[position + 1], &buffer[position], length - position + 1);
+            buffer[position] = c;
+            length++;
         }
         position++;
+
+        return true;
     }
 
     bool do_backspace(void)
@@ -64,7 +91,8 @@ public:
             return false;
         }
 
-        buffer.erase(position - 1, 1);
+        memmove(&buffer[position - 1], &buffer[position], length - position + 1);
+        length--;
         position--;
 
         return true;
@@ -76,7 +104,8 @@ public:
             return false;
         }
 
-        buffer.erase(position, 1);
+        memmove(&buffer[position], &buffer[position + 1], length - position);
+        length--;
 
         return true;
     }
@@ -88,15 +117,16 @@ public:
 
     bool is_at_end(void)
     {
-        return position == buffer.size();
+        return position == length;
     }
 
     bool is_empty(void)
     {
-        return buffer.size() == 0;
+        return length == 0;
     }
 
-    std::string get_string()
+    /* Null terminated line, can be modified in place (eg. by the parser) until the next edit */
+    char *get_string()
     {
         return buffer;
     }
@@ -108,8 +138,8 @@ public:
 
     void set_position(int pos)
     {
-        if (pos > (int)buffer.size()) {
-            position = buffer.size();
+        if (pos > (int)length) {
+            position = length;
         }
         else if (pos < 0) {
             position = 0;
@@ -121,7 +151,7 @@ public:
 
     size_t size()
     {
-        return buffer.size();
+        return length;
     }
 };
 
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2022 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS
+ * IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language
+ * governing permissions and limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ei_binary_transfer.h"
+#include "edge-impulse-sdk/porting/ei_classifier_porting.h"
+
+uint32_t ei_crc32(const uint8_t *data, size_t length, uint32_t crc)
+{
+    // reflected polynomial 0xEDB88320, half a byte per lookup to keep the table small
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0x0f] ^ (crc >> 4);
+        crc = table[(crc ^ (data[i] >> 4)) & 0x0f] ^ (crc >> 4);
+    }
+
+    return ~crc;
+}
+
+static void put_le(uint8_t *dst, uint32_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i++) {
+        dst[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t get_le(const uint8_t *src, size_t bytes)
+{
+    uint32_t value = 0;
+
+    for (size_t i = 0; i < bytes; i++) {
+        value |= (uint32_t)src[i] << (8 * i);
+    }
+
+    return value;
+}
+
+/**
+ * @brief Fill in header and CRC around a payload already in place in frame
+ * @return size of the whole frame
+ */
+static size_t seal_frame(uint8_t *frame, ei_binary_frame_type_t type, uint32_t offset, uint16_t length)
+{
+    frame[0] = 'E';
+    frame[1] = 'I';
+    frame[2] = (uint8_t)type;
+    frame[3] = EI_BINARY_TRANSFER_VERSION;
+    put_le(&frame[4], offset, 4);
+    put_le(&frame[8], length, 2);
+    put_le(
+        &frame[EI_BINARY_TRANSFER_HEADER_SIZE + length],
+        ei_crc32(frame, EI_BINARY_TRANSFER_HEADER_SIZE + length),
+        4);
+
+    return EI_BINARY_TRANSFER_HEADER_SIZE + length + EI_BINARY_TRANSFER_CRC_SIZE;
+}
+
+bool ei_binary_send_sample_buffer(EiTransport *transport, EiDeviceMemory *memory, size_t address, size_t length)
+{
+    const size_t frame_size = EI_BINARY_TRANSFER_HEADER_SIZE + EI_BINARY_TRANSFER_PAYLOAD_SIZE +
+        EI_BINARY_TRANSFER_CRC_SIZE;
+    // one frame is assembled at a time, so it goes out in a single write
+    uint8_t *frame = (uint8_t *)ei_malloc(frame_size);
+    uint8_t *payload = frame + EI_BINARY_TRANSFER_HEADER_SIZE;
+    size_t out_size;
+
+    if (frame == nullptr) {
+        return false;
+    }
+
+    while (length > 0) {
+        uint16_t chunk = length > EI_BINARY_TRANSFER_PAYLOAD_SIZE ? EI_BINARY_TRANSFER_PAYLOAD_SIZE : length;
+
+        if (memory->read_sample_data(payload, address, chunk) != chunk) {
+            out_size = seal_frame(frame, EI_BINARY_FRAME_ERROR, address, 0);
+            transport->write(frame, out_size);
+            ei_free(frame);
+            return false;
+        }
+
+        out_size = seal_frame(frame, EI_BINARY_FRAME_DATA, address, chunk);
+        if (transport->write(frame, out_size) != out_size) {
+            ei_free(frame);
+            return false;
+        }
+
+        address += chunk;
+        length -= chunk;
+    }
+
+    out_size = seal_frame(frame, EI_BINARY_FRAME_END, address, 0);
+    bool res = transport->write(frame, out_size) == out_size;
+    ei_free(frame);
+
+    return res;
+}
+
+int ei_binary_frame_decode(const uint8_t *data, size_t length, ei_binary_frame_t *frame)
+{
+    if ((length >= 1 && data[0] != 'E') || (length >= 2 && data[1] != 'I')) {
+        return -1;
+    }
+    if (length < EI_BINARY_TRANSFER_HEADER_SIZE) {
+        return 0;
+    }
+    if (data[3] != EI_BINARY_TRANSFER_VERSION) {
+        return -1;
+    }
+
+    uint16_t payload_length = (uint16_t)get_le(&data[8], 2);
+    size_t frame_size = EI_BINARY_TRANSFER_HEADER_SIZE + payload_length + EI_BINARY_TRANSFER_CRC_SIZE;
+
+    if (payload_length > EI_BINARY_TRANSFER_PAYLOAD_SIZE) {
+        return -1;
+    }
+    if (length < frame_size) {
+        return 0;
+    }
+    if (ei_crc32(data, EI_BINARY_TRANSFER_HEADER_SIZE + payload_length) !=
+        get_le(&data[EI_BINARY_TRANSFER_HEADER_SIZE + payload_length], 4)) {
+        return -1;
+    }
+
+    frame->type = (ei_binary_frame_type_t)data[2];
+    frame->offset = get_le(&data[4], 4);
+    frame->length = payload_length;
+    frame->payload = &data[EI_BINARY_TRANSFER_HEADER_SIZE];
+
+    return (int)frame_size;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2022 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an "AS
+ * IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language
+ * governing permissions and limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef EI_BINARY_TRANSFER_H
+#define EI_BINARY_TRANSFER_H
+
+#include <cstdint>
+#include <cstddef>
+#include "ei_device_memory.h"
+
+/**
+ * Binary framed readback, an alternative to base64/hex output for
+ * AT+READBUFFER and AT+READRAW. The data is sent as a stream of frames:
+ *
+ *   'E' 'I' | type (1) | version (1) | offset (4) | length (2) | payload (length) | crc32 (4)
+ *
+ * Multi byte fields are little endian. offset is the absolute address of the
+ * payload in the sample memory, crc32 (IEEE 802.3) covers the header and the
+ * payload. The stream ends with an END frame (offset = end address, no payload)
+ * or an ERROR frame (offset = address that failed to read). A host that gets
+ * a corrupted frame re-requests the transfer from that frame's offset.
+ */
+#define EI_BINARY_TRANSFER_VERSION          1
+
+/** Largest frame payload, the host learns it from AT+BINARYTRANSFER? */
+#ifndef EI_BINARY_TRANSFER_PAYLOAD_SIZE
+#define EI_BINARY_TRANSFER_PAYLOAD_SIZE     512
+#endif
+
+#define EI_BINARY_TRANSFER_HEADER_SIZE      10
+#define EI_BINARY_TRANSFER_CRC_SIZE         4
+
+typedef enum {
+    EI_BINARY_FRAME_DATA = 'D',
+    EI_BINARY_FRAME_END = 'E',
+    EI_BINARY_FRAME_ERROR = 'X'
+} ei_binary_frame_type_t;
+
+typedef struct {
+    ei_binary_frame_type_t type;
+    uint32_t offset;
+    uint16_t length;
+    const uint8_t *payload;
+} ei_binary_frame_t;
+
+/**
+ * @brief Byte stream the frames are written to. Implemented per device
+ * (eg. the serial port), or over a pty/socket to exercise the protocol on Linux.
+ */
+class EiTransport {
+public:
+    virtual ~EiTransport() {}
+
+    /**
+     * @brief Write data to the stream
+     * @return number of bytes written, if it differs from length the transfer is aborted
+     */
+    virtual size_t write(const uint8_t *data, size_t length) = 0;
+};
+
+/**
+ * @brief CRC32 (IEEE 802.3, as zlib), can be chained by passing the previous result as crc
+ */
+uint32_t ei_crc32(const uint8_t *data, size_t length, uint32_t crc = 0);
+
+/**
+ * @brief Send length bytes of sample memory starting at address as binary frames
+ *
+ * @param transport stream to write the frames to
+ * @param memory sample memory to read from
+ * @param address first byte to send, a resumed transfer starts at the offset of the first bad frame
+ * @param length number of bytes to send
+ * @return true if all data and the END frame were sent
+ * @return false if reading the memory (ERROR frame sent) or writing the transport failed
+ */
+bool ei_binary_send_sample_buffer(EiTransport *transport, EiDeviceMemory *memory, size_t address, size_t length);
+
+/**
+ * @brief Decode a frame from the start of a received buffer
+ *
+ * @param data received bytes, should start with the 'E' 'I' magic
+ * @param length number of received bytes
+ * @param frame decoded frame, payload points into data
+ * @return size of the frame if it is complete and the CRC matches,
+ * 0 if more data is needed, -1 if the data is not a valid frame
+ */
+int ei_binary_frame_decode(const uint8_t *data, size_t length, ei_binary_frame_t *frame);
+
+#endif /* EI_BINARY_TRANSFER_H */
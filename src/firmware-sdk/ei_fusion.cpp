@@ -59,9 +59,22 @@ int num_fusions, num_fusion_axis;
 
 static float multi_sampling_freq[NUM_MAX_FUSIONS];
 static float multi_freq_combination[NUM_MAX_FUSIONS][EI_MAX_FREQUENCIES];
-static fusion_sample_format_t* old_data;    // store old samples for multi
 #endif
 
+/*
+** @brief gather table compiled by ei_connect_fusion_list
+** fusion_frame[loc] is read from sensor_data[gather_src[loc]], the first
+** gather_count[0] entries come from fusion_sensors[0], the next from
+** fusion_sensors[1], etc.
+*/
+static uint8_t gather_src[EI_MAX_SENSOR_AXES];
+static uint8_t gather_count[NUM_MAX_FUSIONS];
+/*
+** @brief preallocated sample frame handed to the sampler. Kept between ticks,
+** for multi frequency fusion a sensor that is not sampled keeps its last value
+*/
+static fusion_sample_format_t fusion_frame[EI_MAX_SENSOR_AXES];
+
 /* Private function prototypes --------------------------------------------- */
 static void print_fusion_list(int r, uint32_t ingest_memory_size);
 static void print_all_combinations(
@@ -75,6 +88,7 @@ static int generate_bit_flags(int dec);
 static bool add_sensor(int sensor_ix, char *name_buffer);
 static bool add_axis(int sensor_ix, char *name_buffer);
 static float highest_frequency(float *frequencies, size_t size);
+static bool build_gather_table(void);
 #if MULTI_FREQ_ENABLED == 1
 static float calc_gcd(float time1, float time2);
 static void get_multi_freq_combinations(int row, int col, float* mat_period, float* actual_comb, int ix, vector<float>* freq_comb, vector<int>* mem_fact, float allowed_period);
@@ -154,6 +168,10 @@ bool ei_connect_fusion_list(const char *input_list, ei_fusion_list_format format
 
     ei_free(input_string);
 
+    if (is_fusion) {
+        is_fusion = build_gather_table();
+    }
+
     return is_fusion;
 }
 
@@ -165,14 +183,8 @@ void ei_fusion_read_axis_data(void)
 {
     EiDeviceInfo* dev = EiDeviceInfo::get_device();
     fusion_sample_format_t *sensor_data;
-    fusion_sample_format_t *data;
     uint32_t loc = 0;
 
-    data = (fusion_sample_format_t *)ei_malloc(sizeof(fusion_sample_format_t) * num_fusion_axis);
-    if (data == NULL) {
-        return;
-    }
-
     for (int i = 0; i < num_fusions; i++) {
 
         sensor_data = NULL;
@@ -182,27 +194,21 @@ void ei_fusion_read_axis_data(void)
         }
 
         if (sensor_data != NULL) {
-            for (int j = 0; j < fusion_sensors[i]->num_axis; j++) {
-                if (fusion_sensors[i]->axis_flag_used & (1 << j)) {
-                    data[loc++] = *(sensor_data + j); // add sensor data to fusion data
-                }
+            for (int j = 0; j < gather_count[i]; j++, loc++) {
+                fusion_frame[loc] = sensor_data[gather_src[loc]]; // add sensor data to fusion data
             }
         }
         else { // No data, zero fill
-            for (int j = 0; j < fusion_sensors[i]->num_axis; j++) {
-                if (fusion_sensors[i]->axis_flag_used & (1 << j)) {
-                    data[loc++] = 0;
-                }
+            for (int j = 0; j < gather_count[i]; j++, loc++) {
+                fusion_frame[loc] = 0;
             }
         }
     }
 
     if (fusion_cb_sampler(
-            (const void *)&data[0],
+            (const void *)&fusion_frame[0],
             (sizeof(fusion_sample_format_t) * num_fusion_axis))) // send fusion data to sampler
         dev->stop_sample_thread(); // if last sample detach
-
-    ei_free(data);
 }
 
 #if MULTI_FREQ_ENABLED == 1
@@ -214,15 +220,9 @@ void ei_fusion_multi_read_axis_data(uint8_t flag_read)
 {
    EiDeviceInfo* dev = EiDeviceInfo::get_device();
    fusion_sample_format_t *sensor_data;
-   fusion_sample_format_t *data;
    uint32_t loc = 0;
 
    if (flag_read != 0) {
-       data = (fusion_sample_format_t *)ei_malloc(sizeof(fusion_sample_format_t) * num_fusion_axis);
-       if (data == NULL) {
-           return;
-       }
-
        for (int i = 0; i < num_fusions; i++) {
 
            sensor_data = NULL;
@@ -233,39 +233,24 @@ void ei_fusion_multi_read_axis_data(uint8_t flag_read)
            }
 
            if (sensor_data != NULL) {
-               for (int j = 0; j < fusion_sensors[i]->num_axis; j++, loc++) {
-                   if (fusion_sensors[i]->axis_flag_used & (1 << j)) {
-                       data[loc] = *(sensor_data + j); // add sensor data to fusion data
-                       if (old_data != nullptr) {
-
-                        old_data[loc] = data[loc];       // store in old structure
-                        }
-                   }
+               for (int j = 0; j < gather_count[i]; j++, loc++) {
+                   fusion_frame[loc] = sensor_data[gather_src[loc]]; // add sensor data to fusion data
                }
            }
-           else { // No data, zero fill
-               for (int j = 0; j < fusion_sensors[i]->num_axis; j++, loc++) {
-                   if (fusion_sensors[i]->axis_flag_used & (1 << j)) {
-                       data[loc] = old_data[loc];       // not sampled, use last value
-                   }
-               }
+           else { // not sampled, frame still holds the last value
+               loc += gather_count[i];
            }
        }
 
        if (fusion_cb_sampler(
-               (const void *)&data[0],
+               (const void *)&fusion_frame[0],
                (sizeof(fusion_sample_format_t) * num_fusion_axis))) {
            dev->stop_sample_thread(); // if last sample detach
-           ei_free(old_data);
-           // send fusion data to sampler
        }
-
-       ei_free(data);
    }
    else {
        if (fusion_cb_sampler(nullptr, 0)) {
            dev->stop_sample_thread(); // if last sample detach
-           ei_free(old_data);
        }
    }
 
@@ -390,10 +375,9 @@ bool ei_fusion_setup_data_sampling(void)
 
     bool ret = false;
 
-#if MULTI_FREQ_ENABLED == 1
-    old_data = (fusion_sample_format_t *)ei_malloc(sizeof(fusion_sample_format_t) * num_fusion_axis);
-    memset(old_data, 0, sizeof(fusion_sample_format_t) * num_fusion_axis);
+    memset(fusion_frame, 0, sizeof(fusion_frame));
 
+#if MULTI_FREQ_ENABLED == 1
     if (num_fusions == 1) {
         ret = ei_sampler_start_sampling(
                 &payload,
@@ -407,10 +391,6 @@ bool ei_fusion_setup_data_sampling(void)
                 (sizeof(fusion_sample_format_t) * num_fusion_axis));
     }
 
-    if (ret == false) {
-        ei_free(old_data);  //
-    }
-
 #else
     ret = ei_sampler_start_sampling(
             &payload,
@@ -736,6 +716,35 @@ static bool add_axis(int sensor_ix, char *name_buffer)
     return is_fusion;
 }
 
+/**
+ * @brief      Compile the axis_flag_used bits of the connected sensors into
+ *             the gather table used by the sampling callbacks
+ * @return     false if the selected axes don't fit in a fusion frame
+ */
+static bool build_gather_table(void)
+{
+    int loc = 0;
+
+    if (num_fusion_axis > EI_MAX_SENSOR_AXES) {
+        return false;
+    }
+
+    for (int i = 0; i < num_fusions; i++) {
+        gather_count[i] = 0;
+        for (int j = 0; j < fusion_sensors[i]->num_axis; j++) {
+            if (fusion_sensors[i]->axis_flag_used & (1 << j)) {
+                if (loc >= EI_MAX_SENSOR_AXES) {
+                    return false;
+                }
+                gather_src[loc++] = j;
+                gather_count[i]++;
+            }
+        }
+    }
+
+    return true;
+}
+
 /**
  * @brief Run trough freq array and return highest
  *
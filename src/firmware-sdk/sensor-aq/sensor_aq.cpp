@@ -118,6 +118,42 @@ static int sensor_aq_flush_buffer(sensor_aq_ctx *ctx) {
     return AQ_OK;
 }
 
+/**
+ * Number of bytes that are encoded but not flushed yet
+ */
+static size_t sensor_aq_pending_bytes(sensor_aq_ctx *ctx) {
+    return UsefulOutBuf_GetEndPosition(&(ctx->encode_context.OutBuf));
+}
+
+static void sensor_aq_encode_float(sensor_aq_ctx *ctx, float value) {
+    if (ctx->float_encoding == AQ_FLOAT_SINGLE) {
+        QCBOREncode_AddFloatNoPreferred(&ctx->encode_context, value);
+    }
+    else {
+        QCBOREncode_AddFloat(&ctx->encode_context, value);
+    }
+}
+
+/**
+ * Encode the values for a single interval (one value per axis)
+ */
+static void sensor_aq_encode_interval(sensor_aq_ctx *ctx, const float values[]) {
+    // If we only have a single axis then emit flattened array (saves space)
+    if (ctx->axis_count == 1) {
+        sensor_aq_encode_float(ctx, values[0]);
+    }
+    else {
+        // otherwise create an array
+        QCBOREncode_OpenArray(&ctx->encode_context);
+
+        for (size_t ix = 0; ix < ctx->axis_count; ix++) {
+            sensor_aq_encode_float(ctx, values[ix]);
+        }
+
+        QCBOREncode_CloseArray(&ctx->encode_context);
+    }
+}
+
 /**
  * Initialize a sensor acquisition context
  *
@@ -191,6 +227,10 @@ int sensor_aq_init(sensor_aq_ctx *ctx, sensor_aq_payload_info *payload_info, EI_
 
     ctx->axis_count = 0;
 
+    // contexts are often static and initialized without this field, pick
+    // the default here; set AQ_FLOAT_SINGLE after init to change it
+    ctx->float_encoding = AQ_FLOAT_PREFERRED;
+
     QCBOREncode_Init(&ctx->encode_context, ctx->cbor_buffer);
     QCBOREncode_OpenMap(&ctx->encode_context);
 
@@ -310,6 +350,9 @@ int sensor_aq_init(sensor_aq_ctx *ctx, sensor_aq_payload_info *payload_info, EI_
         }
     }
 
+    // start with an empty buffer for the values (the header stays in memory)
+    QCBOREncode_Init(&ctx->encode_context, ctx->cbor_buffer);
+
     return AQ_OK;
 }
 
@@ -324,29 +367,59 @@ int sensor_aq_add_data(sensor_aq_ctx *ctx, float values[], size_t values_size) {
         return AQ_VALUES_SIZE_DOES_NOT_MATCH_AXIS_COUNT;
     }
 
+    int r = sensor_aq_add_data_buffered(ctx, values, values_size);
+    if (r != AQ_OK) {
+        return r;
+    }
+
+    return sensor_aq_flush(ctx);
+}
+
+/**
+ * Add data to the sensor file for one or more intervals, but only sign and
+ * write it once the CBOR buffer is full. Call sensor_aq_flush (or
+ * sensor_aq_finish) to write out the remaining data.
+ * @param ctx The context
+ * @param values Values, axis_count values per interval
+ * @param values_size Size of the values array (multiple of axis_count)
+ */
+int sensor_aq_add_data_buffered(sensor_aq_ctx *ctx, float values[], size_t values_size) {
+    if (ctx->axis_count == 0 || values_size % ctx->axis_count != 0) {
+        return AQ_VALUES_SIZE_DOES_NOT_MATCH_AXIS_COUNT;
+    }
+
     if (ctx->stream == NULL) {
         return AQ_STREAM_IS_NULL;
     }
 
-    // clear memory
-    memset(ctx->cbor_buffer.ptr, 0, ctx->cbor_buffer.len);
+    // worst case: array header + single-precision float per axis
+    const size_t max_interval_size = 1 + ctx->axis_count * 5;
 
-    // re-initialize
-    QCBOREncode_Init(&ctx->encode_context, ctx->cbor_buffer);
+    for (size_t ix = 0; ix < values_size; ix += ctx->axis_count) {
+        if (sensor_aq_pending_bytes(ctx) + max_interval_size > ctx->cbor_buffer.len) {
+            int fr = sensor_aq_flush_buffer(ctx);
+            if (fr != AQ_OK) {
+                return fr;
+            }
+        }
 
-    // If we only have a single axis then emit flattened array (saves space)
-    if (values_size == 1) {
-        QCBOREncode_AddDouble(&ctx->encode_context, values[0]);
+        sensor_aq_encode_interval(ctx, values + ix);
     }
-    else {
-        // otherwise create an array
-        QCBOREncode_OpenArray(&ctx->encode_context);
 
-        for (size_t ix = 0; ix < values_size; ix++) {
-            QCBOREncode_AddDouble(&ctx->encode_context, values[ix]);
-        }
+    return AQ_OK;
+}
 
-        QCBOREncode_CloseArray(&ctx->encode_context);
+/**
+ * Sign and write out all data that was buffered by sensor_aq_add_data_buffered
+ * @param ctx The context
+ */
+int sensor_aq_flush(sensor_aq_ctx *ctx) {
+    if (ctx->stream == NULL) {
+        return AQ_STREAM_IS_NULL;
+    }
+
+    if (sensor_aq_pending_bytes(ctx) == 0) {
+        return AQ_OK;
     }
 
     return sensor_aq_flush_buffer(ctx);
@@ -363,8 +436,10 @@ int sensor_aq_add_data_i16(sensor_aq_ctx *ctx, int16_t values[], size_t values_s
         return AQ_VALUES_SIZE_DOES_NOT_MATCH_AXIS_COUNT;
     }
 
-    if (ctx->stream == NULL) {
-        return AQ_STREAM_IS_NULL;
+    // write out buffered data first, the buffer is re-initialized below
+    int r = sensor_aq_flush(ctx);
+    if (r != AQ_OK) {
+        return r;
     }
 
     // clear memory
@@ -393,26 +468,18 @@ int sensor_aq_add_data_i16(sensor_aq_ctx *ctx, int16_t values[], size_t values_s
 
 /**
  * Add data to the sensor file for many intervals at the same time
- * This only works if there is only a single sensor
  * @param ctx The context
- * @param values Values
- * @param values_size Size of the values array
+ * @param values Values, axis_count values per interval
+ * @param values_size Size of the values array (multiple of axis_count)
  */
-// int sensor_aq_add_data_batch(sensor_aq_ctx *ctx, float values[], size_t values_size) {
-//     if (ctx->axis_count != 1) {
-//         return AQ_BATCH_ONLY_SUPPORTS_SINGLE_AXIS;
-//     }
-
-//     for (size_t ix = 0; ix < values_size; ix++) {
-//         float new_values[1] = { values[ix] };
-//         int r = sensor_aq_add_data(ctx, new_values, 1);
-//         if (r != AQ_OK) {
-//             return r;
-//         }
-//     }
-
-//     return AQ_OK;
-// }
+int sensor_aq_add_data_batch(sensor_aq_ctx *ctx, float values[], size_t values_size) {
+    int r = sensor_aq_add_data_buffered(ctx, values, values_size);
+    if (r != AQ_OK) {
+        return r;
+    }
+
+    return sensor_aq_flush(ctx);
+}
 
 /**
  * Add data to the sensor file for many intervals at the same time
@@ -426,8 +493,10 @@ int sensor_aq_add_data_batch(sensor_aq_ctx *ctx, int16_t values[], size_t values
         return AQ_BATCH_ONLY_SUPPORTS_SINGLE_AXIS;
     }
 
-    if (ctx->stream == NULL) {
-        return AQ_STREAM_IS_NULL;
+    // write out buffered data first, the buffer is re-initialized below
+    int r = sensor_aq_flush(ctx);
+    if (r != AQ_OK) {
+        return r;
     }
 
     // clear memory
@@ -454,12 +523,13 @@ int sensor_aq_add_data_batch(sensor_aq_ctx *ctx, int16_t values[], size_t values
 int sensor_aq_finish(sensor_aq_ctx *ctx) {
     uint8_t final_byte[] = { 0xff };
 
-    if (ctx->stream == NULL) {
-        return AQ_STREAM_IS_NULL;
+    int ctx_err = sensor_aq_flush(ctx);
+    if (ctx_err != AQ_OK) {
+        return ctx_err;
     }
 
     // Update the signature
-    int ctx_err = ctx->signature_ctx->update(ctx->signature_ctx, final_byte, 1);
+    ctx_err = ctx->signature_ctx->update(ctx->signature_ctx, final_byte, 1);
     if (ctx_err != 0) {
         return ctx_err;
     }
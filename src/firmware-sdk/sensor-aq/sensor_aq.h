@@ -74,6 +74,16 @@ typedef enum {
     AQ_OUT_OF_MEM = -6020
 } sensor_aq_status;
 
+/**
+ * Encoding of float samples
+ */
+typedef enum {
+    // half-precision when no precision is lost, single-precision otherwise
+    AQ_FLOAT_PREFERRED = 0,
+    // always single-precision, 5 bytes per value
+    AQ_FLOAT_SINGLE = 1
+} sensor_aq_float_encoding_t;
+
 /**
  * Buffer context
  */
@@ -155,6 +165,10 @@ typedef struct {
 
     // active stream
     EI_SENSOR_AQ_STREAM *stream;
+
+    // how float samples are encoded, sensor_aq_init sets AQ_FLOAT_PREFERRED,
+    // change it after init
+    sensor_aq_float_encoding_t float_encoding;
 } sensor_aq_ctx;
 
 /**
@@ -189,6 +203,9 @@ int sensor_aq_init(sensor_aq_ctx *ctx, sensor_aq_payload_info *payload_info, EI_
 int sensor_aq_add_data(sensor_aq_ctx *ctx, float values[], size_t values_size);
 int sensor_aq_add_data_i16(sensor_aq_ctx *ctx, int16_t values[], size_t values_size);
 int sensor_aq_add_data_batch(sensor_aq_ctx *ctx, int16_t values[], size_t values_size);
+int sensor_aq_add_data_batch(sensor_aq_ctx *ctx, float values[], size_t values_size);
+int sensor_aq_add_data_buffered(sensor_aq_ctx *ctx, float values[], size_t values_size);
+int sensor_aq_flush(sensor_aq_ctx *ctx);
 int sensor_aq_finish(sensor_aq_ctx *ctx);
 
 #endif /* EI_SENSOR_AQ_H */
@@ -33,6 +33,15 @@
 #include "ei_flash_nano_ble33.h"
 #include "sensor_aq_mbedtls_hs256.h"
 
+#include <string.h>
+
+/* Constant defines -------------------------------------------------------- */
+/** Samples wait here until the sampling thread is done with them, holds
+ *  ~250 ms of a 20 axis stream at 100 Hz */
+#define EI_SAMPLER_RING_SIZE        8192
+/** How often the samples in the ring are signed and written to flash */
+#define EI_SAMPLER_DRAIN_PERIOD_MS  10
+
 
 using namespace rtos;
 using namespace events;
@@ -44,6 +53,18 @@ static volatile uint32_t current_sample;
 static uint32_t sample_buffer_size;
 static uint32_t headerOffset = 0;
 
+/* Samples are copied to the ring in the sampling callback, signing and
+ * writing them to flash is done by the thread that waits in
+ * ei_sampler_start_sampling, so a flush never delays the next sample.
+ * Single producer (callback) and consumer (drain), the counts only grow
+ * and are published with release/acquire. */
+static uint8_t sample_ring[EI_SAMPLER_RING_SIZE];
+static uint32_t ring_sample_size;
+static uint32_t ring_slots;
+static uint32_t ring_written;
+static uint32_t ring_read;
+static uint32_t ring_dropped;
+
 
 static char write_word_buf[4];
 static int write_addr = 0;
@@ -101,6 +122,7 @@ EI_SENSOR_AQ_STREAM stream;
 /* Private function prototypes --------------------------------------------- */
 static void finish_and_upload(void);
 static bool sample_data_callback(const void *sample_buf, uint32_t byteLenght);
+static void drain_sample_ring(void);
 
 static bool create_header(sensor_aq_payload_info *payload);
 
@@ -133,6 +155,16 @@ bool ei_sampler_start_sampling(void *v_ptr_payload, starter_callback ei_sample_s
     sample_buffer_size = (samples_required/samples_required_increase) * sample_size * 2;
     current_sample = 0;
 
+    if (sample_size == 0 || sample_size > EI_SAMPLER_RING_SIZE) {
+        ei_printf("ERR: Sample size %lu does not fit the sample ring\r\n", sample_size);
+        return false;
+    }
+    ring_sample_size = sample_size;
+    ring_slots = EI_SAMPLER_RING_SIZE / sample_size;
+    __atomic_store_n(&ring_written, 0, __ATOMIC_RELAXED);
+    ring_read = 0;
+    ring_dropped = 0;
+
     // Minimum delay of 2000 ms for daemon
     if(((sample_buffer_size / mem->block_size)+1) * mem->block_erase_time < 2000) {
         ThisThread::sleep_for(2000 - ((sample_buffer_size / mem->block_size)+1) * mem->block_erase_time);
@@ -156,8 +188,17 @@ bool ei_sampler_start_sampling(void *v_ptr_payload, starter_callback ei_sample_s
         return false;
 	
     while(current_sample <= samples_required) {
-        ThisThread::sleep_for(50);
+        drain_sample_ring();
+        ThisThread::sleep_for(EI_SAMPLER_DRAIN_PERIOD_MS);
     };
+    drain_sample_ring();
+
+    if (ring_dropped > 0) {
+        ei_printf("ERR: %lu samples dropped, flash writes could not keep up\r\n", ring_dropped);
+    }
+
+    // sign and write the samples that are still in the CBOR buffer
+    sensor_aq_flush(&ei_mic_ctx);
 
     ei_write_last_data();
     write_addr++;
@@ -244,7 +285,18 @@ static void finish_and_upload(void)
  */
 static bool sample_data_callback(const void *sample_buf, uint32_t byteLenght)
 {
-    sensor_aq_add_data(&ei_mic_ctx, (float *)sample_buf, byteLenght / sizeof(float));    
+    // only queue the sample, drain_sample_ring signs and writes it
+    if (sample_buf != nullptr && byteLenght == ring_sample_size) {
+        uint32_t written = __atomic_load_n(&ring_written, __ATOMIC_RELAXED);
+
+        if (written - __atomic_load_n(&ring_read, __ATOMIC_ACQUIRE) < ring_slots) {
+            memcpy(&sample_ring[(written % ring_slots) * ring_sample_size], sample_buf, byteLenght);
+            __atomic_store_n(&ring_written, written + 1, __ATOMIC_RELEASE);
+        }
+        else {
+            ring_dropped++;
+        }
+    }
     current_sample += samples_required_increase;
 
     if(current_sample > samples_required) {
@@ -254,3 +306,20 @@ static bool sample_data_callback(const void *sample_buf, uint32_t byteLenght)
         return false;
     }
 }
+
+/**
+ * @brief      Encode the queued samples, the CBOR buffer is signed and
+ *             written to flash each time it fills up
+ */
+static void drain_sample_ring(void)
+{
+    uint32_t written = __atomic_load_n(&ring_written, __ATOMIC_ACQUIRE);
+
+    while (ring_read != written) {
+        float *sample = (float *)&sample_ring[(ring_read % ring_slots) * ring_sample_size];
+
+        sensor_aq_add_data_buffered(&ei_mic_ctx, sample, ring_sample_size / sizeof(float));
+        // hand the slot back to the callback
+        __atomic_store_n(&ring_read, ring_read + 1, __ATOMIC_RELEASE);
+    }
+}
@@ -23,6 +23,7 @@
 #include "ei_at_handlers.h"
 #include "firmware-sdk/ei_device_lib.h"
 #include "firmware-sdk/ei_device_interface.h"
+#include "firmware-sdk/ei_binary_transfer.h"
 #include "edge-impulse-sdk/porting/ei_classifier_porting.h"
 #include "firmware-sdk/at-server/ei_at_command_set.h"
 #include "firmware-sdk/at-server/ei_at_server.h"
@@ -31,6 +32,7 @@
 #include "ei_run_impulse.h"
 #include "sensors/ei_camera.h"
 #include "model-parameters/model_metadata.h"
+#include "edge-impulse-sdk/classifier/ei_model_profiler.h"
 #include <string>
 
 using namespace std;
@@ -194,6 +196,25 @@ bool at_unlink_file(const char **argv, const int argc)
     return true;
 }
 
+/**
+ * @brief Binary frames go out over the serial port in bulk writes
+ */
+class EiSerialTransport : public EiTransport {
+public:
+    size_t write(const uint8_t *data, size_t length) override
+    {
+        ei_write_string((char *)data, (int)length);
+        return length;
+    }
+};
+
+bool at_get_binary_transfer(void)
+{
+    ei_printf("%d,%d\n", EI_BINARY_TRANSFER_VERSION, EI_BINARY_TRANSFER_PAYLOAD_SIZE);
+
+    return true;
+}
+
 bool at_read_buffer(const char **argv, const int argc)
 {
     if (argc < 2) {
@@ -210,6 +231,11 @@ bool at_read_buffer(const char **argv, const int argc)
         use_max_baudrate = true;
     }
 
+    bool use_binary = false;
+    if (argc >= 4 && argv[3][0] == 'y') {
+        use_binary = true;
+    }
+
     if (use_max_baudrate) {
         ei_printf("OK\r\n");
         ei_sleep(100);
@@ -217,7 +243,13 @@ bool at_read_buffer(const char **argv, const int argc)
         ei_sleep(100);
     }
 
-    success = read_encode_send_sample_buffer(start, length);
+    if (use_binary) {
+        EiSerialTransport transport;
+        success = ei_binary_send_sample_buffer(&transport, dev->get_memory(), start, length);
+    }
+    else {
+        success = read_encode_send_sample_buffer(start, length);
+    }
 
     if (use_max_baudrate) {
         ei_printf("\r\nOK\r\n");
@@ -246,15 +278,26 @@ bool at_read_raw(const char **argv, const int argc)
     size_t start = (size_t)atoi(argv[0]);
     size_t length = (size_t)atoi(argv[1]);
 
-    uint8_t buffer[32];
+    if (argc >= 3 && argv[2][0] == 'y') {
+        EiSerialTransport transport;
+        if (!ei_binary_send_sample_buffer(&transport, mem, start, length)) {
+            ei_printf("Failed to read from flash\n");
+        }
+        else {
+            ei_printf("\n");
+        }
+        return true;
+    }
 
-    int count = 0;
-    int n_display_bytes = 16;
+    uint8_t buffer[16];
+    const size_t end = start + length;
 
-    for (; start < length; start += n_display_bytes) {
-        mem->read_sample_data(buffer, start, n_display_bytes);
+    // LENGTH bytes from START, as the binary path sends them
+    for (size_t pos = start; pos < end; pos += sizeof(buffer)) {
+        const size_t n_display_bytes = (end - pos) < sizeof(buffer) ? (end - pos) : sizeof(buffer);
+        mem->read_sample_data(buffer, pos, n_display_bytes);
 
-        for (int i = 0; i < n_display_bytes; i++) {
+        for (size_t i = 0; i < n_display_bytes; i++) {
             ei_printf("%02x", buffer[i]);
             if (i % 16 == 15)
                 ei_printf("\n");
@@ -307,6 +350,15 @@ bool at_run_impulse(void)
     return true;
 }
 
+#if EI_CLASSIFIER_PROFILE_OPS == 1
+bool at_get_profile(void)
+{
+    ei_profiler_print(ei_profiler_get());
+
+    return true;
+}
+#endif
+
 bool at_run_impulse_static_data(const char **argv, const int argc)
 {
 
@@ -615,6 +667,22 @@ ATServer *ei_at_init(EiDeviceNanoBle33 *device)
         nullptr,
         at_read_raw,
         AT_READRAW_ARS);
+    at->register_command(
+        AT_BINARYTRANSFER,
+        AT_BINARYTRANSFER_HELP_TEXT,
+        nullptr,
+        at_get_binary_transfer,
+        nullptr,
+        nullptr);
+#if EI_CLASSIFIER_PROFILE_OPS == 1
+    at->register_command(
+        AT_PROFILE,
+        AT_PROFILE_HELP_TEXT,
+        nullptr,
+        at_get_profile,
+        nullptr,
+        nullptr);
+#endif
 
     return at;
 }
\ No newline at end of file
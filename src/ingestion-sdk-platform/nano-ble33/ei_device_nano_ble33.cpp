@@ -30,6 +30,7 @@
 #include "mbed.h"
 #include "ei_flash_nano_ble33.h"
 #include "edge-impulse-sdk/porting/ei_classifier_porting.h"
+#include "edge-impulse-sdk/porting/ei_log_ring.h"
 #include "firmware-sdk/ei_fusion.h"
 
 using namespace rtos;
@@ -187,7 +188,8 @@ EiSnapshotProperties EiDeviceNanoBle33::get_snapshot_list(void)
 bool EiDeviceNanoBle33::start_sample_thread(void (*sample_read_cb)(void), float sample_interval_ms)
 {
     osStatus retstatus;
-    fusion_thread = new Thread;
+    // above the main thread, so signing and writing samples to flash does not delay sampling
+    fusion_thread = new Thread(osPriorityAboveNormal);
     fusion_queue = new EventQueue;
     retstatus = fusion_thread->start(callback(fusion_queue, &EventQueue::dispatch_forever));    
     queue_id = fusion_queue->call_every(sample_interval_ms, sample_read_cb);
@@ -229,7 +231,8 @@ bool EiDeviceNanoBle33::start_multi_sample_thread(void (*sample_multi_read_cb)(u
     this->actual_timer = 0;
 
     osStatus retstatus;
-    fusion_thread = new Thread;
+    // above the main thread, see start_sample_thread
+    fusion_thread = new Thread(osPriorityAboveNormal);
     fusion_queue = new EventQueue;
     retstatus = fusion_thread->start(callback(fusion_queue, &EventQueue::dispatch_forever));    
     queue_id = fusion_queue->call_every(sample_interval_ms, multi_sample_thread);
@@ -313,6 +316,10 @@ bool EiDeviceNanoBle33::get_resize_list(
  * @param[in]  length  The length
  */
 void ei_write_string(char *data, int length) {
+#if EI_PORTING_DEFERRED_LOG == 1
+    // keep raw output behind everything printed before it
+    ei_log_deferred_flush();
+#endif
     Serial.write(data, length);
 }
 
@@ -22,7 +22,13 @@
 #include "mbed_shared_queues.h"
 #include "drivers/InterruptIn.h"
 
-ei_BoschSensorClass::ei_BoschSensorClass(TwoWire& wire)
+// acc and gyr run at 400 Hz, FIFO downsampled by 2^1 to the highest fusion frequency
+#define BMI270_FIFO_DOWNS         1
+#define BMI270_FIFO_ODR_HZ        200.0f
+
+ei_BoschSensorClass::ei_BoschSensorClass(TwoWire& wire) :
+  _bus(wire, BMI2_I2C_PRIM_ADDR),
+  _fifo(&_bus, BMI270_FIFO_ODR_HZ, BMI270_FIFO_DOWNS)
 {
   _wire = &wire;
   BMI270_INT1 = p11;
@@ -256,6 +262,20 @@ int ei_BoschSensorClass::magneticFieldAvailable() {
   return bmm1.int_status & BMM150_INT_ASSERTED_DRDY;
 }
 
+// Hardware FIFO
+int ei_BoschSensorClass::fifoBegin() {
+  // register access in advanced power save mode needs long delays between writes
+  if (bmi2_set_adv_power_save(BMI2_DISABLE, &bmi2) != BMI2_OK) {
+    return 0;
+  }
+
+  return _fifo.begin();
+}
+
+const ei_imu_fifo_frame_t *ei_BoschSensorClass::readFifoFrame(bool bus_available) {
+  return _fifo.get_frame(micros(), bus_available);
+}
+
 static void panic_led_trap(void)
 {
 #if !defined(LED_BUILTIN)
@@ -23,6 +23,8 @@
 #include <Wire.h>
 #include "utilities/BMI270-Sensor-API/bmi270.h"
 #include "utilities/BMM150-Sensor-API/bmm150.h"
+#include "ei_imu_fifo.h"
+#include "ei_wire_bus.h"
 
 /* Class ----------------------------------------------------- */
 
@@ -45,6 +47,10 @@ class ei_BoschSensorClass : public BoschSensorClass {
     int readMagneticField(float& x, float& y, float& z) override; // Results are in uT (micro Tesla).
     int magneticFieldAvailable() override; // Number of samples in the FIFO.
 
+    // Hardware FIFO
+    int fifoBegin(); // Enable accelerometer + gyroscope FIFO in watermark mode
+    const ei_imu_fifo_frame_t *readFifoFrame(bool bus_available = true); // Raw frame for the current sample tick
+
   protected:    
     int8_t configure_sensor(struct bmm150_dev *dev) override;
     int8_t configure_sensor(struct bmi2_dev *dev) override;
@@ -66,6 +72,8 @@ class ei_BoschSensorClass : public BoschSensorClass {
     struct bmi2_dev bmi2;
     struct bmm150_dev bmm1;
     uint16_t _int_status;
+    EiWireRegisterBus _bus;
+    EiBmi270Fifo _fifo;
   private:
     bool continuousMode;
 };
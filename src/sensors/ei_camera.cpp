@@ -22,6 +22,7 @@
 
 #include "ei_camera.h"
 #include "setup.h"
+#include "edge-impulse-sdk/dsp/image/convert.hpp"
 
 #define DWORD_ALIGN_PTR(a)   ((a & 0x3) ?(((uintptr_t)a + 0x4) & ~(uintptr_t)0x3) : a)
 
@@ -482,31 +483,12 @@ static void finish_snapshot() {
  * @param[out]  out_buf      pointer to store output image
  */
 int ei_camera_cutout_get_data(size_t offset, size_t length, float *out_ptr) {
-    size_t pixel_ix = offset * 2; 
-    size_t bytes_left = length;
-    size_t out_ptr_ix = 0;
-
-    // read byte for byte
-    while (bytes_left != 0) {
-        // grab the value and convert to r/g/b
-        uint16_t pixel = (ei_camera_capture_out[pixel_ix] << 8) | ei_camera_capture_out[pixel_ix+1];
-        uint8_t r, g, b;
-        r = ((pixel >> 11) & 0x1f) << 3;
-        g = ((pixel >> 5) & 0x3f) << 2;
-        b = (pixel & 0x1f) << 3;
-
-        // then convert to out_ptr format
-        float pixel_f = (r << 16) + (g << 8) + b;
-        out_ptr[out_ptr_ix] = pixel_f;
-
-        // and go to the next pixel
-        out_ptr_ix++;
-        pixel_ix+=2;
-        bytes_left--;
-    }
-
-    // and done!
-    return 0;
+    // convert the whole requested range in one pass
+    return ei::image::convert::to_packed(
+        &ei_camera_capture_out[offset * 2],
+        ei::image::convert::FORMAT_RGB565_BE,
+        length,
+        out_ptr);
 }
 
 // This include file works in the Arduino environment
@@ -18,6 +18,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include "ei_environmental_rev2.h"
+#include "ei_sample_hold.h"
 
 #include <Arduino_HS300x.h>
 #include <Arduino_LPS22HB.h>
@@ -27,6 +28,9 @@ extern void ei_printf(const char *format, ...);
 
 static float htps_data[ENVIRONMENT_AXIS_SAMPLED];
 
+static float *environment_rev2_acquire(int n_samples);
+static EiSampleHold environment_rev2_hold(&environment_rev2_acquire, ENVIRONMENT_AXIS_SAMPLED, ENVIRONMENT_REV2_REFRESH_HZ);
+
 bool ei_environment_rev2_init(void)
 {
 	if (!HS300x.begin()) {
@@ -44,13 +48,25 @@ bool ei_environment_rev2_init(void)
 		ei_printf("BARO initialized\r\n");
 	}
 
+    ei_sample_hold_register(&environment_rev2_hold);
     ei_add_sensor_to_fusion_list(environment_sensor_rev2);
 
 	return true;
 }
 
 
+/**
+ * @brief Latest values, refreshed by the sample and hold thread
+ */
 float *ei_fusion_environment_rev2_read_data(int n_samples)
+{
+    return environment_rev2_hold.get(micros());
+}
+
+/**
+ * @brief Blocking read, waits for the HS300x and LPS22HB conversions
+ */
+static float *environment_rev2_acquire(int n_samples)
 {
     htps_data[0] = HS300x.readTemperature();
     htps_data[1] = HS300x.readHumidity();
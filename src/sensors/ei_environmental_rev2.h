@@ -24,6 +24,9 @@
 /** Number of axis used and sample data format */
 #define ENVIRONMENT_AXIS_SAMPLED			3
 
+/** Rate at which the values are refreshed in the background (highest sampling frequency) */
+#define ENVIRONMENT_REV2_REFRESH_HZ         12.5f
+
 /* Function prototypes ----------------------------------------------------- */
 bool ei_environment_rev2_init(void);
 float *ei_fusion_environment_rev2_read_data(int n_samples);
@@ -27,6 +27,7 @@
 #include "ei_environmentsensor.h"
 #include "ei_device_nano_ble33.h"
 #include "firmware-sdk/sensor-aq/sensor_aq.h"
+#include "ei_sample_hold.h"
 
 #include <Arduino_HTS221.h>
 #include <Arduino_LPS22HB.h>
@@ -38,6 +39,9 @@ extern void ei_printf(const char *format, ...);
 static bool rev2 = false;
 static float htps_data[ENVIRONMENT_AXIS_SAMPLED];
 
+static float *environment_acquire(int n_samples);
+static EiSampleHold environment_hold(&environment_acquire, ENVIRONMENT_AXIS_SAMPLED, ENVIRONMENT_REFRESH_HZ);
+
 bool ei_environment_init(void)
 {
 	if (!HTS.begin()) {
@@ -55,13 +59,25 @@ bool ei_environment_init(void)
 		ei_printf("BARO initialized\r\n");
 	}
 
+    ei_sample_hold_register(&environment_hold);
     ei_add_sensor_to_fusion_list(environment_sensor);
 
 	return true;
 }
 
 
+/**
+ * @brief Latest values, refreshed by the sample and hold thread
+ */
 float *ei_fusion_environment_read_data(int n_samples)
+{
+    return environment_hold.get(micros());
+}
+
+/**
+ * @brief Blocking read, waits for the HTS221 and LPS22HB conversions
+ */
+static float *environment_acquire(int n_samples)
 {
 	htps_data[0] = HTS.readTemperature();
 	htps_data[1] = HTS.readHumidity();
@@ -0,0 +1,356 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file ei_imu_fifo.cpp
+ * @brief hardware FIFO handling for the LSM9DS1 (rev1) and BMI270 (rev2) IMUs.
+ * Only talks to the sensors through EiRegisterBus, no Arduino dependencies.
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_imu_fifo.h"
+#include <string.h>
+
+/* Constant defines -------------------------------------------------------- */
+#define IMU_FIFO_FRAME_BYTES        12
+#define IMU_FIFO_CHUNK_FRAMES       (EI_IMU_FIFO_MAX_TRANSFER / IMU_FIFO_FRAME_BYTES)
+
+// LSM9DS1 accelerometer / gyroscope
+#define LSM9DS1_OUT_X_G             0x18
+#define LSM9DS1_CTRL_REG9           0x23
+#define LSM9DS1_FIFO_CTRL           0x2e
+#define LSM9DS1_FIFO_SRC            0x2f
+
+#define LSM9DS1_FIFO_EN             0x02
+#define LSM9DS1_FMODE_BYPASS        0x00
+#define LSM9DS1_FMODE_CONTINUOUS    0xc0
+#define LSM9DS1_FSS_MASK            0x3f
+#define LSM9DS1_OVRN                0x40
+#define LSM9DS1_FIFO_DEPTH          32
+
+// BMI270
+#define BMI270_FIFO_LENGTH_0        0x24
+#define BMI270_FIFO_DATA            0x26
+#define BMI270_FIFO_DOWNS           0x45
+#define BMI270_FIFO_WTM_0           0x46
+#define BMI270_FIFO_CONFIG_0        0x48
+#define BMI270_FIFO_CONFIG_1        0x49
+#define BMI270_CMD                  0x7e
+
+#define BMI270_FIFO_ACC_GYR_EN      0xc0    // headerless, acc + gyr, no aux
+#define BMI270_FIFO_FILT_DATA       0x88    // filtered data for acc and gyr
+#define BMI270_CMD_FIFO_FLUSH       0xb0
+#define BMI270_FIFO_LENGTH_MASK     0x3fff
+#define BMI270_FIFO_DEPTH_BYTES     2048
+
+static inline int16_t get_int16_le(const uint8_t *p)
+{
+    return (int16_t)((uint16_t)p[0] | ((uint16_t)p[1] << 8));
+}
+
+/**
+ * @brief Construct a new EiImuFifo object
+ *
+ * @param bus register access to the sensor
+ * @param odr_hz rate at which the sensor pushes frames into its FIFO
+ */
+EiImuFifo::EiImuFifo(EiRegisterBus *bus, float odr_hz) :
+    bus(bus),
+    overruns(0),
+    head(0),
+    count(0),
+    has_current(false),
+    last_get_us(0)
+{
+    period_us = (uint32_t)(1000000.0f / odr_hz);
+}
+
+void EiImuFifo::flush(void)
+{
+    flush_hw();
+    head = 0;
+    count = 0;
+    has_current = false;
+}
+
+void EiImuFifo::push(const ei_imu_fifo_frame_t *frame)
+{
+    if (count == EI_IMU_FIFO_RING_FRAMES) {
+        // drop the oldest frame
+        count--;
+        overruns++;
+    }
+
+    ring[head] = *frame;
+    head = (head + 1) % EI_IMU_FIFO_RING_FRAMES;
+    count++;
+}
+
+int EiImuFifo::burst_read(uint64_t now_us)
+{
+    ei_imu_fifo_frame_t frames[IMU_FIFO_CHUNK_FRAMES];
+    int n_frames = frames_available();
+    int n_read = 0;
+
+    if (n_frames <= 0) {
+        return 0;
+    }
+
+    while (n_read < n_frames) {
+        int chunk = n_frames - n_read;
+        if (chunk > IMU_FIFO_CHUNK_FRAMES) {
+            chunk = IMU_FIFO_CHUNK_FRAMES;
+        }
+
+        int n_parsed = read_frames(frames, chunk);
+        if (n_parsed <= 0) {
+            break;
+        }
+
+        // newest frame in the burst is stamped with the read time
+        for (int i = 0; i < n_parsed; i++) {
+            uint64_t age_us = (uint64_t)(n_frames - 1 - (n_read + i)) * period_us;
+            frames[i].timestamp_us = (now_us > age_us) ? (now_us - age_us) : 0;
+            push(&frames[i]);
+        }
+        n_read += n_parsed;
+
+        // a short read means the FIFO holds less than it reported, the
+        // rest is picked up by the next burst
+        if (n_parsed < chunk) {
+            break;
+        }
+    }
+
+    return n_read;
+}
+
+const ei_imu_fifo_frame_t *EiImuFifo::get_frame(uint64_t now_us, bool bus_available)
+{
+    const uint64_t latency_us = (uint64_t)period_us * EI_IMU_FIFO_WATERMARK;
+    uint64_t target_us = (now_us > latency_us) ? (now_us - latency_us) : 0;
+
+    if ((last_get_us == 0) || ((now_us - last_get_us) > EI_IMU_FIFO_RESTART_GAP_US)) {
+        // new sampling session, the FIFO runs in continuous mode so it still
+        // holds the most recent frames, just forget what the ring kept
+        head = 0;
+        count = 0;
+        has_current = false;
+    }
+    last_get_us = now_us;
+
+    // without the bus, report from the ring, the FIFO keeps the frames for the next tick
+    if (bus_available) {
+        int newest = (head + EI_IMU_FIFO_RING_FRAMES - 1) % EI_IMU_FIFO_RING_FRAMES;
+        if (count == 0 || ring[newest].timestamp_us < target_us) {
+            burst_read(now_us);
+        }
+    }
+
+    // report the last frame captured at or before the target time
+    while (count > 0) {
+        int oldest = (head + EI_IMU_FIFO_RING_FRAMES - count) % EI_IMU_FIFO_RING_FRAMES;
+        if (has_current && ring[oldest].timestamp_us > target_us) {
+            break;
+        }
+        current = ring[oldest];
+        has_current = true;
+        count--;
+    }
+
+    return has_current ? &current : nullptr;
+}
+
+/**
+ * @brief Continuous mode, the oldest frames are overwritten when the
+ * FIFO is full so the latest 32 frames are always available
+ */
+int EiLsm9ds1Fifo::begin(void)
+{
+    uint8_t wtm = (EI_IMU_FIFO_WATERMARK < LSM9DS1_FIFO_DEPTH) ? EI_IMU_FIFO_WATERMARK : (LSM9DS1_FIFO_DEPTH - 1);
+    uint8_t ctrl_reg9;
+
+    // CTRL_REG9 also holds the I2C / SPI and data ready settings, only set FIFO_EN
+    if (!bus->read_registers(LSM9DS1_CTRL_REG9, &ctrl_reg9, 1)) {
+        return 0;
+    }
+
+    if (!bus->write_register(LSM9DS1_CTRL_REG9, ctrl_reg9 | LSM9DS1_FIFO_EN)) {
+        return 0;
+    }
+
+    return bus->write_register(LSM9DS1_FIFO_CTRL, LSM9DS1_FMODE_CONTINUOUS | wtm);
+}
+
+int EiLsm9ds1Fifo::frames_available(void)
+{
+    uint8_t src;
+
+    if (!bus->read_registers(LSM9DS1_FIFO_SRC, &src, 1)) {
+        return 0;
+    }
+
+    if (src & LSM9DS1_OVRN) {
+        overruns++;
+    }
+
+    return src & LSM9DS1_FSS_MASK;
+}
+
+/**
+ * @brief With the FIFO enabled and IF_ADD_INC set, a burst read starting at
+ * OUT_X_G skips from OUT_Z_H_G to OUT_X_L_XL and rolls back from OUT_Z_H_XL
+ * to OUT_X_L_G, so consecutive FIFO slots come out in one transfer
+ */
+int EiLsm9ds1Fifo::read_frames(ei_imu_fifo_frame_t *frames, int n_frames)
+{
+    uint8_t raw[IMU_FIFO_CHUNK_FRAMES * IMU_FIFO_FRAME_BYTES];
+    size_t length = n_frames * IMU_FIFO_FRAME_BYTES;
+
+    if (!bus->read_registers(LSM9DS1_OUT_X_G, raw, length)) {
+        return 0;
+    }
+
+    return ei_lsm9ds1_fifo_parse(raw, length, frames, n_frames);
+}
+
+int EiLsm9ds1Fifo::flush_hw(void)
+{
+    uint8_t wtm = (EI_IMU_FIFO_WATERMARK < LSM9DS1_FIFO_DEPTH) ? EI_IMU_FIFO_WATERMARK : (LSM9DS1_FIFO_DEPTH - 1);
+
+    // passing through bypass mode empties the FIFO
+    if (!bus->write_register(LSM9DS1_FIFO_CTRL, LSM9DS1_FMODE_BYPASS)) {
+        return 0;
+    }
+
+    return bus->write_register(LSM9DS1_FIFO_CTRL, LSM9DS1_FMODE_CONTINUOUS | wtm);
+}
+
+/**
+ * @brief Headerless stream mode, the oldest frames are overwritten when
+ * the FIFO is full
+ */
+int EiBmi270Fifo::begin(void)
+{
+    uint16_t wtm = EI_IMU_FIFO_WATERMARK * IMU_FIFO_FRAME_BYTES;
+
+    if (!bus->write_register(BMI270_FIFO_DOWNS, BMI270_FIFO_FILT_DATA | ((downs & 0x07) << 4) | (downs & 0x07))) {
+        return 0;
+    }
+
+    if (!bus->write_register(BMI270_FIFO_WTM_0, wtm & 0xff)
+        || !bus->write_register(BMI270_FIFO_WTM_0 + 1, (wtm >> 8) & 0x1f)) {
+        return 0;
+    }
+
+    if (!bus->write_register(BMI270_FIFO_CONFIG_0, 0x00)) {
+        return 0;
+    }
+
+    if (!bus->write_register(BMI270_FIFO_CONFIG_1, BMI270_FIFO_ACC_GYR_EN)) {
+        return 0;
+    }
+
+    return flush_hw();
+}
+
+int EiBmi270Fifo::frames_available(void)
+{
+    uint8_t len[2];
+
+    if (!bus->read_registers(BMI270_FIFO_LENGTH_0, len, sizeof(len))) {
+        return 0;
+    }
+
+    uint16_t bytes = ((uint16_t)len[0] | ((uint16_t)len[1] << 8)) & BMI270_FIFO_LENGTH_MASK;
+
+    if (bytes >= BMI270_FIFO_DEPTH_BYTES) {
+        overruns++;
+    }
+
+    return bytes / IMU_FIFO_FRAME_BYTES;
+}
+
+int EiBmi270Fifo::read_frames(ei_imu_fifo_frame_t *frames, int n_frames)
+{
+    uint8_t raw[IMU_FIFO_CHUNK_FRAMES * IMU_FIFO_FRAME_BYTES];
+    size_t length = n_frames * IMU_FIFO_FRAME_BYTES;
+
+    // FIFO_DATA does not auto increment, every byte read pops the FIFO
+    if (!bus->read_registers(BMI270_FIFO_DATA, raw, length)) {
+        return 0;
+    }
+
+    return ei_bmi270_fifo_parse(raw, length, frames, n_frames);
+}
+
+int EiBmi270Fifo::flush_hw(void)
+{
+    return bus->write_register(BMI270_CMD, BMI270_CMD_FIFO_FLUSH);
+}
+
+/**
+ * @brief Parse LSM9DS1 FIFO slots, gyroscope XYZ followed by accelerometer XYZ
+ *
+ * @param raw bytes as read from the FIFO
+ * @param length number of bytes in raw
+ * @param frames output frames, timestamps are left untouched
+ * @param max_frames size of frames
+ * @return int number of frames parsed
+ */
+int ei_lsm9ds1_fifo_parse(const uint8_t *raw, size_t length, ei_imu_fifo_frame_t *frames, int max_frames)
+{
+    int n = 0;
+
+    for (size_t i = 0; (i + IMU_FIFO_FRAME_BYTES) <= length && n < max_frames; i += IMU_FIFO_FRAME_BYTES) {
+        for (int ax = 0; ax < 3; ax++) {
+            frames[n].gyr[ax] = get_int16_le(&raw[i + (ax * 2)]);
+            frames[n].acc[ax] = get_int16_le(&raw[i + 6 + (ax * 2)]);
+        }
+        n++;
+    }
+
+    return n;
+}
+
+/**
+ * @brief Parse BMI270 headerless FIFO frames, gyroscope XYZ followed by
+ * accelerometer XYZ. Frames starting with 0x8000 are invalid and skipped.
+ *
+ * @param raw bytes as read from the FIFO
+ * @param length number of bytes in raw
+ * @param frames output frames, timestamps are left untouched
+ * @param max_frames size of frames
+ * @return int number of frames parsed
+ */
+int ei_bmi270_fifo_parse(const uint8_t *raw, size_t length, ei_imu_fifo_frame_t *frames, int max_frames)
+{
+    int n = 0;
+
+    for (size_t i = 0; (i + IMU_FIFO_FRAME_BYTES) <= length && n < max_frames; i += IMU_FIFO_FRAME_BYTES) {
+        if (raw[i] == 0x00 && raw[i + 1] == 0x80) {
+            continue;
+        }
+
+        for (int ax = 0; ax < 3; ax++) {
+            frames[n].gyr[ax] = get_int16_le(&raw[i + (ax * 2)]);
+            frames[n].acc[ax] = get_int16_le(&raw[i + 6 + (ax * 2)]);
+        }
+        n++;
+    }
+
+    return n;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef EI_IMU_FIFO_H
+#define EI_IMU_FIFO_H
+
+/* Include ----------------------------------------------------------------- */
+#include <stdint.h>
+#include <stddef.h>
+
+/* Constant defines -------------------------------------------------------- */
+/** Number of parsed frames kept in software between two FIFO bursts */
+#ifndef EI_IMU_FIFO_RING_FRAMES
+#define EI_IMU_FIFO_RING_FRAMES         32
+#endif
+
+/** Frames the sensor collects before a burst read is issued */
+#ifndef EI_IMU_FIFO_WATERMARK
+#define EI_IMU_FIFO_WATERMARK           16
+#endif
+
+/** Largest single bus transfer, mbed Wire buffers up to 256 bytes */
+#ifndef EI_IMU_FIFO_MAX_TRANSFER
+#define EI_IMU_FIFO_MAX_TRANSFER        240
+#endif
+
+/** Gap between two reads after which the sampling is considered restarted */
+#define EI_IMU_FIFO_RESTART_GAP_US      500000
+
+/* Class ------------------------------------------------------------------- */
+
+/**
+ * Register level access to one device on a bus. Kept free from Arduino
+ * dependencies so the FIFO logic can be driven by a mock on Linux.
+ */
+class EiRegisterBus {
+public:
+    virtual ~EiRegisterBus() {}
+
+    /**
+     * @brief Write one register
+     * @return 1 on success, 0 on failure
+     */
+    virtual int write_register(uint8_t address, uint8_t value) = 0;
+
+    /**
+     * @brief Read length consecutive bytes starting at address.
+     * Whether the address auto increments is up to the device.
+     * @return 1 on success, 0 on failure
+     */
+    virtual int read_registers(uint8_t address, uint8_t *data, size_t length) = 0;
+};
+
+/** One accelerometer + gyroscope frame, raw values in sensor axis order */
+typedef struct {
+    int16_t acc[3];
+    int16_t gyr[3];
+    uint64_t timestamp_us;
+} ei_imu_fifo_frame_t;
+
+/**
+ * Hardware FIFO in watermark mode with a software ring of timestamped frames.
+ * The fusion sampling thread asks for one frame per tick, the sensor FIFO is
+ * only drained once the ring runs out of frames for the requested tick, so
+ * one bus burst serves EI_IMU_FIFO_WATERMARK ticks.
+ */
+class EiImuFifo {
+public:
+    EiImuFifo(EiRegisterBus *bus, float odr_hz);
+    virtual ~EiImuFifo() {}
+
+    /**
+     * @brief Enable the hardware FIFO in watermark mode
+     * @return 1 on success, 0 on failure
+     */
+    virtual int begin(void) = 0;
+
+    /**
+     * @brief Drop all frames in the sensor and in the software ring
+     */
+    void flush(void);
+
+    /**
+     * @brief Get the frame to report for the sample tick at now_us.
+     * Frames are reported with a fixed latency of one watermark so the FIFO
+     * is only burst read when the ring runs empty.
+     * @param now_us time of the sample tick
+     * @param bus_available false when the bus is in use by someone else, the
+     * frame then comes from the ring only and the FIFO is drained next tick
+     * @return frame, or nullptr if the sensor never produced data
+     */
+    const ei_imu_fifo_frame_t *get_frame(uint64_t now_us, bool bus_available = true);
+
+    /**
+     * @brief Burst read all frames waiting in the sensor FIFO into the ring
+     * @param now_us time of the read, used to timestamp the newest frame
+     * @return number of frames read
+     */
+    int burst_read(uint64_t now_us);
+
+    uint32_t get_overruns(void) { return overruns; }
+
+protected:
+    /** @brief Number of complete frames waiting in the sensor FIFO */
+    virtual int frames_available(void) = 0;
+    /** @brief Read n_frames from the sensor FIFO and parse them into frames */
+    virtual int read_frames(ei_imu_fifo_frame_t *frames, int n_frames) = 0;
+    /** @brief Clear the sensor FIFO */
+    virtual int flush_hw(void) = 0;
+
+    EiRegisterBus *bus;
+    uint32_t overruns;
+
+private:
+    void push(const ei_imu_fifo_frame_t *frame);
+
+    ei_imu_fifo_frame_t ring[EI_IMU_FIFO_RING_FRAMES];
+    ei_imu_fifo_frame_t current;
+    int head;
+    int count;
+    bool has_current;
+    uint32_t period_us;
+    uint64_t last_get_us;
+};
+
+/**
+ * LSM9DS1 accelerometer/gyroscope FIFO, every FIFO slot holds the gyroscope
+ * and the accelerometer sample (12 bytes).
+ */
+class EiLsm9ds1Fifo : public EiImuFifo {
+public:
+    EiLsm9ds1Fifo(EiRegisterBus *bus, float odr_hz) : EiImuFifo(bus, odr_hz) {}
+    int begin(void) override;
+
+protected:
+    int frames_available(void) override;
+    int read_frames(ei_imu_fifo_frame_t *frames, int n_frames) override;
+    int flush_hw(void) override;
+};
+
+/**
+ * BMI270 FIFO in headerless mode with accelerometer and gyroscope enabled,
+ * every frame holds the gyroscope followed by the accelerometer (12 bytes).
+ */
+class EiBmi270Fifo : public EiImuFifo {
+public:
+    EiBmi270Fifo(EiRegisterBus *bus, float odr_hz, uint8_t downsampling)
+        : EiImuFifo(bus, odr_hz), downs(downsampling) {}
+    int begin(void) override;
+
+protected:
+    int frames_available(void) override;
+    int read_frames(ei_imu_fifo_frame_t *frames, int n_frames) override;
+    int flush_hw(void) override;
+
+private:
+    uint8_t downs;
+};
+
+/* Function prototypes ----------------------------------------------------- */
+int ei_lsm9ds1_fifo_parse(const uint8_t *raw, size_t length, ei_imu_fifo_frame_t *frames, int max_frames);
+int ei_bmi270_fifo_parse(const uint8_t *raw, size_t length, ei_imu_fifo_frame_t *frames, int max_frames);
+
+#endif
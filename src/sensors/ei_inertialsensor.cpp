@@ -26,10 +26,14 @@
 #include <stdlib.h>
 #include "ei_inertialsensor.h"
 #include "ei_lsm9ds1.h"
+#include "ei_wire_bus.h"
 
 /* Constant defines -------------------------------------------------------- */
 #define CONVERT_G_TO_MS2    9.80665f
 
+#define CONVERT_ADC_ACC     (float)(2.0f/32768.0f)      // 2G range
+#define CONVERT_ADC_GYR     (float)(2000.0f/32768.0f)   // 2000 dps range
+
 static float imu_data[INERTIAL_AXIS_SAMPLED];
 
 /**
@@ -62,20 +66,27 @@ bool ei_inertial_init(void)
  */
 float *ei_fusion_inertial_read_data(int n_samples)
 {
-    if (ei_IMU.accelerationAvailable()) {
-        ei_IMU.readAcceleration(imu_data[0], imu_data[1], imu_data[2]);
+    // never wait for a slow sensor on the bus, the FIFO is drained next tick
+    bool bus_available = ei_wire_bus_trylock();
 
-        imu_data[0] *= CONVERT_G_TO_MS2;
-        imu_data[1] *= CONVERT_G_TO_MS2;
-        imu_data[2] *= CONVERT_G_TO_MS2;
-    }
+    const ei_imu_fifo_frame_t *frame = ei_IMU.readFifoFrame(bus_available);
 
-    if (n_samples > 3 && ei_IMU.gyroscopeAvailable()) {
-        ei_IMU.readGyroscope(imu_data[3], imu_data[4], imu_data[5]);
+    if (frame != nullptr) {
+        imu_data[0] = frame->acc[0] * CONVERT_ADC_ACC * CONVERT_G_TO_MS2;
+        imu_data[1] = frame->acc[1] * CONVERT_ADC_ACC * CONVERT_G_TO_MS2;
+        imu_data[2] = frame->acc[2] * CONVERT_ADC_ACC * CONVERT_G_TO_MS2;
+
+        imu_data[3] = frame->gyr[0] * CONVERT_ADC_GYR;
+        imu_data[4] = frame->gyr[1] * CONVERT_ADC_GYR;
+        imu_data[5] = frame->gyr[2] * CONVERT_ADC_GYR;
     }
 
-    if (n_samples > 6 && ei_IMU.magneticFieldAvailable()) {
-        ei_IMU.readMagneticField(imu_data[6], imu_data[7], imu_data[8]);
+    if (bus_available) {
+        if (n_samples > 6 && ei_IMU.magneticFieldAvailable()) {
+            ei_IMU.readMagneticField(imu_data[6], imu_data[7], imu_data[8]);
+        }
+
+        ei_wire_bus_unlock();
     }
 
     return imu_data;
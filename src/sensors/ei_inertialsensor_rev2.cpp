@@ -20,10 +20,13 @@
 #include <stdlib.h>
 #include "ei_inertialsensor_rev2.h"
 #include "ei_bm270_bmm150.h"
+#include "ei_wire_bus.h"
 
 /* Constant defines -------------------------------------------------------- */
 #define CONVERT_G_TO_MS2    9.80665f
 
+#define CONVERT_ADC_ACC             (float)(2.0f/32768.0f)
+
 #define CONVERT_ADC_GYR             (float)(250.0f/32768.0f)
 #define CONVERT_ADC_MAG_XY          (float)(1300.0f/4096.0f)
 #define CONVERT_ADC_MAG_Z           (float)(2500.0f/16384.0f)
@@ -47,6 +50,9 @@ bool ei_inertial_rev2_init(void)
     }
     else {
         ei_IMU_BMI270_BMM150.setContinuousMode();
+        if (!ei_IMU_BMI270_BMM150.fifoBegin()) {
+            ei_printf("Failed to enable IMU FIFO for rev2!\r\n");
+        }
         ei_printf("IMU for rev2 initialized\r\n");        
         ei_add_sensor_to_fusion_list(inertial_rev2_sensor);
         ei_add_sensor_to_fusion_list(mag_rev2_sensor);
@@ -65,20 +71,22 @@ float *ei_fusion_inertial_rev2_read_data(int n_samples)
 {       
     memset(imu_data, 0, sizeof(imu_data));
 
-    if (ei_IMU_BMI270_BMM150.accelerationAvailable()) {
-        ei_IMU_BMI270_BMM150.readAcceleration(imu_data[0], imu_data[1], imu_data[2]);
-
-        imu_data[0] *= CONVERT_G_TO_MS2;
-        imu_data[1] *= CONVERT_G_TO_MS2;
-        imu_data[2] *= CONVERT_G_TO_MS2;
+    // never wait for a slow sensor on the bus, the FIFO is drained next tick
+    bool bus_available = ei_wire_bus_trylock();
+    const ei_imu_fifo_frame_t *frame = ei_IMU_BMI270_BMM150.readFifoFrame(bus_available);
+    if (bus_available) {
+        ei_wire_bus_unlock();
     }
 
-    if ((n_samples > 3) && (ei_IMU_BMI270_BMM150.gyroscopeAvailable())) {
-        ei_IMU_BMI270_BMM150.readGyroscope(imu_data[3], imu_data[4], imu_data[5]);
-        
-        imu_data[3] *= CONVERT_ADC_GYR;
-        imu_data[4] *= CONVERT_ADC_GYR;
-        imu_data[5] *= CONVERT_ADC_GYR;
+    // axes remapped to the board orientation, same as readAcceleration / readGyroscope
+    if (frame != nullptr) {
+        imu_data[0] = -frame->acc[1] * CONVERT_ADC_ACC * CONVERT_G_TO_MS2;
+        imu_data[1] = -frame->acc[0] * CONVERT_ADC_ACC * CONVERT_G_TO_MS2;
+        imu_data[2] = frame->acc[2] * CONVERT_ADC_ACC * CONVERT_G_TO_MS2;
+
+        imu_data[3] = -frame->gyr[1] * CONVERT_ADC_GYR;
+        imu_data[4] = -frame->gyr[0] * CONVERT_ADC_GYR;
+        imu_data[5] = frame->gyr[2] * CONVERT_ADC_GYR;
     }
 
     return imu_data;
@@ -92,6 +100,11 @@ float *ei_fusion_inertial_rev2_read_data(int n_samples)
  */
 float *ei_fusion_mag_rev2_read_data(int n_samples)
 {    
+    // keeps the previous values while the bus is busy
+    if (!ei_wire_bus_trylock()) {
+        return mag_data;
+    }
+
     memset(mag_data, 0, sizeof(mag_data));
 
     if (ei_IMU_BMI270_BMM150.magneticFieldAvailable()) {
@@ -101,6 +114,7 @@ float *ei_fusion_mag_rev2_read_data(int n_samples)
         mag_data[1] *= CONVERT_ADC_MAG_XY;
         mag_data[2] *= CONVERT_ADC_MAG_Z;
     }
+    ei_wire_bus_unlock();
 
     return mag_data;
 }
@@ -27,6 +27,7 @@
 #include "ei_interactionsensor.h"
 #include "ei_device_nano_ble33.h"
 #include "firmware-sdk/sensor-aq/sensor_aq.h"
+#include "ei_sample_hold.h"
 
 #include <Arduino_APDS9960.h>
 #include "mbed.h"
@@ -37,6 +38,9 @@ extern void ei_printf(const char *format, ...);
 static float apds_data[INTERACTION_AXIS_SAMPLED];
 static int temp_data[4];
 
+static float *interaction_acquire(int n_samples);
+static EiSampleHold interaction_hold(&interaction_acquire, INTERACTION_AXIS_SAMPLED, INTERACTION_REFRESH_HZ);
+
 bool ei_interaction_init(void)
 {
 	if (!APDS.begin()) {
@@ -44,11 +48,26 @@ bool ei_interaction_init(void)
 	}
 	else {
 		ei_printf("APDS initialized\r\n");
+        // a board without the APDS does not start the sample and hold thread
+        ei_sample_hold_register(&interaction_hold);
     }
     ei_add_sensor_to_fusion_list(interaction_sensor);
+
+    return true;
 }
 
+/**
+ * @brief Latest values, refreshed by the sample and hold thread
+ */
 float *ei_fusion_interaction_read_data(int n_samples)
+{
+    return interaction_hold.get(micros());
+}
+
+/**
+ * @brief Blocking read, gesture handling keeps the bus until the gesture ends
+ */
+static float *interaction_acquire(int n_samples)
 {
     if (APDS.colorAvailable()) {
         APDS.readColor(temp_data[0], temp_data[1], temp_data[2], temp_data[3]);
@@ -30,6 +30,9 @@
 /** Number of axis used and sample data format */
 #define INTERACTION_AXIS_SAMPLED			6
 
+/** Rate at which the values are refreshed in the background (highest sampling frequency) */
+#define INTERACTION_REFRESH_HZ              50.0f
+
 /* Function prototypes ----------------------------------------------------- */
 bool ei_interaction_init(void);
 
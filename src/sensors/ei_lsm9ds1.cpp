@@ -50,6 +50,8 @@
 #define LSM9DS1_STATUS_REG_M       0x27
 #define LSM9DS1_OUT_X_L_M          0x28
 
+#define LSM9DS1_ODR_HZ             119.0f
+
 /**
  * @brief Construct a new ei LSM9DS1Class::ei LSM9DS1Class object
  * 
@@ -57,7 +59,9 @@
  */
 ei_LSM9DS1Class::ei_LSM9DS1Class(TwoWire& wire) :
   LSM9DS1Class(wire),
-  _wire(&wire)
+  _wire(&wire),
+  _bus(wire, LSM9DS1_ADDRESS, 0x80),
+  _fifo(&_bus, LSM9DS1_ODR_HZ)
 {
 
 }
@@ -91,6 +95,13 @@ int ei_LSM9DS1Class::ei_begin(void)
   writeRegister(LSM9DS1_ADDRESS_M, LSM9DS1_CTRL_REG2_M, 0x00); // 4 Gauss
   writeRegister(LSM9DS1_ADDRESS_M, LSM9DS1_CTRL_REG3_M, 0x00); // Continuous conversion mode
 
+  if (!_fifo.begin()) {
+    end();
+
+    return 0;
+  }
+  _fifo.flush();
+
   return 1;
 }
 
@@ -121,6 +132,17 @@ int ei_LSM9DS1Class::readAcceleration(float& x, float& y, float& z)
   return 1;
 }
 
+/**
+ * @brief Get the accelerometer and gyroscope frame for this sample tick.
+ * The FIFO is burst read once per watermark instead of once per sample.
+ *
+ * @return const ei_imu_fifo_frame_t* nullptr if no data yet
+ */
+const ei_imu_fifo_frame_t *ei_LSM9DS1Class::readFifoFrame(bool bus_available)
+{
+  return _fifo.get_frame(micros(), bus_available);
+}
+
 /**
  * @brief 
  * 
@@ -177,8 +199,8 @@ int ei_LSM9DS1Class::readRegisters(uint8_t slaveAddress, uint8_t address, uint8_
     return 0;
   }
 
-  for (size_t i = 0; i < length; i++) {
-    *data++ = _wire->read();
+  if (_wire->readBytes(data, length) != length) {
+    return 0;
   }
 
   return 1;
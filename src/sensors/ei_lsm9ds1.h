@@ -24,6 +24,8 @@
 
 /* Include ----------------------------------------------------------------- */
 #include <Arduino_LSM9DS1.h>
+#include "ei_imu_fifo.h"
+#include "ei_wire_bus.h"
 
 /* Class ----------------------------------------------------- */
 class ei_LSM9DS1Class: public LSM9DS1Class
@@ -32,6 +34,7 @@ class ei_LSM9DS1Class: public LSM9DS1Class
         ei_LSM9DS1Class(TwoWire& wire);
         int ei_begin(void);
         int readAcceleration(float& x, float& y, float& z); // overloading arduino basic read due to different range setting
+        const ei_imu_fifo_frame_t *readFifoFrame(bool bus_available = true); // raw accelerometer + gyroscope frame for the current sample tick
 
     private:
         int writeRegister(uint8_t slaveAddress, uint8_t address, uint8_t value);
@@ -39,6 +42,8 @@ class ei_LSM9DS1Class: public LSM9DS1Class
         int readRegisters(uint8_t slaveAddress, uint8_t address, uint8_t* data, size_t length);
     private:
         TwoWire* _wire;
+        EiWireRegisterBus _bus;
+        EiLsm9ds1Fifo _fifo;
 };
 
 extern ei_LSM9DS1Class ei_IMU;
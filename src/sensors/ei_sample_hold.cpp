@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file ei_sample_hold.cpp
+ * @brief latest value cache for slow sensors, refreshed from a background
+ * thread. No Arduino dependencies, the thread lives in ei_sample_hold_thread.cpp
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_sample_hold.h"
+#include <string.h>
+
+/* Private variables ------------------------------------------------------- */
+static EiSampleHold *holds[EI_SAMPLE_HOLD_MAX_SENSORS];
+// published after the slot is filled, the thread may already be polling
+static std::atomic<int> n_holds(0);
+
+static void no_lock(void) {}
+static void (*hold_lock)(void) = &no_lock;
+static void (*hold_unlock)(void) = &no_lock;
+
+/**
+ * @brief Construct a new EiSampleHold object
+ *
+ * @param acquire blocking read of the sensor
+ * @param n_axes number of values acquire returns
+ * @param refresh_hz rate at which the thread refreshes the values
+ */
+EiSampleHold::EiSampleHold(ei_sample_hold_acquire_t acquire, int n_axes, float refresh_hz) :
+    acquire(acquire),
+    n_axes(n_axes > EI_SAMPLE_HOLD_MAX_AXES ? EI_SAMPLE_HOLD_MAX_AXES : n_axes),
+    published(0),
+    reads(0),
+    age_us(0),
+    seen_reads(0),
+    last_active_us(0),
+    active(false)
+{
+    period_us = (uint64_t)(1000000.0f / refresh_hz);
+    memset(slot_values, 0, sizeof(slot_values));
+    memset(slot_timestamp_us, 0, sizeof(slot_timestamp_us));
+    memset(values, 0, sizeof(values));
+}
+
+/**
+ * @brief Acquire into the slot that is not published and publish it.
+ * Caller holds the lock, so there is only ever one writer.
+ */
+bool EiSampleHold::refresh(uint64_t now_us)
+{
+    uint32_t current = published.load(std::memory_order_relaxed);
+    uint32_t slot = (current & 1) ^ 1;
+
+    float *acquired = acquire(n_axes);
+    if (acquired == nullptr) {
+        return false;
+    }
+
+    memcpy(slot_values[slot], acquired, n_axes * sizeof(float));
+    slot_timestamp_us[slot] = now_us;
+
+    uint32_t generation = ((current >> 1) + 1) & 0x7fffffff;
+    if (generation == 0) {
+        generation = 1;
+    }
+    published.store((generation << 1) | slot, std::memory_order_release);
+
+    return true;
+}
+
+/**
+ * @brief Copy the published slot into values, retried when a new slot got
+ * published while copying
+ */
+bool EiSampleHold::copy_latest(uint64_t *timestamp_us)
+{
+    for (int attempt = 0; attempt < 3; attempt++) {
+        uint32_t current = published.load(std::memory_order_acquire);
+        if ((current >> 1) == 0) {
+            return false;
+        }
+
+        memcpy(values, slot_values[current & 1], n_axes * sizeof(float));
+        *timestamp_us = slot_timestamp_us[current & 1];
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (published.load(std::memory_order_relaxed) == current) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+float *EiSampleHold::get(uint64_t now_us)
+{
+    uint64_t timestamp_us = 0;
+
+    // lets the thread know the sensor is in use
+    reads.fetch_add(1, std::memory_order_relaxed);
+
+    bool have_values = copy_latest(&timestamp_us);
+    // while the thread refreshes this sensor old values only mean a slow
+    // conversion, reading in place would stall the caller on the bus lock
+    bool stale = have_values && !active.load(std::memory_order_relaxed)
+        && (now_us > timestamp_us)
+        && ((now_us - timestamp_us) > (EI_SAMPLE_HOLD_STALE_PERIODS * period_us));
+
+    if (!have_values || stale) {
+        hold_lock();
+        if (refresh(now_us)) {
+            have_values = copy_latest(&timestamp_us);
+        }
+        hold_unlock();
+    }
+
+    if (!have_values) {
+        memset(values, 0, sizeof(values));
+        timestamp_us = now_us;
+    }
+    age_us = (now_us > timestamp_us) ? (now_us - timestamp_us) : 0;
+
+    return values;
+}
+
+uint64_t EiSampleHold::poll(uint64_t now_us)
+{
+    uint32_t n_reads = reads.load(std::memory_order_relaxed);
+
+    if (n_reads != seen_reads) {
+        seen_reads = n_reads;
+        last_active_us = now_us;
+        active.store(true, std::memory_order_relaxed);
+    }
+    else if (active.load(std::memory_order_relaxed) && (now_us - last_active_us) > EI_SAMPLE_HOLD_IDLE_US) {
+        active.store(false, std::memory_order_relaxed);
+    }
+
+    if (!active.load(std::memory_order_relaxed)) {
+        return EI_SAMPLE_HOLD_IDLE_POLL_US;
+    }
+
+    uint32_t current = published.load(std::memory_order_acquire);
+    if ((current >> 1) != 0) {
+        uint64_t due_us = slot_timestamp_us[current & 1] + period_us;
+        if (now_us < due_us) {
+            return due_us - now_us;
+        }
+    }
+
+    hold_lock();
+    refresh(now_us);
+    hold_unlock();
+
+    return period_us;
+}
+
+/**
+ * @brief Set the lock that serialises sensor reads, e.g. the I2C bus lock
+ * when the IMU shares the bus with the held sensors
+ */
+void ei_sample_hold_set_lock(void (*lock)(void), void (*unlock)(void))
+{
+    hold_lock = lock ? lock : &no_lock;
+    hold_unlock = unlock ? unlock : &no_lock;
+}
+
+/**
+ * @brief Add a sensor to the ones refreshed by the acquisition thread. The
+ * thread is started when the first sensor is added, boards without any of
+ * the slow sensors never pay for its stack. If it can't be started, the
+ * sensor is still read in place on each get().
+ * @return false if the list is full
+ */
+bool ei_sample_hold_register(EiSampleHold *hold)
+{
+    int n = n_holds.load(std::memory_order_relaxed);
+
+    if (n >= EI_SAMPLE_HOLD_MAX_SENSORS) {
+        return false;
+    }
+
+    holds[n] = hold;
+    n_holds.store(n + 1, std::memory_order_release);
+
+    if (n == 0) {
+        ei_sample_hold_start();
+    }
+
+    return true;
+}
+
+/**
+ * @brief Refresh all sensors that are due
+ * @return time until the next sensor is due
+ */
+uint64_t ei_sample_hold_poll(uint64_t now_us)
+{
+    uint64_t wait_us = EI_SAMPLE_HOLD_IDLE_POLL_US;
+
+    int n = n_holds.load(std::memory_order_acquire);
+
+    for (int i = 0; i < n; i++) {
+        uint64_t hold_wait_us = holds[i]->poll(now_us);
+        if (hold_wait_us < wait_us) {
+            wait_us = hold_wait_us;
+        }
+    }
+
+    return wait_us;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef EI_SAMPLE_HOLD_H
+#define EI_SAMPLE_HOLD_H
+
+/* Include ----------------------------------------------------------------- */
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/* Constant defines -------------------------------------------------------- */
+/** Largest number of axes a held sensor can have */
+#ifndef EI_SAMPLE_HOLD_MAX_AXES
+#define EI_SAMPLE_HOLD_MAX_AXES         8
+#endif
+
+/** Number of sensors the acquisition thread can refresh */
+#ifndef EI_SAMPLE_HOLD_MAX_SENSORS
+#define EI_SAMPLE_HOLD_MAX_SENSORS      4
+#endif
+
+/** A sensor nobody read for this long is no longer refreshed */
+#ifndef EI_SAMPLE_HOLD_IDLE_US
+#define EI_SAMPLE_HOLD_IDLE_US          1000000
+#endif
+
+/** Held values older than this many refresh periods are read in place when the thread is idle */
+#define EI_SAMPLE_HOLD_STALE_PERIODS    4
+
+/** Poll interval of the acquisition thread while all sensors are idle */
+#define EI_SAMPLE_HOLD_IDLE_POLL_US     100000
+
+/**
+ * Blocking read of a slow sensor, same signature as the fusion read
+ * functions. Returns nullptr if the sensor could not be read.
+ */
+typedef float *(*ei_sample_hold_acquire_t)(int n_samples);
+
+/* Class ------------------------------------------------------------------- */
+
+/**
+ * Latest value cache for a sensor that is slow to read (I2C conversions,
+ * gesture handling). A background thread refreshes the values at the
+ * sensor's own rate, the fusion sampling thread only copies the latest
+ * values out and never waits on the bus.
+ *
+ * The values are double buffered: the writer fills the slot that is not
+ * published and then publishes it together with a generation count, the
+ * reader retries its copy if a new generation was published meanwhile.
+ * Refreshes (from the thread, or in place on a stale read) are serialised
+ * by the lock set with ei_sample_hold_set_lock(). No Arduino dependencies,
+ * so it can be driven with simulated sensors on Linux.
+ */
+class EiSampleHold {
+public:
+    /**
+     * @param acquire blocking read of the sensor
+     * @param n_axes number of values acquire returns
+     * @param refresh_hz rate at which the thread refreshes the values
+     */
+    EiSampleHold(ei_sample_hold_acquire_t acquire, int n_axes, float refresh_hz);
+
+    /**
+     * @brief Latest values of the sensor. If nothing was acquired yet, or
+     * the held values are stale because the thread stopped refreshing this
+     * sensor, the sensor is read in place, like it would be without the cache.
+     * @param now_us current time
+     * @return values, valid until the next call
+     */
+    float *get(uint64_t now_us);
+
+    /**
+     * @brief Age of the values returned by the last get()
+     */
+    uint64_t get_age_us(void) const { return age_us; }
+
+    /**
+     * @brief Called from the acquisition thread, refreshes the values when
+     * they are a period old and the sensor is being read
+     * @return time until the values are due again
+     */
+    uint64_t poll(uint64_t now_us);
+
+private:
+    bool refresh(uint64_t now_us);
+    bool copy_latest(uint64_t *timestamp_us);
+
+    ei_sample_hold_acquire_t acquire;
+    int n_axes;
+    uint64_t period_us;
+
+    // written by the refreshing side only
+    float slot_values[2][EI_SAMPLE_HOLD_MAX_AXES];
+    uint64_t slot_timestamp_us[2];
+    // (generation << 1) | slot, generation 0 means nothing published
+    std::atomic<uint32_t> published;
+
+    // reader side
+    std::atomic<uint32_t> reads;
+    float values[EI_SAMPLE_HOLD_MAX_AXES];
+    uint64_t age_us;
+
+    // thread side
+    uint32_t seen_reads;
+    uint64_t last_active_us;
+    std::atomic<bool> active;
+};
+
+/* Function prototypes ----------------------------------------------------- */
+void ei_sample_hold_set_lock(void (*lock)(void), void (*unlock)(void));
+bool ei_sample_hold_register(EiSampleHold *hold);
+uint64_t ei_sample_hold_poll(uint64_t now_us);
+
+/* Implemented on top of mbed in ei_sample_hold_thread.cpp, called by
+ * ei_sample_hold_register for the first sensor */
+bool ei_sample_hold_start(void);
+
+#endif
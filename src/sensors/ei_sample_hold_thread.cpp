@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_sample_hold.h"
+#include "ei_wire_bus.h"
+#include "mbed.h"
+
+using namespace rtos;
+
+/* Constant defines -------------------------------------------------------- */
+#define SAMPLE_HOLD_THREAD_STACK_SIZE   2048
+
+extern void ei_printf(const char *format, ...);
+
+/* Private variables ------------------------------------------------------- */
+static Thread *sample_hold_thread = nullptr;
+
+static void sample_hold_loop(void)
+{
+    while (true) {
+        uint64_t wait_us = ei_sample_hold_poll(micros());
+        uint32_t wait_ms = (uint32_t)(wait_us / 1000);
+
+        ThisThread::sleep_for(wait_ms > 0 ? wait_ms : 1);
+    }
+}
+
+/**
+ * @brief Start the thread that refreshes the registered slow sensors,
+ * called when the first one is registered. It runs below the fusion sampling thread, so a sample tick is never
+ * delayed by a conversion, only by the bus transfer that is in progress.
+ *
+ * @return true if the thread is running
+ */
+bool ei_sample_hold_start(void)
+{
+    if (sample_hold_thread != nullptr) {
+        return true;
+    }
+
+    // the held sensors share Wire1 with the IMU
+    ei_sample_hold_set_lock(&ei_wire_bus_lock, &ei_wire_bus_unlock);
+
+    sample_hold_thread = new Thread(osPriorityBelowNormal, SAMPLE_HOLD_THREAD_STACK_SIZE, nullptr, "sample_hold");
+    if (sample_hold_thread->start(callback(sample_hold_loop)) != osOK) {
+        ei_printf("Can't start the sample and hold thread\r\n");
+        delete sample_hold_thread;
+        sample_hold_thread = nullptr;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_wire_bus.h"
+#include "mbed.h"
+
+/* Private variables ------------------------------------------------------- */
+static rtos::Mutex wire_bus_mutex;
+
+void ei_wire_bus_lock(void)
+{
+    wire_bus_mutex.lock();
+}
+
+bool ei_wire_bus_trylock(void)
+{
+    return wire_bus_mutex.trylock();
+}
+
+void ei_wire_bus_unlock(void)
+{
+    wire_bus_mutex.unlock();
+}
+
+/**
+ * @brief Write one register
+ *
+ * @param address
+ * @param value
+ * @return int 1 on success
+ */
+int EiWireRegisterBus::write_register(uint8_t address, uint8_t value)
+{
+    _wire->beginTransmission(_dev_addr);
+    _wire->write(address);
+    _wire->write(value);
+    if (_wire->endTransmission() != 0) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Read consecutive bytes with a single I2C transaction
+ *
+ * @param address
+ * @param data
+ * @param length
+ * @return int 1 on success
+ */
+int EiWireRegisterBus::read_registers(uint8_t address, uint8_t *data, size_t length)
+{
+    _wire->beginTransmission(_dev_addr);
+    _wire->write((length > 1) ? (_burst_flag | address) : address);
+    if (_wire->endTransmission(false) != 0) {
+        return 0;
+    }
+
+    if (_wire->requestFrom(_dev_addr, length) != length) {
+        return 0;
+    }
+
+    if (_wire->readBytes(data, length) != length) {
+        return 0;
+    }
+
+    return 1;
+}
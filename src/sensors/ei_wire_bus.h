@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef EI_WIRE_BUS_H
+#define EI_WIRE_BUS_H
+
+/* Include ----------------------------------------------------------------- */
+#include <Arduino.h>
+#include <Wire.h>
+#include "ei_imu_fifo.h"
+
+/* Class ----------------------------------------------------- */
+
+/**
+ * EiRegisterBus on top of an Arduino TwoWire interface
+ */
+class EiWireRegisterBus : public EiRegisterBus {
+public:
+    /**
+     * @param wire I2C interface the device is on
+     * @param dev_addr 7 bit I2C address of the device
+     * @param burst_flag or'ed with the register address for multi byte reads
+     */
+    EiWireRegisterBus(TwoWire& wire, uint8_t dev_addr, uint8_t burst_flag = 0x00) :
+        _wire(&wire), _dev_addr(dev_addr), _burst_flag(burst_flag) {}
+
+    int write_register(uint8_t address, uint8_t value) override;
+    int read_registers(uint8_t address, uint8_t *data, size_t length) override;
+
+private:
+    TwoWire* _wire;
+    uint8_t _dev_addr;
+    uint8_t _burst_flag;
+};
+
+/* Function prototypes ----------------------------------------------------- */
+/**
+ * Serialise access to the bus between the fusion sampling thread and the
+ * sample and hold thread. Recursive, so nested calls are fine. The IMU
+ * uses trylock so a slow conversion never delays a sample tick.
+ */
+void ei_wire_bus_lock(void);
+bool ei_wire_bus_trylock(void);
+void ei_wire_bus_unlock(void);
+
+#endif
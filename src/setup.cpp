@@ -11,6 +11,7 @@
 #include "ei_camera.h"
 #include "ei_run_impulse.h"
 #include "firmware-sdk/ei_device_info_lib.h"
+#include "edge-impulse-sdk/porting/ei_log_ring.h"
 
 static ATServer *at;
 
@@ -37,6 +38,9 @@ void print_memory_info()
 void ei_main_init(void)
 {
     EiDeviceNanoBle33 *dev = static_cast<EiDeviceNanoBle33*>(EiDeviceInfo::get_device());
+#if EI_PORTING_DEFERRED_LOG == 1
+    ei_log_deferred_start();
+#endif
     ei_printf("Hello from Edge Impulse on Arduino Nano 33 BLE Sense\r\n"
               "Compiled on %s %s\r\n",
               __DATE__,
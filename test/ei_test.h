@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef EI_TEST_H
+#define EI_TEST_H
+
+/* Include ----------------------------------------------------------------- */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/**
+ * Minimal checks for the host tests, a failed check prints where it failed
+ * and the test exits with an error so ctest reports it.
+ */
+static int ei_test_failures = 0;
+
+#define EI_TEST_CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            ei_test_failures++; \
+        } \
+    } while (0)
+
+#define EI_TEST_CHECK_EQ(a, b) do { \
+        long long _a = (long long)(a); \
+        long long _b = (long long)(b); \
+        if (_a != _b) { \
+            printf("%s:%d: check failed: %s == %s (%lld != %lld)\n", \
+                __FILE__, __LINE__, #a, #b, _a, _b); \
+            ei_test_failures++; \
+        } \
+    } while (0)
+
+#define EI_TEST_CHECK_NEAR(a, b, tol) do { \
+        double _a = (double)(a); \
+        double _b = (double)(b); \
+        if (!(fabs(_a - _b) <= (double)(tol))) { \
+            printf("%s:%d: check failed: %s ~= %s (%g != %g, tol %g)\n", \
+                __FILE__, __LINE__, #a, #b, _a, _b, (double)(tol)); \
+            ei_test_failures++; \
+        } \
+    } while (0)
+
+#define EI_TEST_RUN(fn) do { \
+        printf("%s\n", #fn); \
+        fn(); \
+    } while (0)
+
+#define EI_TEST_RESULT() (ei_test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE)
+
+#endif
@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_at_server.cpp
+ * @brief AT server line buffer, history, parser and command lookup. Built
+ * without ei_at_server_singleton.cpp, get_instance returns a new server
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "at-server/ei_at_server.h"
+
+#include <stdarg.h>
+#include <string>
+#include <vector>
+
+/* Mocks ------------------------------------------------------------------- */
+
+static std::string output;
+
+void ei_printf(const char *format, ...)
+{
+    char buf[1024];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    output += buf;
+}
+
+void ei_putchar(char c)
+{
+    output += c;
+}
+
+ATServer *ATServer::get_instance()
+{
+    return ATServer::get_instance(nullptr, 0, default_history_size);
+}
+
+ATServer *ATServer::get_instance(ATCommand_t *commands, size_t length, size_t max_history_size)
+{
+    return new ATServer(commands, length, max_history_size);
+}
+
+/* Handlers ---------------------------------------------------------------- */
+
+static std::vector<std::string> calls;
+
+static bool run_alpha(void)
+{
+    calls.push_back("run ALPHA");
+    return true;
+}
+
+static bool run_alpha_new(void)
+{
+    calls.push_back("run ALPHA new");
+    return true;
+}
+
+static bool run_mid(void)
+{
+    calls.push_back("run MID");
+    return true;
+}
+
+static bool read_mid(void)
+{
+    calls.push_back("read MID");
+    return true;
+}
+
+static bool run_zed(void)
+{
+    calls.push_back("run ZED");
+    return true;
+}
+
+static bool write_args(const char **args, const int count)
+{
+    std::string call = "write";
+    for (int ix = 0; ix < count; ix++) {
+        call += std::string(" [") + args[ix] + "]";
+    }
+    calls.push_back(call);
+    return true;
+}
+
+static void type(ATServer *server, const std::string &line)
+{
+    for (char c : line) {
+        server->handle(c);
+    }
+    server->handle('\r');
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+/* Characters past AT_LINE_BUFFER_SIZE are dropped, wherever the cursor is */
+static void test_line_buffer_overflow(void)
+{
+    LineBuffer buffer;
+
+    for (size_t ix = 0; ix < AT_LINE_BUFFER_SIZE; ix++) {
+        EI_TEST_CHECK(buffer.add((char)('a' + ix % 26)));
+    }
+    EI_TEST_CHECK(!buffer.add('x'));
+    EI_TEST_CHECK_EQ(buffer.size(), AT_LINE_BUFFER_SIZE);
+    EI_TEST_CHECK_EQ(strlen(buffer.get_string()), AT_LINE_BUFFER_SIZE);
+
+    buffer.set_position(10);
+    EI_TEST_CHECK(!buffer.add('x'));
+    buffer.add("xyz");
+    EI_TEST_CHECK_EQ(buffer.size(), AT_LINE_BUFFER_SIZE);
+    EI_TEST_CHECK_EQ(buffer.get_string()[10], 'k');
+
+    // strings are cut to what fits
+    EI_TEST_CHECK(buffer.do_backspace());
+    EI_TEST_CHECK(buffer.do_backspace());
+    buffer.add("XYZ");
+    EI_TEST_CHECK_EQ(buffer.size(), AT_LINE_BUFFER_SIZE);
+    EI_TEST_CHECK(strncmp(buffer.get_string() + 8, "XYk", 3) == 0);
+}
+
+/* The server runs what fits of a line that was too long */
+static void test_overlong_line_is_cut(void)
+{
+    ATServer *server = ATServer::get_instance();
+    server->register_command("LONG", "", nullptr, nullptr, write_args, "ARG");
+
+    std::string line = "AT+LONG=" + std::string(600, 'x');
+    calls.clear();
+    type(server, line);
+
+    EI_TEST_CHECK_EQ(calls.size(), 1);
+    std::string expected = "write [" + std::string(AT_LINE_BUFFER_SIZE - 8, 'x') + "]";
+    EI_TEST_CHECK(calls.size() == 1 && calls[0] == expected);
+}
+
+/* After 10 entries the oldest one is overwritten */
+static void test_history_wrap(void)
+{
+    ATHistory history(10);
+    char entry[16];
+
+    for (int ix = 0; ix < 13; ix++) {
+        snprintf(entry, sizeof(entry), "cmd%d", ix);
+        history.add(entry);
+    }
+    EI_TEST_CHECK(history.is_at_end());
+
+    // newest to oldest, stays at the oldest
+    for (int ix = 12; ix >= 3; ix--) {
+        snprintf(entry, sizeof(entry), "cmd%d", ix);
+        EI_TEST_CHECK(strcmp(history.go_back(), entry) == 0);
+    }
+    EI_TEST_CHECK(history.is_at_begin());
+    EI_TEST_CHECK(strcmp(history.go_back(), "cmd3") == 0);
+
+    for (int ix = 4; ix <= 12; ix++) {
+        snprintf(entry, sizeof(entry), "cmd%d", ix);
+        EI_TEST_CHECK(strcmp(history.go_next(), entry) == 0);
+    }
+    EI_TEST_CHECK(strcmp(history.go_next(), "") == 0);
+    EI_TEST_CHECK(history.is_at_end());
+
+    // empty and too long entries are not kept
+    history.add("");
+    history.add(std::string(AT_HISTORY_ENTRY_SIZE + 1, 'y').c_str());
+    EI_TEST_CHECK(strcmp(history.go_back(), "cmd12") == 0);
+}
+
+/* A size above AT_HISTORY_MAX_SIZE is capped */
+static void test_history_capped(void)
+{
+    ATHistory history(AT_HISTORY_MAX_SIZE + 5);
+    char entry[16];
+
+    for (int ix = 0; ix < AT_HISTORY_MAX_SIZE + 5; ix++) {
+        snprintf(entry, sizeof(entry), "cmd%d", ix);
+        history.add(entry);
+    }
+
+    int entries = 0;
+    while (!history.is_at_begin()) {
+        history.go_back();
+        entries++;
+    }
+    EI_TEST_CHECK_EQ(entries, AT_HISTORY_MAX_SIZE);
+}
+
+static void test_parse_types(void)
+{
+    ATParser parser;
+
+    char run[] = "  AT+CMD \r\n";
+    const ATParseResult_t &res = parser.parse(run);
+    EI_TEST_CHECK_EQ(res.type, AT_RUN);
+    EI_TEST_CHECK(strcmp(res.command, "CMD") == 0);
+
+    char read[] = "AT+CMD?\r";
+    parser.parse(read);
+    EI_TEST_CHECK_EQ(res.type, AT_READ);
+    EI_TEST_CHECK(strcmp(res.command, "CMD") == 0);
+
+    char unknown[] = "ATCMD=1,2";
+    EI_TEST_CHECK_EQ(parser.parse(unknown).type, AT_UNKNOWN);
+    EI_TEST_CHECK(strcmp(unknown, "ATCMD=1,2") == 0);
+}
+
+/* Empty arguments are kept, an argument ending the line too */
+static void test_parse_empty_arguments(void)
+{
+    ATParser parser;
+
+    char line[] = "AT+CMD=,x,,";
+    const ATParseResult_t &res = parser.parse(line);
+    EI_TEST_CHECK_EQ(res.type, AT_WRITE);
+    EI_TEST_CHECK_EQ(res.arguments_count, 4);
+    EI_TEST_CHECK(strcmp(res.arguments[0], "") == 0);
+    EI_TEST_CHECK(strcmp(res.arguments[1], "x") == 0);
+    EI_TEST_CHECK(strcmp(res.arguments[2], "") == 0);
+    EI_TEST_CHECK(strcmp(res.arguments[3], "") == 0);
+    EI_TEST_CHECK_EQ(res.max_arg_len, 1);
+
+    char no_arguments[] = "AT+CMD= ";
+    parser.parse(no_arguments);
+    EI_TEST_CHECK_EQ(res.type, AT_WRITE);
+    EI_TEST_CHECK_EQ(res.arguments_count, 1);
+    EI_TEST_CHECK(strcmp(res.arguments[0], "") == 0);
+}
+
+/* Quotes are not special (yet): commas inside them still split */
+static void test_parse_quoted_arguments(void)
+{
+    ATParser parser;
+
+    char line[] = "AT+CMD=\"a b\",\"c,d\"";
+    const ATParseResult_t &res = parser.parse(line);
+    EI_TEST_CHECK_EQ(res.type, AT_WRITE);
+    EI_TEST_CHECK_EQ(res.arguments_count, 3);
+    EI_TEST_CHECK(strcmp(res.arguments[0], "\"a b\"") == 0);
+    EI_TEST_CHECK(strcmp(res.arguments[1], "\"c") == 0);
+    EI_TEST_CHECK(strcmp(res.arguments[2], "d\"") == 0);
+}
+
+/* AT_MAX_ARGUMENTS is accepted, one more is an error and the line is intact */
+static void test_parse_too_many_arguments(void)
+{
+    ATParser parser;
+    std::string args = "0";
+    for (int ix = 1; ix < AT_MAX_ARGUMENTS; ix++) {
+        args += "," + std::to_string(ix);
+    }
+
+    std::string max_line = "AT+CMD=" + args;
+    std::vector<char> max(max_line.begin(), max_line.end());
+    max.push_back('\0');
+    const ATParseResult_t &res = parser.parse(max.data());
+    EI_TEST_CHECK_EQ(res.type, AT_WRITE);
+    EI_TEST_CHECK_EQ(res.arguments_count, AT_MAX_ARGUMENTS);
+    EI_TEST_CHECK(strcmp(res.arguments[AT_MAX_ARGUMENTS - 1], std::to_string(AT_MAX_ARGUMENTS - 1).c_str()) == 0);
+
+    std::string over_line = "AT+CMD=" + args + ",x\r";
+    std::vector<char> over(over_line.begin(), over_line.end());
+    over.push_back('\0');
+    EI_TEST_CHECK_EQ(parser.parse(over.data()).type, AT_TOO_MANY_ARGUMENTS);
+    EI_TEST_CHECK(over_line == over.data());
+}
+
+/* The server reports too many arguments with the line as typed */
+static void test_too_many_arguments_echo(void)
+{
+    ATServer *server = ATServer::get_instance();
+    server->register_command("CMD", "", nullptr, nullptr, write_args, "ARGS");
+
+    std::string line = "AT+CMD=";
+    for (int ix = 0; ix <= AT_MAX_ARGUMENTS; ix++) {
+        line += (ix ? "," : "") + std::to_string(ix);
+    }
+    calls.clear();
+    output.clear();
+    type(server, line);
+
+    EI_TEST_CHECK(calls.empty());
+    EI_TEST_CHECK(output.find("Too many arguments") != std::string::npos);
+    EI_TEST_CHECK(output.find("(" + line + ")") != std::string::npos);
+}
+
+/**
+ * Commands registered out of order (and one replaced) are all found through
+ * the sorted lookup, names that only share a prefix are not
+ */
+static void test_lookup_after_registering(void)
+{
+    ATServer *server = ATServer::get_instance();
+    EI_TEST_CHECK(server->register_command("ZED", "", run_zed, nullptr, nullptr, nullptr));
+    EI_TEST_CHECK(server->register_command("ALPHA", "", run_alpha, nullptr, nullptr, nullptr));
+    EI_TEST_CHECK(server->register_command("MID", "", run_mid, read_mid, write_args, "A,B"));
+    EI_TEST_CHECK(server->register_command("ALPHA", "", run_alpha_new, nullptr, nullptr, nullptr));
+    EI_TEST_CHECK(server->register_command("AB", "", nullptr, nullptr, nullptr, nullptr));
+    EI_TEST_CHECK(!server->register_command("HELP", "", run_zed, nullptr, nullptr, nullptr));
+    EI_TEST_CHECK(server->register_handlers("AB", run_zed, nullptr, nullptr, nullptr));
+    EI_TEST_CHECK(!server->register_handlers("ABC", run_zed, nullptr, nullptr, nullptr));
+
+    calls.clear();
+    output.clear();
+    type(server, "AT+ZED");
+    type(server, "AT+ALPHA");
+    type(server, "AT+MID?");
+    type(server, "AT+MID=1,,3");
+    type(server, "AT+AB");
+    type(server, "AT+ALPH");
+    type(server, "AT+ALPHAX");
+    type(server, "AT+A");
+
+    const char *expected[] = { "run ZED", "run ALPHA new", "read MID", "write [1] [] [3]", "run ZED" };
+    EI_TEST_CHECK_EQ(calls.size(), 5);
+    for (size_t ix = 0; ix < calls.size() && ix < 5; ix++) {
+        EI_TEST_CHECK(calls[ix] == expected[ix]);
+    }
+    EI_TEST_CHECK(output.find("Command not found! (AT+ALPH)") != std::string::npos);
+    EI_TEST_CHECK(output.find("Command not found! (AT+ALPHAX)") != std::string::npos);
+    EI_TEST_CHECK(output.find("Command not found! (AT+A)") != std::string::npos);
+
+    // help lists every command once, in registration order
+    output.clear();
+    type(server, "AT+HELP");
+    EI_TEST_CHECK(output.find("AT+ZED\n") < output.find("AT+MID?\n"));
+    EI_TEST_CHECK(output.find("AT+ALPHA\n") == output.rfind("AT+ALPHA\n"));
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_line_buffer_overflow);
+    EI_TEST_RUN(test_overlong_line_is_cut);
+    EI_TEST_RUN(test_history_wrap);
+    EI_TEST_RUN(test_history_capped);
+    EI_TEST_RUN(test_parse_types);
+    EI_TEST_RUN(test_parse_empty_arguments);
+    EI_TEST_RUN(test_parse_quoted_arguments);
+    EI_TEST_RUN(test_parse_too_many_arguments);
+    EI_TEST_RUN(test_too_many_arguments_echo);
+    EI_TEST_RUN(test_lookup_after_registering);
+
+    return EI_TEST_RESULT();
+}
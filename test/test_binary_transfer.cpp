@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_binary_transfer.cpp
+ * @brief Binary framed readback round trip over a socketpair
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "firmware-sdk/ei_binary_transfer.h"
+#include "firmware-sdk/ei_device_memory.h"
+
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_BLOCK_SIZE             1024
+#define TEST_MEMORY_BLOCKS          8
+#define TEST_MEMORY_SIZE            (TEST_BLOCK_SIZE * TEST_MEMORY_BLOCKS)
+
+/* Mocks ------------------------------------------------------------------- */
+
+/**
+ * Sample memory with a known pattern, reads fail from fail_address on
+ */
+class TestMemory : public EiDeviceRAM<TEST_BLOCK_SIZE, TEST_MEMORY_BLOCKS> {
+public:
+    TestMemory() : EiDeviceRAM<TEST_BLOCK_SIZE, TEST_MEMORY_BLOCKS>(0), fail_address(TEST_MEMORY_SIZE)
+    {
+        for (int i = 0; i < TEST_MEMORY_SIZE; i++) {
+            ram_memory[i] = (uint8_t)((i * 7) ^ (i >> 8));
+        }
+    }
+
+    const uint8_t *data() const { return ram_memory; }
+
+    uint32_t fail_address;
+
+protected:
+    uint32_t read_data(uint8_t *data, uint32_t address, uint32_t num_bytes) override
+    {
+        if (address + num_bytes > fail_address) {
+            num_bytes = address < fail_address ? fail_address - address : 0;
+        }
+        return EiDeviceRAM<TEST_BLOCK_SIZE, TEST_MEMORY_BLOCKS>::read_data(data, address, num_bytes);
+    }
+};
+
+/**
+ * Device side of the socketpair, optionally flips a bit in one frame
+ */
+class SocketTransport : public EiTransport {
+public:
+    SocketTransport(int fd) : fd(fd), corrupt_frame(-1), frames(0) {}
+
+    size_t write(const uint8_t *data, size_t length) override
+    {
+        std::vector<uint8_t> out(data, data + length);
+
+        if (frames++ == corrupt_frame) {
+            out[length / 2] ^= 0x10;
+        }
+
+        size_t sent = 0;
+        while (sent < length) {
+            ssize_t res = send(fd, &out[sent], length - sent, MSG_NOSIGNAL);
+            if (res <= 0) {
+                break;
+            }
+            sent += (size_t)res;
+        }
+
+        return sent;
+    }
+
+    int fd;
+    int corrupt_frame;
+    int frames;
+};
+
+/* Host side --------------------------------------------------------------- */
+
+typedef struct {
+    bool device_res;
+    bool ended;
+    bool corrupted;
+    bool error;
+    uint32_t next_offset;
+    int n_frames;
+} transfer_t;
+
+/**
+ * Run one transfer request: the device sends from a thread, the host decodes
+ * frames from the socket into received until END, ERROR or a bad frame.
+ */
+static transfer_t
+run_transfer(TestMemory *memory, size_t address, size_t length, int corrupt_frame, std::vector<uint8_t> &received)
+{
+    transfer_t t = { false, false, false, false, (uint32_t)address, 0 };
+    int fds[2];
+
+    EI_TEST_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    std::thread device([&]() {
+        SocketTransport transport(fds[0]);
+        transport.corrupt_frame = corrupt_frame;
+        t.device_res = ei_binary_send_sample_buffer(&transport, memory, address, length);
+        shutdown(fds[0], SHUT_WR);
+    });
+
+    std::vector<uint8_t> stream;
+    uint8_t chunk[300];
+    ssize_t n;
+    bool done = false;
+
+    // odd sized reads so frames arrive split across reads
+    while ((n = read(fds[1], chunk, sizeof(chunk))) > 0) {
+        stream.insert(stream.end(), chunk, chunk + n);
+
+        while (!done) {
+            ei_binary_frame_t frame;
+            int res = ei_binary_frame_decode(stream.data(), stream.size(), &frame);
+
+            if (res == 0) {
+                break;
+            }
+            if (res < 0) {
+                // resume from the first offset not received
+                t.corrupted = true;
+                done = true;
+                break;
+            }
+
+            t.n_frames++;
+            if (frame.type == EI_BINARY_FRAME_DATA) {
+                EI_TEST_CHECK_EQ(frame.offset, t.next_offset);
+                memcpy(&received[frame.offset], frame.payload, frame.length);
+                t.next_offset = frame.offset + frame.length;
+            }
+            else {
+                t.ended = frame.type == EI_BINARY_FRAME_END;
+                t.error = frame.type == EI_BINARY_FRAME_ERROR;
+                EI_TEST_CHECK_EQ(frame.offset, t.next_offset);
+                done = true;
+            }
+            stream.erase(stream.begin(), stream.begin() + res);
+        }
+
+        if (done) {
+            break;
+        }
+    }
+
+    // a host that gave up on the stream hangs up, the device sees a failed write
+    close(fds[1]);
+    device.join();
+    close(fds[0]);
+
+    return t;
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+static void test_crc_check_value(void)
+{
+    const uint8_t check[] = "123456789";
+
+    EI_TEST_CHECK_EQ(ei_crc32(check, 9), 0xcbf43926);
+    // chained over two parts gives the same result
+    EI_TEST_CHECK_EQ(ei_crc32(&check[4], 5, ei_crc32(check, 4)), 0xcbf43926);
+}
+
+static void test_round_trip(void)
+{
+    TestMemory memory;
+    std::vector<uint8_t> received(TEST_MEMORY_SIZE, 0);
+    const size_t address = 100;
+    const size_t length = 5 * EI_BINARY_TRANSFER_PAYLOAD_SIZE + 37;
+
+    transfer_t t = run_transfer(&memory, address, length, -1, received);
+
+    EI_TEST_CHECK(t.device_res);
+    EI_TEST_CHECK(t.ended);
+    EI_TEST_CHECK(!t.corrupted);
+    EI_TEST_CHECK_EQ(t.n_frames, 7);
+    EI_TEST_CHECK_EQ(t.next_offset, address + length);
+    for (size_t i = address; i < address + length; i++) {
+        if (received[i] != memory.data()[i]) {
+            EI_TEST_CHECK_EQ(received[i], memory.data()[i]);
+            break;
+        }
+    }
+}
+
+static void test_corrupted_frame_resumes(void)
+{
+    TestMemory memory;
+    std::vector<uint8_t> received(TEST_MEMORY_SIZE, 0);
+    const size_t length = 4 * EI_BINARY_TRANSFER_PAYLOAD_SIZE;
+
+    // third frame is damaged in transit
+    transfer_t t = run_transfer(&memory, 0, length, 2, received);
+
+    EI_TEST_CHECK(t.corrupted);
+    EI_TEST_CHECK(!t.ended);
+    EI_TEST_CHECK_EQ(t.next_offset, 2 * EI_BINARY_TRANSFER_PAYLOAD_SIZE);
+
+    // re-request from the first offset not received
+    uint32_t resume = t.next_offset;
+    t = run_transfer(&memory, resume, length - resume, -1, received);
+
+    EI_TEST_CHECK(t.device_res);
+    EI_TEST_CHECK(t.ended);
+    EI_TEST_CHECK_EQ(t.next_offset, length);
+    EI_TEST_CHECK(memcmp(received.data(), memory.data(), length) == 0);
+}
+
+static void test_read_failure_sends_error(void)
+{
+    TestMemory memory;
+    std::vector<uint8_t> received(TEST_MEMORY_SIZE, 0);
+
+    memory.fail_address = EI_BINARY_TRANSFER_PAYLOAD_SIZE + 10;
+    transfer_t t = run_transfer(&memory, 0, 3 * EI_BINARY_TRANSFER_PAYLOAD_SIZE, -1, received);
+
+    EI_TEST_CHECK(!t.device_res);
+    EI_TEST_CHECK(t.error);
+    EI_TEST_CHECK(!t.ended);
+    // the ERROR frame points at the start of the chunk that failed to read
+    EI_TEST_CHECK_EQ(t.next_offset, EI_BINARY_TRANSFER_PAYLOAD_SIZE);
+}
+
+static void test_decode_rejects(void)
+{
+    TestMemory memory;
+    std::vector<uint8_t> frame;
+    int fds[2];
+
+    EI_TEST_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    SocketTransport transport(fds[0]);
+    EI_TEST_CHECK(ei_binary_send_sample_buffer(&transport, &memory, 0, 16));
+    shutdown(fds[0], SHUT_WR);
+
+    uint8_t buf[256];
+    ssize_t n;
+    while ((n = read(fds[1], buf, sizeof(buf))) > 0) {
+        frame.insert(frame.end(), buf, buf + n);
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    ei_binary_frame_t decoded;
+    const size_t data_frame_size = EI_BINARY_TRANSFER_HEADER_SIZE + 16 + EI_BINARY_TRANSFER_CRC_SIZE;
+
+    EI_TEST_CHECK_EQ(ei_binary_frame_decode(frame.data(), frame.size(), &decoded), data_frame_size);
+    EI_TEST_CHECK_EQ(decoded.type, EI_BINARY_FRAME_DATA);
+    EI_TEST_CHECK_EQ(decoded.length, 16);
+    // incomplete frames ask for more data
+    EI_TEST_CHECK_EQ(ei_binary_frame_decode(frame.data(), 1, &decoded), 0);
+    EI_TEST_CHECK_EQ(ei_binary_frame_decode(frame.data(), data_frame_size - 1, &decoded), 0);
+
+    std::vector<uint8_t> bad(frame);
+    bad[0] = 'X';
+    EI_TEST_CHECK_EQ(ei_binary_frame_decode(bad.data(), bad.size(), &decoded), -1);
+    bad = frame;
+    bad[3] = EI_BINARY_TRANSFER_VERSION + 1;
+    EI_TEST_CHECK_EQ(ei_binary_frame_decode(bad.data(), bad.size(), &decoded), -1);
+    bad = frame;
+    bad[EI_BINARY_TRANSFER_HEADER_SIZE + 3] ^= 0x01;
+    EI_TEST_CHECK_EQ(ei_binary_frame_decode(bad.data(), bad.size(), &decoded), -1);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_crc_check_value);
+    EI_TEST_RUN(test_round_trip);
+    EI_TEST_RUN(test_corrupted_frame_resumes);
+    EI_TEST_RUN(test_read_failure_sends_error);
+    EI_TEST_RUN(test_decode_rejects);
+
+    return EI_TEST_RESULT();
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_classifier_smooth.cpp
+ * @brief Vote smoothing with running counts against the previous roll and
+ * recount version, and the moving average and hysteresis modes
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+#include "edge-impulse-sdk/classifier/ei_classifier_smooth.h"
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_STEPS                  5000
+
+/* Mocks ------------------------------------------------------------------- */
+
+/* The previous implementation: roll the history, recount every reading */
+typedef struct {
+    int *last_readings;
+    size_t last_readings_size;
+    uint8_t min_readings_same;
+    float classifier_confidence;
+    float anomaly_confidence;
+    uint8_t count[EI_CLASSIFIER_LABEL_COUNT + 2];
+} reference_smooth_t;
+
+static void reference_smooth_init(reference_smooth_t *smooth, size_t n_readings,
+                                  uint8_t min_readings_same, float classifier_confidence,
+                                  float anomaly_confidence) {
+    smooth->last_readings = (int*)ei_malloc(n_readings * sizeof(int));
+    for (size_t ix = 0; ix < n_readings; ix++) {
+        smooth->last_readings[ix] = -1; // -1 == uncertain
+    }
+    smooth->last_readings_size = n_readings;
+    smooth->min_readings_same = min_readings_same;
+    smooth->classifier_confidence = classifier_confidence;
+    smooth->anomaly_confidence = anomaly_confidence;
+}
+
+static const char* reference_smooth_update(reference_smooth_t *smooth, ei_impulse_result_t *result) {
+    // clear out the count array
+    memset(smooth->count, 0, EI_CLASSIFIER_LABEL_COUNT + 2);
+
+    // roll through the last_readings buffer
+    numpy::roll(smooth->last_readings, smooth->last_readings_size, -1);
+
+    int reading = -1; // uncertain
+
+    for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
+        if (result->classification[ix].value >= smooth->classifier_confidence) {
+            reading = (int)ix;
+        }
+    }
+#if EI_CLASSIFIER_HAS_ANOMALY
+    if (result->anomaly >= smooth->anomaly_confidence) {
+        reading = -2; // anomaly
+    }
+#endif
+
+    smooth->last_readings[smooth->last_readings_size - 1] = reading;
+
+    // now count last 10 readings and see what we actually see...
+    for (size_t ix = 0; ix < smooth->last_readings_size; ix++) {
+        if (smooth->last_readings[ix] >= 0) {
+            smooth->count[smooth->last_readings[ix]]++;
+        }
+        else if (smooth->last_readings[ix] == -1) { // uncertain
+            smooth->count[EI_CLASSIFIER_LABEL_COUNT]++;
+        }
+        else if (smooth->last_readings[ix] == -2) { // anomaly
+            smooth->count[EI_CLASSIFIER_LABEL_COUNT + 1]++;
+        }
+    }
+
+    // then loop over the count and see which is highest
+    uint8_t top_result = 0;
+    uint8_t top_count = 0;
+    bool met_confidence_threshold = false;
+    uint8_t confidence_threshold = smooth->min_readings_same; // XX% of windows should be the same
+    for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT + 2; ix++) {
+        if (smooth->count[ix] > top_count) {
+            top_result = ix;
+            top_count = smooth->count[ix];
+        }
+        if (smooth->count[ix] >= confidence_threshold) {
+            met_confidence_threshold = true;
+        }
+    }
+
+    if (met_confidence_threshold) {
+        if (top_result == EI_CLASSIFIER_LABEL_COUNT) {
+            return "uncertain";
+        }
+        else if (top_result == EI_CLASSIFIER_LABEL_COUNT + 1) {
+            return "anomaly";
+        }
+        else {
+            return result->classification[top_result].label;
+        }
+    }
+    return "uncertain";
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+static const char *labels[EI_CLASSIFIER_LABEL_COUNT] = { "l0", "l1", "l2", "l3" };
+
+static void set_result(ei_impulse_result_t *result, const float *values, float anomaly)
+{
+    for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
+        result->classification[ix].label = labels[ix];
+        result->classification[ix].value = values[ix];
+    }
+    result->anomaly = anomaly;
+}
+
+/* A random reading: a confident label, nothing confident (uncertain) or an
+ * anomaly, in runs so the vote actually settles now and then */
+static void random_result(ei_impulse_result_t *result)
+{
+    static int current = 0;
+    if (rand() % 4 == 0) {
+        current = rand() % (EI_CLASSIFIER_LABEL_COUNT + 2) - 2;
+    }
+    int reading = (rand() % 5 == 0) ? rand() % (EI_CLASSIFIER_LABEL_COUNT + 2) - 2 : current;
+
+    float values[EI_CLASSIFIER_LABEL_COUNT];
+    for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
+        values[ix] = 0.05f;
+    }
+    if (reading >= 0) {
+        values[reading] = 0.9f;
+    }
+    else if (reading == -1) {
+        values[rand() % EI_CLASSIFIER_LABEL_COUNT] = 0.5f;
+    }
+    set_result(result, values, reading == -2 ? 0.9f : 0.1f);
+}
+
+/* Same label as the roll and recount version after every update, for
+ * history sizes and thresholds around the edge cases (n = 1, min = n) */
+static void test_vote_matches_reference(void)
+{
+    const size_t sizes[] = { 1, 2, 3, 4, 7, 10, 16 };
+    int mismatches = 0;
+    int uncertain = 0, anomaly = 0, label = 0;
+
+    srand(11);
+    for (size_t n : sizes) {
+        for (size_t min_same = 1; min_same <= n; min_same += (n > 4 ? 3 : 1)) {
+            ei_classifier_smooth_t smooth;
+            reference_smooth_t reference;
+            ei_classifier_smooth_init(&smooth, n, (uint8_t)min_same, 0.8f, 0.3f);
+            reference_smooth_init(&reference, n, (uint8_t)min_same, 0.8f, 0.3f);
+
+            for (int step = 0; step < TEST_STEPS; step++) {
+                ei_impulse_result_t result = { 0 };
+                random_result(&result);
+
+                const char *expected = reference_smooth_update(&reference, &result);
+                const char *actual = ei_classifier_smooth_update(&smooth, &result);
+                if (strcmp(expected, actual) != 0) {
+                    mismatches++;
+                }
+                if (strcmp(expected, "uncertain") == 0) {
+                    uncertain++;
+                }
+                else if (strcmp(expected, "anomaly") == 0) {
+                    anomaly++;
+                }
+                else {
+                    label++;
+                }
+            }
+
+            ei_classifier_smooth_free(&smooth);
+            ei_free(reference.last_readings);
+        }
+    }
+
+    EI_TEST_CHECK_EQ(mismatches, 0);
+    // every kind of answer came up
+    EI_TEST_CHECK(uncertain > 0 && anomaly > 0 && label > 0);
+}
+
+/* The history starts all uncertain, those -1 entries win the vote until
+ * enough real readings came in */
+static void test_vote_starts_uncertain(void)
+{
+    ei_classifier_smooth_t smooth;
+    ei_classifier_smooth_init(&smooth, 5, 3, 0.8f, 0.3f);
+    const float values[EI_CLASSIFIER_LABEL_COUNT] = { 0.0f, 0.9f, 0.1f, 0.0f };
+    ei_impulse_result_t result = { 0 };
+    set_result(&result, values, 0.0f);
+
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "uncertain") == 0);
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "uncertain") == 0);
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "l1") == 0);
+    EI_TEST_CHECK_EQ(smooth.count[EI_CLASSIFIER_LABEL_COUNT], 2);
+    EI_TEST_CHECK_EQ(smooth.count[1], 3);
+
+    // anomalies count in their own slot
+    set_result(&result, values, 0.5f);
+    for (int i = 0; i < 3; i++) {
+        ei_classifier_smooth_update(&smooth, &result);
+    }
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "anomaly") == 0);
+    EI_TEST_CHECK_EQ(smooth.count[EI_CLASSIFIER_LABEL_COUNT + 1], 4);
+    EI_TEST_CHECK_EQ(smooth.count[EI_CLASSIFIER_LABEL_COUNT], 0);
+
+    ei_classifier_smooth_free(&smooth);
+}
+
+/* The averages follow s += alpha * (x - s), seeded by the first reading */
+static void test_ema(void)
+{
+    ei_classifier_smooth_t smooth;
+    ei_classifier_smooth_init_ema(&smooth, 0.5f, 0.8f, 0.5f);
+    EI_TEST_CHECK_EQ(smooth.mode, EI_CLASSIFIER_SMOOTH_EMA);
+    EI_TEST_CHECK(smooth.last_readings == NULL);
+
+    const float first[EI_CLASSIFIER_LABEL_COUNT] = { 1.0f, 0.0f, 0.0f, 0.0f };
+    const float second[EI_CLASSIFIER_LABEL_COUNT] = { 0.0f, 1.0f, 0.0f, 0.0f };
+    ei_impulse_result_t result = { 0 };
+
+    set_result(&result, first, 0.0f);
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "l0") == 0);
+    EI_TEST_CHECK_NEAR(smooth.scores[0], 1.0f, 1e-6f);
+
+    // l0 1 -> 0.5 -> 0.25, l1 0 -> 0.5 -> 0.75: nobody at 0.8
+    set_result(&result, second, 0.0f);
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "uncertain") == 0);
+    EI_TEST_CHECK_NEAR(smooth.scores[0], 0.5f, 1e-6f);
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "uncertain") == 0);
+    EI_TEST_CHECK_NEAR(smooth.scores[1], 0.75f, 1e-6f);
+    // 0.875
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "l1") == 0);
+
+    // the anomaly score is averaged too: 0 -> 0.4 -> 0.6
+    set_result(&result, second, 0.8f);
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "l1") == 0);
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "anomaly") == 0);
+
+    ei_classifier_smooth_free(&smooth);
+}
+
+/* Entered at classifier_confidence, kept until the average drops under
+ * release_confidence, unless another class enters */
+static void test_hysteresis(void)
+{
+    ei_classifier_smooth_t smooth;
+    ei_classifier_smooth_init_ema(&smooth, 0.5f, 0.8f, 1.0f, 0.4f);
+    EI_TEST_CHECK_EQ(smooth.mode, EI_CLASSIFIER_SMOOTH_HYSTERESIS);
+
+    const float on[EI_CLASSIFIER_LABEL_COUNT] = { 1.0f, 0.0f, 0.0f, 0.0f };
+    const float off[EI_CLASSIFIER_LABEL_COUNT] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    const float other[EI_CLASSIFIER_LABEL_COUNT] = { 0.0f, 0.0f, 1.0f, 0.0f };
+    ei_impulse_result_t result = { 0 };
+
+    set_result(&result, on, 0.0f);
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "l0") == 0);
+
+    // 1.0 -> 0.5: under enter, over release, stays
+    set_result(&result, off, 0.0f);
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "l0") == 0);
+    // 0.25: released
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "uncertain") == 0);
+    // 0.625 is over release but under enter, not entered again
+    set_result(&result, on, 0.0f);
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "uncertain") == 0);
+    // 0.8125
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "l0") == 0);
+
+    // l2 0 -> 0.5 -> 0.75 -> 0.875 while l0 falls: l0 held, then l2 enters
+    set_result(&result, other, 0.0f);
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "l0") == 0);
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "uncertain") == 0);
+    EI_TEST_CHECK(strcmp(ei_classifier_smooth_update(&smooth, &result), "l2") == 0);
+
+    // release >= enter is plain EMA
+    ei_classifier_smooth_init_ema(&smooth, 0.5f, 0.8f, 1.0f, 0.8f);
+    EI_TEST_CHECK_EQ(smooth.mode, EI_CLASSIFIER_SMOOTH_EMA);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_vote_matches_reference);
+    EI_TEST_RUN(test_vote_starts_uncertain);
+    EI_TEST_RUN(test_ema);
+    EI_TEST_RUN(test_hysteresis);
+
+    return EI_TEST_RESULT();
+}
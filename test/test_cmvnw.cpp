@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_cmvnw.cpp
+ * @brief speechpy::processing::cmvnw (sliding window statistics) against the
+ * mean and variance of every window computed directly, in double
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/dsp/speechpy/speechpy.hpp"
+
+#include <math.h>
+#include <random>
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+// relative to the largest input value (mean) or to the largest output (variance)
+#define TEST_MEAN_TOL               2e-6
+#define TEST_VARIANCE_TOL           1e-4
+
+using namespace ei;
+
+/* Reference --------------------------------------------------------------- */
+
+/**
+ * Feature row of every row of the padded features, from
+ * numpy::pad_1d_symmetric on a column of row numbers
+ */
+static std::vector<size_t> padded_rows(size_t rows, uint16_t pad_before, uint16_t pad_after)
+{
+    matrix_t index(rows, 1);
+    matrix_t padded(rows + pad_before + pad_after, 1);
+    for (size_t ix = 0; ix < rows; ix++) {
+        index.buffer[ix] = (float)ix;
+    }
+    EI_TEST_CHECK_EQ(numpy::pad_1d_symmetric(&index, &padded, pad_before, pad_after), EIDSP_OK);
+
+    std::vector<size_t> out(padded.rows);
+    for (size_t ix = 0; ix < padded.rows; ix++) {
+        out[ix] = (size_t)padded.buffer[ix];
+    }
+    return out;
+}
+
+/* Every window summed on its own, as the previous cmvnw did, in double */
+static std::vector<double> reference_cmvnw(const std::vector<float> &features, size_t rows, size_t cols,
+    uint16_t win_size, bool variance_normalization)
+{
+    // (win_size - 1) / 2 rows before, the rest after: for even windows the
+    // last window reaches one row past the pad_size padding, and cmvnw
+    // carries on reflecting there
+    const uint16_t pad_before = (win_size - 1) / 2;
+    const std::vector<size_t> pad = padded_rows(rows, pad_before, win_size - 1 - pad_before);
+    std::vector<double> src(features.begin(), features.end());
+    std::vector<double> out(src.size());
+
+    for (size_t ix = 0; ix < rows; ix++) {
+        for (size_t col = 0; col < cols; col++) {
+            double mean = 0.0;
+            for (size_t w = 0; w < win_size; w++) {
+                mean += src[pad[ix + w] * cols + col];
+            }
+            out[ix * cols + col] = src[ix * cols + col] - mean / win_size;
+        }
+    }
+    if (!variance_normalization) {
+        return out;
+    }
+
+    src = out;
+    for (size_t ix = 0; ix < rows; ix++) {
+        for (size_t col = 0; col < cols; col++) {
+            double mean = 0.0, m2 = 0.0;
+            for (size_t w = 0; w < win_size; w++) {
+                mean += src[pad[ix + w] * cols + col];
+            }
+            mean /= win_size;
+            for (size_t w = 0; w < win_size; w++) {
+                const double diff = src[pad[ix + w] * cols + col] - mean;
+                m2 += diff * diff;
+            }
+            out[ix * cols + col] = src[ix * cols + col] / (sqrt(m2 / win_size) + 1e-10);
+        }
+    }
+    return out;
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+typedef struct {
+    size_t rows;
+    size_t cols;
+    uint16_t win_size;
+} test_shape_t;
+
+static const test_shape_t shapes[] = {
+    // MFCC block sizes, the window is longer than the input
+    { 99, 13, 301 },
+    { 49, 40, 101 },
+    // several reflections of the input in one window
+    { 10, 4, 301 },
+    { 3, 5, 64 },
+    // shorter windows, the statistics are recomputed every win_size rows
+    { 200, 13, 31 },
+    { 300, 2, 3 },
+    { 97, 7, 8 },
+    { 64, 3, 1 },
+    { 2, 3, 5 },
+};
+
+/**
+ * Cepstrum like features: a per column offset, a slow drift and noise, so
+ * the windows have a large mean next to a small spread
+ */
+static std::vector<float> make_features(size_t rows, size_t cols, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> offset(-300.0f, 300.0f);
+    std::normal_distribution<float> noise(0.0f, 5.0f);
+    std::vector<float> features(rows * cols);
+
+    for (size_t col = 0; col < cols; col++) {
+        const float base = offset(rng);
+        for (size_t ix = 0; ix < rows; ix++) {
+            features[ix * cols + col] = base + 10.0f * sinf(0.05f * ix + col) + noise(rng);
+        }
+    }
+    return features;
+}
+
+static void check_shape(const test_shape_t &shape, bool variance_normalization)
+{
+    const std::vector<float> features = make_features(shape.rows, shape.cols, shape.rows * 31 + shape.win_size);
+    const std::vector<double> expected = reference_cmvnw(features, shape.rows, shape.cols, shape.win_size,
+        variance_normalization);
+
+    std::vector<float> actual = features;
+    matrix_t matrix(shape.rows, shape.cols, actual.data());
+    EI_TEST_CHECK_EQ(speechpy::processing::cmvnw(&matrix, shape.win_size, variance_normalization, false), EIDSP_OK);
+
+    double max_in = 0.0, max_out = 0.0, max_err = 0.0;
+    for (size_t ix = 0; ix < features.size(); ix++) {
+        max_in = fmax(max_in, fabs(features[ix]));
+        max_out = fmax(max_out, fabs(expected[ix]));
+        max_err = fmax(max_err, fabs(matrix.buffer[ix] - expected[ix]));
+    }
+    // mean normalization errors scale with the input, variance normalized
+    // outputs are unitless
+    const double rel_err = variance_normalization ? max_err / max_out : max_err / max_in;
+    const bool within = rel_err <= (variance_normalization ? TEST_VARIANCE_TOL : TEST_MEAN_TOL);
+    if (!within) {
+        printf("  %zux%zu window %u: relative error %g\n", shape.rows, shape.cols, shape.win_size, rel_err);
+    }
+    EI_TEST_CHECK(within);
+}
+
+/* Mean normalization */
+static void test_mean(void)
+{
+    for (const test_shape_t &shape : shapes) {
+        check_shape(shape, false);
+    }
+}
+
+/* Mean and variance normalization */
+static void test_mean_variance(void)
+{
+    for (const test_shape_t &shape : shapes) {
+        if (shape.win_size == 1) {
+            // every window has zero variance
+            continue;
+        }
+        check_shape(shape, true);
+    }
+}
+
+/* A single row: every padded row is that row, so it normalizes to zero */
+static void test_single_row(void)
+{
+    std::vector<float> features = { 12.5f, -3.0f, 0.0f, 250.0f };
+    matrix_t matrix(1, features.size(), features.data());
+    EI_TEST_CHECK_EQ(speechpy::processing::cmvnw(&matrix, 301, false, false), EIDSP_OK);
+
+    double max_err = 0.0;
+    for (size_t col = 0; col < features.size(); col++) {
+        max_err = fmax(max_err, fabs(matrix.buffer[col]));
+    }
+    EI_TEST_CHECK(max_err <= 250.0 * TEST_MEAN_TOL);
+}
+
+/* Padded rows map onto the same feature rows as numpy::pad_1d_symmetric */
+static void test_symmetric_pad_index(void)
+{
+    const size_t rows_list[] = { 1, 2, 3, 7, 99 };
+    const uint16_t pads[] = { 0, 1, 3, 15, 150 };
+    bool same = true;
+
+    for (size_t rows : rows_list) {
+        for (uint16_t pad_size : pads) {
+            const std::vector<size_t> expected = padded_rows(rows, pad_size, pad_size);
+            for (size_t ix = 0; ix < expected.size(); ix++) {
+                const int32_t q = (int32_t)ix - pad_size;
+                if (speechpy::processing::symmetric_pad_index(q, rows) != expected[ix]) {
+                    same = false;
+                }
+            }
+        }
+    }
+    EI_TEST_CHECK(same);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_symmetric_pad_index);
+    EI_TEST_RUN(test_mean);
+    EI_TEST_RUN(test_mean_variance);
+    EI_TEST_RUN(test_single_row);
+
+    return EI_TEST_RESULT();
+}
@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_feature_q15.cpp
+ * @brief speechpy::feature_q15 against exact references and against the float
+ * speechpy::feature, with the error bounds documented on feature_q15
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+
+#include <complex>
+#include <random>
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_FREQUENCY              16000
+#define TEST_SAMPLES                16000
+#define TEST_FRAMES                 99
+#define TEST_SEEDS                  5
+
+/* Bounds, see the feature_q15 class comment */
+#define TEST_LOG2_TOL_Q16           16
+#define TEST_FFT_TOL_LSB            3.0
+#define TEST_MFE_TOL                (4.0f / 256.0f)
+#define TEST_MFCC_TOL               1.6f
+#define TEST_MFCC_MEAN_TOL          0.03f
+#define TEST_MFCC_CMVNW_TOL         0.75f
+
+using namespace ei;
+
+/**
+ * 1 s of voiced speech like audio: harmonics of a gliding pitch under a
+ * syllable rate envelope, with a little background noise, as int16 samples
+ */
+static std::vector<float> speech(uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> noise(0.0f, 30.0f);
+    std::vector<float> samples(TEST_SAMPLES);
+    float phase = 0.0f;
+
+    for (size_t i = 0; i < samples.size(); i++) {
+        const float t = (float)i / TEST_FREQUENCY;
+        const float f0 = 120.0f + 60.0f * sinf(2.0f * (float)M_PI * 1.3f * t + seed);
+        float envelope = 0.5f + 0.5f * sinf(2.0f * (float)M_PI * 3.7f * t + seed);
+        envelope = envelope * envelope * envelope;
+        phase += 2.0f * (float)M_PI * f0 / TEST_FREQUENCY;
+
+        float v = 0.0f;
+        for (int h = 1; h < 20; h++) {
+            v += sinf(h * phase) / h * (h % 3 == 0 ? 0.3f : 1.0f);
+        }
+        v = roundf(8000.0f * envelope * v + noise(rng));
+        samples[i] = v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v);
+    }
+
+    return samples;
+}
+
+static const ei_dsp_config_mfcc_t mfcc_config = {
+    1, 4, 1, 13, 0.02f, 0.01f, 32, 256, 101, 0, 0, 0.98f, 1
+};
+
+static const ei_dsp_config_mfe_t mfe_config = {
+    1, 4, 1, 0.02f, 0.01f, 40, 256, 0, 0, 101, -52
+};
+
+/* Tests ------------------------------------------------------------------- */
+
+static void test_log2_q16(void)
+{
+    std::mt19937_64 rng(1234);
+    int max_err = 0;
+
+    for (int i = 0; i < 100000; i++) {
+        // spread over all magnitudes
+        const uint64_t value = (rng() >> (rng() % 64)) | 1;
+        const int err = abs(speechpy::feature_q15::log2_q16(value) - (int)lround(log2((double)value) * 65536.0));
+        max_err = err > max_err ? err : max_err;
+    }
+    for (int msb = 0; msb < 64; msb++) {
+        EI_TEST_CHECK_EQ(speechpy::feature_q15::log2_q16((uint64_t)1 << msb), msb << 16);
+    }
+
+    std::uniform_real_distribution<float> exponent(-30.0f, 30.0f);
+    for (int i = 0; i < 100000; i++) {
+        const float value = powf(10.0f, exponent(rng));
+        const int err = abs(speechpy::feature_q15::log2_q16(value) - (int)lround(log2((double)value) * 65536.0));
+        max_err = err > max_err ? err : max_err;
+    }
+    // clamped like mfe_normalization
+    EI_TEST_CHECK_EQ(speechpy::feature_q15::log2_q16(0.0f), speechpy::feature_q15::log2_q16(1e-30f));
+
+    printf("  max error %d Q16 LSB\n", max_err);
+    EI_TEST_CHECK(max_err <= TEST_LOG2_TOL_Q16);
+}
+
+/**
+ * The q15 power spectrum against an exact DFT of the same q15 input: the
+ * frame is brought to q15 with its block exponent, output is X / N
+ */
+static void test_power_spectrum_vs_exact_dft(void)
+{
+    for (uint16_t n_fft : { 32, 256, 512, 1024 }) {
+        std::vector<float> samples = speech(n_fft);
+        const size_t offset = 4000;
+        double max_err = 0.0;
+
+        signal_t signal;
+        numpy::signal_from_buffer(samples.data(), samples.size(), &signal);
+
+        speechpy::q15_detail::mel_q15 engine(n_fft);
+        EI_TEST_CHECK_EQ(engine.init(), EIDSP_OK);
+        int shift = 0;
+        EI_TEST_CHECK_EQ(engine.power_spectrum(&signal, offset, n_fft, &shift), EIDSP_OK);
+        const uint32_t *power = engine.power_buffer();
+
+        float max_abs = 0.0f;
+        for (size_t i = 0; i < n_fft; i++) {
+            max_abs = fmaxf(max_abs, fabsf(samples[offset + i]));
+        }
+        int exponent = 0;
+        frexpf(max_abs, &exponent);
+
+        double peak = 0.0, peak_expected = 0.0;
+        for (size_t k = 0; k <= n_fft / 2U; k++) {
+            std::complex<double> x = 0.0;
+            for (size_t i = 0; i < n_fft; i++) {
+                const double q = round(ldexp(samples[offset + i], 15 - exponent));
+                x += q * std::polar(1.0, -2.0 * M_PI * (double)(k * i) / n_fft);
+            }
+            x /= (double)n_fft;
+
+            const double err = fabs(sqrt((double)power[k]) - std::abs(x));
+            max_err = err > max_err ? err : max_err;
+
+            // the exponent brings the spectrum back to |X|^2 / N of the input
+            if (std::norm(x) > peak_expected) {
+                peak_expected = std::norm(x);
+                peak = (double)power[k];
+            }
+        }
+        const double peak_input = peak_expected * n_fft * ldexp(1.0, 2 * exponent - 30);
+        EI_TEST_CHECK_NEAR(ldexp(peak, shift) / peak_input, 1.0, 0.01);
+
+        printf("  N %4u: max error %.2f LSB\n", n_fft, max_err);
+        EI_TEST_CHECK(max_err <= TEST_FFT_TOL_LSB);
+    }
+}
+
+static void test_mfe_normalization(void)
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> exponent(-12.0f, 12.0f);
+    matrix_t expected(1, 10000);
+    matrix_t actual(1, 10000);
+    float max_err = 0.0f;
+
+    for (size_t i = 0; i < expected.cols; i++) {
+        expected.buffer[i] = actual.buffer[i] = powf(10.0f, exponent(rng));
+    }
+    expected.buffer[0] = actual.buffer[0] = 0.0f;
+
+    EI_TEST_CHECK_EQ(speechpy::processing::mfe_normalization(&expected, -52), EIDSP_OK);
+    EI_TEST_CHECK_EQ(speechpy::feature_q15::mfe_normalization(&actual, -52), EIDSP_OK);
+    for (size_t i = 0; i < expected.cols; i++) {
+        max_err = fmaxf(max_err, fabsf(expected.buffer[i] - actual.buffer[i]));
+    }
+
+    printf("  max error %g\n", max_err);
+    // one quantization step where the table rounds across a boundary
+    EI_TEST_CHECK(max_err <= 1.0f / 256.0f);
+}
+
+static void test_mfe_matches_float(void)
+{
+    const size_t n_features = TEST_FRAMES * mfe_config.num_filters;
+    float max_err = 0.0f;
+
+    for (uint32_t seed = 1; seed <= TEST_SEEDS; seed++) {
+        std::vector<float> samples = speech(seed);
+        signal_t signal;
+        numpy::signal_from_buffer(samples.data(), samples.size(), &signal);
+
+        matrix_t expected(1, n_features);
+        matrix_t actual(1, n_features);
+        ei_dsp_config_mfe_t config = mfe_config;
+        EI_TEST_CHECK_EQ(extract_mfe_features(&signal, &expected, &config, TEST_FREQUENCY), EIDSP_OK);
+        EI_TEST_CHECK_EQ(extract_mfe_q15_features(&signal, &actual, &config, TEST_FREQUENCY), EIDSP_OK);
+
+        for (size_t i = 0; i < n_features; i++) {
+            max_err = fmaxf(max_err, fabsf(expected.buffer[i] - actual.buffer[i]));
+        }
+    }
+
+    printf("  max error %g (%g steps)\n", max_err, max_err * 256.0f);
+    EI_TEST_CHECK(max_err <= TEST_MFE_TOL);
+}
+
+/**
+ * Coefficients straight out of mfcc(), then through the block with cmvnw
+ */
+static void test_mfcc_matches_float(void)
+{
+    const size_t n_cepstral = mfcc_config.num_cepstral;
+    const size_t n_features = TEST_FRAMES * n_cepstral;
+    float max_err = 0.0f;
+    float max_cmvnw_err = 0.0f;
+    double sum_err = 0.0;
+
+    for (uint32_t seed = 1; seed <= TEST_SEEDS; seed++) {
+        std::vector<float> samples = speech(seed);
+        signal_t signal;
+        numpy::signal_from_buffer(samples.data(), samples.size(), &signal);
+
+        matrix_t expected(TEST_FRAMES, n_cepstral);
+        matrix_t actual(TEST_FRAMES, n_cepstral);
+        EI_TEST_CHECK_EQ(speechpy::feature::mfcc(&expected, &signal, TEST_FREQUENCY,
+            mfcc_config.frame_length, mfcc_config.frame_stride, n_cepstral, mfcc_config.num_filters,
+            mfcc_config.fft_length, 0, 0, true, mfcc_config.implementation_version), EIDSP_OK);
+        EI_TEST_CHECK_EQ(speechpy::feature_q15::mfcc(&actual, &signal, TEST_FREQUENCY,
+            mfcc_config.frame_length, mfcc_config.frame_stride, n_cepstral, mfcc_config.num_filters,
+            mfcc_config.fft_length, 0, 0, true, mfcc_config.implementation_version), EIDSP_OK);
+
+        for (size_t i = 0; i < n_features; i++) {
+            const float err = fabsf(expected.buffer[i] - actual.buffer[i]);
+            max_err = fmaxf(max_err, err);
+            sum_err += err;
+        }
+
+        matrix_t expected_block(1, n_features);
+        matrix_t actual_block(1, n_features);
+        ei_dsp_config_mfcc_t config = mfcc_config;
+        EI_TEST_CHECK_EQ(extract_mfcc_features(&signal, &expected_block, &config, TEST_FREQUENCY), EIDSP_OK);
+        EI_TEST_CHECK_EQ(extract_mfcc_q15_features(&signal, &actual_block, &config, TEST_FREQUENCY), EIDSP_OK);
+
+        for (size_t i = 0; i < n_features; i++) {
+            max_cmvnw_err = fmaxf(max_cmvnw_err, fabsf(expected_block.buffer[i] - actual_block.buffer[i]));
+        }
+    }
+
+    const float mean_err = (float)(sum_err / (TEST_SEEDS * n_features));
+    printf("  max error %g, mean %g, after cmvnw %g\n", max_err, mean_err, max_cmvnw_err);
+    EI_TEST_CHECK(max_err <= TEST_MFCC_TOL);
+    EI_TEST_CHECK(mean_err <= TEST_MFCC_MEAN_TOL);
+    EI_TEST_CHECK(max_cmvnw_err <= TEST_MFCC_CMVNW_TOL);
+}
+
+/* Silence and a frame running past the end of the signal */
+static void test_silence_and_padding(void)
+{
+    std::vector<float> samples(TEST_SAMPLES, 0.0f);
+    signal_t signal;
+    numpy::signal_from_buffer(samples.data(), samples.size(), &signal);
+
+    matrix_t out(TEST_FRAMES, mfe_config.num_filters);
+    matrix_t energies(TEST_FRAMES, 1);
+    EI_TEST_CHECK_EQ(speechpy::feature_q15::mfe(&out, &energies, &signal, TEST_FREQUENCY, 0.02f, 0.01f,
+        mfe_config.num_filters, 256, 0, 0, 4), EIDSP_OK);
+    for (size_t i = 0; i < out.rows * out.cols; i++) {
+        EI_TEST_CHECK_EQ(out.buffer[i] == 1e-10f, true);
+    }
+    EI_TEST_CHECK_EQ(energies.buffer[0] == 1e-10f, true);
+
+    // a 512 point frame of 320 samples is zero padded, same as the float path
+    std::vector<float> tone(TEST_SAMPLES);
+    for (size_t i = 0; i < tone.size(); i++) {
+        tone[i] = 10000.0f * sinf(2.0f * (float)M_PI * 1000.0f * i / TEST_FREQUENCY);
+    }
+    numpy::signal_from_buffer(tone.data(), tone.size(), &signal);
+    matrix_t expected(TEST_FRAMES, mfe_config.num_filters);
+    EI_TEST_CHECK_EQ(speechpy::feature::mfe(&expected, nullptr, &signal, TEST_FREQUENCY, 0.02f, 0.01f,
+        mfe_config.num_filters, 512, 0, 0, 4), EIDSP_OK);
+    EI_TEST_CHECK_EQ(speechpy::feature_q15::mfe(&out, nullptr, &signal, TEST_FREQUENCY, 0.02f, 0.01f,
+        mfe_config.num_filters, 512, 0, 0, 4), EIDSP_OK);
+
+    // the band holding the tone
+    size_t peak = 0;
+    for (size_t i = 0; i < out.cols; i++) {
+        peak = expected.buffer[i] > expected.buffer[peak] ? i : peak;
+    }
+    for (size_t row = 0; row < out.rows; row++) {
+        const float e = expected.get_row_ptr(row)[peak];
+        EI_TEST_CHECK_NEAR(out.get_row_ptr(row)[peak], e, 0.01f * e);
+    }
+}
+
+/* FFT lengths the q15 engine doesn't take go through speechpy::feature */
+static void test_unsupported_length_falls_back(void)
+{
+    std::vector<float> samples = speech(7);
+    signal_t signal;
+    numpy::signal_from_buffer(samples.data(), samples.size(), &signal);
+
+    const size_t frames = 124;
+    matrix_t expected(frames, mfe_config.num_filters);
+    matrix_t actual(frames, mfe_config.num_filters);
+    EI_TEST_CHECK_EQ(speechpy::feature::mfe(&expected, nullptr, &signal, TEST_FREQUENCY, 0.0125f, 0.008f,
+        mfe_config.num_filters, 200, 0, 0, 4), EIDSP_OK);
+    EI_TEST_CHECK_EQ(speechpy::feature_q15::mfe(&actual, nullptr, &signal, TEST_FREQUENCY, 0.0125f, 0.008f,
+        mfe_config.num_filters, 200, 0, 0, 4), EIDSP_OK);
+    EI_TEST_CHECK(memcmp(expected.buffer, actual.buffer, frames * mfe_config.num_filters * sizeof(float)) == 0);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_log2_q16);
+    EI_TEST_RUN(test_power_spectrum_vs_exact_dft);
+    EI_TEST_RUN(test_mfe_normalization);
+    EI_TEST_RUN(test_mfe_matches_float);
+    EI_TEST_RUN(test_mfcc_matches_float);
+    EI_TEST_RUN(test_silence_and_padding);
+    EI_TEST_RUN(test_unsupported_length_falls_back);
+
+    return EI_TEST_RESULT();
+}
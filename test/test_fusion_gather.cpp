@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_fusion_gather.cpp
+ * @brief the fusion gather table against the per axis flag walk it replaced
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "ei_fusion.h"
+#include "ei_device_info_lib.h"
+#include "ei_sampler.h"
+
+#include <vector>
+
+/* Mocks ------------------------------------------------------------------- */
+extern std::vector<ei_device_fusion_sensor_t> fusable_sensor_list;
+
+class TestDevice : public EiDeviceInfo {
+public:
+    void init_device_id(void) override {}
+    bool start_sample_thread(void (*sample_read_cb)(void), float sample_interval_ms) override
+    {
+        (void)sample_read_cb;
+        (void)sample_interval_ms;
+        return true;
+    }
+    bool stop_sample_thread(void) override { return true; }
+};
+
+static TestDevice test_device;
+
+EiDeviceInfo *EiDeviceInfo::get_device(void)
+{
+    return &test_device;
+}
+
+bool ei_sampler_start_sampling(void *v_ptr_payload, starter_callback ei_sample_start, uint32_t sample_size)
+{
+    (void)v_ptr_payload;
+    (void)ei_sample_start;
+    (void)sample_size;
+    return false;
+}
+
+/* Every axis reads 1000 * tick + 100 * sensor + axis */
+static int tick;
+static bool sensor_silent[3];
+static fusion_sample_format_t sensor_values[3][EI_MAX_SENSOR_AXES];
+
+template<int SENSOR>
+static fusion_sample_format_t *read_sensor(int n_samples)
+{
+    if (sensor_silent[SENSOR]) {
+        return nullptr;
+    }
+    for (int j = 0; j < n_samples; j++) {
+        sensor_values[SENSOR][j] = (fusion_sample_format_t)(1000 * tick + 100 * SENSOR + j);
+    }
+    return sensor_values[SENSOR];
+}
+
+static std::vector<fusion_sample_format_t> last_frame;
+
+static bool sampler(const void *sample_buf, uint32_t byteLenght)
+{
+    const fusion_sample_format_t *frame = (const fusion_sample_format_t *)sample_buf;
+    if (frame) {
+        last_frame.assign(frame, frame + byteLenght / sizeof(fusion_sample_format_t));
+    }
+    return false;
+}
+
+static void register_sensors(void)
+{
+    const char *inertial[] = { "accX", "accY", "accZ", "gyrX", "gyrY", "gyrZ", "magX", "magY", "magZ" };
+    const char *environmental[] = { "temperature", "humidity", "pressure" };
+    const char *interaction[] = { "red", "green", "blue", "proximity" };
+    ei_device_fusion_sensor_t sensor;
+
+    memset(&sensor, 0, sizeof(sensor));
+    sensor.name = "Inertial";
+    sensor.num_axis = 9;
+    sensor.frequencies[0] = 100.0f;
+    for (int i = 0; i < 9; i++) {
+        sensor.sensors[i] = { inertial[i], "m/s2" };
+    }
+    sensor.read_data = &read_sensor<0>;
+    ei_add_sensor_to_fusion_list(sensor);
+
+    memset(&sensor, 0, sizeof(sensor));
+    sensor.name = "Environmental";
+    sensor.num_axis = 3;
+    sensor.frequencies[0] = 12.5f;
+    for (int i = 0; i < 3; i++) {
+        sensor.sensors[i] = { environmental[i], "unit" };
+    }
+    sensor.read_data = &read_sensor<1>;
+    ei_add_sensor_to_fusion_list(sensor);
+
+    memset(&sensor, 0, sizeof(sensor));
+    sensor.name = "Interaction";
+    sensor.num_axis = 4;
+    sensor.frequencies[0] = 12.5f;
+    for (int i = 0; i < 4; i++) {
+        sensor.sensors[i] = { interaction[i], "unit" };
+    }
+    sensor.read_data = &read_sensor<2>;
+    ei_add_sensor_to_fusion_list(sensor);
+}
+
+/**
+ * The gather the table replaced: walk every axis of every fused sensor, in
+ * fusion order, and keep the ones flagged in axis_flag_used
+ */
+static std::vector<fusion_sample_format_t> reference_frame(const std::vector<int> &order, uint8_t flag_read,
+    const std::vector<fusion_sample_format_t> &previous)
+{
+    std::vector<fusion_sample_format_t> frame;
+    size_t loc = 0;
+
+    for (size_t i = 0; i < order.size(); i++) {
+        const ei_device_fusion_sensor_t &s = fusable_sensor_list[order[i]];
+        fusion_sample_format_t *data = nullptr;
+        if (flag_read & (1 << i)) {
+            data = s.read_data(s.num_axis);
+        }
+        for (int j = 0; j < s.num_axis; j++) {
+            if (s.axis_flag_used & (1 << j)) {
+                if (data) {
+                    frame.push_back(data[j]);
+                }
+                else {
+                    frame.push_back(loc < previous.size() ? previous[loc] : 0);
+                }
+                loc++;
+            }
+        }
+    }
+
+    return frame;
+}
+
+/* Tests ------------------------------------------------------------------- */
+static void check_single_frequency(const char *list, ei_fusion_list_format format, const std::vector<int> &order,
+    size_t expected_axes)
+{
+    EI_TEST_CHECK(ei_connect_fusion_list(list, format));
+    // connects the sampler, only starts the thread for a single sensor
+    ei_fusion_sample_start(&sampler, 10.0f);
+
+    for (tick = 1; tick < 4; tick++) {
+        last_frame.clear();
+        ei_fusion_read_axis_data();
+        std::vector<fusion_sample_format_t> expected = reference_frame(order, 0xff, {});
+        EI_TEST_CHECK_EQ(last_frame.size(), expected_axes);
+        EI_TEST_CHECK(last_frame == expected);
+    }
+}
+
+static void test_full_sensors_keep_axis_order(void)
+{
+    check_single_frequency("Inertial + Environmental", SENSOR_FORMAT, { 0, 1 }, 12);
+    check_single_frequency("Interaction + Inertial", SENSOR_FORMAT, { 2, 0 }, 13);
+}
+
+static void test_selected_axes_keep_axis_order(void)
+{
+    // axes out of order in the list still come out in sensor axis order
+    check_single_frequency("gyrY + accX + magZ + pressure + temperature", AXIS_FORMAT, { 0, 1 }, 5);
+    check_single_frequency("humidity + proximity + green + accZ", AXIS_FORMAT, { 1, 2, 0 }, 4);
+}
+
+static void test_missing_sensor_data_is_zero_filled(void)
+{
+    EI_TEST_CHECK(ei_connect_fusion_list("accY + humidity + magX", AXIS_FORMAT));
+    // connects the sampler, only starts the thread for a single sensor
+    ei_fusion_sample_start(&sampler, 10.0f);
+
+    tick = 7;
+    sensor_silent[1] = true;
+    ei_fusion_read_axis_data();
+    sensor_silent[1] = false;
+
+    std::vector<fusion_sample_format_t> expected = { 7001, 7006, 0 };
+    EI_TEST_CHECK(last_frame == expected);
+}
+
+#if MULTI_FREQ_ENABLED == 1
+/* A sensor that is not sampled on a tick keeps its previous values */
+static void test_multi_frequency_holds_last_value(void)
+{
+    const std::vector<int> order = { 0, 1, 2 };
+    const uint8_t flags[] = { 0x07, 0x01, 0x03, 0x05, 0x01, 0x07 };
+    std::vector<fusion_sample_format_t> previous;
+
+    EI_TEST_CHECK(ei_connect_fusion_list("accX + gyrZ + temperature + pressure + blue", AXIS_FORMAT));
+    // connects the sampler, only starts the thread for a single sensor
+    ei_fusion_sample_start(&sampler, 10.0f);
+
+    for (tick = 0; tick < (int)sizeof(flags); tick++) {
+        ei_fusion_multi_read_axis_data(flags[tick]);
+        std::vector<fusion_sample_format_t> expected = reference_frame(order, flags[tick], previous);
+        EI_TEST_CHECK_EQ(last_frame.size(), 5);
+        EI_TEST_CHECK(last_frame == expected);
+        previous = expected;
+    }
+}
+#endif
+
+int main(void)
+{
+    register_sensors();
+
+    EI_TEST_RUN(test_full_sensors_keep_axis_order);
+    EI_TEST_RUN(test_selected_axes_keep_axis_order);
+    EI_TEST_RUN(test_missing_sensor_data_is_zero_filled);
+#if MULTI_FREQ_ENABLED == 1
+    EI_TEST_RUN(test_multi_frequency_holds_last_value);
+#endif
+
+    return EI_TEST_RESULT();
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_greedy_memory_planner.cpp
+ * @brief GreedyMemoryPlanner against a plain linear scan planner
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/tensorflow/lite/micro/memory_planner/greedy_memory_planner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace tflite {
+// greedy_memory_planner.cc, not in the header
+void ReverseSort(int* values, int* ids, int size, int* values_scratch, int* ids_scratch);
+}
+
+/* Reference --------------------------------------------------------------- */
+
+typedef struct {
+    int size;
+    int first_time_used;
+    int last_time_used;
+    int offline_offset;
+} test_buffer_t;
+
+/**
+ * The greedy algorithm as it was before the interval index: offline buffers
+ * first, then the online ones by descending size (stable, over the reverse
+ * order they were added in), each placed in the first gap of a linear scan
+ * over all placed buffers ordered by offset.
+ */
+static std::vector<int> reference_plan(const std::vector<test_buffer_t> &buffers)
+{
+    std::vector<int> order;
+    std::vector<int> online;
+    std::vector<int> offsets(buffers.size(), -1);
+
+    for (size_t i = 0; i < buffers.size(); i++) {
+        if (buffers[i].offline_offset == tflite::kOnlinePlannedBuffer) {
+            online.insert(online.begin(), (int)i);
+        }
+        else {
+            order.push_back((int)i);
+        }
+    }
+    std::stable_sort(online.begin(), online.end(), [&](int a, int b) {
+        return buffers[a].size > buffers[b].size;
+    });
+    order.insert(order.end(), online.begin(), online.end());
+
+    std::vector<int> placed;
+    for (int id : order) {
+        const test_buffer_t &wanted = buffers[id];
+        int candidate = 0;
+
+        if (wanted.offline_offset == tflite::kOnlinePlannedBuffer) {
+            for (int other : placed) {
+                const test_buffer_t &b = buffers[other];
+                if (b.first_time_used > wanted.last_time_used || wanted.first_time_used > b.last_time_used) {
+                    continue;
+                }
+                if (offsets[other] - candidate >= wanted.size) {
+                    break;
+                }
+                candidate = std::max(candidate, offsets[other] + b.size);
+            }
+        }
+        else {
+            candidate = wanted.offline_offset;
+        }
+
+        offsets[id] = candidate;
+        placed.insert(
+            std::upper_bound(placed.begin(), placed.end(), candidate, [&](int offset, int other) {
+                return offset < offsets[other];
+            }),
+            id);
+    }
+
+    return offsets;
+}
+
+static size_t reference_arena(const std::vector<test_buffer_t> &buffers, const std::vector<int> &offsets)
+{
+    size_t arena = 0;
+
+    for (size_t i = 0; i < buffers.size(); i++) {
+        arena = std::max(arena, (size_t)(offsets[i] + buffers[i].size));
+    }
+
+    return arena;
+}
+
+/**
+ * Random lifetimes: mostly short lived buffers, and one in long_lived_one_in
+ * that lives for up to long_lived_steps. Sizes have plenty of duplicates.
+ */
+static std::vector<test_buffer_t> random_buffers(std::mt19937 &rng, int count, int offline_count,
+    int long_lived_one_in = 8, int long_lived_steps = 0)
+{
+    std::vector<test_buffer_t> buffers;
+    const int steps = count / 2 + 1;
+    int offline_end = 0;
+
+    if (long_lived_steps == 0) {
+        long_lived_steps = steps;
+    }
+
+    for (int i = 0; i < count; i++) {
+        test_buffer_t b;
+        b.first_time_used = (int)(rng() % steps);
+        b.last_time_used = b.first_time_used +
+            (rng() % long_lived_one_in == 0 ? (int)(rng() % long_lived_steps) : (int)(rng() % 3));
+        b.size = 16 * (1 + (int)(rng() % 64));
+        b.offline_offset = tflite::kOnlinePlannedBuffer;
+        if (i < offline_count) {
+            b.offline_offset = offline_end;
+            offline_end += b.size;
+        }
+        buffers.push_back(b);
+    }
+
+    return buffers;
+}
+
+static bool plan(tflite::GreedyMemoryPlanner &planner, std::vector<unsigned char> &scratch,
+    const std::vector<test_buffer_t> &buffers)
+{
+    scratch.assign(buffers.size() * tflite::GreedyMemoryPlanner::per_buffer_size(), 0);
+    planner.Init(scratch.data(), (int)scratch.size());
+
+    for (const test_buffer_t &b : buffers) {
+        TfLiteStatus res = b.offline_offset == tflite::kOnlinePlannedBuffer ?
+            planner.AddBuffer(b.size, b.first_time_used, b.last_time_used) :
+            planner.AddBuffer(b.size, b.first_time_used, b.last_time_used, b.offline_offset);
+        if (res != kTfLiteOk) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+static void test_matches_linear_scan(void)
+{
+    std::mt19937 rng(1234);
+    const int counts[] = { 1, 2, 3, 17, 64, 100, 333 };
+
+    for (int count : counts) {
+        for (int offline_count : { 0, count / 4 }) {
+            for (int round = 0; round < 20; round++) {
+                std::vector<test_buffer_t> buffers = random_buffers(rng, count, offline_count);
+                std::vector<int> expected = reference_plan(buffers);
+                std::vector<unsigned char> scratch;
+                tflite::GreedyMemoryPlanner planner;
+
+                EI_TEST_CHECK(plan(planner, scratch, buffers));
+
+                for (int i = 0; i < count; i++) {
+                    int offset = -1;
+                    EI_TEST_CHECK(planner.GetOffsetForBuffer(i, &offset) == kTfLiteOk);
+                    if (offset != expected[i]) {
+                        printf("count %d offline %d round %d buffer %d\n", count, offline_count, round, i);
+                        EI_TEST_CHECK_EQ(offset, expected[i]);
+                        return;
+                    }
+                }
+                EI_TEST_CHECK_EQ(planner.GetMaximumMemorySize(), reference_arena(buffers, expected));
+                if (offline_count == 0) {
+                    EI_TEST_CHECK(!planner.DoAnyBuffersOverlap());
+                }
+            }
+        }
+    }
+}
+
+/* Same order as std::stable_sort, for sizes around the insertion sort block
+ * and merge widths, with many equal values */
+static void test_reverse_sort(void)
+{
+    std::mt19937 rng(7);
+    bool same = true;
+
+    for (int size : { 0, 1, 2, 15, 16, 17, 31, 32, 33, 100, 1000, 4097 }) {
+        std::vector<int> values(size), ids(size);
+        for (int i = 0; i < size; i++) {
+            values[i] = (int)(rng() % 20) - 10;
+            ids[i] = i;
+        }
+        std::vector<int> expected(ids);
+        std::stable_sort(expected.begin(), expected.end(), [&](int a, int b) {
+            return values[a] > values[b];
+        });
+
+        std::vector<int> values_scratch(size), ids_scratch(size);
+        tflite::ReverseSort(values.data(), ids.data(), size, values_scratch.data(), ids_scratch.data());
+
+        for (int i = 0; i < size; i++) {
+            if (ids[i] != expected[i] || (i > 0 && values[i] > values[i - 1])) {
+                same = false;
+            }
+        }
+    }
+    EI_TEST_CHECK(same);
+}
+
+static void test_scratch_size(void)
+{
+    std::vector<unsigned char> scratch(4 * tflite::GreedyMemoryPlanner::per_buffer_size());
+    tflite::GreedyMemoryPlanner planner;
+
+    planner.Init(scratch.data(), (int)scratch.size());
+    for (int i = 0; i < 4; i++) {
+        EI_TEST_CHECK(planner.AddBuffer(100, i, i + 1) == kTfLiteOk);
+    }
+    EI_TEST_CHECK(planner.AddBuffer(100, 0, 1) == kTfLiteError);
+    // neighbours in time alternate between two slots
+    EI_TEST_CHECK_EQ(planner.GetMaximumMemorySize(), 200);
+}
+
+/**
+ * Not a pass/fail check, prints how planning time grows with the graph size.
+ * Graph like: activations live for a few steps, one in 32 is a skip
+ * connection living for up to 64 steps. Dense: one in 8 buffers lives for
+ * up to the whole graph, so most buffers overlap a lot of others.
+ */
+static void benchmark(const char *name, int long_lived_one_in, int long_lived_steps)
+{
+    std::mt19937 rng(42);
+
+    printf("  %s\n", name);
+    for (int count : { 1000, 4000, 16000 }) {
+        std::vector<test_buffer_t> buffers = random_buffers(rng, count, 0, long_lived_one_in, long_lived_steps);
+        std::vector<unsigned char> scratch;
+        tflite::GreedyMemoryPlanner planner;
+
+        EI_TEST_CHECK(plan(planner, scratch, buffers));
+        auto start = std::chrono::steady_clock::now();
+        size_t arena = planner.GetMaximumMemorySize();
+        auto planner_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        std::vector<int> expected = reference_plan(buffers);
+        auto reference_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+        EI_TEST_CHECK_EQ(arena, reference_arena(buffers, expected));
+        printf("    %5d buffers: %8lld us (linear scan %8lld us), arena %zu\n",
+            count, (long long)planner_us, (long long)reference_us, arena);
+    }
+}
+
+static void test_benchmark(void)
+{
+    benchmark("graph like", 32, 64);
+    benchmark("dense", 8, 0);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_matches_linear_scan);
+    EI_TEST_RUN(test_reverse_sort);
+    EI_TEST_RUN(test_scratch_size);
+    EI_TEST_RUN(test_benchmark);
+
+    return EI_TEST_RESULT();
+}
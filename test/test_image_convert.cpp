@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_image_convert.cpp
+ * @brief ei::image::convert, every pixel format and scaling, bit for bit
+ * against the per pixel code it replaced
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/dsp/image/convert.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_RANDOM_PIXELS          4096
+
+using namespace ei;
+using namespace ei::image::convert;
+
+/* Reference --------------------------------------------------------------- */
+
+typedef enum {
+    MODE_0_1 = 0,
+    MODE_0_255,
+    MODE_TORCH,
+    MODE_MIN1_1,
+    MODE_MIN128_127,
+    MODE_BGR_SUBTRACT_IMAGENET_MEAN,
+} test_mode_t;
+
+typedef struct {
+    test_mode_t mode;
+    const pixel_scaling_t *scaling;
+    // input tensor quantization covering the scaled range
+    float scale;
+    float zero_point;
+} test_scaling_t;
+
+static const test_scaling_t scalings[] = {
+    { MODE_0_1, &SCALING_0_1, 0.003921568859368563f, -128 },
+    { MODE_0_255, &SCALING_0_255, 1.0f, -128 },
+    { MODE_TORCH, &SCALING_TORCH, 0.019f, -12 },
+    { MODE_MIN1_1, &SCALING_MIN1_1, 1.0f / 127.0f, 0 },
+    { MODE_MIN128_127, &SCALING_MIN128_127, 1.0f, 0 },
+    { MODE_BGR_SUBTRACT_IMAGENET_MEAN, &SCALING_BGR_SUBTRACT_IMAGENET_MEAN, 1.1f, -10 },
+};
+
+/**
+ * One pixel scaled as the previous per pixel code did it (extract_image_features
+ * for 0..1, extract_image_features_quantized for TORCH and MIN128_127), and as
+ * defined for the modes it didn't have
+ */
+static void reference_scale(test_mode_t mode, int32_t r, int32_t g, int32_t b, float out[3])
+{
+    static const float torch_mean[] = { 0.485, 0.456, 0.406 };
+    static const float torch_std[] = { 0.229, 0.224, 0.225 };
+    float rf = static_cast<float>(r);
+    float gf = static_cast<float>(g);
+    float bf = static_cast<float>(b);
+
+    switch (mode) {
+        case MODE_0_1:
+            out[0] = rf / 255.0f;
+            out[1] = gf / 255.0f;
+            out[2] = bf / 255.0f;
+            break;
+        case MODE_0_255:
+            out[0] = rf;
+            out[1] = gf;
+            out[2] = bf;
+            break;
+        case MODE_TORCH:
+            rf /= 255.0f;
+            gf /= 255.0f;
+            bf /= 255.0f;
+            out[0] = (rf - torch_mean[0]) / torch_std[0];
+            out[1] = (gf - torch_mean[1]) / torch_std[1];
+            out[2] = (bf - torch_mean[2]) / torch_std[2];
+            break;
+        case MODE_MIN1_1:
+            out[0] = rf / 127.5f - 1.0f;
+            out[1] = gf / 127.5f - 1.0f;
+            out[2] = bf / 127.5f - 1.0f;
+            break;
+        case MODE_MIN128_127:
+            out[0] = rf - 128.0f;
+            out[1] = gf - 128.0f;
+            out[2] = bf - 128.0f;
+            break;
+        case MODE_BGR_SUBTRACT_IMAGENET_MEAN:
+            // red, green, blue here, swapped by the caller
+            out[0] = rf - 123.68f;
+            out[1] = gf - 116.779f;
+            out[2] = bf - 103.939f;
+            break;
+    }
+}
+
+/* Features of one pixel, 1 or 3 values */
+static size_t reference_features(test_mode_t mode, bool grayscale, int32_t r, int32_t g, int32_t b, float *out)
+{
+    float rgb[3];
+    reference_scale(mode, r, g, b, rgb);
+
+    if (grayscale) {
+        // ITU-R 601-2 luma transform
+        out[0] = (0.299f * rgb[0]) + (0.587f * rgb[1]) + (0.114f * rgb[2]);
+        return 1;
+    }
+    if (mode == MODE_BGR_SUBTRACT_IMAGENET_MEAN) {
+        out[0] = rgb[2];
+        out[1] = rgb[1];
+        out[2] = rgb[0];
+    }
+    else {
+        out[0] = rgb[0];
+        out[1] = rgb[1];
+        out[2] = rgb[2];
+    }
+    return 3;
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+typedef struct {
+    PIXEL_FORMAT format;
+    std::vector<uint8_t> raw;
+    std::vector<float> packed;
+    // expected channels of every pixel
+    std::vector<int32_t> r, g, b;
+
+    const void *src() const {
+        return format == FORMAT_PACKED ? static_cast<const void *>(packed.data()) : raw.data();
+    }
+    size_t pixels() const {
+        return r.size();
+    }
+} test_image_t;
+
+static void add_pixel(test_image_t *image, int32_t r, int32_t g, int32_t b)
+{
+    image->r.push_back(r);
+    image->g.push_back(g);
+    image->b.push_back(b);
+}
+
+/**
+ * Every RGB565 and grayscale value, random RGB888 and packed pixels. The
+ * channels of RGB565 come from the previous camera cutout code.
+ */
+static test_image_t make_image(PIXEL_FORMAT format)
+{
+    test_image_t image;
+    image.format = format;
+    srand(format + 1);
+
+    switch (format) {
+        case FORMAT_RGB565_BE:
+            for (uint32_t v = 0; v <= 0xffff; v++) {
+                image.raw.push_back((uint8_t)(v >> 8));
+                image.raw.push_back((uint8_t)(v & 0xff));
+                uint16_t pixel = (image.raw[v * 2] << 8) | image.raw[v * 2 + 1];
+                uint8_t r, g, b;
+                r = ((pixel >> 11) & 0x1f) << 3;
+                g = ((pixel >> 5) & 0x3f) << 2;
+                b = (pixel & 0x1f) << 3;
+                add_pixel(&image, r, g, b);
+            }
+            break;
+        case FORMAT_RGB888:
+            for (int ix = 0; ix < TEST_RANDOM_PIXELS; ix++) {
+                uint8_t rgb[3] = { (uint8_t)rand(), (uint8_t)rand(), (uint8_t)rand() };
+                image.raw.insert(image.raw.end(), rgb, rgb + 3);
+                add_pixel(&image, rgb[0], rgb[1], rgb[2]);
+            }
+            break;
+        case FORMAT_GRAYSCALE:
+            for (int v = 0; v < 256; v++) {
+                image.raw.push_back((uint8_t)v);
+                add_pixel(&image, v, v, v);
+            }
+            break;
+        case FORMAT_PACKED:
+            for (int ix = 0; ix < TEST_RANDOM_PIXELS; ix++) {
+                uint32_t pixel = rand() & 0xffffff;
+                image.packed.push_back((float)pixel);
+                add_pixel(&image, pixel >> 16 & 0xff, pixel >> 8 & 0xff, pixel & 0xff);
+            }
+            break;
+    }
+    return image;
+}
+
+static const PIXEL_FORMAT formats[] = {
+    FORMAT_PACKED, FORMAT_RGB565_BE, FORMAT_RGB888, FORMAT_GRAYSCALE
+};
+
+/* Packed features, as (r << 16) + (g << 8) + b */
+static void test_to_packed(void)
+{
+    for (PIXEL_FORMAT format : formats) {
+        test_image_t image = make_image(format);
+        std::vector<float> actual(image.pixels());
+
+        int res = to_packed(image.raw.data(), format, image.pixels(), actual.data());
+        if (format == FORMAT_PACKED) {
+            EI_TEST_CHECK_EQ(res, EIDSP_PARAMETER_INVALID);
+            continue;
+        }
+        EI_TEST_CHECK_EQ(res, EIDSP_OK);
+
+        std::vector<float> expected(image.pixels());
+        for (size_t ix = 0; ix < image.pixels(); ix++) {
+            expected[ix] = (image.r[ix] << 16) + (image.g[ix] << 8) + image.b[ix];
+        }
+        bool same = memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)) == 0;
+        if (!same) {
+            printf("  format %d differs\n", format);
+        }
+        EI_TEST_CHECK(same);
+    }
+}
+
+/* Float features, every format, scaling, RGB and grayscale */
+static void test_to_float(void)
+{
+    const bool grayscales[] = { false, true };
+
+    for (PIXEL_FORMAT format : formats) {
+        test_image_t image = make_image(format);
+        for (const test_scaling_t &s : scalings) {
+            for (bool grayscale : grayscales) {
+                const size_t channels = grayscale ? 1 : 3;
+                std::vector<float> actual(image.pixels() * channels);
+                EI_TEST_CHECK_EQ(to_float(image.src(), format, image.pixels(), grayscale, s.scaling,
+                    actual.data()), EIDSP_OK);
+
+                std::vector<float> expected(image.pixels() * channels);
+                for (size_t ix = 0; ix < image.pixels(); ix++) {
+                    reference_features(s.mode, grayscale, image.r[ix], image.g[ix], image.b[ix],
+                        &expected[ix * channels]);
+                }
+
+                bool same = memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)) == 0;
+                if (!same) {
+                    printf("  format %d mode %d grayscale %d differs\n", format, s.mode, grayscale);
+                }
+                EI_TEST_CHECK(same);
+            }
+        }
+    }
+}
+
+/**
+ * int8 features: the float features quantized, and for 0..1 with a 1/255
+ * scale and -128 zero point, the previous integer fast path
+ */
+static void test_to_int8(void)
+{
+    const int32_t iRedToGray = (int32_t)(0.299f * 65536.0f);
+    const int32_t iGreenToGray = (int32_t)(0.587f * 65536.0f);
+    const int32_t iBlueToGray = (int32_t)(0.114f * 65536.0f);
+    const bool grayscales[] = { false, true };
+
+    for (PIXEL_FORMAT format : formats) {
+        test_image_t image = make_image(format);
+        for (const test_scaling_t &s : scalings) {
+            for (bool grayscale : grayscales) {
+                const size_t channels = grayscale ? 1 : 3;
+                std::vector<int8_t> actual(image.pixels() * channels);
+                EI_TEST_CHECK_EQ(to_int8(image.src(), format, image.pixels(), grayscale, s.scaling,
+                    s.scale, s.zero_point, actual.data()), EIDSP_OK);
+
+                std::vector<int8_t> expected(image.pixels() * channels);
+                for (size_t ix = 0; ix < image.pixels(); ix++) {
+                    int8_t *out = &expected[ix * channels];
+                    if (s.mode == MODE_0_1) {
+                        int32_t r = image.r[ix], g = image.g[ix], b = image.b[ix];
+                        if (grayscale) {
+                            int32_t gray = (iRedToGray * r) + (iGreenToGray * g) + (iBlueToGray * b);
+                            gray >>= 16;
+                            gray += (int32_t)s.zero_point;
+                            if (gray < -128) gray = -128;
+                            else if (gray > 127) gray = 127;
+                            out[0] = static_cast<int8_t>(gray);
+                        }
+                        else {
+                            out[0] = static_cast<int8_t>(r + s.zero_point);
+                            out[1] = static_cast<int8_t>(g + s.zero_point);
+                            out[2] = static_cast<int8_t>(b + s.zero_point);
+                        }
+                        continue;
+                    }
+                    float features[3];
+                    reference_features(s.mode, grayscale, image.r[ix], image.g[ix], image.b[ix], features);
+                    for (size_t c = 0; c < channels; c++) {
+                        out[c] = static_cast<int8_t>(round(features[c] / s.scale) + s.zero_point);
+                    }
+                }
+
+                bool same = memcmp(expected.data(), actual.data(), expected.size()) == 0;
+                if (!same) {
+                    printf("  format %d mode %d grayscale %d differs\n", format, s.mode, grayscale);
+                }
+                EI_TEST_CHECK(same);
+            }
+        }
+    }
+}
+
+/* Lengths that don't fill the 4 pixel blocks of to_packed */
+static void test_to_packed_tails(void)
+{
+    test_image_t image = make_image(FORMAT_RGB888);
+    bool same = true;
+
+    for (size_t pixels = 0; pixels < 9; pixels++) {
+        std::vector<float> actual(pixels + 1, -1.0f);
+        EI_TEST_CHECK_EQ(to_packed(image.raw.data(), FORMAT_RGB888, pixels, actual.data()), EIDSP_OK);
+        for (size_t ix = 0; ix < pixels; ix++) {
+            if (actual[ix] != (float)((image.r[ix] << 16) + (image.g[ix] << 8) + image.b[ix])) {
+                same = false;
+            }
+        }
+        if (actual[pixels] != -1.0f) {
+            same = false;
+        }
+    }
+    EI_TEST_CHECK(same);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_to_packed);
+    EI_TEST_RUN(test_to_packed_tails);
+    EI_TEST_RUN(test_to_float);
+    EI_TEST_RUN(test_to_int8);
+
+    return EI_TEST_RESULT();
+}
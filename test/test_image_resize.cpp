@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_image_resize.cpp
+ * @brief Single pass crop_and_interpolate_image against the previous two
+ * pass path (cropImage into a copy, then resize_image)
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/dsp/image/processing.hpp"
+#include "edge-impulse-sdk/dsp/returntypes.hpp"
+
+#include <algorithm>
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+// resize_image reads one pixel (and one row) past the crop window
+#define TEST_SLACK_ROWS             2
+
+using namespace ei;
+using namespace ei::image::processing;
+
+/* Tests ------------------------------------------------------------------- */
+
+typedef struct {
+    int src_width;
+    int src_height;
+    int dst_width;
+    int dst_height;
+} test_size_t;
+
+static const test_size_t sizes[] = {
+    { 160, 120, 96, 96 },
+    { 160, 120, 48, 48 },
+    { 320, 240, 96, 96 },
+    { 640, 480, 96, 96 },
+    { 120, 160, 64, 64 },
+    { 160, 120, 80, 60 },
+    { 100, 100, 100, 100 },
+    { 96, 96, 160, 120 },
+    { 48, 48, 96, 96 },
+    { 33, 17, 10, 7 },
+};
+
+static std::vector<uint8_t> make_image(int width, int height, int pixel_size_B, unsigned seed)
+{
+    std::vector<uint8_t> image(width * height * pixel_size_B);
+    srand(seed);
+    for (size_t ix = 0; ix < image.size(); ix++) {
+        image[ix] = (uint8_t)rand();
+    }
+    return image;
+}
+
+/* Crop into a copy, then resize the copy */
+static void two_pass(const std::vector<uint8_t> &src, const test_size_t &size, int pixel_size_B,
+    std::vector<uint8_t> &out, int *crop_width, int *crop_height)
+{
+    calculate_crop_dims(size.src_width, size.src_height, size.dst_width, size.dst_height,
+        *crop_width, *crop_height);
+    const int crop_x = (size.src_width - *crop_width) / 2;
+    const int crop_y = (size.src_height - *crop_height) / 2;
+
+    std::vector<uint8_t> cropped((*crop_height + TEST_SLACK_ROWS) * *crop_width * pixel_size_B, 0);
+    cropImage(src.data(), size.src_width * pixel_size_B, size.src_height,
+        crop_x * pixel_size_B, crop_y, cropped.data(), *crop_width * pixel_size_B, *crop_height, 8);
+
+    out.assign(size.dst_width * size.dst_height * pixel_size_B, 0);
+    resize_image(cropped.data(), *crop_width, *crop_height, out.data(),
+        size.dst_width, size.dst_height, pixel_size_B);
+}
+
+/* Source column or row an output pixel interpolates from, as resize_image */
+static int source_index(int dst, int crop, int out)
+{
+    const uint32_t frac_val = 1 << 14;
+    const uint32_t step = ((uint32_t)crop * frac_val) / out;
+    return (frac_val / 2 + (uint32_t)dst * step) >> 14;
+}
+
+/* Same output as the two pass path, apart from pixels interpolated from the
+ * last column or row of the crop window (or past it, when upscaling): the
+ * single pass clamps them to the window, the two pass path read past it */
+static void check_against_two_pass(bool in_place)
+{
+    const int pixel_sizes[] = { MONO_B_SIZE, RGB888_B_SIZE };
+    int mismatches = 0;
+    int edge_differences = 0;
+
+    for (const test_size_t &size : sizes) {
+        for (int pixel_size_B : pixel_sizes) {
+            std::vector<uint8_t> src = make_image(size.src_width, size.src_height, pixel_size_B,
+                size.src_width + size.dst_width);
+            std::vector<uint8_t> expected;
+            int crop_width, crop_height;
+            two_pass(src, size, pixel_size_B, expected, &crop_width, &crop_height);
+            if (in_place && (crop_width < size.dst_width || crop_height < size.dst_height)) {
+                // upscaling in place overwrites source pixels it still needs,
+                // on either path
+                continue;
+            }
+
+            std::vector<uint8_t> actual;
+            int res;
+            if (in_place) {
+                actual = src;
+                actual.resize(std::max(src.size(), expected.size()) + size.src_width * pixel_size_B * TEST_SLACK_ROWS);
+                res = crop_and_interpolate_image(actual.data(), size.src_width, size.src_height,
+                    actual.data(), size.dst_width, size.dst_height, pixel_size_B);
+            }
+            else {
+                actual.assign(expected.size(), 0);
+                res = crop_and_interpolate_image(src.data(), size.src_width, size.src_height,
+                    actual.data(), size.dst_width, size.dst_height, pixel_size_B);
+            }
+            EI_TEST_CHECK_EQ(res, EIDSP_OK);
+
+            for (int y = 0; y < size.dst_height; y++) {
+                const bool last_row = source_index(y, crop_height, size.dst_height) >= crop_height - 1;
+                for (int x = 0; x < size.dst_width; x++) {
+                    const bool last_col = source_index(x, crop_width, size.dst_width) >= crop_width - 1;
+                    for (int c = 0; c < pixel_size_B; c++) {
+                        const size_t ix = (y * size.dst_width + x) * pixel_size_B + c;
+                        if (expected[ix] == actual[ix]) {
+                            continue;
+                        }
+                        if (last_row || last_col) {
+                            edge_differences++;
+                        }
+                        else {
+                            mismatches++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    EI_TEST_CHECK_EQ(mismatches, 0);
+    // the edge really is handled differently in at least one of the sizes
+    EI_TEST_CHECK(edge_differences > 0);
+}
+
+static void test_matches_two_pass(void)
+{
+    check_against_two_pass(false);
+}
+
+/* In place, for the sizes that can be done in place */
+static void test_matches_two_pass_in_place(void)
+{
+    check_against_two_pass(true);
+}
+
+/* Pixels next to the crop window never leak into the output: a flat crop
+ * window in a noisy frame comes out flat */
+static void test_reads_only_crop_window(void)
+{
+    const int src_width = 160, src_height = 120;
+    std::vector<uint8_t> src = make_image(src_width, src_height, RGB888_B_SIZE, 9);
+    // calculate_crop_dims keeps the 120 rows and the centre 120 columns
+    for (int y = 0; y < src_height; y++) {
+        for (int x = 20; x < 140; x++) {
+            for (int c = 0; c < RGB888_B_SIZE; c++) {
+                src[(y * src_width + x) * RGB888_B_SIZE + c] = (uint8_t)(50 + c);
+            }
+        }
+    }
+
+    std::vector<uint8_t> out(96 * 96 * RGB888_B_SIZE);
+    EI_TEST_CHECK_EQ(crop_and_interpolate_rgb888(src.data(), src_width, src_height, out.data(), 96, 96), EIDSP_OK);
+
+    bool flat = true;
+    for (size_t ix = 0; ix < out.size(); ix++) {
+        if (out[ix] != 50 + ix % RGB888_B_SIZE) {
+            flat = false;
+        }
+    }
+    EI_TEST_CHECK(flat);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_matches_two_pass);
+    EI_TEST_RUN(test_matches_two_pass_in_place);
+    EI_TEST_RUN(test_reads_only_crop_window);
+
+    return EI_TEST_RESULT();
+}
@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_image_scaling.cpp
+ * @brief Image features scaled while unpacking (single pass) against 0..1
+ * features scaled by ei_scale_fmatrix (two pass), and the quantized image
+ * features against the previous implementation
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+// the generated model has no image blocks, turn on the image scaling path
+#include "model-parameters/model_metadata.h"
+#undef EI_CLASSIFIER_LOAD_IMAGE_SCALING
+#define EI_CLASSIFIER_LOAD_IMAGE_SCALING 1
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+
+#include <math.h>
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+// more than one 1024 pixel page of extract_image_features
+#define TEST_PIXELS                 1500
+// a few float steps of a 0..255 channel value, luma sums three rounded terms
+#define TEST_TOLERANCE              5e-5f
+
+using namespace ei;
+
+/* Reference --------------------------------------------------------------- */
+
+namespace reference {
+
+// extract_image_features_quantized before the single pass conversion,
+// MIN1_1 and BGR_SUBTRACT_IMAGENET_MEAN were left at 0..255
+static int extract_image_features_quantized(signal_t *signal, matrix_i8_t *output_matrix, void *config_ptr, float scale, float zero_point, const float frequency,
+                                                             int image_scaling) {
+    ei_dsp_config_image_t config = *((ei_dsp_config_image_t*)config_ptr);
+
+    int16_t channel_count = strcmp(config.channels, "Grayscale") == 0 ? 1 : 3;
+
+    size_t output_ix = 0;
+
+    const int32_t iRedToGray = (int32_t)(0.299f * 65536.0f);
+    const int32_t iGreenToGray = (int32_t)(0.587f * 65536.0f);
+    const int32_t iBlueToGray = (int32_t)(0.114f * 65536.0f);
+
+    static const float torch_mean[] = { 0.485, 0.456, 0.406 };
+    static const float torch_std[] = { 0.229, 0.224, 0.225 };
+
+#if defined(EI_DSP_IMAGE_BUFFER_STATIC_SIZE)
+    const size_t page_size = EI_DSP_IMAGE_BUFFER_STATIC_SIZE;
+#else
+    const size_t page_size = 1024;
+#endif
+
+    // buffered read from the signal
+    size_t bytes_left = signal->total_length;
+    for (size_t ix = 0; ix < signal->total_length; ix += page_size) {
+        size_t elements_to_read = bytes_left > page_size ? page_size : bytes_left;
+
+#if defined(EI_DSP_IMAGE_BUFFER_STATIC_SIZE)
+        matrix_t input_matrix(elements_to_read, config.axes, ei_dsp_image_buffer);
+#else
+        matrix_t input_matrix(elements_to_read, config.axes);
+#endif
+        if (!input_matrix.buffer) {
+            EIDSP_ERR(EIDSP_OUT_OF_MEM);
+        }
+        signal->get_data(ix, elements_to_read, input_matrix.buffer);
+
+        for (size_t jx = 0; jx < elements_to_read; jx++) {
+            uint32_t pixel = static_cast<uint32_t>(input_matrix.buffer[jx]);
+
+            if (channel_count == 3) {
+                // fast code path
+                if (scale == 0.003921568859368563f && zero_point == -128 && image_scaling == EI_CLASSIFIER_IMAGE_SCALING_NONE) {
+                    int32_t r = static_cast<int32_t>(pixel >> 16 & 0xff);
+                    int32_t g = static_cast<int32_t>(pixel >> 8 & 0xff);
+                    int32_t b = static_cast<int32_t>(pixel & 0xff);
+
+                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(r + zero_point);
+                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(g + zero_point);
+                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(b + zero_point);
+                }
+                // slow code path
+                else {
+                    float r = static_cast<float>(pixel >> 16 & 0xff);
+                    float g = static_cast<float>(pixel >> 8 & 0xff);
+                    float b = static_cast<float>(pixel & 0xff);
+
+                    if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_NONE) {
+                        r /= 255.0f;
+                        g /= 255.0f;
+                        b /= 255.0f;
+                    }
+                    else if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_TORCH) {
+                        r /= 255.0f;
+                        g /= 255.0f;
+                        b /= 255.0f;
+
+                        r = (r - torch_mean[0]) / torch_std[0];
+                        g = (g - torch_mean[1]) / torch_std[1];
+                        b = (b - torch_mean[2]) / torch_std[2];
+                    }
+                    else if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_MIN128_127) {
+                        r -= 128.0f;
+                        g -= 128.0f;
+                        b -= 128.0f;
+                    }
+
+                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(round(r / scale) + zero_point);
+                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(round(g / scale) + zero_point);
+                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(round(b / scale) + zero_point);
+                }
+            }
+            else {
+                // fast code path
+                if (scale == 0.003921568859368563f && zero_point == -128 && image_scaling == EI_CLASSIFIER_IMAGE_SCALING_NONE) {
+                    int32_t r = static_cast<int32_t>(pixel >> 16 & 0xff);
+                    int32_t g = static_cast<int32_t>(pixel >> 8 & 0xff);
+                    int32_t b = static_cast<int32_t>(pixel & 0xff);
+
+                    // ITU-R 601-2 luma transform
+                    // see: https://pillow.readthedocs.io/en/stable/reference/Image.html#PIL.Image.Image.convert
+                    int32_t gray = (iRedToGray * r) + (iGreenToGray * g) + (iBlueToGray * b);
+                    gray >>= 16; // scale down to int8_t
+                    gray += zero_point;
+                    if (gray < - 128) gray = -128;
+                    else if (gray > 127) gray = 127;
+                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(gray);
+                }
+                // slow code path
+                else {
+                    float r = static_cast<float>(pixel >> 16 & 0xff);
+                    float g = static_cast<float>(pixel >> 8 & 0xff);
+                    float b = static_cast<float>(pixel & 0xff);
+
+                    if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_NONE) {
+                        r /= 255.0f;
+                        g /= 255.0f;
+                        b /= 255.0f;
+                    }
+                    else if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_TORCH) {
+                        r /= 255.0f;
+                        g /= 255.0f;
+                        b /= 255.0f;
+
+                        r = (r - torch_mean[0]) / torch_std[0];
+                        g = (g - torch_mean[1]) / torch_std[1];
+                        b = (b - torch_mean[2]) / torch_std[2];
+                    }
+                    else if (image_scaling == EI_CLASSIFIER_IMAGE_SCALING_MIN128_127) {
+                        r -= 128.0f;
+                        g -= 128.0f;
+                        b -= 128.0f;
+                    }
+
+                    // ITU-R 601-2 luma transform
+                    // see: https://pillow.readthedocs.io/en/stable/reference/Image.html#PIL.Image.Image.convert
+                    float v = (0.299f * r) + (0.587f * g) + (0.114f * b);
+                    output_matrix->buffer[output_ix++] = static_cast<int8_t>(round(v / scale) + zero_point);
+                }
+            }
+        }
+
+        bytes_left -= elements_to_read;
+
+    }
+    return EIDSP_OK;
+}
+
+} // namespace reference
+
+/* Tests ------------------------------------------------------------------- */
+
+typedef struct {
+    int image_scaling;
+    // input tensor quantization covering the scaled range
+    float scale;
+    float zero_point;
+} test_mode_t;
+
+static const test_mode_t modes[] = {
+    { EI_CLASSIFIER_IMAGE_SCALING_NONE, 0.003921568859368563f, -128 },
+    { EI_CLASSIFIER_IMAGE_SCALING_0_255, 1.0f, -128 },
+    { EI_CLASSIFIER_IMAGE_SCALING_TORCH, 0.019f, -12 },
+    { EI_CLASSIFIER_IMAGE_SCALING_MIN1_1, 1.0f / 127.0f, 0 },
+    { EI_CLASSIFIER_IMAGE_SCALING_MIN128_127, 1.0f, 0 },
+    { EI_CLASSIFIER_IMAGE_SCALING_BGR_SUBTRACT_IMAGENET_MEAN, 1.1f, -10 },
+};
+
+// random 0xRRGGBB pixels, as signal_t::get_data returns them
+static std::vector<float> make_pixels(unsigned seed)
+{
+    std::vector<float> pixels(TEST_PIXELS);
+    srand(seed);
+    for (size_t ix = 0; ix < pixels.size(); ix++) {
+        pixels[ix] = (float)(rand() & 0xffffff);
+    }
+    return pixels;
+}
+
+static ei_dsp_config_image_t make_config(bool grayscale)
+{
+    ei_dsp_config_image_t config = { 1, 1, 1, grayscale ? "Grayscale" : "RGB" };
+    return config;
+}
+
+/* Previous path: 0..1 features, then ei_scale_fmatrix in run_inference */
+static void two_pass(std::vector<float> &pixels, bool grayscale, int image_scaling, matrix_t *out)
+{
+    ei_dsp_config_image_t config = make_config(grayscale);
+    signal_t signal;
+    numpy::signal_from_buffer(pixels.data(), pixels.size(), &signal);
+
+    EI_TEST_CHECK_EQ(extract_image_features(&signal, out, &config, 0.0f), EIDSP_OK);
+
+    ei_learning_block_t block = { };
+    block.image_scaling = image_scaling;
+    EI_TEST_CHECK_EQ(ei_scale_fmatrix(&block, out), EI_IMPULSE_OK);
+}
+
+/* Largest difference, relative to the value for values past 1 */
+static float max_difference(const matrix_t &expected, const matrix_t &actual)
+{
+    float max_diff = 0.0f;
+    for (size_t ix = 0; ix < expected.rows * expected.cols; ix++) {
+        float e = expected.buffer[ix];
+        float diff = fabsf(e - actual.buffer[ix]) / (fabsf(e) > 1.0f ? fabsf(e) : 1.0f);
+        if (diff > max_diff) {
+            max_diff = diff;
+        }
+    }
+    return max_diff;
+}
+
+/* Every mode, RGB: same features up to float rounding */
+static void test_single_pass_rgb(void)
+{
+    std::vector<float> pixels = make_pixels(1);
+    ei_dsp_config_image_t config = make_config(false);
+
+    for (const test_mode_t &mode : modes) {
+        matrix_t expected(1, TEST_PIXELS * 3);
+        two_pass(pixels, false, mode.image_scaling, &expected);
+
+        matrix_t actual(1, TEST_PIXELS * 3);
+        signal_t signal;
+        numpy::signal_from_buffer(pixels.data(), pixels.size(), &signal);
+        EI_TEST_CHECK_EQ(extract_image_features_scaled(&signal, &actual, &config, 0.0f, mode.image_scaling), EIDSP_OK);
+
+        float diff = max_difference(expected, actual);
+        if (diff > TEST_TOLERANCE) {
+            printf("  image_scaling %d differs by %g\n", mode.image_scaling, (double)diff);
+        }
+        EI_TEST_CHECK(diff <= TEST_TOLERANCE);
+    }
+}
+
+/* Grayscale, for the modes that scale every channel the same: luma of the
+ * scaled channels is the scaled luma (the weights sum to 1). ei_scale_fmatrix
+ * steps over r, g, b, so TORCH and BGR were never defined on grayscale. */
+static void test_single_pass_grayscale(void)
+{
+    std::vector<float> pixels = make_pixels(2);
+    ei_dsp_config_image_t config = make_config(true);
+
+    for (const test_mode_t &mode : modes) {
+        if (mode.image_scaling == EI_CLASSIFIER_IMAGE_SCALING_TORCH ||
+            mode.image_scaling == EI_CLASSIFIER_IMAGE_SCALING_BGR_SUBTRACT_IMAGENET_MEAN) {
+            continue;
+        }
+        matrix_t expected(1, TEST_PIXELS);
+        two_pass(pixels, true, mode.image_scaling, &expected);
+
+        matrix_t actual(1, TEST_PIXELS);
+        signal_t signal;
+        numpy::signal_from_buffer(pixels.data(), pixels.size(), &signal);
+        EI_TEST_CHECK_EQ(extract_image_features_scaled(&signal, &actual, &config, 0.0f, mode.image_scaling), EIDSP_OK);
+
+        float diff = max_difference(expected, actual);
+        if (diff > TEST_TOLERANCE) {
+            printf("  image_scaling %d differs by %g\n", mode.image_scaling, (double)diff);
+        }
+        EI_TEST_CHECK(diff <= TEST_TOLERANCE);
+    }
+}
+
+/* Quantized features, for every mode, are the two pass float features
+ * quantized with the tensor scale / zero point (off by one step at most,
+ * where rounding lands on the other side of a half step) */
+static void test_quantized_matches_float(void)
+{
+    std::vector<float> pixels = make_pixels(3);
+    const bool grayscales[] = { false, true };
+
+    for (bool grayscale : grayscales) {
+        ei_dsp_config_image_t config = make_config(grayscale);
+        const size_t features = TEST_PIXELS * (grayscale ? 1 : 3);
+
+        for (const test_mode_t &mode : modes) {
+            if (grayscale && (mode.image_scaling == EI_CLASSIFIER_IMAGE_SCALING_TORCH ||
+                mode.image_scaling == EI_CLASSIFIER_IMAGE_SCALING_BGR_SUBTRACT_IMAGENET_MEAN)) {
+                continue;
+            }
+            matrix_t expected(1, features);
+            two_pass(pixels, grayscale, mode.image_scaling, &expected);
+
+            matrix_i8_t actual(1, features);
+            signal_t signal;
+            numpy::signal_from_buffer(pixels.data(), pixels.size(), &signal);
+            EI_TEST_CHECK_EQ(extract_image_features_quantized(&signal, &actual, &config,
+                mode.scale, mode.zero_point, 0.0f, mode.image_scaling), EIDSP_OK);
+
+            int worst = 0;
+            for (size_t ix = 0; ix < features; ix++) {
+                int q = (int)(round(expected.buffer[ix] / mode.scale) + mode.zero_point);
+                int diff = abs(q - actual.buffer[ix]);
+                if (diff > worst) {
+                    worst = diff;
+                }
+            }
+            if (worst > 1) {
+                printf("  image_scaling %d grayscale %d off by %d\n", mode.image_scaling, grayscale, worst);
+            }
+            EI_TEST_CHECK(worst <= 1);
+        }
+    }
+}
+
+/* Modes the previous quantized path handled give the same int8 values (it
+ * left 0..255 as is, which is right for 0_255) */
+static void test_quantized_against_previous(void)
+{
+    std::vector<float> pixels = make_pixels(4);
+    const bool grayscales[] = { false, true };
+
+    for (bool grayscale : grayscales) {
+        ei_dsp_config_image_t config = make_config(grayscale);
+        const size_t features = TEST_PIXELS * (grayscale ? 1 : 3);
+
+        for (const test_mode_t &mode : modes) {
+            if (mode.image_scaling == EI_CLASSIFIER_IMAGE_SCALING_MIN1_1 ||
+                mode.image_scaling == EI_CLASSIFIER_IMAGE_SCALING_BGR_SUBTRACT_IMAGENET_MEAN) {
+                continue;
+            }
+            matrix_i8_t expected(1, features);
+            signal_t signal;
+            numpy::signal_from_buffer(pixels.data(), pixels.size(), &signal);
+            EI_TEST_CHECK_EQ(reference::extract_image_features_quantized(&signal, &expected, &config,
+                mode.scale, mode.zero_point, 0.0f, mode.image_scaling), EIDSP_OK);
+
+            matrix_i8_t actual(1, features);
+            numpy::signal_from_buffer(pixels.data(), pixels.size(), &signal);
+            EI_TEST_CHECK_EQ(extract_image_features_quantized(&signal, &actual, &config,
+                mode.scale, mode.zero_point, 0.0f, mode.image_scaling), EIDSP_OK);
+
+            const bool same = memcmp(expected.buffer, actual.buffer, features) == 0;
+            if (!same) {
+                printf("  image_scaling %d grayscale %d changed\n", mode.image_scaling, grayscale);
+            }
+            EI_TEST_CHECK(same);
+        }
+    }
+}
+
+/* The behaviour change: the previous quantized path fed MIN1_1 and BGR
+ * models 0..255, the same values as 0_255. Now they are scaled (the values
+ * themselves are checked in test_quantized_matches_float). A scale that
+ * keeps 0..255 in int8 range for both. */
+static void test_quantized_min1_1_bgr_scaled(void)
+{
+    std::vector<float> pixels = make_pixels(5);
+    const int changed[] = {
+        EI_CLASSIFIER_IMAGE_SCALING_MIN1_1,
+        EI_CLASSIFIER_IMAGE_SCALING_BGR_SUBTRACT_IMAGENET_MEAN
+    };
+    ei_dsp_config_image_t config = make_config(false);
+    const size_t features = TEST_PIXELS * 3;
+
+    matrix_i8_t unscaled(1, features);
+    signal_t signal;
+    numpy::signal_from_buffer(pixels.data(), pixels.size(), &signal);
+    EI_TEST_CHECK_EQ(extract_image_features_quantized(&signal, &unscaled, &config, 2.0f, -64, 0.0f,
+        EI_CLASSIFIER_IMAGE_SCALING_0_255), EIDSP_OK);
+
+    for (int image_scaling : changed) {
+        matrix_i8_t previous(1, features);
+        numpy::signal_from_buffer(pixels.data(), pixels.size(), &signal);
+        EI_TEST_CHECK_EQ(reference::extract_image_features_quantized(&signal, &previous, &config, 2.0f, -64, 0.0f,
+            image_scaling), EIDSP_OK);
+        bool previous_unscaled = memcmp(previous.buffer, unscaled.buffer, features) == 0;
+        EI_TEST_CHECK(previous_unscaled);
+
+        matrix_i8_t actual(1, features);
+        numpy::signal_from_buffer(pixels.data(), pixels.size(), &signal);
+        EI_TEST_CHECK_EQ(extract_image_features_quantized(&signal, &actual, &config, 2.0f, -64, 0.0f,
+            image_scaling), EIDSP_OK);
+        bool now_unscaled = memcmp(actual.buffer, unscaled.buffer, features) == 0;
+        EI_TEST_CHECK(!now_unscaled);
+    }
+}
+
+/* BGR: the first value of a pixel comes from blue */
+static void test_quantized_bgr_order(void)
+{
+    float pixel = (float)((10 << 16) + (20 << 8) + 200);
+    ei_dsp_config_image_t config = make_config(false);
+    signal_t signal;
+    numpy::signal_from_buffer(&pixel, 1, &signal);
+
+    matrix_i8_t out(1, 3);
+    EI_TEST_CHECK_EQ(extract_image_features_quantized(&signal, &out, &config, 1.0f, 0.0f, 0.0f,
+        EI_CLASSIFIER_IMAGE_SCALING_BGR_SUBTRACT_IMAGENET_MEAN), EIDSP_OK);
+    EI_TEST_CHECK_EQ(out.buffer[0], (int)round(200 - 103.939));
+    EI_TEST_CHECK_EQ(out.buffer[1], (int)round(20 - 116.779));
+    EI_TEST_CHECK_EQ(out.buffer[2], (int)round(10 - 123.68));
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_single_pass_rgb);
+    EI_TEST_RUN(test_single_pass_grayscale);
+    EI_TEST_RUN(test_quantized_matches_float);
+    EI_TEST_RUN(test_quantized_against_previous);
+    EI_TEST_RUN(test_quantized_min1_1_bgr_scaled);
+    EI_TEST_RUN(test_quantized_bgr_order);
+
+    return EI_TEST_RESULT();
+}
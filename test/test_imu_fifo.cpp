@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_imu_fifo.cpp
+ * @brief EiImuFifo against mock LSM9DS1 and BMI270 register maps
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "sensors/ei_imu_fifo.h"
+
+#include <deque>
+#include <map>
+#include <string.h>
+
+/* Constant defines -------------------------------------------------------- */
+#define LSM9DS1_OUT_X_G             0x18
+#define LSM9DS1_CTRL_REG9           0x23
+#define LSM9DS1_FIFO_CTRL           0x2e
+#define LSM9DS1_FIFO_SRC            0x2f
+#define BMI270_FIFO_LENGTH_0        0x24
+#define BMI270_FIFO_DATA            0x26
+
+#define TEST_ODR_HZ                 100
+#define TEST_PERIOD_US              (1000000 / TEST_ODR_HZ)
+
+/* Mocks ------------------------------------------------------------------- */
+
+/**
+ * Sensor FIFO holding 12 byte slots, gyroscope then accelerometer. The
+ * accelerometer X value of every frame is its sequence number.
+ */
+class MockFifoBus : public EiRegisterBus {
+public:
+    MockFifoBus(bool bmi270) : bmi270(bmi270), next_seq(0), extra_reported(0), bursts(0) {}
+
+    void push_frames(int n)
+    {
+        for (int i = 0; i < n; i++) {
+            int16_t v[6] = { 1, 2, 3, next_seq, -5, 6 };
+            next_seq++;
+            for (int ax = 0; ax < 6; ax++) {
+                fifo.push_back((uint8_t)(v[ax] & 0xff));
+                fifo.push_back((uint8_t)((uint16_t)v[ax] >> 8));
+            }
+        }
+    }
+
+    int write_register(uint8_t address, uint8_t value) override
+    {
+        registers[address] = value;
+        return 1;
+    }
+
+    int read_registers(uint8_t address, uint8_t *data, size_t length) override
+    {
+        int frames = (int)(fifo.size() / 12) + extra_reported;
+
+        if (!bmi270 && address == LSM9DS1_FIFO_SRC && length == 1) {
+            data[0] = (uint8_t)(frames & 0x3f);
+            return 1;
+        }
+        if (bmi270 && address == BMI270_FIFO_LENGTH_0 && length == 2) {
+            data[0] = (uint8_t)((frames * 12) & 0xff);
+            data[1] = (uint8_t)((frames * 12) >> 8);
+            return 1;
+        }
+        if ((!bmi270 && address == LSM9DS1_OUT_X_G) || (bmi270 && address == BMI270_FIFO_DATA)) {
+            bursts++;
+            for (size_t i = 0; i < length; i++) {
+                if (!fifo.empty()) {
+                    data[i] = fifo.front();
+                    fifo.pop_front();
+                }
+                else {
+                    // BMI270 returns the invalid frame pattern when reading
+                    // past the end of the FIFO
+                    data[i] = (i % 2) ? 0x80 : 0x00;
+                }
+            }
+            return 1;
+        }
+        if (length == 1 && registers.count(address)) {
+            data[0] = registers[address];
+            return 1;
+        }
+        return 0;
+    }
+
+    bool bmi270;
+    int16_t next_seq;
+    int extra_reported;
+    int bursts;
+    std::deque<uint8_t> fifo;
+    std::map<uint8_t, uint8_t> registers;
+};
+
+/* Tests ------------------------------------------------------------------- */
+
+/* A full FIFO takes two transfers, frames keep their order and the newest
+ * one is stamped with the read time */
+static void test_burst_read_chunks_in_order(void)
+{
+    MockFifoBus bus(false);
+    EiLsm9ds1Fifo fifo(&bus, TEST_ODR_HZ);
+    const uint64_t now = 10000000;
+    const uint64_t latency = (uint64_t)TEST_PERIOD_US * EI_IMU_FIFO_WATERMARK;
+    const int n = 31;
+
+    // start the session before the burst, so the ring is not reset below
+    EI_TEST_CHECK(fifo.get_frame(now - (uint64_t)n * TEST_PERIOD_US + latency, false) == nullptr);
+
+    bus.push_frames(n);
+    EI_TEST_CHECK_EQ(fifo.burst_read(now), n);
+    EI_TEST_CHECK_EQ(bus.bursts, 2);
+    EI_TEST_CHECK(bus.fifo.empty());
+
+    // step through the ring one frame at a time, from the bus free path
+    for (int i = 0; i < n; i++) {
+        uint64_t ts = now - (uint64_t)(n - 1 - i) * TEST_PERIOD_US;
+        const ei_imu_fifo_frame_t *f = fifo.get_frame(ts + latency, false);
+        EI_TEST_CHECK(f != nullptr);
+        if (!f) {
+            return;
+        }
+        EI_TEST_CHECK_EQ(f->acc[0], i);
+        EI_TEST_CHECK_EQ(f->timestamp_us, ts);
+    }
+}
+
+/* The FIFO reports more frames than it holds: only the parsed frames are
+ * counted and the burst stops at the short read */
+static void test_short_read_counts_parsed_frames(void)
+{
+    MockFifoBus bus(true);
+    EiBmi270Fifo fifo(&bus, TEST_ODR_HZ, 0);
+    const uint64_t now = 10000000;
+
+    bus.push_frames(12);
+    bus.extra_reported = 30;
+    EI_TEST_CHECK_EQ(fifo.burst_read(now), 12);
+    EI_TEST_CHECK_EQ(bus.bursts, 1);
+
+    // the next burst picks up where the previous one stopped
+    bus.extra_reported = 0;
+    bus.push_frames(4);
+    EI_TEST_CHECK_EQ(fifo.burst_read(now + 4 * TEST_PERIOD_US), 4);
+}
+
+/* One frame per tick: after the watermark latency every tick reports the
+ * next frame, without gaps or repeats, with one burst per watermark */
+static void test_get_frame_sequence(void)
+{
+    MockFifoBus bus(false);
+    EiLsm9ds1Fifo fifo(&bus, TEST_ODR_HZ);
+    const int ticks = 10 * EI_IMU_FIFO_WATERMARK;
+    int16_t last_seq = -1;
+    int reported = 0;
+
+    uint64_t t = 1000000;
+    for (int i = 0; i < ticks; i++, t += TEST_PERIOD_US) {
+        bus.push_frames(1);
+        const ei_imu_fifo_frame_t *f = fifo.get_frame(t);
+        EI_TEST_CHECK(f != nullptr);
+        if (!f) {
+            continue;
+        }
+        EI_TEST_CHECK(f->timestamp_us <= t);
+        if (i > EI_IMU_FIFO_WATERMARK) {
+            EI_TEST_CHECK_EQ(f->acc[0], last_seq + 1);
+            reported++;
+        }
+        last_seq = f->acc[0];
+    }
+
+    EI_TEST_CHECK(reported > 0);
+    EI_TEST_CHECK(bus.bursts <= (ticks / EI_IMU_FIFO_WATERMARK) + 2);
+    EI_TEST_CHECK_EQ(fifo.get_overruns(), 0);
+}
+
+/* begin() sets FIFO_EN without touching the other CTRL_REG9 bits */
+static void test_lsm9ds1_begin_keeps_ctrl_reg9(void)
+{
+    MockFifoBus bus(false);
+    EiLsm9ds1Fifo fifo(&bus, TEST_ODR_HZ);
+
+    // I2C_DISABLE and DRDY_mask_bit set by the driver
+    bus.registers[LSM9DS1_CTRL_REG9] = 0x0c;
+    EI_TEST_CHECK_EQ(fifo.begin(), 1);
+    EI_TEST_CHECK_EQ(bus.registers[LSM9DS1_CTRL_REG9], 0x0e);
+    EI_TEST_CHECK_EQ(bus.registers[LSM9DS1_FIFO_CTRL] & 0xe0, 0xc0);
+
+    // a failed read leaves the register alone
+    MockFifoBus unreadable(false);
+    EiLsm9ds1Fifo no_fifo(&unreadable, TEST_ODR_HZ);
+    EI_TEST_CHECK_EQ(no_fifo.begin(), 0);
+    EI_TEST_CHECK_EQ(unreadable.registers.count(LSM9DS1_CTRL_REG9), 0);
+}
+
+/* Invalid BMI270 frames are skipped by the parser */
+static void test_bmi270_parse_skips_invalid(void)
+{
+    uint8_t raw[36];
+    ei_imu_fifo_frame_t frames[3];
+
+    memset(raw, 0x11, sizeof(raw));
+    raw[12] = 0x00;
+    raw[13] = 0x80;
+
+    EI_TEST_CHECK_EQ(ei_bmi270_fifo_parse(raw, sizeof(raw), frames, 3), 2);
+    EI_TEST_CHECK_EQ(ei_lsm9ds1_fifo_parse(raw, sizeof(raw), frames, 3), 3);
+    EI_TEST_CHECK_EQ(frames[1].gyr[0], (int16_t)0x8000);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_burst_read_chunks_in_order);
+    EI_TEST_RUN(test_short_read_counts_parsed_frames);
+    EI_TEST_RUN(test_get_frame_sequence);
+    EI_TEST_RUN(test_lsm9ds1_begin_keeps_ctrl_reg9);
+    EI_TEST_RUN(test_bmi270_parse_skips_invalid);
+
+    return EI_TEST_RESULT();
+}
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_log_ring.cpp
+ * @brief EiLogRing with concurrent producers, overflow, wrap-around and
+ * ei_log_format_float against printf
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/porting/ei_log_ring.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_PRODUCERS              4
+#define TEST_RECORDS_PER_PRODUCER   2000
+
+/* Mocks ------------------------------------------------------------------- */
+
+// drain() calls the write function once per record
+static std::vector<std::string> drained;
+
+static void collect(const char *data, size_t length)
+{
+    drained.push_back(std::string(data, length));
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+// "<producer>:<sequence>:" followed by a filler that depends on both, so a
+// torn or mixed record does not parse back
+static std::string make_record(int producer, int sequence)
+{
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "%d:%d:", producer, sequence);
+    std::string record(prefix);
+    int filler = (producer * 7 + sequence) % 40;
+    for (int i = 0; i < filler; i++) {
+        record += (char)('a' + (producer + sequence + i) % 26);
+    }
+    return record;
+}
+
+/* Producers retry when the ring is full, every record comes out once, whole
+ * and in the order its producer wrote it */
+static void test_concurrent_producers(void)
+{
+    static EiLogRing<1024> ring;
+    std::atomic<int> running(TEST_PRODUCERS);
+    std::vector<std::thread> producers;
+
+    drained.clear();
+    for (int p = 0; p < TEST_PRODUCERS; p++) {
+        producers.push_back(std::thread([p, &running]() {
+            for (int s = 0; s < TEST_RECORDS_PER_PRODUCER; s++) {
+                std::string record = make_record(p, s);
+                while (!ring.write(record.data(), record.size())) {
+                    std::this_thread::yield();
+                }
+            }
+            running--;
+        }));
+    }
+
+    while (running.load() > 0 || !ring.empty()) {
+        if (ring.drain(&collect) == 0) {
+            std::this_thread::yield();
+        }
+    }
+    for (auto &t : producers) {
+        t.join();
+    }
+
+    EI_TEST_CHECK_EQ(drained.size(), TEST_PRODUCERS * TEST_RECORDS_PER_PRODUCER);
+
+    int next[TEST_PRODUCERS] = { 0 };
+    bool intact = true;
+    for (const std::string &record : drained) {
+        int p = -1, s = -1;
+        if (sscanf(record.c_str(), "%d:%d:", &p, &s) != 2 || p < 0 || p >= TEST_PRODUCERS) {
+            intact = false;
+            break;
+        }
+        if (s != next[p] || record != make_record(p, s)) {
+            intact = false;
+            break;
+        }
+        next[p]++;
+    }
+    EI_TEST_CHECK(intact);
+
+    ei_log_ring_stats_t stats;
+    ring.get_stats(&stats);
+    EI_TEST_CHECK_EQ(stats.written_messages, TEST_PRODUCERS * TEST_RECORDS_PER_PRODUCER);
+    EI_TEST_CHECK(stats.high_watermark <= 1024);
+}
+
+/* A full ring drops and counts, what was written before still comes out */
+static void test_overflow_counters(void)
+{
+    EiLogRing<64> ring;
+    const char *message = "0123456789";    // 16 bytes per record
+    int written = 0;
+
+    drained.clear();
+    while (ring.write(message, 10)) {
+        written++;
+    }
+    EI_TEST_CHECK_EQ(written, 4);
+    EI_TEST_CHECK(!ring.write(message, 3));
+    // longer than the whole ring
+    char big[100] = { 0 };
+    EI_TEST_CHECK(!ring.write(big, sizeof(big)));
+
+    ei_log_ring_stats_t stats;
+    ring.get_stats(&stats);
+    EI_TEST_CHECK_EQ(stats.written_messages, 4);
+    EI_TEST_CHECK_EQ(stats.dropped_messages, 3);
+    EI_TEST_CHECK_EQ(stats.dropped_bytes, 10 + 3 + sizeof(big));
+    EI_TEST_CHECK_EQ(stats.high_watermark, 64);
+
+    EI_TEST_CHECK_EQ(ring.drain(&collect), 40);
+    EI_TEST_CHECK(ring.empty());
+    EI_TEST_CHECK_EQ(drained.size(), 4);
+    EI_TEST_CHECK(drained[3] == "0123456789");
+
+    // room again after the drain
+    EI_TEST_CHECK(ring.write(message, 10));
+}
+
+/* Records that do not fit before the end are padded to the start, the
+ * output stays in order across many wraps */
+static void test_wrap_around(void)
+{
+    EiLogRing<64> ring;
+    std::vector<std::string> expected;
+
+    drained.clear();
+    for (int i = 0; i < 200; i++) {
+        // 1..11 bytes, record sizes that don't divide the ring
+        std::string record(1 + (i * 5) % 11, (char)('a' + i % 26));
+        EI_TEST_CHECK(ring.write(record.data(), record.size()));
+        expected.push_back(record);
+        if (i % 2 == 1) {
+            ring.drain(&collect);
+        }
+    }
+    ring.drain(&collect);
+
+    EI_TEST_CHECK(ring.empty());
+    bool same = drained == expected;
+    EI_TEST_CHECK(same);
+
+    ei_log_ring_stats_t stats;
+    ring.get_stats(&stats);
+    EI_TEST_CHECK_EQ(stats.dropped_messages, 0);
+}
+
+/* The consumer stops at a reserved record that is not committed yet, even
+ * when records after it are */
+static void test_uncommitted_blocks_drain(void)
+{
+    EiLogRing<64> ring;
+    uint32_t first, second;
+
+    drained.clear();
+    char *a = ring.reserve(3, &first);
+    char *b = ring.reserve(3, &second);
+    EI_TEST_CHECK(a != nullptr && b != nullptr);
+    memcpy(b, "bbb", 3);
+    ring.commit(second, 3);
+
+    EI_TEST_CHECK_EQ(ring.drain(&collect), 0);
+    EI_TEST_CHECK(!ring.empty());
+
+    memcpy(a, "aaa", 3);
+    ring.commit(first, 3);
+    EI_TEST_CHECK_EQ(ring.drain(&collect), 6);
+    EI_TEST_CHECK_EQ(drained.size(), 2);
+    EI_TEST_CHECK(drained[0] == "aaa" && drained[1] == "bbb");
+}
+
+/* Same text as printf %.*f in the range printf is used for */
+static void test_format_float(void)
+{
+    const float values[] = {
+        0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 1.5f, 2.5f, 0.1f, 0.125f, 3.14159265f,
+        -2.71828f, 99.99999f, 123456.789f, 0.000123f, 1e-7f, 65535.5f, 1e9f, -7.0e12f
+    };
+    bool same = true;
+
+    for (float f : values) {
+        for (int decimals = 0; decimals <= 6; decimals++) {
+            char expected[64], actual[64];
+            snprintf(expected, sizeof(expected), "%.*f", decimals, (double)f);
+            int n = ei_log_format_float(actual, sizeof(actual), f, decimals);
+            if (strcmp(expected, actual) != 0 || n != (int)strlen(expected)) {
+                printf("  %s != %s\n", actual, expected);
+                same = false;
+            }
+        }
+    }
+    EI_TEST_CHECK(same);
+
+    // random values in the range classification scores and sensor data use
+    srand(3);
+    same = true;
+    for (int i = 0; i < 10000; i++) {
+        float f = ((float)rand() / (float)RAND_MAX - 0.5f) * 2000.0f;
+        char expected[64], actual[64];
+        snprintf(expected, sizeof(expected), "%.5f", (double)f);
+        ei_log_format_float(actual, sizeof(actual), f, 5);
+        if (strcmp(expected, actual) != 0) {
+            printf("  %s != %s\n", actual, expected);
+            same = false;
+            break;
+        }
+    }
+    EI_TEST_CHECK(same);
+
+    char buf[16];
+    ei_log_format_float(buf, sizeof(buf), NAN, 2);
+    EI_TEST_CHECK(strcmp(buf, "nan") == 0);
+    ei_log_format_float(buf, sizeof(buf), -INFINITY, 2);
+    EI_TEST_CHECK(strcmp(buf, "-inf") == 0);
+    ei_log_format_float(buf, sizeof(buf), 2.5e20f, 1);
+    EI_TEST_CHECK(strncmp(buf, "2.5e+20", 7) == 0);
+
+    // truncated, but the full length is returned
+    EI_TEST_CHECK_EQ(ei_log_format_float(buf, 4, 1234.5f, 1), 6);
+    EI_TEST_CHECK(strcmp(buf, "123") == 0);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_concurrent_producers);
+    EI_TEST_RUN(test_overflow_counters);
+    EI_TEST_RUN(test_wrap_around);
+    EI_TEST_RUN(test_uncommitted_blocks_drain);
+    EI_TEST_RUN(test_format_float);
+
+    return EI_TEST_RESULT();
+}
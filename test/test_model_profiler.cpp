@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_model_profiler.cpp
+ * @brief Per op profile of the compiled (EON) model, recorded by the kernel
+ * wrappers, built with EI_CLASSIFIER_PROFILE_OPS set by the test target
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+#if EI_CLASSIFIER_TFLITE_OUTPUT_DATATYPE == EI_CLASSIFIER_DATATYPE_FLOAT32
+#define TEST_OUTPUT_ELEMENT_BYTES   4
+#else
+#define TEST_OUTPUT_ELEMENT_BYTES   1
+#endif
+
+/* Tests ------------------------------------------------------------------- */
+
+/* The generated model is three dense layers and a softmax */
+static void test_compiled_model_ops(void)
+{
+    std::vector<float> features(EI_CLASSIFIER_DSP_INPUT_FRAME_SIZE);
+    for (size_t ix = 0; ix < features.size(); ix++) {
+        features[ix] = (float)(ix % 7) - 3.0f;
+    }
+    signal_t signal;
+    numpy::signal_from_buffer(features.data(), features.size(), &signal);
+    ei_impulse_result_t result;
+
+    // twice, the table holds the last inference only
+    for (int run = 0; run < 2; run++) {
+        EI_TEST_CHECK_EQ(run_classifier(&signal, &result, false), EI_IMPULSE_OK);
+    }
+
+    const ei_model_profile_t *profile = result.timing.ops;
+    EI_TEST_CHECK(profile == ei_profiler_get());
+    EI_TEST_CHECK_EQ(profile->count, 4);
+    EI_TEST_CHECK_EQ(profile->dropped, 0);
+
+    const char *expected[] = { "FULLY_CONNECTED", "FULLY_CONNECTED", "FULLY_CONNECTED", "SOFTMAX" };
+    for (uint16_t ix = 0; ix < profile->count && ix < 4; ix++) {
+        const ei_op_profile_t *op = &profile->ops[ix];
+        EI_TEST_CHECK(op->op != nullptr && strcmp(op->op, expected[ix]) == 0);
+        EI_TEST_CHECK(op->input_bytes > 0);
+        EI_TEST_CHECK(op->output_bytes > 0);
+    }
+
+    // input features, weights and bias of the first layer
+    EI_TEST_CHECK(profile->ops[0].input_bytes > EI_CLASSIFIER_NN_INPUT_FRAME_SIZE);
+    // the softmax reads and writes one value per label
+    EI_TEST_CHECK_EQ(profile->ops[3].input_bytes, EI_CLASSIFIER_LABEL_COUNT * TEST_OUTPUT_ELEMENT_BYTES);
+    EI_TEST_CHECK_EQ(profile->ops[3].output_bytes, EI_CLASSIFIER_LABEL_COUNT * TEST_OUTPUT_ELEMENT_BYTES);
+}
+
+/* A kernel is wrapped once, however often it is registered */
+static void test_kernel_wrapped_once(void)
+{
+    TfLiteRegistration first = tflite::Register_SOFTMAX();
+    TfLiteRegistration second = tflite::Register_SOFTMAX();
+
+    EI_TEST_CHECK(first.invoke != nullptr);
+    EI_TEST_CHECK(first.invoke == second.invoke);
+}
+
+/* Ops past EI_CLASSIFIER_PROFILE_MAX_OPS are counted, not recorded */
+static void test_table_overflow(void)
+{
+    ei_profiler_reset();
+
+    for (int ix = 0; ix < EI_CLASSIFIER_PROFILE_MAX_OPS + 3; ix++) {
+        uint32_t handle = ei_profiler_op_begin("OP");
+        ei_profiler_op_end(handle, 10, 20);
+    }
+
+    const ei_model_profile_t *profile = ei_profiler_get();
+    EI_TEST_CHECK_EQ(profile->count, EI_CLASSIFIER_PROFILE_MAX_OPS);
+    EI_TEST_CHECK_EQ(profile->dropped, 3);
+    EI_TEST_CHECK_EQ(profile->ops[EI_CLASSIFIER_PROFILE_MAX_OPS - 1].input_bytes, 10);
+    EI_TEST_CHECK_EQ(profile->ops[EI_CLASSIFIER_PROFILE_MAX_OPS - 1].output_bytes, 20);
+
+    ei_profiler_reset();
+    EI_TEST_CHECK_EQ(profile->count, 0);
+    EI_TEST_CHECK_EQ(profile->dropped, 0);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_compiled_model_ops);
+    EI_TEST_RUN(test_kernel_wrapped_once);
+    EI_TEST_RUN(test_table_overflow);
+
+    return EI_TEST_RESULT();
+}
@@ -0,0 +1,499 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_multi_impulse.cpp
+ * @brief run_classifier_multi with two impulses of the generated model on a
+ * shared stream, against run_classifier on each impulse, and image impulses
+ * that share (or don't share) scaled features
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+// the generated model has no image blocks, turn on the image scaling path
+// for the image impulses built below
+#include "model-parameters/model_metadata.h"
+#undef EI_CLASSIFIER_LOAD_IMAGE_SCALING
+#define EI_CLASSIFIER_LOAD_IMAGE_SCALING 1
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+#include "edge-impulse-sdk/classifier/ei_multi_impulse.h"
+
+#include <map>
+#include <random>
+#include <stdarg.h>
+#include <string>
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_WINDOWS                12
+#define TEST_SLICE                  (EI_CLASSIFIER_SLICE_SIZE * EI_CLASSIFIER_RAW_SAMPLES_PER_FRAME)
+#define TEST_WINDOW                 EI_CLASSIFIER_DSP_INPUT_FRAME_SIZE
+#define TEST_IMAGE_PIXELS           48
+
+/* Mocks ------------------------------------------------------------------- */
+
+static bool capture = false;
+static std::string captured;
+
+/**
+ * Replaces the weak POSIX ei_printf, run_classifier_multi reports how many
+ * DSP blocks it ran in debug mode
+ */
+void ei_printf(const char *format, ...)
+{
+    char buf[1024];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    if (capture) {
+        captured += buf;
+    }
+    else {
+        fputs(buf, stdout);
+    }
+}
+
+typedef struct {
+    int dsp_runs;
+    int dsp_blocks;
+} multi_counts_t;
+
+/**
+ * run_classifier_multi in debug mode, returns the DSP blocks it ran and the
+ * DSP blocks of the due impulses
+ */
+static multi_counts_t run_multi(ei_scheduled_impulse_t *impulses, size_t count, signal_t *signal)
+{
+    multi_counts_t counts = { -1, -1 };
+
+    captured.clear();
+    capture = true;
+    EI_TEST_CHECK_EQ(run_classifier_multi(impulses, count, signal, true), EI_IMPULSE_OK);
+    capture = false;
+
+    const char *line = strstr(captured.c_str(), "Running ");
+    while (line && sscanf(line, "Running %d DSP blocks for %d blocks", &counts.dsp_runs, &counts.dsp_blocks) != 2) {
+        line = strstr(line + 1, "Running ");
+    }
+
+    return counts;
+}
+
+/* Impulses ---------------------------------------------------------------- */
+
+/**
+ * The generated impulse with another project id and DSP block table
+ */
+static ei_impulse_t impulse_with_blocks(uint32_t project_id, ei_model_dsp_t *dsp_blocks)
+{
+    ei_impulse_t impulse = *ei_default_impulse.impulse;
+
+    impulse.project_id = project_id;
+    impulse.dsp_blocks = dsp_blocks;
+
+    return impulse;
+}
+
+/**
+ * A second deployment of the generated model: its own DSP block table that
+ * points at the generated block (same extract function and config)
+ */
+static ei_model_dsp_t generated_blocks[ei_dsp_blocks_size];
+static const ei_impulse_t generated_impulse = impulse_with_blocks(1001, generated_blocks);
+
+/**
+ * Impulses with the stock spectral analysis function, each with its own copy
+ * of the config as another project would generate it (block_id differs)
+ */
+static ei_dsp_config_spectral_analysis_t stock_configs[3];
+static ei_model_dsp_t stock_blocks[3][ei_dsp_blocks_size];
+static const ei_impulse_t stock_impulses[3] = {
+    impulse_with_blocks(2001, stock_blocks[0]),
+    impulse_with_blocks(2002, stock_blocks[1]),
+    impulse_with_blocks(2003, stock_blocks[2]),
+};
+
+static void build_impulses(void)
+{
+    memcpy(generated_blocks, ei_dsp_blocks, sizeof(generated_blocks));
+
+    for (size_t ix = 0; ix < 3; ix++) {
+        stock_configs[ix] = ei_dsp_config_2;
+        stock_configs[ix].block_id = 100 + ix;
+        memcpy(stock_blocks[ix], ei_dsp_blocks, sizeof(stock_blocks[ix]));
+        stock_blocks[ix][0].extract_fn = &extract_spectral_analysis_features;
+        stock_blocks[ix][0].config = &stock_configs[ix];
+    }
+    // the third one computes different features
+    stock_configs[2].scale_axes = 2.0f;
+}
+
+/**
+ * Image impulses: one RGB image block, learning blocks that record the
+ * features they are given, keyed by project id and learning block index
+ */
+static std::map<std::pair<uint32_t, uint32_t>, ei_feature_t> seen_scaling;
+static std::map<std::pair<uint32_t, uint32_t>, std::vector<float>> seen_features;
+
+static EI_IMPULSE_ERROR record_features(const ei_impulse_t *impulse, ei_feature_t *fmatrix,
+    uint32_t learn_block_index, uint32_t *input_block_ids, uint32_t input_block_ids_size,
+    ei_impulse_result_t *result, void *config, bool debug)
+{
+    const ei::matrix_t *matrix = fmatrix[0].matrix;
+    std::pair<uint32_t, uint32_t> key(impulse->project_id, learn_block_index);
+
+    seen_scaling[key] = fmatrix[0];
+    seen_features[key].assign(matrix->buffer, matrix->buffer + matrix->rows * matrix->cols);
+    return EI_IMPULSE_OK;
+}
+
+static ei_dsp_config_image_t image_config = { 1, 1, 1, "RGB" };
+static uint8_t image_axes[1] = { 0 };
+static ei_model_dsp_t image_blocks[1] = {
+    { 1, TEST_IMAGE_PIXELS * 3, &extract_image_features, &image_config, image_axes, 1, 1, nullptr },
+};
+
+static ei_learning_block_t learning_block(int image_scaling)
+{
+    ei_learning_block_t block = { 2, false, &record_features, nullptr, image_scaling, nullptr, 0, 0 };
+    return block;
+}
+
+static const ei_learning_block_t torch_blocks[1] = { learning_block(EI_CLASSIFIER_IMAGE_SCALING_TORCH) };
+static const ei_learning_block_t min128_blocks[1] = { learning_block(EI_CLASSIFIER_IMAGE_SCALING_MIN128_127) };
+static const ei_learning_block_t bgr_blocks[1] = { learning_block(EI_CLASSIFIER_IMAGE_SCALING_BGR_SUBTRACT_IMAGENET_MEAN) };
+static const ei_learning_block_t u8_blocks[1] = { learning_block(EI_CLASSIFIER_IMAGE_SCALING_0_255) };
+static const ei_learning_block_t mixed_blocks[2] = {
+    learning_block(EI_CLASSIFIER_IMAGE_SCALING_TORCH),
+    learning_block(EI_CLASSIFIER_IMAGE_SCALING_0_255),
+};
+
+static ei_impulse_t image_impulse(uint32_t project_id, const ei_learning_block_t *blocks, size_t blocks_size)
+{
+    const ei_impulse_t &base = *ei_default_impulse.impulse;
+    ei_impulse_t impulse = {
+        project_id, base.project_owner, base.project_name, base.deploy_version,
+        TEST_IMAGE_PIXELS * 3, TEST_IMAGE_PIXELS, 1, TEST_IMAGE_PIXELS, 8, 6, 1, 1.0f, 1.0f,
+        1, image_blocks,
+        0, 0, 0,
+        blocks_size, blocks,
+        base.inferencing_engine,
+        EI_CLASSIFIER_SENSOR_CAMERA, "image", TEST_IMAGE_PIXELS, 1,
+        0, 0, base.calibration, base.categories, base.object_detection_nms,
+    };
+    return impulse;
+}
+
+// built on first use, ei_default_impulse lives in another translation unit
+static const ei_impulse_t *image_impulses(void)
+{
+    static const ei_impulse_t impulses[6] = {
+        image_impulse(3001, torch_blocks, 1),
+        image_impulse(3002, torch_blocks, 1),
+        image_impulse(3003, min128_blocks, 1),
+        image_impulse(3004, bgr_blocks, 1),
+        image_impulse(3005, u8_blocks, 1),
+        image_impulse(3006, mixed_blocks, 2),
+    };
+    return impulses;
+}
+
+static std::vector<float> random_image(void)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint32_t> pixel(0, 0xffffff);
+    std::vector<float> pixels(TEST_IMAGE_PIXELS);
+
+    for (size_t ix = 0; ix < pixels.size(); ix++) {
+        pixels[ix] = (float)pixel(rng);
+    }
+    return pixels;
+}
+
+/**
+ * What the image block computes for a learning block with this scaling
+ */
+static std::vector<float> scaled_image(signal_t *signal, int image_scaling)
+{
+    ei::matrix_t matrix(1, TEST_IMAGE_PIXELS * 3);
+    EI_TEST_CHECK_EQ(extract_image_features_scaled(signal, &matrix, &image_config, 1.0f, image_scaling), EIDSP_OK);
+    return std::vector<float>(matrix.buffer, matrix.buffer + TEST_IMAGE_PIXELS * 3);
+}
+
+static bool seen_exactly(uint32_t project_id, uint32_t learn_block_index, const std::vector<float> &expected)
+{
+    std::pair<uint32_t, uint32_t> key(project_id, learn_block_index);
+    return seen_features.count(key) == 1 && seen_features[key] == expected;
+}
+
+/**
+ * Accelerometer like stream: a few slow movements per axis plus noise
+ */
+static std::vector<float> stream(size_t windows)
+{
+    std::mt19937 rng(1234);
+    std::normal_distribution<float> noise(0.0f, 0.3f);
+    std::vector<float> samples(TEST_WINDOW + windows * TEST_SLICE);
+
+    for (size_t i = 0; i < samples.size(); i++) {
+        const float t = (float)(i / EI_CLASSIFIER_RAW_SAMPLES_PER_FRAME) / EI_CLASSIFIER_FREQUENCY;
+        const size_t axis = i % EI_CLASSIFIER_RAW_SAMPLES_PER_FRAME;
+        samples[i] = 4.0f * sinf(2.0f * (float)M_PI * (0.7f + 1.9f * axis) * t + axis) *
+            (1.0f + sinf(0.4f * t)) + noise(rng);
+    }
+
+    return samples;
+}
+
+/**
+ * The scheduled result has to be what run_classifier gives for the impulse
+ * on its own
+ */
+static void check_matches_run_classifier(ei_impulse_handle_t *handle, signal_t *signal,
+    const ei_impulse_result_t *result)
+{
+    ei_impulse_result_t expected;
+
+    EI_TEST_CHECK_EQ(run_classifier(handle, signal, &expected), EI_IMPULSE_OK);
+    for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
+        EI_TEST_CHECK(strcmp(result->classification[ix].label, expected.classification[ix].label) == 0);
+        EI_TEST_CHECK_EQ(result->classification[ix].value == expected.classification[ix].value, true);
+    }
+#if EI_CLASSIFIER_HAS_ANOMALY
+    EI_TEST_CHECK_EQ(result->anomaly == expected.anomaly, true);
+#endif
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+static void test_generated_block_runs_once(void)
+{
+    ei_impulse_handle_t second(&generated_impulse);
+    ei_impulse_result_t results[2];
+    ei_scheduled_impulse_t impulses[2] = {
+        { &ei_default_impulse, &results[0], 1, false, 0 },
+        { &second, &results[1], 1, false, 0 },
+    };
+    std::vector<float> samples = stream(0);
+    signal_t signal;
+    numpy::signal_from_buffer(samples.data(), TEST_WINDOW, &signal);
+
+    multi_counts_t counts = run_multi(impulses, 2, &signal);
+    EI_TEST_CHECK_EQ(counts.dsp_runs, 1);
+    EI_TEST_CHECK_EQ(counts.dsp_blocks, 2);
+    EI_TEST_CHECK(impulses[0].has_result && impulses[1].has_result);
+
+    check_matches_run_classifier(&ei_default_impulse, &signal, &results[0]);
+    check_matches_run_classifier(&second, &signal, &results[1]);
+}
+
+/* Equal configs are shared by content, a different one runs on its own */
+static void test_equal_configs_share_dsp(void)
+{
+    ei_impulse_handle_t handles[3] = {
+        ei_impulse_handle_t(&stock_impulses[0]),
+        ei_impulse_handle_t(&stock_impulses[1]),
+        ei_impulse_handle_t(&stock_impulses[2]),
+    };
+    ei_impulse_result_t results[3];
+    ei_scheduled_impulse_t impulses[3] = {
+        { &handles[0], &results[0], 1, false, 0 },
+        { &handles[1], &results[1], 1, false, 0 },
+        { &handles[2], &results[2], 1, false, 0 },
+    };
+    std::vector<float> samples = stream(0);
+    signal_t signal;
+    numpy::signal_from_buffer(samples.data(), TEST_WINDOW, &signal);
+
+    multi_counts_t counts = run_multi(impulses, 2, &signal);
+    EI_TEST_CHECK_EQ(counts.dsp_runs, 1);
+    EI_TEST_CHECK_EQ(counts.dsp_blocks, 2);
+
+    counts = run_multi(impulses, 3, &signal);
+    EI_TEST_CHECK_EQ(counts.dsp_runs, 2);
+    EI_TEST_CHECK_EQ(counts.dsp_blocks, 3);
+
+    for (size_t ix = 0; ix < 3; ix++) {
+        EI_TEST_CHECK(impulses[ix].has_result);
+        check_matches_run_classifier(&handles[ix], &signal, &results[ix]);
+    }
+}
+
+/**
+ * Sliding windows over one stream, the first impulse classifies every window
+ * and the second one every other window
+ */
+static void test_decision_intervals(void)
+{
+    ei_impulse_handle_t second(&generated_impulse);
+    ei_impulse_result_t results[2];
+    ei_scheduled_impulse_t impulses[2] = {
+        { &ei_default_impulse, &results[0], 1, false, 0 },
+        { &second, &results[1], 2, false, 0 },
+    };
+    std::vector<float> samples = stream(TEST_WINDOWS);
+    int second_results = 0;
+
+    for (size_t w = 0; w < TEST_WINDOWS; w++) {
+        signal_t signal;
+        numpy::signal_from_buffer(&samples[w * TEST_SLICE], TEST_WINDOW, &signal);
+
+        multi_counts_t counts = run_multi(impulses, 2, &signal);
+        const bool second_due = (w % 2) == 0;
+
+        EI_TEST_CHECK_EQ(counts.dsp_runs, 1);
+        EI_TEST_CHECK_EQ(counts.dsp_blocks, second_due ? 2 : 1);
+        EI_TEST_CHECK(impulses[0].has_result);
+        EI_TEST_CHECK_EQ(impulses[1].has_result, second_due);
+
+        check_matches_run_classifier(&ei_default_impulse, &signal, &results[0]);
+        if (impulses[1].has_result) {
+            check_matches_run_classifier(&second, &signal, &results[1]);
+            second_results++;
+        }
+    }
+
+    EI_TEST_CHECK_EQ(impulses[0].window_count, TEST_WINDOWS);
+    EI_TEST_CHECK_EQ(impulses[1].window_count, TEST_WINDOWS);
+    EI_TEST_CHECK_EQ(second_results, TEST_WINDOWS / 2);
+}
+
+/* Impulses that want the same scaling share the pre-scaled image */
+static void test_image_same_scaling_shares(void)
+{
+    ei_impulse_handle_t handles[2] = {
+        ei_impulse_handle_t(&image_impulses()[0]),
+        ei_impulse_handle_t(&image_impulses()[1]),
+    };
+    ei_impulse_result_t results[2];
+    ei_scheduled_impulse_t impulses[2] = {
+        { &handles[0], &results[0], 1, false, 0 },
+        { &handles[1], &results[1], 1, false, 0 },
+    };
+    std::vector<float> pixels = random_image();
+    signal_t signal;
+    numpy::signal_from_buffer(pixels.data(), pixels.size(), &signal);
+    std::vector<float> expected = scaled_image(&signal, EI_CLASSIFIER_IMAGE_SCALING_TORCH);
+
+    seen_features.clear();
+    multi_counts_t counts = run_multi(impulses, 2, &signal);
+    EI_TEST_CHECK_EQ(counts.dsp_runs, 1);
+    EI_TEST_CHECK(seen_exactly(3001, 0, expected));
+    EI_TEST_CHECK(seen_exactly(3002, 0, expected));
+    EI_TEST_CHECK_EQ(seen_scaling[std::make_pair(3001u, 0u)].image_scaling, EI_CLASSIFIER_IMAGE_SCALING_TORCH);
+}
+
+/* Every scaling gets its own features, computed in that scaling */
+static void test_image_scalings_grouped(void)
+{
+    ei_impulse_handle_t handles[4] = {
+        ei_impulse_handle_t(&image_impulses()[0]),
+        ei_impulse_handle_t(&image_impulses()[2]),
+        ei_impulse_handle_t(&image_impulses()[3]),
+        ei_impulse_handle_t(&image_impulses()[1]),
+    };
+    ei_impulse_result_t results[4];
+    ei_scheduled_impulse_t impulses[4] = {
+        { &handles[0], &results[0], 1, false, 0 },
+        { &handles[1], &results[1], 1, false, 0 },
+        { &handles[2], &results[2], 1, false, 0 },
+        { &handles[3], &results[3], 1, false, 0 },
+    };
+    std::vector<float> pixels = random_image();
+    signal_t signal;
+    numpy::signal_from_buffer(pixels.data(), pixels.size(), &signal);
+
+    seen_features.clear();
+    multi_counts_t counts = run_multi(impulses, 4, &signal);
+    EI_TEST_CHECK_EQ(counts.dsp_runs, 3);
+    EI_TEST_CHECK(seen_exactly(3001, 0, scaled_image(&signal, EI_CLASSIFIER_IMAGE_SCALING_TORCH)));
+    EI_TEST_CHECK(seen_exactly(3002, 0, scaled_image(&signal, EI_CLASSIFIER_IMAGE_SCALING_TORCH)));
+    EI_TEST_CHECK(seen_exactly(3003, 0, scaled_image(&signal, EI_CLASSIFIER_IMAGE_SCALING_MIN128_127)));
+    EI_TEST_CHECK(seen_exactly(3004, 0, scaled_image(&signal, EI_CLASSIFIER_IMAGE_SCALING_BGR_SUBTRACT_IMAGENET_MEAN)));
+}
+
+/**
+ * An impulse whose learning blocks want different scalings is rescaled in
+ * place by run_inference, on its own copy: the impulse after it still gets
+ * the exact features
+ */
+static void test_image_mixed_scaling_private(void)
+{
+    ei_impulse_handle_t handles[3] = {
+        ei_impulse_handle_t(&image_impulses()[5]),
+        ei_impulse_handle_t(&image_impulses()[4]),
+        ei_impulse_handle_t(&image_impulses()[0]),
+    };
+    ei_impulse_result_t results[3];
+    ei_scheduled_impulse_t impulses[3] = {
+        { &handles[0], &results[0], 1, false, 0 },
+        { &handles[1], &results[1], 1, false, 0 },
+        { &handles[2], &results[2], 1, false, 0 },
+    };
+    std::vector<float> pixels = random_image();
+    signal_t signal;
+    numpy::signal_from_buffer(pixels.data(), pixels.size(), &signal);
+    std::vector<float> u8 = scaled_image(&signal, EI_CLASSIFIER_IMAGE_SCALING_0_255);
+    std::vector<float> torch = scaled_image(&signal, EI_CLASSIFIER_IMAGE_SCALING_TORCH);
+
+    seen_features.clear();
+    multi_counts_t counts = run_multi(impulses, 3, &signal);
+    EI_TEST_CHECK_EQ(counts.dsp_runs, 3);
+    EI_TEST_CHECK(seen_exactly(3005, 0, u8));
+    EI_TEST_CHECK(seen_exactly(3001, 0, torch));
+
+    // the mixed impulse sees its scalings, up to the in place round trip
+    const std::vector<float> &mixed_torch = seen_features[std::make_pair(3006u, 0u)];
+    const std::vector<float> &mixed_u8 = seen_features[std::make_pair(3006u, 1u)];
+    EI_TEST_CHECK_EQ(mixed_torch.size(), torch.size());
+    EI_TEST_CHECK_EQ(mixed_u8.size(), u8.size());
+    for (size_t ix = 0; ix < torch.size() && ix < mixed_torch.size() && ix < mixed_u8.size(); ix++) {
+        EI_TEST_CHECK_NEAR(mixed_torch[ix], torch[ix], 1e-4f);
+        EI_TEST_CHECK_NEAR(mixed_u8[ix], u8[ix], 1e-3f);
+    }
+}
+
+static void test_rejects_mismatched_window(void)
+{
+    ei_impulse_result_t result;
+    ei_scheduled_impulse_t impulses[1] = {
+        { &ei_default_impulse, &result, 1, false, 0 },
+    };
+    std::vector<float> samples = stream(0);
+    signal_t signal;
+    numpy::signal_from_buffer(samples.data(), TEST_WINDOW - 1, &signal);
+
+    EI_TEST_CHECK_EQ(run_classifier_multi(impulses, 1, &signal), EI_IMPULSE_INVALID_SIZE);
+    EI_TEST_CHECK_EQ(run_classifier_multi(impulses, 0, &signal), EI_IMPULSE_INFERENCE_ERROR);
+}
+
+int main(void)
+{
+    build_impulses();
+
+    EI_TEST_RUN(test_generated_block_runs_once);
+    EI_TEST_RUN(test_equal_configs_share_dsp);
+    EI_TEST_RUN(test_decision_intervals);
+    EI_TEST_RUN(test_image_same_scaling_shares);
+    EI_TEST_RUN(test_image_scalings_grouped);
+    EI_TEST_RUN(test_image_mixed_scaling_private);
+    EI_TEST_RUN(test_rejects_mismatched_window);
+
+    return EI_TEST_RESULT();
+}
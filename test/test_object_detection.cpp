@@ -0,0 +1,955 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_object_detection.cpp
+ * @brief YOLOv5 decoders with the top-k prefilter against the previous full
+ * scan, and NMS against the previous priority queue implementation
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+// the generated model is not an object detection model, build the YOLOv5
+// decoders (and NMS) anyway
+#include "model-parameters/model_metadata.h"
+#undef EI_CLASSIFIER_OBJECT_DETECTION_LAST_LAYER
+#define EI_CLASSIFIER_OBJECT_DETECTION_LAST_LAYER EI_CLASSIFIER_LAST_LAYER_YOLOV5
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+
+#include <algorithm>
+#include <deque>
+#include <queue>
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_INPUT_SIZE             96
+#define TEST_COL_SIZE               (5 + EI_CLASSIFIER_LABEL_COUNT)
+#define TEST_OBJECT_COUNT           10
+
+/* Reference --------------------------------------------------------------- */
+
+namespace reference {
+
+// the decoders before the top-k prefilter, every anchor is decoded
+/**
+  * Fill the result structure from an unquantized output tensor
+  */
+__attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_f32_yolov5(const ei_impulse_t *impulse,
+                                                                              const ei_learning_block_config_tflite_graph_t *block_config,
+                                                                              ei_impulse_result_t *result,
+                                                                              int version,
+                                                                              float *data,
+                                                                              size_t output_features_count,
+                                                                              bool debug = false) {
+#ifdef EI_HAS_YOLOV5
+    static std::vector<ei_impulse_result_bounding_box_t> results;
+    results.clear();
+
+    size_t col_size = 5 + impulse->label_count;
+    size_t row_count = output_features_count / col_size;
+
+    for (size_t ix = 0; ix < row_count; ix++) {
+        size_t base_ix = ix * col_size;
+        float xc = data[base_ix + 0];
+        float yc = data[base_ix + 1];
+        float w = data[base_ix + 2];
+        float h = data[base_ix + 3];
+        float x = xc - (w / 2.0f);
+        float y = yc - (h / 2.0f);
+        if (x < 0) {
+            x = 0;
+        }
+        if (y < 0) {
+            y = 0;
+        }
+        if (x + w > impulse->input_width) {
+            w = impulse->input_width - x;
+        }
+        if (y + h > impulse->input_height) {
+            h = impulse->input_height - y;
+        }
+
+        if (w < 0 || h < 0) {
+            continue;
+        }
+
+        float score = data[base_ix + 4];
+
+        uint32_t label = 0;
+        for (size_t lx = 0; lx < impulse->label_count; lx++) {
+            float l = data[base_ix + 5 + lx];
+            if (l > 0.5f) {
+                label = lx;
+                break;
+            }
+        }
+
+        if (score >= block_config->threshold && score <= 1.0f) {
+            ei_impulse_result_bounding_box_t r;
+            r.label = impulse->categories[label];
+
+            if (version != 5) {
+                x *= static_cast<float>(impulse->input_width);
+                y *= static_cast<float>(impulse->input_height);
+                w *= static_cast<float>(impulse->input_width);
+                h *= static_cast<float>(impulse->input_height);
+            }
+
+            r.x = static_cast<uint32_t>(x);
+            r.y = static_cast<uint32_t>(y);
+            r.width = static_cast<uint32_t>(w);
+            r.height = static_cast<uint32_t>(h);
+            r.value = score;
+            results.push_back(r);
+        }
+    }
+
+    EI_IMPULSE_ERROR nms_res = ei_run_nms(impulse, &results, debug);
+    if (nms_res != EI_IMPULSE_OK) {
+        return nms_res;
+    }
+
+    // if we didn't detect min required objects, fill the rest with fixed value
+    size_t added_boxes_count = results.size();
+    size_t min_object_detection_count = impulse->object_detection_count;
+    if (added_boxes_count < min_object_detection_count) {
+        results.resize(min_object_detection_count);
+        for (size_t ix = added_boxes_count; ix < min_object_detection_count; ix++) {
+            results[ix].value = 0.0f;
+        }
+    }
+
+    result->bounding_boxes = results.data();
+    result->bounding_boxes_count = results.size();
+
+    return EI_IMPULSE_OK;
+#else
+    return EI_IMPULSE_LAST_LAYER_NOT_AVAILABLE;
+#endif
+}
+
+/**
+ * Fill the result structure from a quantized output tensor
+*/
+template<typename T>
+__attribute__((unused)) static EI_IMPULSE_ERROR fill_result_struct_quantized_yolov5(const ei_impulse_t *impulse,
+                                                                                    const ei_learning_block_config_tflite_graph_t *block_config,
+                                                                                    ei_impulse_result_t *result,
+                                                                                    int version,
+                                                                                    T *data,
+                                                                                    float zero_point,
+                                                                                    float scale,
+                                                                                    size_t output_features_count,
+                                                                                    bool debug = false) {
+#ifdef EI_HAS_YOLOV5
+    static std::vector<ei_impulse_result_bounding_box_t> results;
+    results.clear();
+
+    size_t col_size = 5 + impulse->label_count;
+    size_t row_count = output_features_count / col_size;
+
+    for (size_t ix = 0; ix < row_count; ix++) {
+        size_t base_ix = ix * col_size;
+        float xc = (data[base_ix + 0] - zero_point) * scale;
+        float yc = (data[base_ix + 1] - zero_point) * scale;
+        float w = (data[base_ix + 2] - zero_point) * scale;
+        float h = (data[base_ix + 3] - zero_point) * scale;
+        float x = xc - (w / 2.0f);
+        float y = yc - (h / 2.0f);
+        if (x < 0) {
+            x = 0;
+        }
+        if (y < 0) {
+            y = 0;
+        }
+        if (x + w > impulse->input_width) {
+            w = impulse->input_width - x;
+        }
+        if (y + h > impulse->input_height) {
+            h = impulse->input_height - y;
+        }
+
+        if (w < 0 || h < 0) {
+            continue;
+        }
+
+        float score = (data[base_ix + 4] - zero_point) * scale;
+
+        uint32_t label = 0;
+        for (size_t lx = 0; lx < impulse->label_count; lx++) {
+            float l = (data[base_ix + 5 + lx] - zero_point) * scale;
+            if (l > 0.5f) {
+                label = lx;
+                break;
+            }
+        }
+
+        if (score >= block_config->threshold && score <= 1.0f) {
+            ei_impulse_result_bounding_box_t r;
+            r.label = ei_classifier_inferencing_categories[label];
+
+            if (version != 5) {
+                x *= static_cast<float>(impulse->input_width);
+                y *= static_cast<float>(impulse->input_height);
+                w *= static_cast<float>(impulse->input_width);
+                h *= static_cast<float>(impulse->input_height);
+            }
+
+            r.x = static_cast<uint32_t>(x);
+            r.y = static_cast<uint32_t>(y);
+            r.width = static_cast<uint32_t>(w);
+            r.height = static_cast<uint32_t>(h);
+            r.value = score;
+            results.push_back(r);
+        }
+    }
+
+    EI_IMPULSE_ERROR nms_res = ei_run_nms(impulse, &results, debug);
+    if (nms_res != EI_IMPULSE_OK) {
+        return nms_res;
+    }
+
+    // if we didn't detect min required objects, fill the rest with fixed value
+    size_t added_boxes_count = results.size();
+    size_t min_object_detection_count = impulse->object_detection_count;
+    if (added_boxes_count < min_object_detection_count) {
+        results.resize(min_object_detection_count);
+        for (size_t ix = added_boxes_count; ix < min_object_detection_count; ix++) {
+            results[ix].value = 0.0f;
+        }
+    }
+
+    result->bounding_boxes = results.data();
+    result->bounding_boxes_count = results.size();
+
+    return EI_IMPULSE_OK;
+#else
+    return EI_IMPULSE_LAST_LAYER_NOT_AVAILABLE;
+#endif
+}
+
+} // namespace reference
+
+namespace reference_nms {
+
+// ei_nms.h before the sorted index array and the preallocated scratch. Its
+// calls to ei_run_nms are qualified, argument dependent lookup would find
+// the current ones too.
+
+// A pair of diagonal corners of the box.
+struct BoxCornerEncoding {
+  float y1;
+  float x1;
+  float y2;
+  float x2;
+};
+
+static inline float ComputeIntersectionOverUnion(const float* boxes, const int i,
+                                          const int j) {
+  auto& box_i = reinterpret_cast<const BoxCornerEncoding*>(boxes)[i];
+  auto& box_j = reinterpret_cast<const BoxCornerEncoding*>(boxes)[j];
+  const float box_i_y_min = std::min<float>(box_i.y1, box_i.y2);
+  const float box_i_y_max = std::max<float>(box_i.y1, box_i.y2);
+  const float box_i_x_min = std::min<float>(box_i.x1, box_i.x2);
+  const float box_i_x_max = std::max<float>(box_i.x1, box_i.x2);
+  const float box_j_y_min = std::min<float>(box_j.y1, box_j.y2);
+  const float box_j_y_max = std::max<float>(box_j.y1, box_j.y2);
+  const float box_j_x_min = std::min<float>(box_j.x1, box_j.x2);
+  const float box_j_x_max = std::max<float>(box_j.x1, box_j.x2);
+
+  const float area_i =
+      (box_i_y_max - box_i_y_min) * (box_i_x_max - box_i_x_min);
+  const float area_j =
+      (box_j_y_max - box_j_y_min) * (box_j_x_max - box_j_x_min);
+  if (area_i <= 0 || area_j <= 0) return 0.0;
+  const float intersection_ymax = std::min<float>(box_i_y_max, box_j_y_max);
+  const float intersection_xmax = std::min<float>(box_i_x_max, box_j_x_max);
+  const float intersection_ymin = std::max<float>(box_i_y_min, box_j_y_min);
+  const float intersection_xmin = std::max<float>(box_i_x_min, box_j_x_min);
+  const float intersection_area =
+      std::max<float>(intersection_ymax - intersection_ymin, 0.0) *
+      std::max<float>(intersection_xmax - intersection_xmin, 0.0);
+  return intersection_area / (area_i + area_j - intersection_area);
+}
+
+// Implements (Single-Class) Soft NMS (with Gaussian weighting).
+// Supports functionality of TensorFlow ops NonMaxSuppressionV4 & V5.
+// Reference: "Soft-NMS - Improving Object Detection With One Line of Code"
+//            [Bodla et al, https://arxiv.org/abs/1704.04503]
+// Implementation adapted from the TensorFlow NMS code at
+// tensorflow/core/kernels/non_max_suppression_op.cc.
+//
+// Arguments:
+//  boxes: box encodings in format [y1, x1, y2, x2], shape: [num_boxes, 4]
+//  num_boxes: number of candidates
+//  scores: scores for candidate boxes, in the same order. shape: [num_boxes]
+//  max_output_size: the maximum number of selections.
+//  iou_threshold: Intersection-over-Union (IoU) threshold for NMS
+//  score_threshold: All candidate scores below this value are rejected
+//  soft_nms_sigma: Soft NMS parameter, used for decaying scores
+//
+// Outputs:
+//  selected_indices: all the selected indices. Underlying array must have
+//    length >= max_output_size. Cannot be null.
+//  selected_scores: scores of selected indices. Defer from original value for
+//    Soft NMS. If not null, array must have length >= max_output_size.
+//  num_selected_indices: Number of selections. Only these many elements are
+//    set in selected_indices, selected_scores. Cannot be null.
+//
+// Assumes inputs are valid (for eg, iou_threshold must be >= 0).
+static inline void NonMaxSuppression(const float* boxes, const int num_boxes,
+                              const float* scores, const int max_output_size,
+                              const float iou_threshold,
+                              const float score_threshold,
+                              const float soft_nms_sigma, int* selected_indices,
+                              float* selected_scores,
+                              int* num_selected_indices) {
+  struct Candidate {
+    int index;
+    float score;
+    int suppress_begin_index;
+  };
+
+  // Priority queue to hold candidates.
+  auto cmp = [](const Candidate bs_i, const Candidate bs_j) {
+    return bs_i.score < bs_j.score;
+  };
+  std::priority_queue<Candidate, std::deque<Candidate>, decltype(cmp)>
+      candidate_priority_queue(cmp);
+  // Populate queue with candidates above the score threshold.
+  for (int i = 0; i < num_boxes; ++i) {
+    if (scores[i] > score_threshold) {
+      candidate_priority_queue.emplace(Candidate({i, scores[i], 0}));
+    }
+  }
+
+  *num_selected_indices = 0;
+  int num_outputs = std::min(static_cast<int>(candidate_priority_queue.size()),
+                             max_output_size);
+  if (num_outputs == 0) return;
+
+  // NMS loop.
+  float scale = 0;
+  if (soft_nms_sigma > 0.0) {
+    scale = -0.5 / soft_nms_sigma;
+  }
+  while (*num_selected_indices < num_outputs &&
+         !candidate_priority_queue.empty()) {
+    Candidate next_candidate = candidate_priority_queue.top();
+    const float original_score = next_candidate.score;
+    candidate_priority_queue.pop();
+
+    // Overlapping boxes are likely to have similar scores, therefore we
+    // iterate through the previously selected boxes backwards in order to
+    // see if `next_candidate` should be suppressed. We also enforce a property
+    // that a candidate can be suppressed by another candidate no more than
+    // once via `suppress_begin_index` which tracks which previously selected
+    // boxes have already been compared against next_candidate prior to a given
+    // iteration.  These previous selected boxes are then skipped over in the
+    // following loop.
+    bool should_hard_suppress = false;
+    for (int j = *num_selected_indices - 1;
+         j >= next_candidate.suppress_begin_index; --j) {
+      const float iou = ComputeIntersectionOverUnion(
+          boxes, next_candidate.index, selected_indices[j]);
+
+      // First decide whether to perform hard suppression.
+      if (iou >= iou_threshold) {
+        should_hard_suppress = true;
+        break;
+      }
+
+      // Suppress score if NMS sigma > 0.
+      if (soft_nms_sigma > 0.0) {
+        next_candidate.score =
+            next_candidate.score * std::exp(scale * iou * iou);
+      }
+
+      // If score has fallen below score_threshold, it won't be pushed back into
+      // the queue.
+      if (next_candidate.score <= score_threshold) break;
+    }
+    // If `next_candidate.score` has not dropped below `score_threshold`
+    // by this point, then we know that we went through all of the previous
+    // selections and can safely update `suppress_begin_index` to
+    // `selected.size()`. If on the other hand `next_candidate.score`
+    // *has* dropped below the score threshold, then since `suppress_weight`
+    // always returns values in [0, 1], further suppression by items that were
+    // not covered in the above for loop would not have caused the algorithm
+    // to select this item. We thus do the same update to
+    // `suppress_begin_index`, but really, this element will not be added back
+    // into the priority queue.
+    next_candidate.suppress_begin_index = *num_selected_indices;
+
+    if (!should_hard_suppress) {
+      if (next_candidate.score == original_score) {
+        // Suppression has not occurred, so select next_candidate.
+        selected_indices[*num_selected_indices] = next_candidate.index;
+        if (selected_scores) {
+          selected_scores[*num_selected_indices] = next_candidate.score;
+        }
+        ++*num_selected_indices;
+      }
+      if ((soft_nms_sigma > 0.0) && (next_candidate.score > score_threshold)) {
+        // Soft suppression might have occurred and current score is still
+        // greater than score_threshold; add next_candidate back onto priority
+        // queue.
+        candidate_priority_queue.push(next_candidate);
+      }
+    }
+  }
+}
+
+/**
+ * Run non-max suppression over the results array (for bounding boxes)
+ */
+EI_IMPULSE_ERROR ei_run_nms(
+    const ei_impulse_t *impulse,
+    std::vector<ei_impulse_result_bounding_box_t> *results,
+    float *boxes,
+    float *scores,
+    int *classes,
+    size_t bb_count,
+    bool clip_boxes,
+    bool debug) {
+
+    if (bb_count < 1) {
+        return EI_IMPULSE_OK;
+    }
+
+    int *selected_indices = (int*)ei_malloc(1 * bb_count * sizeof(int));
+    float *selected_scores = (float*)ei_malloc(1 * bb_count * sizeof(float));
+
+    if (!scores || !boxes || !selected_indices || !selected_scores || !classes) {
+        ei_free(selected_indices);
+        ei_free(selected_scores);
+        return EI_IMPULSE_OUT_OF_MEMORY;
+    }
+
+    //  boxes: box encodings in format [y1, x1, y2, x2], shape: [num_boxes, 4]
+    //  num_boxes: number of candidates
+    //  scores: scores for candidate boxes, in the same order. shape: [num_boxes]
+    //  max_output_size: the maximum number of selections.
+    //  iou_threshold: Intersection-over-Union (IoU) threshold for NMS
+    //  score_threshold: All candidate scores below this value are rejected
+    //  soft_nms_sigma: Soft NMS parameter, used for decaying scores
+
+    int num_selected_indices;
+
+    NonMaxSuppression(
+        (const float*)boxes, // boxes
+        bb_count, // num_boxes
+        (const float*)scores, // scores
+        bb_count, // max_output_size
+        impulse->object_detection_nms.iou_threshold, // iou_threshold
+        impulse->object_detection_nms.confidence_threshold, // score_threshold
+        0.0f, // soft_nms_sigma
+        selected_indices,
+        selected_scores,
+        &num_selected_indices);
+
+    std::vector<ei_impulse_result_bounding_box_t> new_results;
+
+    for (size_t ix = 0; ix < (size_t)num_selected_indices; ix++) {
+
+        int out_ix = selected_indices[ix];
+        ei_impulse_result_bounding_box_t bb;
+        bb.label  = impulse->categories[classes[out_ix]];
+        bb.value  = selected_scores[ix];
+
+        float ymin = boxes[(out_ix * 4) + 0];
+        float xmin = boxes[(out_ix * 4) + 1];
+        float ymax = boxes[(out_ix * 4) + 2];
+        float xmax = boxes[(out_ix * 4) + 3];
+
+        if (clip_boxes) {
+            ymin = std::min(std::max(ymin, 0.0f), (float)impulse->input_height);
+            xmin = std::min(std::max(xmin, 0.0f), (float)impulse->input_width);
+            ymax = std::min(std::max(ymax, 0.0f), (float)impulse->input_height);
+            xmax = std::min(std::max(xmax, 0.0f), (float)impulse->input_width);
+        }
+
+        bb.y      = static_cast<uint32_t>(ymin);
+        bb.x      = static_cast<uint32_t>(xmin);
+        bb.height = static_cast<uint32_t>(ymax) - bb.y;
+        bb.width  = static_cast<uint32_t>(xmax) - bb.x;
+        new_results.push_back(bb);
+
+        if (debug) {
+          ei_printf("Found bb with label %s\n", bb.label);
+        }
+
+    }
+
+    results->clear();
+
+    for (size_t ix = 0; ix < new_results.size(); ix++) {
+        results->push_back(new_results[ix]);
+    }
+
+    ei_free(selected_indices);
+    ei_free(selected_scores);
+
+    return EI_IMPULSE_OK;
+
+}
+
+/**
+ * Run non-max suppression over the results array (for bounding boxes)
+ */
+EI_IMPULSE_ERROR ei_run_nms(
+    const ei_impulse_t *impulse,
+    std::vector<ei_impulse_result_bounding_box_t> *results,
+    bool clip_boxes,
+    bool debug) {
+
+    size_t bb_count = 0;
+    for (size_t ix = 0; ix < results->size(); ix++) {
+        auto bb = results->at(ix);
+        if (bb.value == 0) {
+            continue;
+        }
+        bb_count++;
+    }
+
+    if (bb_count < 1) {
+        return EI_IMPULSE_OK;
+    }
+
+    float *boxes = (float*)ei_malloc(4 * bb_count * sizeof(float));
+    float *scores = (float*)ei_malloc(1 * bb_count * sizeof(float));
+    int *classes = (int*) ei_malloc(bb_count * sizeof(int));
+
+    if (!scores || !boxes || !classes) {
+        ei_free(boxes);
+        ei_free(scores);
+        ei_free(classes);
+        return EI_IMPULSE_OUT_OF_MEMORY;
+    }
+
+    size_t box_ix = 0;
+    for (size_t ix = 0; ix < results->size(); ix++) {
+        auto bb = results->at(ix);
+        if (bb.value == 0) {
+            continue;
+        }
+        boxes[(box_ix * 4) + 0] = bb.y;
+        boxes[(box_ix * 4) + 1] = bb.x;
+        boxes[(box_ix * 4) + 2] = bb.y + bb.height;
+        boxes[(box_ix * 4) + 3] = bb.x + bb.width;
+        scores[box_ix] = bb.value;
+
+        for (size_t j = 0; j < impulse->label_count; j++) {
+          if (strcmp(impulse->categories[j], bb.label) == 0)
+          classes[box_ix] = j;
+        }
+
+        box_ix++;
+    }
+
+    EI_IMPULSE_ERROR nms_res = reference_nms::ei_run_nms(impulse, results,
+                                          boxes, scores,
+                                          classes, bb_count,
+                                          clip_boxes,
+                                          debug);
+
+
+    ei_free(boxes);
+    ei_free(scores);
+    ei_free(classes);
+
+    return nms_res;
+
+}
+
+/**
+ * Run non-max suppression over the results array (for bounding boxes)
+ */
+EI_IMPULSE_ERROR ei_run_nms(
+    const ei_impulse_t *impulse,
+    std::vector<ei_impulse_result_bounding_box_t> *results,
+    bool debug = false) {
+  return reference_nms::ei_run_nms(impulse, results, true, debug);
+}
+
+} // namespace reference_nms
+
+/* Mocks ------------------------------------------------------------------- */
+
+static int malloc_count = 0;
+
+/**
+ * Replaces the weak POSIX ei_malloc, counts the allocations
+ */
+void *ei_malloc(size_t size)
+{
+    malloc_count++;
+    return malloc(size);
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+static ei_impulse_t make_impulse(void)
+{
+    ei_impulse_t impulse = { };
+    impulse.input_width = TEST_INPUT_SIZE;
+    impulse.input_height = TEST_INPUT_SIZE;
+    impulse.object_detection_count = TEST_OBJECT_COUNT;
+    impulse.label_count = EI_CLASSIFIER_LABEL_COUNT;
+    impulse.categories = ei_classifier_inferencing_categories;
+    impulse.object_detection_nms.confidence_threshold = 0.0f;
+    impulse.object_detection_nms.iou_threshold = 0.2f;
+    return impulse;
+}
+
+static ei_learning_block_config_tflite_graph_t make_config(void)
+{
+    ei_learning_block_config_tflite_graph_t config = { };
+    config.threshold = 0.5f;
+    return config;
+}
+
+static float random_float(float min, float max)
+{
+    return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+static std::vector<ei_impulse_result_bounding_box_t> copy_boxes(const ei_impulse_result_t &result)
+{
+    return std::vector<ei_impulse_result_bounding_box_t>(result.bounding_boxes,
+        result.bounding_boxes + result.bounding_boxes_count);
+}
+
+static bool same_boxes(const std::vector<ei_impulse_result_bounding_box_t> &expected,
+    const std::vector<ei_impulse_result_bounding_box_t> &actual)
+{
+    if (expected.size() != actual.size()) {
+        printf("  %d boxes, expected %d\n", (int)actual.size(), (int)expected.size());
+        return false;
+    }
+    for (size_t ix = 0; ix < expected.size(); ix++) {
+        const ei_impulse_result_bounding_box_t &e = expected[ix];
+        const ei_impulse_result_bounding_box_t &a = actual[ix];
+        if (e.value == 0.0f && a.value == 0.0f) {
+            // padding up to object_detection_count
+            continue;
+        }
+        if (e.label != a.label || e.x != a.x || e.y != a.y || e.width != a.width ||
+            e.height != a.height || e.value != a.value) {
+            printf("  box %d differs\n", (int)ix);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Pixel coordinates (version 5). `valid` anchors above the threshold, and
+ * `clipped` anchors above the threshold, with higher scores, whose box lies
+ * past the right edge and is dropped
+ */
+static std::vector<float> make_f32_output(size_t rows, size_t valid, size_t clipped, unsigned seed)
+{
+    std::vector<float> data(rows * TEST_COL_SIZE);
+    srand(seed);
+
+    for (size_t ix = 0; ix < rows; ix++) {
+        float *row = &data[ix * TEST_COL_SIZE];
+        row[0] = random_float(0, TEST_INPUT_SIZE);
+        row[1] = random_float(0, TEST_INPUT_SIZE);
+        row[2] = random_float(4, 40);
+        row[3] = random_float(4, 40);
+        row[4] = random_float(0.0f, 0.45f);
+        for (size_t lx = 0; lx < EI_CLASSIFIER_LABEL_COUNT; lx++) {
+            row[5 + lx] = random_float(0.0f, 1.0f);
+        }
+    }
+    // spread both kinds over the anchors
+    for (size_t n = 0; n < valid + clipped; n++) {
+        float *row = &data[((n * 7919) % rows) * TEST_COL_SIZE];
+        if (n < valid) {
+            row[4] = random_float(0.5f, 0.9f);
+        }
+        else {
+            row[0] = TEST_INPUT_SIZE * 2.0f;
+            row[4] = random_float(0.9f, 1.0f);
+        }
+    }
+    return data;
+}
+
+/* Fewer valid anchors than the top-k holds, and more high scoring boxes that
+ * are clipped away than it holds: the clipped boxes must not push the valid
+ * ones out */
+static void test_f32_clipped_boxes(void)
+{
+    ei_impulse_t impulse = make_impulse();
+    ei_learning_block_config_tflite_graph_t config = make_config();
+    const size_t rows = 2000;
+
+    std::vector<float> data = make_f32_output(rows, EI_CLASSIFIER_OBJECT_DETECTION_MAX_CANDIDATES / 2,
+        EI_CLASSIFIER_OBJECT_DETECTION_MAX_CANDIDATES * 2, 1);
+
+    ei_impulse_result_t result = { };
+    EI_TEST_CHECK_EQ(reference::fill_result_struct_f32_yolov5(&impulse, &config, &result, 5,
+        data.data(), data.size()), EI_IMPULSE_OK);
+    std::vector<ei_impulse_result_bounding_box_t> expected = copy_boxes(result);
+
+    EI_TEST_CHECK_EQ(fill_result_struct_f32_yolov5(&impulse, &config, &result, 5,
+        data.data(), data.size()), EI_IMPULSE_OK);
+    std::vector<ei_impulse_result_bounding_box_t> actual = copy_boxes(result);
+
+    EI_TEST_CHECK(expected.size() > 0 && expected[0].value > 0.0f);
+    EI_TEST_CHECK(same_boxes(expected, actual));
+}
+
+/* Random outputs with up to the top-k size of anchors above the threshold */
+static void test_f32_random(void)
+{
+    ei_impulse_t impulse = make_impulse();
+    ei_learning_block_config_tflite_graph_t config = make_config();
+    const size_t valid_counts[] = { 0, 1, 10, 100, EI_CLASSIFIER_OBJECT_DETECTION_MAX_CANDIDATES };
+
+    for (size_t valid : valid_counts) {
+        std::vector<float> data = make_f32_output(1000, valid, valid / 2, 2 + valid);
+
+        ei_impulse_result_t result = { };
+        EI_TEST_CHECK_EQ(reference::fill_result_struct_f32_yolov5(&impulse, &config, &result, 5,
+            data.data(), data.size()), EI_IMPULSE_OK);
+        std::vector<ei_impulse_result_bounding_box_t> expected = copy_boxes(result);
+
+        EI_TEST_CHECK_EQ(fill_result_struct_f32_yolov5(&impulse, &config, &result, 5,
+            data.data(), data.size()), EI_IMPULSE_OK);
+        std::vector<ei_impulse_result_bounding_box_t> actual = copy_boxes(result);
+
+        EI_TEST_CHECK(same_boxes(expected, actual));
+    }
+}
+
+/* int8, normalized coordinates (version 6), scale 1/100: boxes with a
+ * negative size are dropped, and must not push valid ones out either */
+static void test_quantized_clipped_boxes(void)
+{
+    ei_impulse_t impulse = make_impulse();
+    ei_learning_block_config_tflite_graph_t config = make_config();
+    const float zero_point = 0.0f;
+    const float scale = 0.01f;
+    const size_t rows = 2000;
+    const size_t valid = EI_CLASSIFIER_OBJECT_DETECTION_MAX_CANDIDATES / 2;
+    const size_t dropped = EI_CLASSIFIER_OBJECT_DETECTION_MAX_CANDIDATES * 2;
+    std::vector<int8_t> data(rows * TEST_COL_SIZE);
+
+    srand(3);
+    for (size_t ix = 0; ix < rows; ix++) {
+        int8_t *row = &data[ix * TEST_COL_SIZE];
+        row[0] = (int8_t)(rand() % 100);
+        row[1] = (int8_t)(rand() % 100);
+        row[2] = (int8_t)(5 + rand() % 30);
+        row[3] = (int8_t)(5 + rand() % 30);
+        row[4] = (int8_t)(rand() % 45);
+        for (size_t lx = 0; lx < EI_CLASSIFIER_LABEL_COUNT; lx++) {
+            row[5 + lx] = (int8_t)(rand() % 100);
+        }
+    }
+    for (size_t n = 0; n < valid + dropped; n++) {
+        int8_t *row = &data[((n * 7919) % rows) * TEST_COL_SIZE];
+        if (n < valid) {
+            row[4] = (int8_t)(50 + rand() % 40);
+        }
+        else {
+            row[2 + n % 2] = (int8_t)-(1 + rand() % 30);
+            row[4] = (int8_t)(90 + rand() % 11);
+        }
+    }
+
+    ei_impulse_result_t result = { };
+    EI_TEST_CHECK_EQ(reference::fill_result_struct_quantized_yolov5(&impulse, &config, &result, 6,
+        data.data(), zero_point, scale, data.size()), EI_IMPULSE_OK);
+    std::vector<ei_impulse_result_bounding_box_t> expected = copy_boxes(result);
+
+    EI_TEST_CHECK_EQ(fill_result_struct_quantized_yolov5(&impulse, &config, &result, 6,
+        data.data(), zero_point, scale, data.size()), EI_IMPULSE_OK);
+    std::vector<ei_impulse_result_bounding_box_t> actual = copy_boxes(result);
+
+    EI_TEST_CHECK(expected.size() > 0 && expected[0].value > 0.0f);
+    EI_TEST_CHECK(same_boxes(expected, actual));
+}
+
+/**
+ * Boxes scattered around a few centres, so most of them overlap others.
+ * Scores are distinct, the previous implementation did not order equal
+ * scores.
+ */
+static std::vector<ei_impulse_result_bounding_box_t> make_overlapping_boxes(const ei_impulse_t &impulse,
+    size_t count, unsigned seed)
+{
+    srand(seed);
+    const size_t clusters = 1 + count / 20;
+    std::vector<uint32_t> cx(clusters), cy(clusters);
+    for (size_t c = 0; c < clusters; c++) {
+        cx[c] = rand() % 64;
+        cy[c] = rand() % 64;
+    }
+
+    std::vector<float> scores(count);
+    for (size_t ix = 0; ix < count; ix++) {
+        scores[ix] = (float)(ix + 1) / (float)(count + 1);
+    }
+    for (size_t ix = count; ix > 1; ix--) {
+        std::swap(scores[ix - 1], scores[rand() % ix]);
+    }
+
+    std::vector<ei_impulse_result_bounding_box_t> boxes(count);
+    for (size_t ix = 0; ix < count; ix++) {
+        size_t c = rand() % clusters;
+        boxes[ix].label = impulse.categories[rand() % impulse.label_count];
+        boxes[ix].x = cx[c] + rand() % 8;
+        boxes[ix].y = cy[c] + rand() % 8;
+        boxes[ix].width = 8 + rand() % 24;
+        boxes[ix].height = 8 + rand() % 24;
+        boxes[ix].value = scores[ix];
+    }
+    return boxes;
+}
+
+static void sort_by_score(std::vector<ei_impulse_result_bounding_box_t> *boxes)
+{
+    std::sort(boxes->begin(), boxes->end(), [](const ei_impulse_result_bounding_box_t &a,
+        const ei_impulse_result_bounding_box_t &b) {
+        return a.value > b.value;
+    });
+}
+
+/* All classes suppress each other (the decoders' call), with and without a
+ * score threshold */
+static void test_nms_matches_previous(void)
+{
+    ei_impulse_t impulse = make_impulse();
+    const size_t counts[] = { 1, 2, 5, 50, 500, 2000 };
+    const float thresholds[] = { 0.0f, 0.3f };
+
+    for (float threshold : thresholds) {
+        impulse.object_detection_nms.confidence_threshold = threshold;
+        for (size_t count : counts) {
+            std::vector<ei_impulse_result_bounding_box_t> expected =
+                make_overlapping_boxes(impulse, count, (unsigned)count);
+            std::vector<ei_impulse_result_bounding_box_t> actual = expected;
+
+            EI_TEST_CHECK_EQ(reference_nms::ei_run_nms(&impulse, &expected), EI_IMPULSE_OK);
+            EI_TEST_CHECK_EQ(ei_run_nms(&impulse, &actual), EI_IMPULSE_OK);
+
+            // boxes were suppressed
+            EI_TEST_CHECK(count < 50 || expected.size() < count / 2);
+            EI_TEST_CHECK(same_boxes(expected, actual));
+        }
+    }
+}
+
+/* Class aware in one call against the previous per class calls (what the
+ * TAO decoders did), ordered by score as prepare_tao_results_common does */
+static void test_nms_class_aware_matches_previous(void)
+{
+    ei_impulse_t impulse = make_impulse();
+    const size_t count = 1000;
+    std::vector<ei_impulse_result_bounding_box_t> input = make_overlapping_boxes(impulse, count, 11);
+
+    std::vector<float> boxes;
+    std::vector<float> scores;
+    std::vector<int> classes;
+    for (const ei_impulse_result_bounding_box_t &bb : input) {
+        boxes.push_back((float)bb.y);
+        boxes.push_back((float)bb.x);
+        boxes.push_back((float)(bb.y + bb.height));
+        boxes.push_back((float)(bb.x + bb.width));
+        scores.push_back(bb.value);
+        for (int c = 0; c < impulse.label_count; c++) {
+            if (strcmp(impulse.categories[c], bb.label) == 0) {
+                classes.push_back(c);
+            }
+        }
+    }
+
+    std::vector<ei_impulse_result_bounding_box_t> expected;
+    for (int c = 0; c < impulse.label_count; c++) {
+        std::vector<float> class_boxes;
+        std::vector<float> class_scores;
+        std::vector<int> class_classes;
+        for (size_t ix = 0; ix < count; ix++) {
+            if (classes[ix] == c) {
+                class_boxes.insert(class_boxes.end(), &boxes[ix * 4], &boxes[ix * 4 + 4]);
+                class_scores.push_back(scores[ix]);
+                class_classes.push_back(c);
+            }
+        }
+        std::vector<ei_impulse_result_bounding_box_t> class_results;
+        EI_TEST_CHECK_EQ(reference_nms::ei_run_nms(&impulse, &class_results, class_boxes.data(),
+            class_scores.data(), class_classes.data(), class_scores.size(), true, false), EI_IMPULSE_OK);
+        expected.insert(expected.end(), class_results.begin(), class_results.end());
+    }
+    sort_by_score(&expected);
+
+    std::vector<ei_impulse_result_bounding_box_t> actual;
+    EI_TEST_CHECK_EQ(ei_run_nms(&impulse, &actual, boxes.data(), scores.data(), classes.data(),
+        count, true, false, true), EI_IMPULSE_OK);
+    sort_by_score(&actual);
+
+    EI_TEST_CHECK(same_boxes(expected, actual));
+}
+
+/* The shared scratch is allocated once for the largest count seen, a
+ * caller's scratch reserved up front is never grown */
+static void test_nms_scratch_reused(void)
+{
+    ei_impulse_t impulse = make_impulse();
+    std::vector<ei_impulse_result_bounding_box_t> boxes = make_overlapping_boxes(impulse, 500, 21);
+    std::vector<ei_impulse_result_bounding_box_t> results;
+
+    results = boxes;
+    EI_TEST_CHECK_EQ(ei_run_nms(&impulse, &results), EI_IMPULSE_OK);
+
+    malloc_count = 0;
+    for (int i = 0; i < 10; i++) {
+        results = boxes;
+        EI_TEST_CHECK_EQ(ei_run_nms(&impulse, &results), EI_IMPULSE_OK);
+        results.assign(boxes.begin(), boxes.begin() + 100);
+        EI_TEST_CHECK_EQ(ei_run_nms(&impulse, &results), EI_IMPULSE_OK);
+    }
+    EI_TEST_CHECK_EQ(malloc_count, 0);
+
+    ei_nms_scratch scratch;
+    EI_TEST_CHECK(scratch.reserve(boxes.size()));
+    malloc_count = 0;
+    results = boxes;
+    EI_TEST_CHECK_EQ(ei_run_nms(&impulse, &results, true, false, &scratch), EI_IMPULSE_OK);
+    EI_TEST_CHECK_EQ(malloc_count, 0);
+
+    // more boxes than the scratch holds, it grows
+    std::vector<ei_impulse_result_bounding_box_t> more = make_overlapping_boxes(impulse, 800, 22);
+    EI_TEST_CHECK_EQ(ei_run_nms(&impulse, &more, true, false, &scratch), EI_IMPULSE_OK);
+    EI_TEST_CHECK(malloc_count > 0);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_f32_clipped_boxes);
+    EI_TEST_RUN(test_f32_random);
+    EI_TEST_RUN(test_quantized_clipped_boxes);
+    EI_TEST_RUN(test_nms_matches_previous);
+    EI_TEST_RUN(test_nms_class_aware_matches_previous);
+    EI_TEST_RUN(test_nms_scratch_reused);
+
+    return EI_TEST_RESULT();
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_sample_hold.cpp
+ * @brief EiSampleHold with simulated slow sensors, on a virtual clock and
+ * with a real acquisition thread
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "sensors/ei_sample_hold.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_AXES                   3
+
+/* Mocks ------------------------------------------------------------------- */
+
+static int thread_starts = 0;
+
+/**
+ * Stands in for the mbed thread, test_sampling_never_waits runs the poll
+ * loop itself
+ */
+bool ei_sample_hold_start(void)
+{
+    thread_starts++;
+    return true;
+}
+
+static std::mutex bus;
+
+static void bus_lock(void) { bus.lock(); }
+static void bus_unlock(void) { bus.unlock(); }
+
+static uint64_t micros(void)
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * A simulated sensor: each read blocks for latency_us (conversion plus bus
+ * transfer) and returns the read count on every axis
+ */
+typedef struct {
+    uint32_t latency_us;
+    std::atomic<int> reads;
+    float values[EI_SAMPLE_HOLD_MAX_AXES];
+} test_sensor_t;
+
+static float *test_sensor_read(test_sensor_t *sensor, int n_samples)
+{
+    if (sensor->latency_us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(sensor->latency_us));
+    }
+
+    float value = (float)(sensor->reads.fetch_add(1) + 1);
+    for (int i = 0; i < n_samples; i++) {
+        sensor->values[i] = value;
+    }
+
+    return sensor->values;
+}
+
+// acquire functions take no context, one per simulated sensor
+static test_sensor_t counted = { 0, { 0 }, { 0 } };
+static test_sensor_t environment = { 15000, { 0 }, { 0 } };
+static test_sensor_t interaction = { 40000, { 0 }, { 0 } };
+static test_sensor_t fast = { 0, { 0 }, { 0 } };
+
+static float *counted_acquire(int n_samples) { return test_sensor_read(&counted, n_samples); }
+static float *environment_acquire(int n_samples) { return test_sensor_read(&environment, n_samples); }
+static float *interaction_acquire(int n_samples) { return test_sensor_read(&interaction, n_samples); }
+static float *fast_acquire(int n_samples) { return test_sensor_read(&fast, n_samples); }
+
+static EiSampleHold environment_hold(&environment_acquire, TEST_AXES, 20.0f);
+static EiSampleHold interaction_hold(&interaction_acquire, TEST_AXES, 5.0f);
+
+/* Tests ------------------------------------------------------------------- */
+
+static void test_first_register_starts_thread(void)
+{
+    EI_TEST_CHECK_EQ(thread_starts, 0);
+    EI_TEST_CHECK(ei_sample_hold_register(&environment_hold));
+    EI_TEST_CHECK_EQ(thread_starts, 1);
+    EI_TEST_CHECK(ei_sample_hold_register(&interaction_hold));
+    EI_TEST_CHECK_EQ(thread_starts, 1);
+}
+
+/**
+ * Virtual clock, poll() is called the way the thread would call it
+ */
+static void test_refresh_and_idle(void)
+{
+    // 10 ms period, not registered so only this test polls it
+    EiSampleHold hold(&counted_acquire, TEST_AXES, 100.0f);
+    float *values;
+
+    // nothing held yet, read in place
+    values = hold.get(1000);
+    EI_TEST_CHECK_EQ(counted.reads.load(), 1);
+    EI_TEST_CHECK_EQ(values[0], 1);
+    EI_TEST_CHECK_EQ(hold.get_age_us(), 0);
+
+    // the read marks the sensor active, next refresh is a period later
+    EI_TEST_CHECK_EQ(hold.poll(2000), 9000);
+    EI_TEST_CHECK_EQ(counted.reads.load(), 1);
+    EI_TEST_CHECK_EQ(hold.poll(11000), 10000);
+    EI_TEST_CHECK_EQ(counted.reads.load(), 2);
+
+    values = hold.get(12000);
+    EI_TEST_CHECK_EQ(values[TEST_AXES - 1], 2);
+    EI_TEST_CHECK_EQ(hold.get_age_us(), 1000);
+
+    // old values while the thread refreshes the sensor (a slow conversion)
+    // don't make the reader wait for the bus
+    values = hold.get(11000 + 10 * 10000);
+    EI_TEST_CHECK_EQ(counted.reads.load(), 2);
+    EI_TEST_CHECK_EQ(hold.get_age_us(), 10 * 10000);
+
+    // nobody reads it for EI_SAMPLE_HOLD_IDLE_US, the thread stops
+    hold.poll(200000);
+    EI_TEST_CHECK_EQ(counted.reads.load(), 3);
+    EI_TEST_CHECK_EQ(hold.poll(200000 + EI_SAMPLE_HOLD_IDLE_US + 1), EI_SAMPLE_HOLD_IDLE_POLL_US);
+    EI_TEST_CHECK_EQ(hold.poll(200000 + 2 * EI_SAMPLE_HOLD_IDLE_US), EI_SAMPLE_HOLD_IDLE_POLL_US);
+    EI_TEST_CHECK_EQ(counted.reads.load(), 3);
+
+    // stale with the thread idle, read in place
+    values = hold.get(200000 + 3 * EI_SAMPLE_HOLD_IDLE_US);
+    EI_TEST_CHECK_EQ(counted.reads.load(), 4);
+    EI_TEST_CHECK_EQ(values[0], 4);
+    EI_TEST_CHECK_EQ(hold.get_age_us(), 0);
+}
+
+/**
+ * A writer refreshing as fast as it can while a reader copies, every copy
+ * must come from a single acquisition
+ */
+static void test_no_torn_reads(void)
+{
+    EiSampleHold hold(&fast_acquire, EI_SAMPLE_HOLD_MAX_AXES, 1000000.0f);
+    std::atomic<bool> stop(false);
+    int torn = 0;
+    int reads = 0;
+    float last = 0;
+
+    // held values are never stale here, so all refreshes come from the writer
+    hold.get(0);
+    std::thread writer([&]() {
+        uint64_t now_us = 0;
+        while (!stop.load()) {
+            hold.poll(now_us += 10);
+        }
+    });
+
+    // on a single core the loop can end before the writer is scheduled,
+    // keep reading until it refreshed a few times
+    for (int i = 0; i < 200000 || fast.reads.load() < 3; i++) {
+        float *values = hold.get(0);
+        for (int ax = 1; ax < EI_SAMPLE_HOLD_MAX_AXES; ax++) {
+            if (values[ax] != values[0]) {
+                torn++;
+                break;
+            }
+        }
+        // a generation is never returned after a newer one
+        EI_TEST_CHECK(values[0] >= last);
+        last = values[0];
+        reads++;
+    }
+
+    stop.store(true);
+    writer.join();
+
+    EI_TEST_CHECK_EQ(torn, 0);
+    EI_TEST_CHECK(fast.reads.load() > 1);
+    printf("  %d reads over %d acquisitions\n", reads, fast.reads.load());
+}
+
+/**
+ * The registered sensors take 15 and 40 ms to read. A 100 Hz sampler reads
+ * both for one second while the poll loop refreshes them in the background,
+ * after the first (in place) read get() must never wait for a conversion.
+ */
+static void test_sampling_never_waits(void)
+{
+    std::atomic<bool> stop(false);
+
+    std::thread acquisition([&]() {
+        // sample_hold_loop from ei_sample_hold_thread.cpp, woken at least
+        // every 10 ms so the test can stop it
+        while (!stop.load()) {
+            uint64_t wait_us = ei_sample_hold_poll(micros());
+            wait_us = std::min<uint64_t>(std::max<uint64_t>(wait_us, 1000), 10000);
+            std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+        }
+    });
+
+    uint64_t max_get_us = 0;
+    uint64_t max_environment_age_us = 0;
+    uint64_t max_interaction_age_us = 0;
+    float first = 0;
+    float last = 0;
+
+    for (int tick = 0; tick < 100; tick++) {
+        uint64_t start_us = micros();
+        float environment_value = environment_hold.get(start_us)[0];
+        uint64_t environment_age_us = environment_hold.get_age_us();
+        interaction_hold.get(start_us);
+        uint64_t get_us = micros() - start_us;
+
+        if (tick == 0) {
+            first = environment_value;
+        }
+        else {
+            max_get_us = std::max(max_get_us, get_us);
+            max_environment_age_us = std::max(max_environment_age_us, environment_age_us);
+            max_interaction_age_us = std::max(max_interaction_age_us, interaction_hold.get_age_us());
+        }
+        last = environment_value;
+
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+            std::chrono::microseconds(start_us + 10000)));
+    }
+
+    stop.store(true);
+    acquisition.join();
+
+    printf("  slowest get %llu us, oldest values %llu us (environment) %llu us (interaction)\n",
+        (unsigned long long)max_get_us, (unsigned long long)max_environment_age_us,
+        (unsigned long long)max_interaction_age_us);
+
+    // well below the 15 ms conversion, leaves room for a loaded host
+    EI_TEST_CHECK(max_get_us < 5000);
+    // a period plus both read latencies (one thread refreshes both), plus
+    // scheduling slack
+    EI_TEST_CHECK(max_environment_age_us < 50000 + 15000 + 40000 + 30000);
+    EI_TEST_CHECK(max_interaction_age_us < 200000 + 15000 + 40000 + 30000);
+    // refreshed at about 20 Hz
+    EI_TEST_CHECK(last - first >= 10);
+}
+
+int main(void)
+{
+    ei_sample_hold_set_lock(&bus_lock, &bus_unlock);
+
+    EI_TEST_RUN(test_first_register_starts_thread);
+    EI_TEST_RUN(test_refresh_and_idle);
+    EI_TEST_RUN(test_no_torn_reads);
+    EI_TEST_RUN(test_sampling_never_waits);
+
+    return EI_TEST_RESULT();
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_scratch_planner.cpp
+ * @brief ei::scratch_planner sessions, out of order frees and peak reporting,
+ * built with EIDSP_SHARED_SCRATCH_SIZE set by the test target
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/dsp/memory.hpp"
+
+/* Tests ------------------------------------------------------------------- */
+
+static void test_outside_session_uses_heap(void)
+{
+    void *ptr = ei::scratch_planner::malloc(64);
+
+    EI_TEST_CHECK(ptr != nullptr);
+    EI_TEST_CHECK_EQ(ei::scratch_planner::in_use(), 0);
+    ei::scratch_planner::free(ptr);
+}
+
+/* Blocks freed out of order are released once the ones above are gone, the
+ * high-water mark shows up in ei_memory_peak_use */
+static void test_session_stack_and_peak(void)
+{
+    ei_memory_peak_use = 0;
+    {
+        EI_DSP_SCRATCH_SESSION();
+
+        void *a = ei::scratch_planner::malloc(100);
+        void *b = ei::scratch_planner::calloc(10, 30);
+        size_t both = ei::scratch_planner::in_use();
+        EI_TEST_CHECK(both >= 400);
+
+        ei::scratch_planner::free(a);
+        EI_TEST_CHECK_EQ(ei::scratch_planner::in_use(), both);
+        void *arena = ei::scratch_planner::aligned_calloc(16, 1000);
+        EI_TEST_CHECK_EQ(((uintptr_t)arena) % 16, 0);
+        ei::scratch_planner::free(b);
+        ei::scratch_planner::aligned_free(arena);
+        EI_TEST_CHECK_EQ(ei::scratch_planner::in_use(), 0);
+    }
+
+    EI_TEST_CHECK(ei::scratch_planner::high_water() >= 1400);
+    EI_TEST_CHECK_EQ(ei_memory_peak_use, ei::scratch_planner::high_water());
+}
+
+/* A nested (or second) session does not own the region and doesn't close it */
+static void test_single_owner(void)
+{
+    EI_TEST_CHECK(ei::scratch_planner::session_begin());
+    EI_TEST_CHECK(!ei::scratch_planner::session_begin());
+
+    {
+        EI_DSP_SCRATCH_SESSION();
+        void *ptr = ei::scratch_planner::malloc(32);
+        EI_TEST_CHECK(ei::scratch_planner::in_use() > 0);
+        ei::scratch_planner::free(ptr);
+    }
+    // still open after the inner session went away
+    void *ptr = ei::scratch_planner::malloc(32);
+    EI_TEST_CHECK(ei::scratch_planner::in_use() > 0);
+    ei::scratch_planner::free(ptr);
+
+    ei::scratch_planner::session_end();
+    EI_TEST_CHECK(ei::scratch_planner::session_begin());
+    ei::scratch_planner::session_end();
+}
+
+/* Requests past the end of the region go to the heap */
+static void test_overflow_falls_back(void)
+{
+    EI_DSP_SCRATCH_SESSION();
+    size_t fallbacks = ei::scratch_planner::heap_fallbacks();
+
+    void *ptr = ei::scratch_planner::malloc(EIDSP_SHARED_SCRATCH_SIZE);
+    EI_TEST_CHECK(ptr != nullptr);
+    EI_TEST_CHECK_EQ(ei::scratch_planner::in_use(), 0);
+    EI_TEST_CHECK_EQ(ei::scratch_planner::heap_fallbacks(), fallbacks + 1);
+    ei::scratch_planner::free(ptr);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_outside_session_uses_heap);
+    EI_TEST_RUN(test_session_stack_and_peak);
+    EI_TEST_RUN(test_single_owner);
+    EI_TEST_RUN(test_overflow_falls_back);
+
+    return EI_TEST_RESULT();
+}
@@ -0,0 +1,450 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_sensor_aq.cpp
+ * @brief sensor_aq streams decoded with QCBOR, HMAC signature re-verified
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "firmware-sdk/sensor-aq/sensor_aq.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_HMAC_KEY               "0123456789abcdef0123456789abcdef"
+#define TEST_BUFFER_SIZE            1024
+
+/* Signing ----------------------------------------------------------------- */
+
+/**
+ * HS256 over everything passed to update, computed with OpenSSL in finish
+ */
+typedef struct {
+    std::vector<uint8_t> signed_data;
+    int updates;
+} test_signer_t;
+
+static int signer_init(sensor_aq_signing_ctx_t *aq_ctx)
+{
+    test_signer_t *signer = (test_signer_t *)aq_ctx->ctx;
+    signer->signed_data.clear();
+    signer->updates = 0;
+    return 0;
+}
+
+static int signer_update(sensor_aq_signing_ctx_t *aq_ctx, const uint8_t *data, size_t size)
+{
+    test_signer_t *signer = (test_signer_t *)aq_ctx->ctx;
+    signer->signed_data.insert(signer->signed_data.end(), data, data + size);
+    signer->updates++;
+    return 0;
+}
+
+static int signer_finish(sensor_aq_signing_ctx_t *aq_ctx, uint8_t *signature)
+{
+    test_signer_t *signer = (test_signer_t *)aq_ctx->ctx;
+    unsigned int length = 32;
+
+    HMAC(EVP_sha256(), TEST_HMAC_KEY, strlen(TEST_HMAC_KEY),
+        signer->signed_data.data(), signer->signed_data.size(), signature, &length);
+
+    return length == 32 ? 0 : -1;
+}
+
+/* Stream ------------------------------------------------------------------ */
+
+typedef enum {
+    WRITE_PER_SAMPLE,
+    WRITE_BUFFERED,
+    WRITE_BATCH
+} write_mode_t;
+
+typedef struct {
+    std::vector<uint8_t> file;
+    int updates;
+} stream_t;
+
+/**
+ * Write n_samples intervals of values (axes per interval) to a signed
+ * stream in a temporary file, and read the file back
+ */
+static stream_t write_stream(
+    const std::vector<float> &values,
+    size_t axes,
+    write_mode_t mode,
+    sensor_aq_float_encoding_t encoding,
+    bool set_encoding = true)
+{
+    stream_t out = { {}, 0 };
+    unsigned char buffer[TEST_BUFFER_SIZE];
+    test_signer_t signer;
+    sensor_aq_signing_ctx_t signing_ctx;
+    const char *names[] = { "accX", "accY", "accZ" };
+
+    signing_ctx.alg = "HS256";
+    signing_ctx.signature_length = 32;
+    signing_ctx.ctx = &signer;
+    signing_ctx.init = &signer_init;
+    signing_ctx.set_protected = NULL;
+    signing_ctx.update = &signer_update;
+    signing_ctx.finish = &signer_finish;
+
+    sensor_aq_ctx ctx;
+    // a context on the stack, only the fields callers fill in are set
+    memset(&ctx, 0xa5, sizeof(ctx));
+    ctx.buffer.buffer = buffer;
+    ctx.buffer.size = sizeof(buffer);
+    ctx.signature_ctx = &signing_ctx;
+    ctx.fwrite = &fwrite;
+    ctx.fseek = &fseek;
+    ctx.time = NULL;
+
+    sensor_aq_payload_info payload = { "test-device", "TEST_DEVICE", 10.0f, { } };
+    for (size_t ix = 0; ix < axes; ix++) {
+        payload.sensors[ix].name = names[ix];
+        payload.sensors[ix].units = "m/s2";
+    }
+
+    FILE *file = tmpfile();
+    EI_TEST_CHECK_EQ(sensor_aq_init(&ctx, &payload, file, false), AQ_OK);
+    EI_TEST_CHECK_EQ(ctx.float_encoding, AQ_FLOAT_PREFERRED);
+    // set after init, as the header documents
+    if (set_encoding) {
+        ctx.float_encoding = encoding;
+    }
+
+    std::vector<float> copy(values);
+    switch (mode) {
+        case WRITE_PER_SAMPLE:
+            for (size_t ix = 0; ix < copy.size(); ix += axes) {
+                EI_TEST_CHECK_EQ(sensor_aq_add_data(&ctx, &copy[ix], axes), AQ_OK);
+            }
+            break;
+        case WRITE_BUFFERED:
+            // uneven chunks, as the sampler hands them over
+            for (size_t ix = 0; ix < copy.size();) {
+                size_t n = std::min(copy.size() - ix, axes * (1 + (ix / axes) % 5));
+                EI_TEST_CHECK_EQ(sensor_aq_add_data_buffered(&ctx, &copy[ix], n), AQ_OK);
+                ix += n;
+            }
+            break;
+        case WRITE_BATCH:
+            EI_TEST_CHECK_EQ(sensor_aq_add_data_batch(&ctx, copy.data(), copy.size()), AQ_OK);
+            break;
+    }
+    EI_TEST_CHECK_EQ(sensor_aq_finish(&ctx), AQ_OK);
+
+    fseek(file, 0, SEEK_END);
+    out.file.resize(ftell(file));
+    rewind(file);
+    EI_TEST_CHECK_EQ(fread(out.file.data(), 1, out.file.size(), file), out.file.size());
+    fclose(file);
+    out.updates = signer.updates;
+
+    return out;
+}
+
+/* Decoding ---------------------------------------------------------------- */
+
+typedef struct {
+    std::string device_type;
+    double interval_ms;
+    std::vector<std::string> sensors;
+    std::vector<std::vector<double>> values;
+    size_t signature_offset;
+    std::string signature;
+    bool ok;
+} decoded_t;
+
+static bool label_is(const QCBORItem &item, const char *label)
+{
+    return item.uLabelType == QCBOR_TYPE_TEXT_STRING &&
+        item.label.string.len == strlen(label) &&
+        memcmp(item.label.string.ptr, label, item.label.string.len) == 0;
+}
+
+static std::string text(const QCBORItem &item)
+{
+    return std::string((const char *)item.val.string.ptr, item.val.string.len);
+}
+
+/**
+ * Walk the whole file with the QCBOR decoder, the way ingestion reads it
+ */
+static decoded_t decode_stream(const std::vector<uint8_t> &file)
+{
+    decoded_t d = { "", 0, {}, {}, 0, "", false };
+    QCBORDecodeContext dc;
+    QCBORItem item;
+    int values_level = -1;
+    int sensors_level = -1;
+
+    UsefulBufC encoded = { file.data(), file.size() };
+
+    QCBORDecode_Init(&dc, encoded, QCBOR_DECODE_MODE_NORMAL);
+
+    QCBORError res;
+    while ((res = QCBORDecode_GetNext(&dc, &item)) == QCBOR_SUCCESS) {
+        if (values_level >= 0 && item.uNestingLevel > values_level) {
+            if (item.uDataType == QCBOR_TYPE_ARRAY) {
+                d.values.push_back({});
+            }
+            else if (item.uDataType == QCBOR_TYPE_DOUBLE) {
+                if (item.uNestingLevel == values_level + 1) {
+                    d.values.push_back({});
+                }
+                d.values.back().push_back(item.val.dfnum);
+            }
+            continue;
+        }
+        if (sensors_level >= 0 && item.uNestingLevel > sensors_level) {
+            if (label_is(item, "name")) {
+                d.sensors.push_back(text(item));
+            }
+            continue;
+        }
+        values_level = -1;
+        sensors_level = -1;
+
+        if (label_is(item, "signature")) {
+            d.signature = text(item);
+            d.signature_offset = (const uint8_t *)item.val.string.ptr - file.data();
+        }
+        else if (label_is(item, "device_type")) {
+            d.device_type = text(item);
+        }
+        else if (label_is(item, "interval_ms")) {
+            d.interval_ms = item.val.dfnum;
+        }
+        else if (label_is(item, "sensors")) {
+            sensors_level = item.uNestingLevel;
+        }
+        else if (label_is(item, "values")) {
+            values_level = item.uNestingLevel;
+        }
+    }
+
+    // this QCBOR version does not close the definite length maps around an
+    // indefinite array on its break, so QCBORDecode_Finish always reports them
+    // open here; a walk that ran off the end past the final break is complete
+    d.ok = res == QCBOR_ERR_HIT_END && !file.empty() && file.back() == 0xff &&
+        UsefulInputBuf_BytesUnconsumed(&dc.InBuf) == 0;
+
+    return d;
+}
+
+/**
+ * Recompute HS256 over the file with the signature field zeroed, as the
+ * ingestion service does, and compare with the hex signature in the file
+ */
+static bool signature_matches(const std::vector<uint8_t> &file, const decoded_t &d)
+{
+    if (d.signature.size() != 64) {
+        return false;
+    }
+
+    std::vector<uint8_t> zeroed(file);
+    memset(&zeroed[d.signature_offset], '0', 64);
+
+    uint8_t mac[32];
+    unsigned int length = sizeof(mac);
+    HMAC(EVP_sha256(), TEST_HMAC_KEY, strlen(TEST_HMAC_KEY), zeroed.data(), zeroed.size(), mac, &length);
+
+    char hex[65];
+    for (int ix = 0; ix < 32; ix++) {
+        snprintf(&hex[ix * 2], 3, "%02x", mac[ix]);
+    }
+
+    return d.signature == std::string(hex, 64);
+}
+
+static std::vector<float> test_values(size_t count)
+{
+    // half representable, single only, zero signs, subnormal, large
+    const float special[] = { 1.5f, 0.1f, -3.3f, 0.0f, -0.0f, 1e-40f, 70000.0f, -65504.0f, 9.81f };
+    std::vector<float> values;
+
+    for (size_t ix = 0; ix < count; ix++) {
+        values.push_back(ix < 9 ? special[ix] : sinf((float)ix * 0.37f) * (float)(ix % 17));
+    }
+
+    return values;
+}
+
+static void check_stream(const stream_t &s, const std::vector<float> &values, size_t axes)
+{
+    decoded_t d = decode_stream(s.file);
+
+    EI_TEST_CHECK(d.ok);
+    EI_TEST_CHECK(d.device_type == "TEST_DEVICE");
+    EI_TEST_CHECK_EQ(d.interval_ms, 10);
+    EI_TEST_CHECK_EQ(d.sensors.size(), axes);
+    EI_TEST_CHECK(signature_matches(s.file, d));
+
+    EI_TEST_CHECK_EQ(d.values.size(), values.size() / axes);
+    for (size_t ix = 0; ix < d.values.size(); ix++) {
+        EI_TEST_CHECK_EQ(d.values[ix].size(), axes);
+        for (size_t ax = 0; ax < axes && ax < d.values[ix].size(); ax++) {
+            const double expected = values[ix * axes + ax];
+            // exact, including the sign of zero
+            if (d.values[ix][ax] != expected || signbit(d.values[ix][ax]) != signbit(expected)) {
+                printf("interval %zu axis %zu: %g != %g\n", ix, ax, d.values[ix][ax], expected);
+                EI_TEST_CHECK(false);
+                return;
+            }
+        }
+    }
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+static void test_preferred_is_byte_compatible_with_double(void)
+{
+    // every float that is not subnormal encodes as QCBOREncode_AddDouble did
+    std::vector<float> values = test_values(2000);
+    values.push_back(INFINITY);
+    values.push_back(-INFINITY);
+    values.push_back(NAN);
+    values.push_back(FLT_MAX);
+    values.push_back(FLT_MIN);
+
+    for (float v : values) {
+        if (fpclassify(v) == FP_SUBNORMAL) {
+            continue;
+        }
+        uint8_t a[16], b[16];
+        QCBOREncodeContext ea, eb;
+        UsefulBufC ra, rb;
+
+        UsefulBuf ba = { a, sizeof(a) };
+        UsefulBuf bb = { b, sizeof(b) };
+
+        QCBOREncode_Init(&ea, ba);
+        QCBOREncode_AddFloat(&ea, v);
+        QCBOREncode_Init(&eb, bb);
+        QCBOREncode_AddDouble(&eb, (double)v);
+        EI_TEST_CHECK(QCBOREncode_Finish(&ea, &ra) == QCBOR_SUCCESS);
+        EI_TEST_CHECK(QCBOREncode_Finish(&eb, &rb) == QCBOR_SUCCESS);
+        if (ra.len != rb.len || memcmp(ra.ptr, rb.ptr, ra.len) != 0) {
+            printf("value %g\n", v);
+            EI_TEST_CHECK(false);
+            return;
+        }
+    }
+}
+
+static void test_single_is_float32(void)
+{
+    const float values[] = { 1.5f, 0.1f, -0.0f, 1e-40f };
+
+    for (float v : values) {
+        uint8_t out[16];
+        uint32_t bits;
+        QCBOREncodeContext e;
+        UsefulBufC r;
+
+        UsefulBuf bo = { out, sizeof(out) };
+
+        QCBOREncode_Init(&e, bo);
+        QCBOREncode_AddFloatNoPreferred(&e, v);
+        EI_TEST_CHECK(QCBOREncode_Finish(&e, &r) == QCBOR_SUCCESS);
+
+        memcpy(&bits, &v, sizeof(bits));
+        const uint8_t expected[] = { 0xfa, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16), (uint8_t)(bits >> 8),
+            (uint8_t)bits };
+        EI_TEST_CHECK_EQ(r.len, 5);
+        EI_TEST_CHECK(memcmp(r.ptr, expected, 5) == 0);
+    }
+}
+
+static void test_streams_decode_and_verify(void)
+{
+    const sensor_aq_float_encoding_t encodings[] = { AQ_FLOAT_PREFERRED, AQ_FLOAT_SINGLE };
+
+    for (sensor_aq_float_encoding_t encoding : encodings) {
+        for (size_t axes : { 1, 3 }) {
+            std::vector<float> values = test_values(axes * 700);
+
+            stream_t per_sample = write_stream(values, axes, WRITE_PER_SAMPLE, encoding);
+            stream_t buffered = write_stream(values, axes, WRITE_BUFFERED, encoding);
+            stream_t batch = write_stream(values, axes, WRITE_BATCH, encoding);
+
+            check_stream(per_sample, values, axes);
+            check_stream(buffered, values, axes);
+            check_stream(batch, values, axes);
+
+            // buffering only changes how often the signature is updated
+            EI_TEST_CHECK(buffered.file == per_sample.file);
+            EI_TEST_CHECK(batch.file == per_sample.file);
+            EI_TEST_CHECK(buffered.updates < per_sample.updates / 10);
+        }
+    }
+}
+
+static void test_single_encoding_size(void)
+{
+    std::vector<float> values = test_values(3 * 100);
+
+    stream_t preferred = write_stream(values, 3, WRITE_BUFFERED, AQ_FLOAT_PREFERRED);
+    stream_t single = write_stream(values, 3, WRITE_BUFFERED, AQ_FLOAT_SINGLE);
+
+    // same header, every value takes 5 bytes instead of its preferred size
+    size_t saved = 0;
+    for (float v : values) {
+        uint8_t out[16];
+        UsefulBuf bo = { out, sizeof(out) };
+        QCBOREncodeContext e;
+        UsefulBufC r;
+
+        QCBOREncode_Init(&e, bo);
+        QCBOREncode_AddFloat(&e, v);
+        EI_TEST_CHECK(QCBOREncode_Finish(&e, &r) == QCBOR_SUCCESS);
+        saved += 5 - r.len;
+    }
+    EI_TEST_CHECK(saved > 0);
+    EI_TEST_CHECK_EQ(single.file.size() - preferred.file.size(), saved);
+}
+
+static void test_init_sets_float_encoding(void)
+{
+    std::vector<float> values = test_values(3 * 50);
+
+    // the stack garbage in float_encoding does not leak into the stream
+    stream_t garbage = write_stream(values, 3, WRITE_BUFFERED, AQ_FLOAT_SINGLE, false);
+    stream_t preferred = write_stream(values, 3, WRITE_BUFFERED, AQ_FLOAT_PREFERRED);
+
+    EI_TEST_CHECK(garbage.file == preferred.file);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_preferred_is_byte_compatible_with_double);
+    EI_TEST_RUN(test_single_is_float32);
+    EI_TEST_RUN(test_streams_decode_and_verify);
+    EI_TEST_RUN(test_single_encoding_size);
+    EI_TEST_RUN(test_init_sets_float_encoding);
+
+    return EI_TEST_RESULT();
+}
@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_shared_signal.cpp
+ * @brief process_impulse with EI_CLASSIFIER_SHARED_SIGNAL_READ set by the test
+ * target, against every DSP block reading the signal on its own (the path
+ * without it): window in order, gathered, not loaded, wide frames, and
+ * spectral blocks sharing their transpose, scale and filter
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+
+#include <random>
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_FRAMES         64
+#define TEST_FREQUENCY      62.5f
+
+/* Impulses ---------------------------------------------------------------- */
+
+/**
+ * A signal that counts the get_data calls on it
+ */
+typedef struct {
+    std::vector<float> data;
+    size_t reads;
+    signal_t signal;
+} counted_signal_t;
+
+static void make_signal(counted_signal_t *s, size_t per_frame, size_t frames, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(-4.0f, 4.0f);
+
+    s->data.resize(per_frame * frames);
+    for (size_t ix = 0; ix < s->data.size(); ix++) {
+        s->data[ix] = dist(rng);
+    }
+    s->reads = 0;
+    s->signal.total_length = s->data.size();
+    s->signal.get_data = [s](size_t offset, size_t length, float *out_ptr) {
+        s->reads++;
+        memcpy(out_ptr, s->data.data() + offset, length * sizeof(float));
+        return 0;
+    };
+}
+
+/* features the learning block was given, one vector per DSP block */
+static std::vector<std::vector<float>> seen_features;
+
+static EI_IMPULSE_ERROR record_features(const ei_impulse_t *impulse, ei_feature_t *fmatrix,
+    uint32_t learn_block_index, uint32_t *input_block_ids, uint32_t input_block_ids_size,
+    ei_impulse_result_t *result, void *config, bool debug)
+{
+    seen_features.clear();
+    for (size_t ix = 0; ix < impulse->dsp_blocks_size; ix++) {
+        const ei::matrix_t *matrix = fmatrix[ix].matrix;
+        seen_features.push_back(std::vector<float>(matrix->buffer, matrix->buffer + matrix->rows * matrix->cols));
+    }
+    return EI_IMPULSE_OK;
+}
+
+static const ei_learning_block_t record_blocks[1] = {
+    { 1, false, &record_features, nullptr, 0, nullptr, 0, 0 },
+};
+
+static ei_impulse_t test_impulse(ei_model_dsp_t *blocks, size_t blocks_size, size_t per_frame, size_t frames)
+{
+    const ei_impulse_t &base = *ei_default_impulse.impulse;
+    size_t features = 0;
+    for (size_t ix = 0; ix < blocks_size; ix++) {
+        features += blocks[ix].n_output_features;
+    }
+
+    ei_impulse_t impulse = {
+        9001, base.project_owner, base.project_name, base.deploy_version,
+        (uint32_t)features, (uint32_t)frames, (uint32_t)per_frame, (uint32_t)(frames * per_frame),
+        0, 0, 0, 1000.0f / TEST_FREQUENCY, TEST_FREQUENCY,
+        blocks_size, blocks,
+        0, 0, 0,
+        1, record_blocks,
+        base.inferencing_engine,
+        base.sensor, "test", (uint32_t)frames, 1,
+        0, 0, base.calibration, base.categories, base.object_detection_nms,
+    };
+    return impulse;
+}
+
+static ei_dsp_config_raw_t raw_config = { 1, 1, 1, 2.0f };
+
+static ei_model_dsp_t raw_block(uint8_t *axes, size_t axes_size, size_t frames)
+{
+    ei_model_dsp_t block = { 1, frames * axes_size, &extract_raw_features, &raw_config, axes, axes_size, 1, nullptr };
+    return block;
+}
+
+static ei_dsp_config_spectral_analysis_t spectral_config(int axes, int fft_length, const char *filter_type, float cutoff)
+{
+    ei_dsp_config_spectral_analysis_t config = {
+        2, 2, axes, 1.5f, 1, filter_type, cutoff, 4, "FFT", fft_length, 3, 0.1f,
+        "0.1, 0.5, 1.0, 2.0, 5.0", true, true, 1, "db4", false
+    };
+    return config;
+}
+
+static size_t spectral_features(const ei_dsp_config_spectral_analysis_t *config)
+{
+    size_t start_bin = 1;
+    size_t stop_bin = config->fft_length / 2 + 1;
+    if (strcmp(config->filter_type, "low") == 0 || strcmp(config->filter_type, "high") == 0) {
+        spectral::feature::get_start_stop_bin(TEST_FREQUENCY, config->fft_length, config->filter_cutoff,
+            &start_bin, &stop_bin, strcmp(config->filter_type, "high") == 0);
+    }
+    return config->axes * (3 + stop_bin - start_bin);
+}
+
+static ei_model_dsp_t spectral_block(ei_dsp_config_spectral_analysis_t *config, uint8_t *axes)
+{
+    ei_model_dsp_t block = {
+        2, spectral_features(config), &extract_spectral_analysis_features, config, axes, (size_t)config->axes, 1, nullptr
+    };
+    return block;
+}
+
+/**
+ * What every block computes reading the signal on its own, as process_impulse
+ * does without EI_CLASSIFIER_SHARED_SIGNAL_READ
+ */
+static std::vector<std::vector<float>> unshared_features(const ei_impulse_t *impulse, signal_t *signal)
+{
+    std::vector<std::vector<float>> features;
+    for (size_t ix = 0; ix < impulse->dsp_blocks_size; ix++) {
+        const ei_model_dsp_t *block = &impulse->dsp_blocks[ix];
+        ei::matrix_t matrix(1, block->n_output_features);
+        SignalWithAxes swa(signal, block->axes, block->axes_size, impulse);
+        EI_TEST_CHECK_EQ(block->extract_fn(swa.get_signal(), &matrix, block->config, impulse->frequency), EIDSP_OK);
+        features.push_back(std::vector<float>(matrix.buffer, matrix.buffer + block->n_output_features));
+    }
+    return features;
+}
+
+/**
+ * process_impulse gives every block bit-identical features, returns the reads
+ * on the original signal
+ */
+static size_t check_process_impulse(const ei_impulse_t *impulse, counted_signal_t *s)
+{
+    std::vector<std::vector<float>> expected = unshared_features(impulse, &s->signal);
+
+    ei_impulse_handle_t handle(impulse);
+    ei_impulse_result_t result;
+    seen_features.clear();
+    s->reads = 0;
+    EI_TEST_CHECK_EQ(process_impulse(&handle, &s->signal, &result, false), EI_IMPULSE_OK);
+    size_t reads = s->reads;
+
+    EI_TEST_CHECK_EQ(seen_features.size(), expected.size());
+    for (size_t ix = 0; ix < expected.size() && ix < seen_features.size(); ix++) {
+        bool same = seen_features[ix] == expected[ix];
+        EI_TEST_CHECK(same);
+    }
+    return reads;
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+/* Every block takes all axes in order: one read, memcpy from the window */
+static void test_window_in_order(void)
+{
+    uint8_t axes[3] = { 0, 1, 2 };
+    ei_dsp_config_spectral_analysis_t config = spectral_config(3, 16, "none", 3.0f);
+    ei_model_dsp_t blocks[2] = { spectral_block(&config, axes), raw_block(axes, 3, TEST_FRAMES) };
+    ei_impulse_t impulse = test_impulse(blocks, 2, 3, TEST_FRAMES);
+    counted_signal_t s;
+    make_signal(&s, 3, TEST_FRAMES, 1);
+
+    EI_TEST_CHECK_EQ(check_process_impulse(&impulse, &s), 1);
+}
+
+/* Blocks take some axes, one in another order: gathered from the window */
+static void test_window_gather(void)
+{
+    uint8_t spectral_axes[3] = { 0, 2, 3 };
+    uint8_t raw_axes[2] = { 3, 0 };
+    ei_dsp_config_spectral_analysis_t config = spectral_config(3, 16, "low", 10.0f);
+    ei_model_dsp_t blocks[2] = { spectral_block(&config, spectral_axes), raw_block(raw_axes, 2, TEST_FRAMES) };
+    ei_impulse_t impulse = test_impulse(blocks, 2, 5, TEST_FRAMES);
+    counted_signal_t s;
+    make_signal(&s, 5, TEST_FRAMES, 2);
+
+    // read 32 frames at a time to drop the unused axes
+    EI_TEST_CHECK_EQ(check_process_impulse(&impulse, &s), TEST_FRAMES / 32);
+}
+
+/* No axis in common: no window, blocks read the signal */
+static void test_no_overlap_falls_back(void)
+{
+    uint8_t spectral_axes[2] = { 0, 1 };
+    uint8_t raw_axes[1] = { 2 };
+    ei_dsp_config_spectral_analysis_t config = spectral_config(2, 16, "none", 3.0f);
+    ei_model_dsp_t blocks[2] = { spectral_block(&config, spectral_axes), raw_block(raw_axes, 1, TEST_FRAMES) };
+    ei_impulse_t impulse = test_impulse(blocks, 2, 3, TEST_FRAMES);
+    counted_signal_t s;
+    make_signal(&s, 3, TEST_FRAMES, 3);
+
+    // SignalWithAxes reads one sample at a time
+    EI_TEST_CHECK_EQ(check_process_impulse(&impulse, &s), TEST_FRAMES * 3);
+}
+
+/* More than 255 axes per frame, the 256th window column is a real one */
+static void test_wide_frame(void)
+{
+    const size_t per_frame = 300;
+    const size_t frames = 4;
+    uint8_t all_axes[256];
+    for (size_t ix = 0; ix < 256; ix++) {
+        all_axes[ix] = (uint8_t)ix;
+    }
+    uint8_t some_axes[2] = { 255, 7 };
+    ei_model_dsp_t blocks[2] = { raw_block(all_axes, 256, frames), raw_block(some_axes, 2, frames) };
+    ei_impulse_t impulse = test_impulse(blocks, 2, per_frame, frames);
+    counted_signal_t s;
+    make_signal(&s, per_frame, frames, 4);
+
+    EI_TEST_CHECK_EQ(check_process_impulse(&impulse, &s), 1);
+}
+
+/**
+ * Spectral blocks with the same axes, scale and filter share the
+ * preprocessing, whatever their FFT length; a block filtering differently
+ * preprocesses on its own
+ */
+static void test_shared_preprocessing_in_impulse(void)
+{
+    uint8_t axes[2] = { 0, 1 };
+    ei_dsp_config_spectral_analysis_t configs[3] = {
+        spectral_config(2, 16, "low", 10.0f),
+        spectral_config(2, 32, "low", 10.0f),
+        spectral_config(2, 16, "high", 5.0f),
+    };
+    configs[1].do_log = false;
+    ei_model_dsp_t blocks[3] = {
+        spectral_block(&configs[0], axes), spectral_block(&configs[1], axes), spectral_block(&configs[2], axes),
+    };
+    ei_impulse_t impulse = test_impulse(blocks, 3, 3, TEST_FRAMES);
+    counted_signal_t s;
+    make_signal(&s, 3, TEST_FRAMES, 5);
+
+    EI_TEST_CHECK_EQ(check_process_impulse(&impulse, &s), TEST_FRAMES / 32);
+}
+
+/**
+ * The second block of a group starts from the stored matrix and does not
+ * read the signal, a block not in a group does
+ */
+static void test_shared_preprocessing_reuses(void)
+{
+    uint8_t axes[2] = { 0, 1 };
+    ei_dsp_config_spectral_analysis_t configs[3] = {
+        spectral_config(2, 16, "high", 5.0f),
+        spectral_config(2, 32, "high", 5.0f),
+        spectral_config(2, 32, "none", 3.0f),
+    };
+    // filter settings of a block without a filter don't matter
+    configs[2].filter_order = 2;
+    ei_model_dsp_t blocks[3] = {
+        spectral_block(&configs[0], axes), spectral_block(&configs[1], axes), spectral_block(&configs[2], axes),
+    };
+    ei_impulse_t impulse = test_impulse(blocks, 3, 2, TEST_FRAMES);
+    counted_signal_t s;
+    make_signal(&s, 2, TEST_FRAMES, 6);
+    std::vector<std::vector<float>> expected = unshared_features(&impulse, &s.signal);
+
+    SharedPreprocessing shared(3);
+    for (size_t ix = 0; ix < 3; ix++) {
+        ei_dsp_preprocessing_t preprocessing;
+        EI_TEST_CHECK(ei_dsp_block_preprocessing(&impulse, &blocks[ix], &preprocessing));
+        shared.add(ix, &preprocessing);
+    }
+    shared.plan();
+
+    const size_t reads[3] = { 1, 0, 1 };
+    for (size_t ix = 0; ix < 3; ix++) {
+        ei::matrix_t matrix(1, blocks[ix].n_output_features);
+        s.reads = 0;
+        shared.begin_block(ix, &s.signal);
+        EI_TEST_CHECK_EQ(SharedPreprocessing::active(&s.signal) != nullptr, ix < 2);
+        EI_TEST_CHECK_EQ(extract_spectral_analysis_features(&s.signal, &matrix, &configs[ix], TEST_FREQUENCY), EIDSP_OK);
+        shared.end_block();
+        EI_TEST_CHECK(SharedPreprocessing::active(&s.signal) == nullptr);
+
+        EI_TEST_CHECK_EQ(s.reads, reads[ix]);
+        bool same = std::vector<float>(matrix.buffer, matrix.buffer + matrix.cols) == expected[ix];
+        EI_TEST_CHECK(same);
+    }
+}
+
+/* Decimating, wavelet and fixed (3 axes, EI_CLASSIFIER_RAW_SAMPLE_COUNT) configs keep their own path */
+static void test_preprocessing_not_shared(void)
+{
+    uint8_t axes[3] = { 0, 1, 2 };
+    ei_dsp_preprocessing_t preprocessing;
+
+    ei_dsp_config_spectral_analysis_t decimating = spectral_config(3, 16, "none", 3.0f);
+    decimating.implementation_version = 4;
+    decimating.input_decimation_ratio = 10;
+    ei_dsp_config_spectral_analysis_t wavelet = spectral_config(3, 16, "none", 3.0f);
+    wavelet.analysis_type = "Wavelet";
+    ei_dsp_config_spectral_analysis_t fixed = spectral_config(3, 16, "none", 3.0f);
+
+    ei_model_dsp_t blocks[3] = {
+        spectral_block(&decimating, axes), spectral_block(&wavelet, axes), spectral_block(&fixed, axes),
+    };
+    ei_impulse_t impulse = test_impulse(blocks, 3, 3, EI_CLASSIFIER_RAW_SAMPLE_COUNT);
+    for (size_t ix = 0; ix < 3; ix++) {
+        EI_TEST_CHECK(!ei_dsp_block_preprocessing(&impulse, &blocks[ix], &preprocessing));
+    }
+
+    ei_model_dsp_t raw = raw_block(axes, 3, EI_CLASSIFIER_RAW_SAMPLE_COUNT);
+    EI_TEST_CHECK(!ei_dsp_block_preprocessing(&impulse, &raw, &preprocessing));
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_window_in_order);
+    EI_TEST_RUN(test_window_gather);
+    EI_TEST_RUN(test_no_overlap_falls_back);
+    EI_TEST_RUN(test_wide_frame);
+    EI_TEST_RUN(test_shared_preprocessing_in_impulse);
+    EI_TEST_RUN(test_shared_preprocessing_reuses);
+    EI_TEST_RUN(test_preprocessing_not_shared);
+
+    return EI_TEST_RESULT();
+}
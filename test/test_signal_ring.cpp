@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_signal_ring.cpp
+ * @brief numpy::signal_ring_get_data and signal_from_ring_buffer against a
+ * linear copy of the window, for every window start and read
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/dsp/numpy.hpp"
+
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_RING_SIZE              13
+#define TEST_SENTINEL               -12345.0f
+
+using namespace ei;
+
+/* Tests ------------------------------------------------------------------- */
+
+// ring[i] = 100 + i, so every value says where in the ring it came from
+static std::vector<float> make_ring(size_t size)
+{
+    std::vector<float> ring(size);
+    for (size_t ix = 0; ix < size; ix++) {
+        ring[ix] = 100.0f + (float)ix;
+    }
+    return ring;
+}
+
+/* Every (start, offset, length) in a small ring, including reads that
+ * straddle the end, reads that start past it and reads of the whole ring.
+ * Nothing is written past length. */
+static void test_get_data_all_reads(void)
+{
+    std::vector<float> ring = make_ring(TEST_RING_SIZE);
+    bool same = true;
+
+    for (size_t start = 0; start < TEST_RING_SIZE; start++) {
+        signal_ring_t desc = { ring.data(), TEST_RING_SIZE, start };
+        for (size_t offset = 0; offset < TEST_RING_SIZE; offset++) {
+            for (size_t length = 0; offset + length <= TEST_RING_SIZE; length++) {
+                std::vector<float> out(length + 1, TEST_SENTINEL);
+                numpy::signal_ring_get_data(&desc, offset, length, out.data());
+
+                for (size_t ix = 0; ix < length; ix++) {
+                    float expected = ring[(start + offset + ix) % TEST_RING_SIZE];
+                    if (out[ix] != expected) {
+                        same = false;
+                    }
+                }
+                if (out[length] != TEST_SENTINEL) {
+                    same = false;
+                }
+            }
+        }
+    }
+
+    EI_TEST_CHECK(same);
+}
+
+/* A read of exactly the ring length from the middle comes back rotated */
+static void test_get_data_full_length(void)
+{
+    std::vector<float> ring = make_ring(TEST_RING_SIZE);
+    signal_ring_t desc = { ring.data(), TEST_RING_SIZE, 5 };
+    float out[TEST_RING_SIZE];
+
+    numpy::signal_ring_get_data(&desc, 0, TEST_RING_SIZE, out);
+    EI_TEST_CHECK_EQ(out[0], 105);
+    EI_TEST_CHECK_EQ(out[TEST_RING_SIZE - 6], 100 + TEST_RING_SIZE - 1);
+    EI_TEST_CHECK_EQ(out[TEST_RING_SIZE - 5], 100);
+    EI_TEST_CHECK_EQ(out[TEST_RING_SIZE - 1], 104);
+
+    // start 0, no wrap at all
+    desc.start = 0;
+    numpy::signal_ring_get_data(&desc, 0, TEST_RING_SIZE, out);
+    bool same = memcmp(out, ring.data(), sizeof(out)) == 0;
+    EI_TEST_CHECK(same);
+}
+
+/* Reading a window in slices, as the DSP blocks do, gives the linear window */
+static void test_signal_from_ring_buffer(void)
+{
+    std::vector<float> ring = make_ring(TEST_RING_SIZE);
+    const size_t window = 10;
+
+    for (size_t start = 0; start < TEST_RING_SIZE; start++) {
+        signal_ring_t desc = { ring.data(), TEST_RING_SIZE, start };
+        signal_t signal;
+        EI_TEST_CHECK_EQ(numpy::signal_from_ring_buffer(&desc, window, &signal), EIDSP_OK);
+        EI_TEST_CHECK_EQ(signal.total_length, window);
+
+        std::vector<float> out(window);
+        for (size_t offset = 0; offset < window; offset += 3) {
+            size_t length = (window - offset < 3) ? window - offset : 3;
+            EI_TEST_CHECK_EQ(signal.get_data(offset, length, out.data() + offset), 0);
+        }
+
+        bool same = true;
+        for (size_t ix = 0; ix < window; ix++) {
+            if (out[ix] != ring[(start + ix) % TEST_RING_SIZE]) {
+                same = false;
+            }
+        }
+        EI_TEST_CHECK(same);
+    }
+}
+
+/* Windows longer than the ring, or starting outside it, are rejected */
+static void test_signal_from_ring_buffer_invalid(void)
+{
+    std::vector<float> ring = make_ring(TEST_RING_SIZE);
+    signal_t signal;
+
+    signal_ring_t too_long = { ring.data(), TEST_RING_SIZE, 0 };
+    EI_TEST_CHECK(numpy::signal_from_ring_buffer(&too_long, TEST_RING_SIZE + 1, &signal) != EIDSP_OK);
+
+    signal_ring_t bad_start = { ring.data(), TEST_RING_SIZE, TEST_RING_SIZE };
+    EI_TEST_CHECK(numpy::signal_from_ring_buffer(&bad_start, 1, &signal) != EIDSP_OK);
+
+    signal_ring_t full = { ring.data(), TEST_RING_SIZE, TEST_RING_SIZE - 1 };
+    EI_TEST_CHECK_EQ(numpy::signal_from_ring_buffer(&full, TEST_RING_SIZE, &signal), EIDSP_OK);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_get_data_all_reads);
+    EI_TEST_RUN(test_get_data_full_length);
+    EI_TEST_RUN(test_signal_from_ring_buffer);
+    EI_TEST_RUN(test_signal_from_ring_buffer_invalid);
+
+    return EI_TEST_RESULT();
+}
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_spectral_fixed.cpp
+ * @brief extract_spectral_analysis_features_fixed and the config lookup in
+ * extract_spectral_analysis_features against the generic implementation
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/classifier/ei_run_classifier.h"
+
+#include <random>
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_WINDOWS        200
+#define TEST_REL_TOL        1e-4f
+#define TEST_ABS_TOL        1e-4f
+
+static std::mt19937 rng(1234);
+
+static void random_window(std::vector<float> &buf, size_t axes)
+{
+    std::uniform_real_distribution<float> noise(-2.0f, 2.0f);
+    std::uniform_real_distribution<float> freq(0.5f, 20.0f);
+    float f = freq(rng);
+
+    for (size_t i = 0; i < buf.size(); i++) {
+        float t = (float)(i / axes) / EI_CLASSIFIER_FREQUENCY;
+        buf[i] = 5.0f * sinf(2.0f * (float)M_PI * f * t + (float)(i % axes)) + noise(rng);
+    }
+}
+
+static size_t feature_count(const ei_dsp_config_spectral_analysis_t &config)
+{
+    size_t start_bin = 1;
+    size_t stop_bin = config.fft_length / 2 + 1;
+
+    if (ei::spectral::filter_from_name(config.filter_type) != ei::spectral::filter_none) {
+        ei::spectral::feature::get_start_stop_bin(EI_CLASSIFIER_FREQUENCY, config.fft_length,
+            config.filter_cutoff, &start_bin, &stop_bin,
+            ei::spectral::filter_from_name(config.filter_type) == ei::spectral::filter_highpass);
+    }
+    return config.axes * (3 + stop_bin - start_bin);
+}
+
+/**
+ * Run both paths over random windows and compare every feature
+ */
+static void compare_paths(extract_fn_t fixed_fn, ei_dsp_config_spectral_analysis_t config, size_t window)
+{
+    std::vector<float> buf(window * config.axes);
+    size_t n_features = feature_count(config);
+    float max_err = 0.0f;
+
+    for (int w = 0; w < TEST_WINDOWS; w++) {
+        random_window(buf, config.axes);
+
+        signal_t signal;
+        numpy::signal_from_buffer(buf.data(), buf.size(), &signal);
+
+        matrix_t fixed_out(1, n_features);
+        matrix_t generic_out(1, n_features);
+        EI_TEST_CHECK_EQ(fixed_fn(&signal, &fixed_out, &config, EI_CLASSIFIER_FREQUENCY), EIDSP_OK);
+        EI_TEST_CHECK_EQ(extract_spectral_analysis_features_generic(&signal, &generic_out, &config,
+            EI_CLASSIFIER_FREQUENCY), EIDSP_OK);
+
+        for (size_t i = 0; i < n_features; i++) {
+            float expected = generic_out.buffer[i];
+            float err = fabsf(fixed_out.buffer[i] - expected);
+            EI_TEST_CHECK_NEAR(fixed_out.buffer[i], expected, TEST_ABS_TOL + TEST_REL_TOL * fabsf(expected));
+            max_err = err > max_err ? err : max_err;
+        }
+    }
+
+    printf("    %d windows, %u features, max abs error %g\n", TEST_WINDOWS, (unsigned)n_features, max_err);
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+/* The generated block keeps the stock function, which looks up the fixed path for ei_dsp_config_2 */
+static void test_generated_config_matches_generic(void)
+{
+    std::vector<float> buf(EI_CLASSIFIER_RAW_SAMPLE_COUNT * ei_dsp_config_2.axes);
+    signal_t signal;
+    numpy::signal_from_buffer(buf.data(), buf.size(), &signal);
+
+    EI_TEST_CHECK(ei_dsp_blocks[0].extract_fn == &extract_spectral_analysis_features);
+    extract_fn_t expected_fn =
+        &extract_spectral_analysis_features_fixed<3, EI_CLASSIFIER_RAW_SAMPLE_COUNT, 16, ei::spectral::filter_none, 6>;
+    EI_TEST_CHECK(spectral_analysis_fixed_fn(&signal, &ei_dsp_config_2) == expected_fn);
+    EI_TEST_CHECK_EQ(feature_count(ei_dsp_config_2), ei_dsp_blocks[0].n_output_features);
+
+    compare_paths(ei_dsp_blocks[0].extract_fn, ei_dsp_config_2, EI_CLASSIFIER_RAW_SAMPLE_COUNT);
+}
+
+/* Filtered instantiation with a longer FFT (numpy::power_spectrum) */
+static void test_highpass_fft128_matches_generic(void)
+{
+    ei_dsp_config_spectral_analysis_t config = ei_dsp_config_2;
+    config.filter_type = "high";
+    config.fft_length = 128;
+
+    compare_paths(
+        &extract_spectral_analysis_features_fixed<3, EI_CLASSIFIER_RAW_SAMPLE_COUNT, 128, ei::spectral::filter_highpass, 6>,
+        config, EI_CLASSIFIER_RAW_SAMPLE_COUNT);
+}
+
+/* The lookup picks the variant of the config, without one it runs the generic path */
+static void test_lookup(void)
+{
+    std::vector<float> buf(EI_CLASSIFIER_RAW_SAMPLE_COUNT * 3);
+    signal_t signal;
+    numpy::signal_from_buffer(buf.data(), buf.size(), &signal);
+    ei_dsp_config_spectral_analysis_t config = ei_dsp_config_2;
+
+    config.filter_type = "low";
+    config.fft_length = 64;
+    extract_fn_t expected_fn =
+        &extract_spectral_analysis_features_fixed<3, EI_CLASSIFIER_RAW_SAMPLE_COUNT, 64, ei::spectral::filter_lowpass, 6>;
+    EI_TEST_CHECK(spectral_analysis_fixed_fn(&signal, &config) == expected_fn);
+    compare_paths(&extract_spectral_analysis_features, config, EI_CLASSIFIER_RAW_SAMPLE_COUNT);
+
+    // no high-pass variant in the default list
+    config.filter_type = "high";
+    EI_TEST_CHECK(spectral_analysis_fixed_fn(&signal, &config) == nullptr);
+    compare_paths(&extract_spectral_analysis_features, config, EI_CLASSIFIER_RAW_SAMPLE_COUNT);
+
+    // decimating configs always go through the generic path
+    config = ei_dsp_config_2;
+    config.input_decimation_ratio = 3;
+    EI_TEST_CHECK(spectral_analysis_fixed_fn(&signal, &config) == nullptr);
+}
+
+/* A config that doesn't match the instantiation goes through the generic path */
+static void test_mismatched_config_falls_back(void)
+{
+    extract_fn_t fixed_fn =
+        &extract_spectral_analysis_features_fixed<3, EI_CLASSIFIER_RAW_SAMPLE_COUNT, 16, ei::spectral::filter_lowpass, 6>;
+    ei_dsp_config_spectral_analysis_t config = ei_dsp_config_2;
+
+    compare_paths(fixed_fn, config, EI_CLASSIFIER_RAW_SAMPLE_COUNT);
+
+    config.filter_type = "low";
+    config.filter_order = 4;
+    compare_paths(fixed_fn, config, EI_CLASSIFIER_RAW_SAMPLE_COUNT);
+}
+
+/* A decimating config gets whatever the generic path computes for it */
+static void test_decimating_config_falls_back(void)
+{
+    ei_dsp_config_spectral_analysis_t config = ei_dsp_config_2;
+    config.implementation_version = 3;
+    config.input_decimation_ratio = 3;
+
+    std::vector<float> buf(EI_CLASSIFIER_RAW_SAMPLE_COUNT * config.axes);
+    random_window(buf, config.axes);
+    signal_t signal;
+    numpy::signal_from_buffer(buf.data(), buf.size(), &signal);
+
+    matrix_t fixed_out(1, ei_dsp_blocks[0].n_output_features);
+    matrix_t generic_out(1, ei_dsp_blocks[0].n_output_features);
+    int fixed_ret = extract_spectral_analysis_features_fixed<3, EI_CLASSIFIER_RAW_SAMPLE_COUNT, 16,
+        ei::spectral::filter_none, 6>(&signal, &fixed_out, &config, EI_CLASSIFIER_FREQUENCY);
+    int generic_ret = extract_spectral_analysis_features_generic(&signal, &generic_out, &config,
+        EI_CLASSIFIER_FREQUENCY);
+
+    EI_TEST_CHECK_EQ(fixed_ret, generic_ret);
+    if (fixed_ret == EIDSP_OK) {
+        EI_TEST_CHECK_EQ(memcmp(fixed_out.buffer, generic_out.buffer,
+            fixed_out.rows * fixed_out.cols * sizeof(float)), 0);
+    }
+}
+
+/* Windows too large for the stack budget go through the generic path */
+static void test_large_window_falls_back(void)
+{
+    typedef ei::spectral::fixed_feature<3, 1000, 16, ei::spectral::filter_none, 6> large_t;
+    static_assert(!large_t::fits_on_stack, "window should exceed EIDSP_SPECTRAL_FIXED_MAX_STACK");
+    static_assert(ei::spectral::fixed_feature<3, EI_CLASSIFIER_RAW_SAMPLE_COUNT, 16,
+        ei::spectral::filter_none, 6>::fits_on_stack, "generated config should fit on the stack");
+
+    compare_paths(
+        &extract_spectral_analysis_features_fixed<3, 1000, 16, ei::spectral::filter_none, 6>,
+        ei_dsp_config_2, 1000);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_generated_config_matches_generic);
+    EI_TEST_RUN(test_highpass_fft128_matches_generic);
+    EI_TEST_RUN(test_lookup);
+    EI_TEST_RUN(test_mismatched_config_falls_back);
+    EI_TEST_RUN(test_decimating_config_falls_back);
+    EI_TEST_RUN(test_large_window_falls_back);
+
+    return EI_TEST_RESULT();
+}
@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_tlsf.cpp
+ * @brief EiTlsfAllocator fuzzed against its own consistency checks, the
+ * ei_tlsf_heap wrappers from several threads, and a benchmark against malloc
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/porting/ei_tlsf.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <pthread.h>
+#include <random>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_THREADS                8
+#define TEST_THREAD_ROUNDS          2000
+
+/* Mocks ------------------------------------------------------------------- */
+
+// what the posix porting layer does when built with EI_PORTING_TLSF_HEAP_SIZE
+static pthread_mutex_t heap_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void ei_tlsf_heap_lock(void)
+{
+    pthread_mutex_lock(&heap_mutex);
+}
+
+void ei_tlsf_heap_unlock(void)
+{
+    pthread_mutex_unlock(&heap_mutex);
+}
+
+/* Helpers ----------------------------------------------------------------- */
+
+typedef struct {
+    uint8_t *ptr;
+    size_t size;
+    uint8_t pattern;
+} live_block_t;
+
+/**
+ * Mostly small requests, some medium (DSP buffers) and a few large ones
+ * (tensor arenas, matrices)
+ */
+static size_t random_size(std::mt19937 &rng, size_t large_max)
+{
+    uint32_t kind = rng() % 100;
+
+    if (kind < 70) {
+        return 1 + rng() % 256;
+    }
+    if (kind < 95) {
+        return 257 + rng() % (8192 - 257);
+    }
+    return 8193 + rng() % (large_max - 8193);
+}
+
+static void fill(const live_block_t &block)
+{
+    for (size_t i = 0; i < block.size; i++) {
+        block.ptr[i] = (uint8_t)(block.pattern + i);
+    }
+}
+
+static bool intact(const live_block_t &block)
+{
+    for (size_t i = 0; i < block.size; i++) {
+        if (block.ptr[i] != (uint8_t)(block.pattern + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+/**
+ * Runs first, so the threads race on constructing the heap as well as on
+ * allocating from it
+ */
+static void test_concurrent_first_use(void)
+{
+    std::atomic<bool> go(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < TEST_THREADS; t++) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 rng(t);
+            live_block_t held[4] = { };
+
+            while (!go.load()) {
+            }
+
+            for (int round = 0; round < TEST_THREAD_ROUNDS; round++) {
+                live_block_t &block = held[round % 4];
+                if (block.ptr) {
+                    if (!intact(block)) {
+                        failures++;
+                    }
+                    ei_tlsf_heap_free(block.ptr);
+                }
+                block.size = 1 + rng() % 512;
+                block.pattern = (uint8_t)(t * 31 + round);
+                block.ptr = (uint8_t *)ei_tlsf_heap_malloc(block.size, (const void *)&test_concurrent_first_use);
+                fill(block);
+            }
+            for (live_block_t &block : held) {
+                if (!intact(block)) {
+                    failures++;
+                }
+                ei_tlsf_heap_free(block.ptr);
+            }
+        });
+    }
+
+    go.store(true);
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    ei_tlsf_stats_t stats;
+    ei_tlsf_heap_get_stats(&stats);
+
+    EI_TEST_CHECK_EQ(failures.load(), 0);
+    EI_TEST_CHECK_EQ(ei_tlsf_heap_fallbacks(), 0);
+    EI_TEST_CHECK_EQ(stats.allocations, TEST_THREADS * TEST_THREAD_ROUNDS);
+    EI_TEST_CHECK_EQ(stats.frees, TEST_THREADS * TEST_THREAD_ROUNDS);
+    EI_TEST_CHECK_EQ(stats.used_bytes, 0);
+    EI_TEST_CHECK_EQ(stats.fragmentation_pct, 0);
+
+    ei_tlsf_call_site_t sites[EI_TLSF_CALL_SITES];
+    EI_TEST_CHECK_EQ(ei_tlsf_heap_get_call_sites(sites, EI_TLSF_CALL_SITES), 1);
+    EI_TEST_CHECK_EQ(sites[0].calls, TEST_THREADS * TEST_THREAD_ROUNDS);
+}
+
+static void test_heap_fallback(void)
+{
+    ei_tlsf_stats_t stats;
+    uint32_t fallbacks = ei_tlsf_heap_fallbacks();
+
+    // does not fit the region, served by malloc and freed with free
+    uint8_t *big = (uint8_t *)ei_tlsf_heap_calloc(EI_PORTING_TLSF_HEAP_SIZE, 2, nullptr);
+    EI_TEST_CHECK(big != nullptr);
+    EI_TEST_CHECK_EQ(ei_tlsf_heap_fallbacks(), fallbacks + 1);
+    EI_TEST_CHECK_EQ(big[0], 0);
+    EI_TEST_CHECK_EQ(big[2 * EI_PORTING_TLSF_HEAP_SIZE - 1], 0);
+    ei_tlsf_heap_free(big);
+
+    // calloc zeroes blocks that were used before
+    uint8_t *used = (uint8_t *)ei_tlsf_heap_malloc(100, nullptr);
+    memset(used, 0xa5, 100);
+    ei_tlsf_heap_free(used);
+    uint8_t *zeroed = (uint8_t *)ei_tlsf_heap_calloc(25, 4, nullptr);
+    EI_TEST_CHECK(zeroed == used);
+    EI_TEST_CHECK(std::all_of(zeroed, zeroed + 100, [](uint8_t b) { return b == 0; }));
+    ei_tlsf_heap_free(zeroed);
+
+    EI_TEST_CHECK(ei_tlsf_heap_calloc(SIZE_MAX / 2, 4, nullptr) == nullptr);
+    ei_tlsf_heap_free(nullptr);
+
+    ei_tlsf_heap_get_stats(&stats);
+    EI_TEST_CHECK_EQ(stats.used_bytes, 0);
+}
+
+/**
+ * Random allocation and free sequences on a region small enough to run full
+ * often. Every block must be aligned, inside the region, not overlap any
+ * other block and keep its contents until it is freed.
+ */
+static void test_fuzz(void)
+{
+    std::vector<uint64_t> region(256 * 1024 / sizeof(uint64_t));
+    EiTlsfAllocator allocator;
+    ei_tlsf_stats_t stats;
+    int failed_allocations = 0;
+
+    for (uint32_t seed = 1; seed <= 8; seed++) {
+        std::mt19937 rng(seed);
+        std::vector<live_block_t> live;
+        std::map<uintptr_t, size_t> ranges;
+
+        // misaligned on odd seeds, init skips to the next aligned address
+        EI_TEST_CHECK(allocator.init((uint8_t *)region.data() + (seed & 1) * 3, region.size() * 8 - 3));
+
+        for (int op = 0; op < 50000; op++) {
+            if (live.empty() || rng() % 100 < 55) {
+                live_block_t block;
+                block.size = random_size(rng, 64 * 1024);
+                block.pattern = (uint8_t)rng();
+                block.ptr = (uint8_t *)allocator.malloc(block.size);
+
+                if (!block.ptr) {
+                    // a good fit rounds up to the next size class (1/16th)
+                    allocator.get_stats(&stats);
+                    EI_TEST_CHECK(stats.largest_free < block.size + block.size / 16 + 2 * EiTlsfAllocator::ALIGN);
+                    failed_allocations++;
+                    continue;
+                }
+
+                EI_TEST_CHECK_EQ((uintptr_t)block.ptr % EiTlsfAllocator::ALIGN, 0);
+                EI_TEST_CHECK(allocator.owns(block.ptr));
+                EI_TEST_CHECK(allocator.owns(block.ptr + block.size - 1));
+                EI_TEST_CHECK(allocator.block_size(block.ptr) >= block.size);
+
+                uintptr_t start = (uintptr_t)block.ptr;
+                auto next = ranges.lower_bound(start);
+                EI_TEST_CHECK(next == ranges.end() || next->first >= start + block.size);
+                if (next != ranges.begin()) {
+                    auto prev = std::prev(next);
+                    EI_TEST_CHECK(prev->first + prev->second <= start);
+                }
+                ranges[start] = block.size;
+
+                fill(block);
+                live.push_back(block);
+            }
+            else {
+                size_t ix = rng() % live.size();
+                EI_TEST_CHECK(intact(live[ix]));
+                ranges.erase((uintptr_t)live[ix].ptr);
+                allocator.free(live[ix].ptr);
+                live[ix] = live.back();
+                live.pop_back();
+            }
+
+            if (op % 1000 == 0 && !allocator.check()) {
+                EI_TEST_CHECK(allocator.check());
+                return;
+            }
+        }
+
+        for (const live_block_t &block : live) {
+            EI_TEST_CHECK(intact(block));
+            allocator.free(block.ptr);
+        }
+
+        // everything merged back into one block
+        allocator.get_stats(&stats);
+        EI_TEST_CHECK(allocator.check());
+        EI_TEST_CHECK_EQ(stats.used_bytes, 0);
+        EI_TEST_CHECK_EQ(stats.largest_free, stats.free_bytes);
+        EI_TEST_CHECK_EQ(stats.fragmentation_pct, 0);
+    }
+
+    // the region really did run full
+    EI_TEST_CHECK(failed_allocations > 0);
+    printf("  %d allocations did not fit\n", failed_allocations);
+}
+
+typedef struct {
+    bool is_alloc;
+    size_t size;    // alloc: bytes, free: index of the alloc in the trace
+} trace_op_t;
+
+/**
+ * An alloc / free trace that keeps at most max_live bytes live
+ */
+static std::vector<trace_op_t> make_trace(std::mt19937 &rng, int n_ops, size_t max_live)
+{
+    std::vector<trace_op_t> trace;
+    std::vector<std::pair<size_t, size_t>> live;    // alloc index, size
+    size_t live_bytes = 0;
+    size_t n_allocs = 0;
+
+    for (int op = 0; op < n_ops; op++) {
+        size_t size = random_size(rng, 32 * 1024);
+
+        if (live.empty() || (rng() % 100 < 50 && live_bytes + size < max_live)) {
+            trace.push_back({ true, size });
+            live.push_back({ n_allocs++, size });
+            live_bytes += size;
+        }
+        else {
+            size_t ix = rng() % live.size();
+            trace.push_back({ false, live[ix].first });
+            live_bytes -= live[ix].second;
+            live[ix] = live.back();
+            live.pop_back();
+        }
+    }
+    for (const auto &entry : live) {
+        trace.push_back({ false, entry.first });
+    }
+
+    return trace;
+}
+
+template<typename Alloc, typename Free>
+static void replay(const std::vector<trace_op_t> &trace, Alloc alloc, Free release,
+    double *mean_ns, uint64_t *worst_ns, int *failures)
+{
+    std::vector<void *> ptrs;
+    uint64_t total_ns = 0;
+
+    ptrs.reserve(trace.size());
+    *worst_ns = 0;
+    *failures = 0;
+
+    for (const trace_op_t &op : trace) {
+        auto start = std::chrono::steady_clock::now();
+        if (op.is_alloc) {
+            ptrs.push_back(alloc(op.size));
+        }
+        else {
+            release(ptrs[op.size]);
+        }
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+        if (op.is_alloc && ptrs.back() == nullptr) {
+            (*failures)++;
+        }
+        else if (op.is_alloc) {
+            // touch the block like a caller would
+            ((uint8_t *)ptrs.back())[0] = 1;
+        }
+        total_ns += ns;
+        *worst_ns = std::max(*worst_ns, ns);
+    }
+
+    *mean_ns = (double)total_ns / trace.size();
+}
+
+/**
+ * Not a pass/fail check on speed, prints the mean and worst operation time
+ * of the same trace replayed on the allocator and on the C library heap
+ */
+static void test_benchmark(void)
+{
+    std::mt19937 rng(42);
+    std::vector<trace_op_t> trace = make_trace(rng, 400000, 512 * 1024);
+    std::vector<uint64_t> region(1024 * 1024 / sizeof(uint64_t));
+    EiTlsfAllocator allocator;
+    double mean_ns;
+    uint64_t worst_ns;
+    int failures;
+
+    EI_TEST_CHECK(allocator.init(region.data(), region.size() * sizeof(uint64_t)));
+    replay(trace,
+        [&](size_t size) { return allocator.malloc(size); },
+        [&](void *ptr) { allocator.free(ptr); },
+        &mean_ns, &worst_ns, &failures);
+    EI_TEST_CHECK_EQ(failures, 0);
+    EI_TEST_CHECK(allocator.check());
+
+    ei_tlsf_stats_t stats;
+    allocator.get_stats(&stats);
+    EI_TEST_CHECK_EQ(stats.used_bytes, 0);
+    printf("  %zu ops, at most 512 KB live, high water %zu bytes\n", trace.size(), stats.high_water);
+    printf("    tlsf:   %6.1f ns mean, %8llu ns worst\n", mean_ns, (unsigned long long)worst_ns);
+
+    replay(trace,
+        [](size_t size) { return ::malloc(size); },
+        [](void *ptr) { ::free(ptr); },
+        &mean_ns, &worst_ns, &failures);
+    EI_TEST_CHECK_EQ(failures, 0);
+    printf("    malloc: %6.1f ns mean, %8llu ns worst\n", mean_ns, (unsigned long long)worst_ns);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_concurrent_first_use);
+    EI_TEST_RUN(test_heap_fallback);
+    EI_TEST_RUN(test_fuzz);
+    EI_TEST_RUN(test_benchmark);
+
+    return EI_TEST_RESULT();
+}
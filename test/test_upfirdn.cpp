@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2023 EdgeImpulse Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file test_upfirdn.cpp
+ * @brief Polyphase upfirdn against the zero stuffing direct form it replaced,
+ * and upfirdn_stream fed in chunks against one call over the whole signal
+ */
+
+/* Include ----------------------------------------------------------------- */
+#include "ei_test.h"
+#include "edge-impulse-sdk/dsp/spectral/signal.hpp"
+
+#include <random>
+#include <vector>
+
+using ei::signal;
+typedef signal::fvec fvec;
+
+/* Constant defines -------------------------------------------------------- */
+#define TEST_SIGNAL_SIZE    125
+
+/* Reference --------------------------------------------------------------- */
+
+/**
+ * upfirdn as it was: upsample by inserting zeros, convolve, keep every
+ * down-th sample starting at the filter delay
+ */
+static void upfirdn_direct(const float *x, size_t x_size, std::vector<float> &y, int up, int down, const fvec &h)
+{
+    int nx = x_size;
+    int nh = h.size();
+    std::vector<float> r(up * nx, 0.0f);
+    for (int i = 0; i < nx; i++) {
+        r[i * up] = x[i];
+    }
+    std::vector<float> z(nh + up * nx - 1, 0.0f);
+    for (int i = 0; i < up * nx; i++) {
+        for (int j = 0; j < nh; j++) {
+            if (i - j >= 0 && i - j < up * nx) {
+                z[i] += r[i - j] * h[j];
+            }
+        }
+    }
+    int skip = (nh - 1) / 2;
+    for (size_t i = 0; i < y.size(); i++) {
+        y[i] = z[i * down + skip];
+    }
+}
+
+static std::vector<float> random_vector(size_t size, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<float> v(size);
+    for (size_t ix = 0; ix < size; ix++) {
+        v[ix] = dist(rng);
+    }
+    return v;
+}
+
+static fvec random_filter(size_t size, uint32_t seed)
+{
+    std::vector<float> taps = random_vector(size, seed);
+    return fvec(taps.data(), taps.data() + taps.size());
+}
+
+/* Tests ------------------------------------------------------------------- */
+
+static const int ratios[][2] = {
+    { 1, 1 }, { 1, 2 }, { 2, 1 }, { 1, 3 }, { 3, 2 }, { 2, 3 }, { 4, 5 }, { 5, 4 }, { 3, 7 }, { 7, 3 },
+};
+static const size_t filter_lengths[] = { 1, 3, 7, 15, 31, 61 };
+
+/* Every ratio and odd filter length, including filters longer than the input */
+static void test_matches_direct_form(void)
+{
+    std::vector<float> x = random_vector(TEST_SIGNAL_SIZE, 1);
+
+    for (const auto &ratio : ratios) {
+        for (size_t nh : filter_lengths) {
+            const int up = ratio[0];
+            const int down = ratio[1];
+            fvec h = random_filter(nh, (uint32_t)(nh * 100 + up * 10 + down));
+            for (size_t nx : { (size_t)TEST_SIGNAL_SIZE, (size_t)5 }) {
+                signal::upfirdn_filter filter(h, up, down);
+                size_t ny = filter.output_size(nx);
+
+                fvec y(ny);
+                signal::upfirdn(x.data(), nx, y, up, down, h);
+                std::vector<float> expected(ny);
+                upfirdn_direct(x.data(), nx, expected, up, down, h);
+
+                for (size_t ix = 0; ix < ny; ix++) {
+                    EI_TEST_CHECK_NEAR(y[ix], expected[ix], 1e-5f);
+                }
+            }
+        }
+    }
+}
+
+/* resample_poly is upfirdn with the filter scaled by up */
+static void test_resample_poly(void)
+{
+    std::vector<float> x = random_vector(TEST_SIGNAL_SIZE, 2);
+    fvec window = random_filter(21, 3);
+
+    fvec y;
+    signal::resample_poly(x.data(), x.size(), y, 6, 4, window);
+
+    // 6/4 is reduced to 3/2
+    fvec h = window;
+    signal::scale(h, 3.0f);
+    std::vector<float> expected((TEST_SIGNAL_SIZE * 3 + 1) / 2);
+    upfirdn_direct(x.data(), x.size(), expected, 3, 2, h);
+
+    EI_TEST_CHECK_EQ(y.size(), expected.size());
+    for (size_t ix = 0; ix < y.size() && ix < expected.size(); ix++) {
+        EI_TEST_CHECK_NEAR(y[ix], expected[ix], 1e-5f);
+    }
+}
+
+/**
+ * Chunks of varying size (one sample, shorter and longer than the filter)
+ * give the outputs of one apply() over the whole signal
+ */
+static void test_stream_matches_one_shot(void)
+{
+    const size_t chunks[] = { 1, 2, 5, 17, 3, 40, 1, 56 };
+    size_t total = 0;
+    for (size_t c : chunks) {
+        total += c;
+    }
+    std::vector<float> x = random_vector(total, 4);
+
+    for (const auto &ratio : ratios) {
+        for (size_t nh : filter_lengths) {
+            const int up = ratio[0];
+            const int down = ratio[1];
+            fvec h = random_filter(nh, (uint32_t)(nh * 7 + up * 3 + down));
+
+            signal::upfirdn_filter filter(h, up, down);
+            std::vector<float> one_shot(filter.output_size(total));
+            filter.apply(x.data(), total, one_shot.data(), one_shot.size());
+
+            signal::upfirdn_stream stream(h, up, down);
+            std::vector<float> streamed;
+            size_t offset = 0;
+            for (size_t c : chunks) {
+                std::vector<float> y(stream.max_output_size(c));
+                size_t n = stream.process(x.data() + offset, c, y.data());
+                EI_TEST_CHECK(n <= y.size());
+                streamed.insert(streamed.end(), y.begin(), y.begin() + n);
+                offset += c;
+            }
+
+            // the stream stops at the last input, apply() pads with zeros
+            EI_TEST_CHECK(streamed.size() <= one_shot.size());
+            for (size_t ix = 0; ix < one_shot.size(); ix++) {
+                if (ix < streamed.size()) {
+                    EI_TEST_CHECK(streamed[ix] == one_shot[ix]);
+                }
+                else {
+                    EI_TEST_CHECK(one_shot[ix] == 0.0f);
+                }
+            }
+        }
+    }
+}
+
+/* After reset() the stream starts over */
+static void test_stream_reset(void)
+{
+    std::vector<float> x = random_vector(64, 5);
+    fvec h = random_filter(15, 6);
+    signal::upfirdn_stream stream(h, 3, 2);
+
+    std::vector<float> first(stream.max_output_size(x.size()));
+    size_t n_first = stream.process(x.data(), x.size(), first.data());
+
+    stream.reset();
+    std::vector<float> second(stream.max_output_size(x.size()));
+    size_t n_second = stream.process(x.data(), x.size(), second.data());
+
+    EI_TEST_CHECK_EQ(n_first, n_second);
+    EI_TEST_CHECK(first == second);
+}
+
+int main(void)
+{
+    EI_TEST_RUN(test_matches_direct_form);
+    EI_TEST_RUN(test_resample_poly);
+    EI_TEST_RUN(test_stream_matches_one_shot);
+    EI_TEST_RUN(test_stream_reset);
+
+    return EI_TEST_RESULT();
+}